@@ -0,0 +1,195 @@
+/*
+ *  Copyright (c) 2020-2021 Thakee Nathees
+ *  Distributed Under The MIT License
+ */
+
+// A line oriented debugger front end (like gdb) on top of the pocketlang
+// debugger API. The execution is paused at the breakpoints and the steps and
+// the commands are read from stdin till it's resumed.
+
+#include "internal.h"
+
+#include <ctype.h> // isspace
+
+// The maximum length of a command line.
+#define COMMAND_SIZE 256
+
+// Path of the script being debugged, used for the breakpoints set without a
+// file name. And the last command which will be repeated for an empty line.
+static char debug_path[FILENAME_MAX];
+static char last_command[COMMAND_SIZE];
+
+static void printHelp(void) {
+  printf(
+    "  break [file:]line  Set a breakpoint at the line.\n"
+    "  delete id          Delete the breakpoint of the id.\n"
+    "  continue           Continue till the next breakpoint.\n"
+    "  step               Step to the next line, into the calls.\n"
+    "  next               Step to the next line of the current function.\n"
+    "  finish             Continue till the current function returns.\n"
+    "  bt                 Print the call frames.\n"
+    "  locals [depth]     Print the stack slots of the frame.\n"
+    "  globals [depth]    Print the globals of the frame's script.\n"
+    "  help               Print this help message.\n"
+    "  quit               Exit the program.\n"
+    "  An empty line repeats the last command.\n");
+}
+
+// Print the [line] of the source file at [path] if it could be read.
+static void printSourceLine(const char* path, int line) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) return;
+
+  char buff[COMMAND_SIZE];
+  int current = 1;
+  while (fgets(buff, sizeof(buff), file) != NULL) {
+    size_t length = strlen(buff);
+    bool line_end = (length > 0 && buff[length - 1] == '\n');
+    if (current == line) {
+      if (line_end) buff[length - 1] = '\0';
+      printf("%5d  %s\n", line, buff);
+      break;
+    }
+    if (line_end) current++;
+  }
+
+  fclose(file);
+}
+
+static void printFrame(PKVM* vm, int depth) {
+  PkDebugFrame frame;
+  if (!pkDebugGetFrame(vm, depth, &frame)) return;
+  printf("#%d  %s() [\"%s\":%d]\n", depth, frame.name, frame.file,
+         frame.line);
+}
+
+static void printLocals(PKVM* vm, int depth) {
+  PkDebugFrame frame;
+  if (!pkDebugGetFrame(vm, depth, &frame)) {
+    printf("No frame at depth %d.\n", depth);
+    return;
+  }
+
+  // The local names aren't available at runtime, the parameters are the
+  // first slots followed by the locals and the temporaries.
+  for (int i = 0; i < frame.slots; i++) {
+    printf("  [%d]%s = ", i, (i < frame.arity) ? " (param)" : "");
+    pkDebugWriteValue(vm, pkDebugGetSlot(vm, depth, i));
+    printf("\n");
+  }
+}
+
+static void printGlobals(PKVM* vm, int depth) {
+  const char* name;
+  PkVar value;
+  for (int i = 0; (value = pkDebugGetGlobal(vm, depth, i, &name)); i++) {
+    printf("  %s = ", name);
+    pkDebugWriteValue(vm, value);
+    printf("\n");
+  }
+}
+
+static void setBreakpoint(PKVM* vm, const char* arg) {
+  const char* file = debug_path;
+  char buff[COMMAND_SIZE];
+
+  // Split the argument "file:line" at the last colon.
+  const char* colon = strrchr(arg, ':');
+  if (colon != NULL) {
+    size_t length = (size_t)(colon - arg);
+    memcpy(buff, arg, length);
+    buff[length] = '\0';
+    file = buff;
+    arg = colon + 1;
+  }
+
+  int line = atoi(arg);
+  if (line <= 0 || file[0] == '\0') {
+    printf("Expected a line number: break [file:]line\n");
+    return;
+  }
+
+  int id = pkDebugSetBreakpoint(vm, file, line);
+  printf("Breakpoint %d at \"%s\":%d\n", id, file, line);
+}
+
+// The pkDebugFn callback of the VM, reads and runs the commands till it's
+// resumed.
+PkDebugAction debugCallback(PKVM* vm, int breakpoint) {
+  PkDebugFrame frame;
+  pkDebugGetFrame(vm, 0, &frame);
+
+  if (breakpoint != 0) printf("Breakpoint %d, ", breakpoint);
+  printf("%s() [\"%s\":%d]\n", frame.name, frame.file, frame.line);
+  printSourceLine(frame.file, frame.line);
+
+  char line[COMMAND_SIZE];
+  do {
+    printf("(debug) ");
+    fflush(stdout);
+
+    // Continue the execution if there aren't any more commands.
+    if (fgets(line, sizeof(line), stdin) == NULL) return PK_DEBUG_CONTINUE;
+    line[strcspn(line, "\r\n")] = '\0';
+
+    if (line[0] == '\0') strcpy(line, last_command);
+    else strcpy(last_command, line);
+
+    // Split the command and it's argument.
+    char* arg = line;
+    while (*arg != '\0' && !isspace(*arg)) arg++;
+    if (*arg != '\0') *arg++ = '\0';
+    while (isspace(*arg)) arg++;
+
+    const char* cmd = line;
+    if (cmd[0] == '\0') continue;
+
+#define IS_CMD(short_name, name) \
+  (strcmp(cmd, short_name) == 0 || strcmp(cmd, name) == 0)
+
+    if (IS_CMD("c", "continue")) return PK_DEBUG_CONTINUE;
+    if (IS_CMD("s", "step")) return PK_DEBUG_STEP;
+    if (IS_CMD("n", "next")) return PK_DEBUG_NEXT;
+    if (IS_CMD("f", "finish")) return PK_DEBUG_FINISH;
+
+    if (IS_CMD("b", "break")) {
+      setBreakpoint(vm, arg);
+
+    } else if (IS_CMD("d", "delete")) {
+      if (!pkDebugRemoveBreakpoint(vm, atoi(arg))) {
+        printf("No breakpoint with id '%s'.\n", arg);
+      }
+
+    } else if (IS_CMD("bt", "backtrace")) {
+      int count = pkDebugGetFrameCount(vm);
+      for (int i = 0; i < count; i++) printFrame(vm, i);
+
+    } else if (IS_CMD("l", "locals")) {
+      printLocals(vm, atoi(arg));
+
+    } else if (IS_CMD("g", "globals")) {
+      printGlobals(vm, atoi(arg));
+
+    } else if (IS_CMD("h", "help")) {
+      printHelp();
+
+    } else if (IS_CMD("q", "quit")) {
+      exit(0);
+
+    } else {
+      printf("Unknown command '%s', try 'help'.\n", cmd);
+    }
+
+#undef IS_CMD
+
+  } while (true);
+}
+
+// Start debugging the script at [path] which will be paused at it's first
+// line.
+void debuggerStart(PKVM* vm, const char* path) {
+  strncpy(debug_path, path, sizeof(debug_path) - 1);
+
+  printf("Debugging \"%s\", type 'help' for the commands.\n", path);
+  pkDebugPause(vm);
+}
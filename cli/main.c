@@ -13,8 +13,21 @@
 int repl(PKVM* vm, const PkCompileOptions* options);
 const char* read_line(uint32_t* length);
 
+PkDebugAction debugCallback(PKVM* vm, int breakpoint);
+void debuggerStart(PKVM* vm, const char* path);
+
 // ---------------------------------------
 
+// The number of the events kept with the --trace option and the minimum
+// duration of a native call to be recorded (in microseconds).
+#define TRACE_CAPACITY  (1024 * 64)
+#define TRACE_THRESHOLD 100.0
+
+// The function of the script called for the requests with the --serve option
+// and the default path of the socket.
+#define SERVE_FN     "handle"
+#define SERVE_SOCKET "pocket.sock"
+
 void onResultDone(PKVM* vm, PkStringPtr result) {
   if ((bool)result.user_data) {
     free((void*)result.string);
@@ -122,6 +135,94 @@ PkStringPtr loadScript(PKVM* vm, const char* path) {
   return result;
 }
 
+// Write the module name of the script at [path] (it's file name without the
+// extension, non identifier characters replaced with '_') to the [buff].
+static void getModuleName(const char* path, char* buff, size_t buff_size) {
+  size_t dir_length;
+  pathGetDirName(path, &dir_length);
+
+  const char* name = path + dir_length;
+  while (*name == '/' || *name == '\\') name++;
+
+  size_t length = 0;
+  for (; name[length] != '\0' && name[length] != '.'; length++) {
+    if (length + 1 >= buff_size) break;
+    char c = name[length];
+    bool is_name = (c == '_') || (c >= 'a' && c <= 'z') ||
+                   (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+    buff[length] = (is_name) ? c : '_';
+  }
+  buff[length] = '\0';
+}
+
+// Write the string of the [report] handle to the file at [path] and release
+// the handle.
+static void writeReport(PKVM* vm, PkHandle* report, const char* path) {
+  FILE* file = fopen(path, "w");
+  if (file != NULL) {
+    fputs(pkStringGetData(pkGetHandleValue(report)), file);
+    fclose(file);
+  } else {
+    fprintf(stderr, "Error: cannot open file at \"%s\"\n", path);
+  }
+  pkReleaseHandle(vm, report);
+}
+
+// Write the line coverage report of the [vm] to the file at [path], as JSON if
+// the path ends with ".json" otherwise as an lcov tracefile.
+static void writeCoverage(PKVM* vm, const char* path) {
+  size_t length = strlen(path);
+  bool json = length >= 5 && strcmp(path + length - 5, ".json") == 0;
+  writeReport(vm, pkGetCoverage(vm, json ? PK_COVERAGE_JSON
+                                         : PK_COVERAGE_LCOV), path);
+}
+
+// Print the statistics of the compilations to stderr, the times are in
+// milliseconds.
+static void printCompileStats(PKVM* vm) {
+  int count;
+  const PkCompileStats* stats = pkGetCompileStats(vm, &count);
+
+  fprintf(stderr, "%8s %7s %5s %6s %6s %8s %8s %8s %8s %8s %8s  %s\n",
+          "bytes", "tokens", "funcs", "consts", "names", "bytecode", "lex",
+          "parse", "resolve", "import", "total", "path");
+  for (int i = 0; i < count; i++) {
+    const PkCompileStats* s = &stats[i];
+    fprintf(stderr, "%8u %7u %5u %6u %6u %8u %8.3f %8.3f %8.3f %8.3f %8.3f  "
+            "%s\n", s->source, s->tokens, s->functions, s->constants,
+            s->names, s->bytecode, s->lex_time * 1e3, s->parse_time * 1e3,
+            s->resolve_time * 1e3, s->import_time * 1e3, s->total_time * 1e3,
+            s->path);
+  }
+}
+
+// Serve the requests of the [socket] with [workers] processes by calling the
+// handle(request) function of the script at [path] (which should be run).
+static int serveScript(PKVM* vm, const char* path, const char* socket,
+                       int workers) {
+  PkHandle* module = pkGetModule(vm, path);
+  PkHandle* fn = NULL;
+  if (module != NULL) {
+    fn = pkGetFunction(vm, module, SERVE_FN);
+    pkReleaseHandle(vm, module);
+  }
+
+  if (fn == NULL) {
+    fprintf(stderr, "Error: function " SERVE_FN "(request) is not defined "
+            "in \"%s\"\n", path);
+    return 1;
+  }
+
+  bool success = pkServe(vm, fn, socket, workers);
+  pkReleaseHandle(vm, fn);
+  if (!success) {
+    fprintf(stderr, "Error: cannot serve at \"%s\" (%s)\n", socket,
+            strerror(errno));
+    return 1;
+  }
+  return 0;
+}
+
 // Create new pocket VM and set it's configuration.
 static PKVM* intializePocketVM() {
   PkConfiguration config = pkNewConfiguration();
@@ -136,6 +237,7 @@ static PKVM* intializePocketVM() {
 
   config.load_script_fn = loadScript;
   config.resolve_path_fn = resolvePath;
+  config.debug_fn = debugCallback;
 
   return pkNewVM(&config);
 }
@@ -150,14 +252,35 @@ int main(int argc, const char** argv) {
   };
 
   const char* cmd = NULL;
-  int debug = false, help = false, quiet = false, version = false;
+  const char* coverage = NULL;
+  const char* trace = NULL;
+  const char* socket_path = SERVE_SOCKET;
+  int serve = 0;
+  int debug = false, emit_c = false, help = false, quiet = false;
+  int version = false, debugger = false, compile_stats = false;
   struct argparse_option cli_opts[] = {
       OPT_STRING('c', "cmd", (void*)&cmd,
         "Evaluate and run the passed string.", NULL, 0, 0),
 
+      OPT_BOOLEAN(0, "compile-stats", (void*)&compile_stats,
+        "Print the compilation statistics of the scripts to stderr "
+        "(the times are in milliseconds).", NULL, 0, 0),
+
+      OPT_STRING(0, "coverage", (void*)&coverage,
+        "Write the line coverage to the file (JSON if it ends with '.json' "
+        "otherwise lcov).", NULL, 0, 0),
+
       OPT_BOOLEAN('d', "debug", (void*)&debug,
         "Compile and run the debug version.", NULL, 0, 0),
 
+      OPT_BOOLEAN('g', "debugger", (void*)&debugger,
+        "Run the file with the debugger, paused at the first line.",
+        NULL, 0, 0),
+
+      OPT_BOOLEAN(0, "emit-c", (void*)&emit_c,
+        "Write the C translation of the file's functions to stdout.",
+        NULL, 0, 0),
+
       OPT_BOOLEAN('h', "help",  (void*)&help,
         "Prints this help message and exit.", NULL, 0, 0),
 
@@ -165,6 +288,19 @@ int main(int argc, const char** argv) {
         "Don't print version and copyright statement on REPL startup.",
         NULL, 0, 0),
 
+      OPT_INTEGER(0, "serve", (void*)&serve,
+        "Run the file and fork the number of worker processes which call "
+        "it's " SERVE_FN "(request) for each line of a connection to the "
+        "socket.", NULL, 0, 0),
+
+      OPT_STRING(0, "socket", (void*)&socket_path,
+        "Path of the Unix socket to serve (default: " SERVE_SOCKET ").",
+        NULL, 0, 0),
+
+      OPT_STRING(0, "trace", (void*)&trace,
+        "Write the timeline of the VM to the file in the Chrome trace event "
+        "format.", NULL, 0, 0),
+
       OPT_BOOLEAN('v', "version", &version,
         "Prints the pocketlang version and exit.", NULL, 0, 0),
       OPT_END(),
@@ -193,16 +329,20 @@ int main(int argc, const char** argv) {
   user_data.repl_mode = false;
   pkSetUserData(vm, &user_data);
 
+  if (trace != NULL) pkTraceStart(vm, TRACE_CAPACITY, TRACE_THRESHOLD);
+
   registerModules(vm);
 
   PkCompileOptions options = pkNewCompilerOptions();
   options.debug = debug;
+  options.coverage = (coverage != NULL);
+  options.stats = compile_stats;
 
   if (cmd != NULL) { // pocket -c "print('foo')"
 
     PkStringPtr source = { cmd, NULL, NULL, 0, 0 };
     PkStringPtr path = { "$(Source)", NULL, NULL, 0, 0 };
-    PkResult result = pkInterpretSource(vm, source, path, NULL);
+    PkResult result = pkInterpretSource(vm, source, path, &options);
     exitcode = (int)result;
 
   } else if (argc == 0) { // Run on REPL mode.
@@ -220,9 +360,25 @@ int main(int argc, const char** argv) {
     PkStringPtr resolved = resolvePath(vm, ".", argv[0]);
     PkStringPtr source = loadScript(vm, resolved.string);
 
-    if (source.string != NULL) {
+    if (source.string != NULL && emit_c) { // pocket --emit-c file.pk
+      char module[FILENAME_MAX];
+      getModuleName(resolved.string, module, sizeof(module));
+      PkResult result = pkEmitC(vm, source, resolved, module);
+      exitcode = (int)result;
+
+    } else if (source.string != NULL) {
+      if (debugger) debuggerStart(vm, resolved.string);
+
+      // The resolved path will be freed by pkInterpretSource().
+      char path[FILENAME_MAX];
+      snprintf(path, sizeof(path), "%s", resolved.string);
+
       PkResult result = pkInterpretSource(vm, source, resolved, &options);
       exitcode = (int)result;
+
+      if (result == PK_RESULT_SUCCESS && serve > 0) {
+        exitcode = serveScript(vm, path, socket_path, serve);
+      }
     } else {
       fprintf(stderr, "Error: cannot open file at \"%s\"\n", resolved.string);
       if (resolved.on_done != NULL) resolved.on_done(vm, resolved);
@@ -230,6 +386,10 @@ int main(int argc, const char** argv) {
     }
   }
 
+  if (coverage != NULL) writeCoverage(vm, coverage);
+  if (trace != NULL) writeReport(vm, pkTraceFlush(vm), trace);
+  if (compile_stats) printCompileStats(vm);
+
   // Cleanup the VM and exit.
   pkFreeVM(vm);
   return exitcode;
@@ -0,0 +1,116 @@
+#!python
+## Copyright (c) 2020-2021 Thakee Nathees
+## Distributed Under The MIT License
+
+## This will generate a single translation unit "pocketlang.c" of all the
+## sources in the src/ directory with their internal headers inlined, along
+## with a copy of the public header "pocketlang.h". Compiling a single unit
+## let the compiler inline the hot helpers (varAdd, mapGet, vmRealloc, ...)
+## into the interpreter loop, and it's easier to embed pocketlang in another
+## project by just adding these two files.
+##
+##   usage: python3 scripts/amalgamate.py [output-dir]
+
+import os, re, sys
+from os.path import join, abspath, dirname, relpath
+
+## The absolute path of this file, when run as a script.
+## This file is not intended to be included in other files at the moment.
+THIS_PATH = abspath(dirname(__file__))
+
+## Path of the top level of the project.
+ROOT_PATH = abspath(join(THIS_PATH, '..'))
+
+## Directory of the sources and the public header.
+SOURCE_DIR = join(ROOT_PATH, 'src')
+PUBLIC_HEADER = join(SOURCE_DIR, 'include', 'pocketlang.h')
+
+## The default output directory (relative to the top level).
+DEFAULT_OUTPUT_DIR = join('build', 'amalgamation')
+
+## Matches a local include directive: #include "header.h"
+INCLUDE_PATTERN = re.compile(r'^\s*#\s*include\s+"([^"]+)"')
+
+## Matches the include guard at the beginning of a header.
+GUARD_PATTERN = re.compile(r'^\s*#\s*ifndef\s+(\w+)\s*\n\s*#\s*define\s+\1\b',
+                           re.MULTILINE)
+
+def main():
+  output_dir = sys.argv[1] if len(sys.argv) > 1 else \
+                 join(ROOT_PATH, DEFAULT_OUTPUT_DIR)
+  os.makedirs(output_dir, exist_ok=True)
+
+  ## Headers with an include guard are only inlined once, others (like the
+  ## opcodes X macro header) are inlined everywhere they're included.
+  included = set()
+
+  lines = [
+    '/*',
+    ' *  Copyright (c) 2020-2021 Thakee Nathees',
+    ' *  Distributed Under The MIT License',
+    ' */',
+    '',
+    '// Amalgamated sources of pocketlang generated by scripts/amalgamate.py',
+    '// Do not edit this file, edit the sources and re-generate it instead.',
+    '',
+    '// Some of the sources use system extensions (ex: mremap() on linux).',
+    '#if defined(__linux__) && !defined(_GNU_SOURCE)',
+    '  #define _GNU_SOURCE',
+    '#endif',
+    '',
+    '#include "pocketlang.h"',
+    '',
+  ]
+
+  for file in sorted(os.listdir(SOURCE_DIR)):
+    if not file.endswith('.c'): continue
+    inline_file(join(SOURCE_DIR, file), included, lines)
+
+  with open(join(output_dir, 'pocketlang.c'), 'w') as fp:
+    fp.write('\n'.join(lines) + '\n')
+
+  with open(PUBLIC_HEADER, 'r') as src:
+    with open(join(output_dir, 'pocketlang.h'), 'w') as dst:
+      dst.write(src.read())
+
+## Append the content of the source [path] to [lines], replacing the local
+## includes with the content of the header (recursively).
+def inline_file(path, included, lines):
+  with open(path, 'r') as fp:
+    content = fp.read()
+
+  if path.endswith('.h'):
+    if GUARD_PATTERN.search(content):
+      if path in included: return
+      included.add(path)
+
+  ## The public header is included at the top of the amalgamation.
+  if path == PUBLIC_HEADER: return
+
+  name = relpath(path, ROOT_PATH).replace('\\', '/')
+  lines.append(f'#line 1 "{name}"')
+
+  line_no = 0
+  for line in content.split('\n'):
+    line_no += 1
+    match = INCLUDE_PATTERN.match(line)
+    if match is None:
+      lines.append(line)
+      continue
+
+    header = abspath(join(dirname(path), match.group(1)))
+    if not os.path.exists(header):
+      error_exit(f'"{name}":{line_no} - can\'t find "{match.group(1)}"')
+
+    inline_file(header, included, lines)
+    lines.append(f'#line {line_no + 1} "{name}"')
+
+  ## Remove the last empty line (split() leaves one after the last '\n').
+  if lines[-1] == '': lines.pop()
+
+def error_exit(msg):
+  print("Error:", msg, file=sys.stderr)
+  sys.exit(1)
+
+if __name__ == '__main__':
+  main()
@@ -91,11 +91,17 @@ typedef enum {
   PK_FIBER,
   PK_CLASS,
   PK_INST,
+  PK_AUTOMATON,
+  PK_BIGINT,
+  PK_PATTERN,
+  PK_HASHER,
 } PkVarType;
 
 typedef struct PkStringPtr PkStringPtr;
 typedef struct PkConfiguration PkConfiguration;
 typedef struct PkCompileOptions PkCompileOptions;
+typedef struct PkDebugFrame PkDebugFrame;
+typedef struct PkCompileStats PkCompileStats;
 
 // Type of the error message that pocketlang will provide with the pkErrorFn
 // callback.
@@ -121,6 +127,21 @@ typedef enum {
   PK_RESULT_RUNTIME_ERROR,  // An error occurred at runtime.
 } PkResult;
 
+// The action returned from the pkDebugFn callback to tell the VM how to
+// resume the paused execution.
+typedef enum {
+  PK_DEBUG_CONTINUE = 0, // Run till the next breakpoint.
+  PK_DEBUG_STEP,         // Pause at the next line, stepping into the calls.
+  PK_DEBUG_NEXT,         // Pause at the next line of the current function.
+  PK_DEBUG_FINISH,       // Pause once the current function returns.
+} PkDebugAction;
+
+// Format of the line coverage report returned by pkGetCoverage().
+typedef enum {
+  PK_COVERAGE_LCOV = 0, // The lcov tracefile format.
+  PK_COVERAGE_JSON,     // {"path": {"line": hits, ...}, ...}
+} PkCoverageFormat;
+
 /*****************************************************************************/
 /* POCKETLANG FUNCTION POINTERS & CALLBACKS                                  */
 /*****************************************************************************/
@@ -199,6 +220,12 @@ typedef PkStringPtr (*pkResolvePathFn) (PKVM* vm, const char* from,
 // to indicate if it's failed to load the script.
 typedef PkStringPtr (*pkLoadScriptFn) (PKVM* vm, const char* path);
 
+// Debugger callback, called when the execution is paused at the breakpoint of
+// the id [breakpoint] or after a step (the [breakpoint] will be 0). The paused
+// state could be inspected with the pkDebug...() functions and the returned
+// action tells the VM how to resume the execution.
+typedef PkDebugAction (*pkDebugFn) (PKVM* vm, int breakpoint);
+
 /*****************************************************************************/
 /* POCKETLANG PUBLIC API                                                     */
 /*****************************************************************************/
@@ -225,6 +252,12 @@ PK_PUBLIC void pkSetUserData(PKVM* vm, void* user_data);
 // Returns the associated user data.
 PK_PUBLIC void* pkGetUserData(const PKVM* vm);
 
+// Run a full garbage collection and freeze the remaining objects. The frozen
+// objects are never freed or written by the garbage collector (till the VM is
+// freed), so the pages of a warmed up heap will be shared by the processes
+// forked after this (copy-on-write) even when they collect garbage.
+PK_PUBLIC void pkFreezeHeap(PKVM* vm);
+
 // Create a new handle for the [value]. This is useful to keep the [value]
 // alive once it acquired from the stack. Do not use the [value] once
 // creating a new handle for it instead get the value from the handle by
@@ -254,6 +287,10 @@ PK_PUBLIC void pkModuleAddFunction(PKVM* vm, PkHandle* module,
 PK_PUBLIC PkHandle* pkGetFunction(PKVM* vm, PkHandle* module,
                                   const char* name);
 
+// Returns the script compiled (or imported) with the resolved [path] or the
+// core module of the name as a handle, if not found it'll return NULL.
+PK_PUBLIC PkHandle* pkGetModule(PKVM* vm, const char* path);
+
 // Compile the [module] with the provided [source]. Set the compiler options
 // with the the [options] argument or set to NULL for default options.
 PK_PUBLIC PkResult pkCompileModule(PKVM* vm, PkHandle* module,
@@ -269,6 +306,51 @@ PK_PUBLIC PkResult pkInterpretSource(PKVM* vm,
                                      PkStringPtr path,
                                      const PkCompileOptions* options);
 
+// Compile the [source] once to run it many times with pkRunPrepared(). The
+// script isn't added to the VM's scripts (so it won't be shared with the
+// imports or the other scripts of the same [path]). The [globals] are the
+// names of the [count] globals provided by the host application (null unless
+// they're overridden by a run) so the script could use them. Returns the
+// compiled script as a handle or NULL if the compilation failed.
+PK_PUBLIC PkHandle* pkPrepareScript(PKVM* vm, PkStringPtr source,
+                                    PkStringPtr path, int count,
+                                    const char** globals);
+
+// Run the body of the script prepared with pkPrepareScript() with fresh
+// globals, the globals are reset to their values after the compilation and
+// the [count] globals of the [names] are set to the [values]. The globals of
+// a run are valid till the next run of the script, so a run shouldn't be
+// resumed (if it's yielded) after another one is started.
+PK_PUBLIC PkResult pkRunPrepared(PKVM* vm, PkHandle* script, int count,
+                                 const char** names, PkHandle** values);
+
+// Compile the [source] as a single expression of the [count] variables of
+// the [names] (ex: "price * qty * (1 - discount)") to evaluate it many times
+// with pkEvalExpression(). Returns the compiled expression as a handle or
+// NULL if the compilation failed.
+PK_PUBLIC PkHandle* pkCompileExpression(PKVM* vm, const char* source,
+                                        const char** names, int count);
+
+// Evaluate the compiled [expression] with the [values] of it's variables (in
+// the order of their names) and set the [result] to it's value, which is
+// valid till the next evaluation of the expression. It reuses the same fiber
+// for every evaluation, so an expression shouldn't be evaluated by itself.
+PK_PUBLIC PkResult pkEvalExpression(PKVM* vm, PkHandle* expression,
+                                    const PkVar* values, PkVar* result);
+
+// Compile the [source] and write its C translation as a native module named
+// [module] using the configuration's write function. The named functions that
+// doesn't use globals, imports, classes, iterators and lambdas are translated
+// and the generated source defines registerModule_<module>(PKVM*) to register
+// them. It won't run the script and returns the compilation result.
+PK_PUBLIC PkResult pkEmitC(PKVM* vm, PkStringPtr source, PkStringPtr path,
+                           const char* module);
+
+// Returns the statistics of the compilations with the stats option (in the
+// order they've started, an imported script is after the script importing
+// it) and set their [count]. The array is valid till the next compilation.
+PK_PUBLIC const PkCompileStats* pkGetCompileStats(const PKVM* vm, int* count);
+
 // Runs the fiber's function with the provided arguments (param [arc] is the
 // argument count and [argv] are the values). It'll returns it's run status
 // result (success or failure) if you need the yielded or returned value use
@@ -282,6 +364,19 @@ PK_PUBLIC PkResult pkRunFiber(PKVM* vm, PkHandle* fiber,
 // yielded or returned value use the pkFiberGetReturnValue() function.
 PK_PUBLIC PkResult pkResumeFiber(PKVM* vm, PkHandle* fiber, PkVar value);
 
+// Serve the requests of the Unix domain socket at [path] with [workers]
+// processes forked from this one (after freezing the heap with
+// pkFreezeHeap(), so the warmed up heap is shared by the workers). Every line
+// of a connection is a request, the function [fn] is called with the line
+// (without the newline) and the string of it's return value is written back
+// followed by a newline (an empty line if it failed). It returns once all the
+// workers have exited. On failure it returns false and set errno, EINVAL if
+// the function doesn't have exactly 1 parameter, EEXIST if a file which
+// isn't a socket exists at the [path] (a socket is replaced), ENOSYS if the
+// platform doesn't support it, otherwise the error of the socket or the fork.
+PK_PUBLIC bool pkServe(PKVM* vm, PkHandle* fn, const char* path,
+                       int workers);
+
 /*****************************************************************************/
 /* POCKETLANG PUBLIC TYPE DEFINES                                            */
 /*****************************************************************************/
@@ -318,6 +413,10 @@ struct PkConfiguration {
   pkResolvePathFn resolve_path_fn;
   pkLoadScriptFn load_script_fn;
 
+  // Called when the execution is paused by the debugger, if it's NULL the
+  // breakpoints will be ignored.
+  pkDebugFn debug_fn;
+
   // User defined data associated with VM.
   void* user_data;
 };
@@ -335,6 +434,43 @@ struct PkCompileOptions {
   // an assertion).
   bool repl_mode;
 
+  // Emit the instructions to record the executed lines of the script (and
+  // the scripts it imports) for pkGetCoverage().
+  bool coverage;
+
+  // Collect the statistics of the compilation of the script (and the scripts
+  // it imports) for pkGetCompileStats().
+  bool stats;
+
+};
+
+// A call frame of the paused execution, see pkDebugGetFrame().
+struct PkDebugFrame {
+  const char* name; //< Name of the function.
+  const char* file; //< Path of the script of the function.
+  int line;         //< Line number of the current instruction.
+  int arity;        //< The number of parameters (the first slots).
+  int slots;        //< The number of stack slots of the frame.
+};
+
+// The statistics of a compilation, see pkGetCompileStats(). The times are in
+// seconds and the time of the parsing includes the emitting of the bytecode
+// (since it's a single pass compiler) but not the lexing and the imports.
+struct PkCompileStats {
+  const char* path;   //< Path of the compiled script.
+
+  uint32_t source;    //< Number of the source bytes lexed.
+  uint32_t tokens;    //< Number of the tokens lexed.
+  uint32_t functions; //< Number of the functions added (including lambdas).
+  uint32_t constants; //< Number of the literal constants added.
+  uint32_t names;     //< Number of the names added.
+  uint32_t bytecode;  //< Number of the bytecode bytes emitted.
+
+  double lex_time;     //< Time spent in lexing.
+  double parse_time;   //< Time spent in parsing and emitting the bytecode.
+  double resolve_time; //< Time spent in resolving the forward names.
+  double import_time;  //< Time spent in compiling the imported scripts.
+  double total_time;   //< Total time of the compilation.
 };
 
 /*****************************************************************************/
@@ -419,6 +555,11 @@ PK_PUBLIC PkHandle* pkNewStringLength(PKVM* vm, const char* value, size_t len);
 PK_PUBLIC PkHandle* pkNewList(PKVM* vm);
 PK_PUBLIC PkHandle* pkNewMap(PKVM* vm);
 
+// Same as pkNewList() and pkNewMap() but the list or map can hold [capacity]
+// elements before it needs to grow.
+PK_PUBLIC PkHandle* pkNewListCapacity(PKVM* vm, uint32_t capacity);
+PK_PUBLIC PkHandle* pkNewMapCapacity(PKVM* vm, uint32_t capacity);
+
 // Add a new module named [name] to the [vm]. Note that the module shouldn't
 // already existed, otherwise an assertion will fail to indicate that.
 PK_PUBLIC PkHandle* pkNewModule(PKVM* vm, const char* name);
@@ -441,6 +582,67 @@ PK_PUBLIC PkHandle* pkNewInstNative(PKVM* vm, void* data, uint32_t id);
 //PK_PUBLIC PkVar pkPushBool(PKVM* vm, bool value);
 //PK_PUBLIC PkVar pkPushNumber(PKVM* vm, double value);
 
+/*****************************************************************************/
+/* DEBUGGER API                                                              */
+/*****************************************************************************/
+
+// Set a breakpoint at the first instruction of the [line] (or the next line
+// that has any instructions) of the script which path ends with [file]. If
+// the script isn't compiled yet it'll be set once it's compiled. Returns the
+// id of the breakpoint which will be passed to the pkDebugFn callback.
+PK_PUBLIC int pkDebugSetBreakpoint(PKVM* vm, const char* file, int line);
+
+// Remove the breakpoint of the [id] and returns true if it was exists.
+PK_PUBLIC bool pkDebugRemoveBreakpoint(PKVM* vm, int id);
+
+// Pause the execution at the next line that runs (as if it's stepped into).
+// This could be called before running a script to start it paused.
+PK_PUBLIC void pkDebugPause(PKVM* vm);
+
+// The functions below are used to inspect the paused execution from the
+// pkDebugFn callback. The frames are indexed with the [depth] where 0 is the
+// current (top most) frame.
+
+// Returns the number of call frames of the paused fiber.
+PK_PUBLIC int pkDebugGetFrameCount(const PKVM* vm);
+
+// Set the [frame] at the [depth] and returns true, if the depth is out of
+// range it'll return false.
+PK_PUBLIC bool pkDebugGetFrame(const PKVM* vm, int depth, PkDebugFrame* frame);
+
+// Returns the stack slot at the [index] of the frame at [depth] (the
+// parameters followed by the locals and the temporaries) or NULL if out of
+// range. The value is only valid till the execution is resumed.
+PK_PUBLIC PkVar pkDebugGetSlot(const PKVM* vm, int depth, int index);
+
+// Returns the global at the [index] of the script of the frame at [depth] and
+// set it's [name] or NULL if out of range.
+PK_PUBLIC PkVar pkDebugGetGlobal(const PKVM* vm, int depth, int index,
+                                 const char** name);
+
+// Write the repr string of the [value] with the pkWriteFn callback.
+PK_PUBLIC void pkDebugWriteValue(PKVM* vm, PkVar value);
+
+// Returns the line coverage of the scripts compiled with the coverage option
+// as a string of the [format]. The hit count of a line is 1 if it was
+// executed and 0 otherwise (only the first execution is recorded).
+PK_PUBLIC PkHandle* pkGetCoverage(PKVM* vm, PkCoverageFormat format);
+
+// Start recording the timeline of the VM (the compilations, the garbage
+// collections, the fiber switches and the native calls which took at least
+// [threshold] microseconds) to a ring buffer of [capacity] events. Once it's
+// full the oldest events are overwritten. If it's already recording, the
+// recorded events are discarded.
+PK_PUBLIC void pkTraceStart(PKVM* vm, uint32_t capacity, double threshold);
+
+// Stop recording the timeline and discard the recorded events.
+PK_PUBLIC void pkTraceStop(PKVM* vm);
+
+// Returns the recorded events as a string of the Chrome trace event JSON
+// format (which could be opened with chrome://tracing or Perfetto) and clear
+// them, the recording will be continued.
+PK_PUBLIC PkHandle* pkTraceFlush(PKVM* vm);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -0,0 +1,1174 @@
+/*
+ *  Copyright (c) 2020-2021 Thakee Nathees
+ *  Distributed Under The MIT License
+ */
+
+#include "pk_bigint.h"
+
+#include <ctype.h>
+#include <math.h>
+
+#include "pk_utils.h"
+#include "pk_vm.h"
+
+// The operands smaller than this number of limbs are multiplied with the
+// schoolbook method and the larger ones with Karatsuba (or Toom-3 if they're
+// larger than TOOM3_THRESHOLD).
+#define KARATSUBA_THRESHOLD 32
+#define TOOM3_THRESHOLD     128
+
+// Numbers smaller than this number of limbs are converted to and from decimal
+// with the quadratic method and the larger ones are split (divide and
+// conquer) with the powers of 10^9.
+#define CONVERT_THRESHOLD 40
+
+// The largest power of 10 in a limb and its number of digits.
+#define DECIMAL_BASE   1000000000u
+#define DECIMAL_DIGITS 9
+
+// The maximum number of limbs of the result of a power or a left shift, to
+// fail before trying to allocate a huge amount of memory.
+#define MAX_RESULT_LIMBS (1 << 24)
+
+// The powers of 10, for the partial chunks of the decimal digits.
+static const uint32_t _pow10[DECIMAL_DIGITS + 1] = {
+  1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+};
+
+/*****************************************************************************/
+/* LIMB ARRAYS                                                               */
+/*****************************************************************************/
+
+// The functions below work on the magnitudes as arrays of limbs with their
+// number of limbs. Unless mentioned the result [r] could be the same array
+// as the first operand but shouldn't overlap with the other operands.
+
+// Returns the number of limbs without the leading zeros.
+static inline size_t _bigNorm(const uint32_t* a, size_t n) {
+  while (n > 0 && a[n - 1] == 0) n--;
+  return n;
+}
+
+// Compare the magnitudes and returns -1, 0 or 1.
+static int _bigCmp(const uint32_t* a, size_t na, const uint32_t* b,
+                   size_t nb) {
+  na = _bigNorm(a, na);
+  nb = _bigNorm(b, nb);
+  if (na != nb) return (na < nb) ? -1 : 1;
+  while (na-- > 0) {
+    if (a[na] != b[na]) return (a[na] < b[na]) ? -1 : 1;
+  }
+  return 0;
+}
+
+// r = a + b where [na] >= [nb], r has [na] limbs and returns the carry.
+static uint32_t _bigAdd(uint32_t* r, const uint32_t* a, size_t na,
+                        const uint32_t* b, size_t nb) {
+  uint64_t carry = 0;
+  size_t i = 0;
+  for (; i < nb; i++) {
+    carry += (uint64_t)a[i] + b[i];
+    r[i] = (uint32_t)carry;
+    carry >>= 32;
+  }
+  for (; i < na; i++) {
+    carry += a[i];
+    r[i] = (uint32_t)carry;
+    carry >>= 32;
+  }
+  return (uint32_t)carry;
+}
+
+// r = a - b where [na] >= [nb], r has [na] limbs and returns the borrow.
+static uint32_t _bigSub(uint32_t* r, const uint32_t* a, size_t na,
+                        const uint32_t* b, size_t nb) {
+  uint32_t borrow = 0;
+  size_t i = 0;
+  for (; i < nb; i++) {
+    uint64_t diff = (uint64_t)a[i] - b[i] - borrow;
+    r[i] = (uint32_t)diff;
+    borrow = (uint32_t)(diff >> 63);
+  }
+  for (; i < na; i++) {
+    uint64_t diff = (uint64_t)a[i] - borrow;
+    r[i] = (uint32_t)diff;
+    borrow = (uint32_t)(diff >> 63);
+  }
+  return borrow;
+}
+
+// Add the [carry] to [r] in place and returns the carry out.
+static inline uint32_t _bigIncr(uint32_t* r, size_t n, uint32_t carry) {
+  for (size_t i = 0; i < n && carry != 0; i++) {
+    uint64_t sum = (uint64_t)r[i] + carry;
+    r[i] = (uint32_t)sum;
+    carry = (uint32_t)(sum >> 32);
+  }
+  return carry;
+}
+
+// r += a in place where the sum should fit in the [nr] limbs of [r].
+static void _bigAddTo(uint32_t* r, size_t nr, const uint32_t* a, size_t na) {
+  na = _bigNorm(a, na);
+  ASSERT(na <= nr, OOPS);
+  uint64_t carry = 0;
+  for (size_t i = 0; i < na; i++) {
+    carry += (uint64_t)r[i] + a[i];
+    r[i] = (uint32_t)carry;
+    carry >>= 32;
+  }
+  _bigIncr(r + na, nr - na, (uint32_t)carry);
+}
+
+// Negate the [n] limbs (two's complement) in place.
+static void _bigComplement(uint32_t* r, size_t n) {
+  uint32_t carry = 1;
+  for (size_t i = 0; i < n; i++) {
+    uint64_t sum = (uint64_t)(~r[i]) + carry;
+    r[i] = (uint32_t)sum;
+    carry = (uint32_t)(sum >> 32);
+  }
+}
+
+// r = a << s where 0 < s < 32 and returns the shifted out bits.
+static uint32_t _bigShl(uint32_t* r, const uint32_t* a, size_t n, int s) {
+  uint32_t carry = 0;
+  for (size_t i = 0; i < n; i++) {
+    uint32_t limb = a[i];
+    r[i] = (limb << s) | carry;
+    carry = limb >> (32 - s);
+  }
+  return carry;
+}
+
+// r = a >> s where 0 < s < 32.
+static void _bigShr(uint32_t* r, const uint32_t* a, size_t n, int s) {
+  for (size_t i = 0; i < n; i++) {
+    uint32_t high = (i + 1 < n) ? (a[i + 1] << (32 - s)) : 0;
+    r[i] = (a[i] >> s) | high;
+  }
+}
+
+// r = a * m + add where r has [n] limbs and returns the carry.
+static uint32_t _bigMulAdd1(uint32_t* r, const uint32_t* a, size_t n,
+                            uint32_t m, uint32_t add) {
+  uint64_t carry = add;
+  for (size_t i = 0; i < n; i++) {
+    carry += (uint64_t)a[i] * m;
+    r[i] = (uint32_t)carry;
+    carry >>= 32;
+  }
+  return (uint32_t)carry;
+}
+
+// r += a * m where r has [n] limbs and returns the carry.
+static uint32_t _bigAddMul1(uint32_t* r, const uint32_t* a, size_t n,
+                            uint32_t m) {
+  uint64_t carry = 0;
+  for (size_t i = 0; i < n; i++) {
+    carry += (uint64_t)a[i] * m + r[i];
+    r[i] = (uint32_t)carry;
+    carry >>= 32;
+  }
+  return (uint32_t)carry;
+}
+
+// q = a / d and returns the remainder.
+static uint32_t _bigDiv1(uint32_t* q, const uint32_t* a, size_t n,
+                         uint32_t d) {
+  uint64_t rem = 0;
+  for (size_t i = n; i-- > 0;) {
+    uint64_t cur = (rem << 32) | a[i];
+    q[i] = (uint32_t)(cur / d);
+    rem = cur % d;
+  }
+  return (uint32_t)rem;
+}
+
+// r = |x - y| with [n] limbs (at least the size of both) and returns true if
+// x < y. [r] shouldn't overlap with any of the operands.
+static bool _bigAbsDiff(uint32_t* r, const uint32_t* x, size_t nx,
+                        const uint32_t* y, size_t ny, size_t n) {
+  nx = _bigNorm(x, nx);
+  ny = _bigNorm(y, ny);
+  bool negative = _bigCmp(x, nx, y, ny) < 0;
+  if (negative) {
+    _bigSub(r, y, ny, x, nx);
+    memset(r + ny, 0, (n - ny) * sizeof(uint32_t));
+  } else {
+    _bigSub(r, x, nx, y, ny);
+    memset(r + nx, 0, (n - nx) * sizeof(uint32_t));
+  }
+  return negative;
+}
+
+// Signed addition of the values with [n] limbs (used by Toom-3 which has
+// negative intermediate values), r = x + y where [y] has [ny] <= [n] limbs
+// and [r] could be the same as [x]. Returns the sign of the result.
+static bool _bigSignedAdd(uint32_t* r, const uint32_t* x, bool xneg,
+                          const uint32_t* y, size_t ny, bool yneg, size_t n) {
+  if (xneg == yneg) {
+    _bigAdd(r, x, n, y, ny);
+    return xneg;
+  }
+  if (_bigSub(r, x, n, y, ny) != 0) {
+    _bigComplement(r, n);
+    return yneg;
+  }
+  return xneg;
+}
+
+/*****************************************************************************/
+/* MULTIPLICATION                                                            */
+/*****************************************************************************/
+
+static void _bigMulRec(uint32_t* r, const uint32_t* a, size_t na,
+                       const uint32_t* b, size_t nb, uint32_t* scratch);
+
+// r = a * b with the schoolbook method, [nb] should be at least 1.
+static void _bigMulBasecase(uint32_t* r, const uint32_t* a, size_t na,
+                            const uint32_t* b, size_t nb) {
+  r[na] = _bigMulAdd1(r, a, na, b[0], 0);
+  for (size_t j = 1; j < nb; j++) {
+    r[na + j] = _bigAddMul1(r + j, a, na, b[j]);
+  }
+}
+
+// r = a * b written to [n] limbs (the rest of the product are zeros).
+static void _bigMulFixed(uint32_t* r, const uint32_t* a, size_t na,
+                         const uint32_t* b, size_t nb, size_t n,
+                         uint32_t* scratch) {
+  na = _bigNorm(a, na);
+  nb = _bigNorm(b, nb);
+  if (na == 0 || nb == 0) {
+    memset(r, 0, n * sizeof(uint32_t));
+    return;
+  }
+  _bigMulRec(r, a, na, b, nb, scratch);
+  memset(r + na + nb, 0, (n - na - nb) * sizeof(uint32_t));
+}
+
+// Multiply a large [a] with a much smaller [b] ([na] >= 2 * [nb] - 1) by
+// splitting [a] into the pieces of the size of [b].
+static void _bigMulUnbalanced(uint32_t* r, const uint32_t* a, size_t na,
+                              const uint32_t* b, size_t nb,
+                              uint32_t* scratch) {
+  uint32_t* product = scratch;
+  uint32_t* next = scratch + 2 * nb;
+
+  _bigMulRec(r, a, nb, b, nb, next);
+  for (size_t offset = nb; offset < na; offset += nb) {
+    size_t size = (na - offset < nb) ? na - offset : nb;
+    _bigMulRec(product, a + offset, size, b, nb, next);
+
+    // The lower half overlaps with the previous product.
+    uint32_t carry = _bigAdd(r + offset, r + offset, nb, product, nb);
+    memcpy(r + offset + nb, product + nb, size * sizeof(uint32_t));
+    _bigIncr(r + offset + nb, size, carry);
+  }
+}
+
+// Karatsuba multiplication, with a = a1*B^m + a0 and b = b1*B^m + b0 the
+// product is z2*B^2m + z1*B^m + z0 where z0 = a0*b0, z2 = a1*b1 and
+// z1 = z0 + z2 - (a0 - a1)*(b0 - b1) (3 multiplications instead of 4).
+static void _bigMulKaratsuba(uint32_t* r, const uint32_t* a, size_t na,
+                             const uint32_t* b, size_t nb,
+                             uint32_t* scratch) {
+  size_t m = (na + 1) / 2;
+  size_t ha = na - m, hb = nb - m;
+
+  uint32_t* da = scratch;
+  uint32_t* db = da + m;
+  uint32_t* zm = db + m;
+  uint32_t* z1 = zm + 2 * m;
+  uint32_t* next = z1 + 2 * m + 1;
+
+  _bigMulRec(r, a, m, b, m, next);                   // z0
+  _bigMulRec(r + 2 * m, a + m, ha, b + m, hb, next); // z2
+
+  bool neg_a = _bigAbsDiff(da, a, m, a + m, ha, m);
+  bool neg_b = _bigAbsDiff(db, b, m, b + m, hb, m);
+  _bigMulFixed(zm, da, m, db, m, 2 * m, next);
+
+  z1[2 * m] = _bigAdd(z1, r, 2 * m, r + 2 * m, ha + hb);
+  if (neg_a == neg_b) {
+    _bigSub(z1, z1, 2 * m + 1, zm, 2 * m);
+  } else {
+    _bigAdd(z1, z1, 2 * m + 1, zm, 2 * m);
+  }
+
+  _bigAddTo(r + m, na + nb - m, z1, 2 * m + 1);
+}
+
+// Evaluate the polynomial of the 3 parts of [a] at 1, -1 and -2 (the sizes
+// of the values are [k] + 1 limbs) for Toom-3.
+static void _bigToomEval(const uint32_t* a, size_t k, size_t h,
+                         uint32_t* v1, uint32_t* vm1, uint32_t* vm2,
+                         bool* neg_m1, bool* neg_m2) {
+  const uint32_t *a0 = a, *a1 = a + k, *a2 = a + 2 * k;
+  const size_t n = k + 1;
+
+  // p = a0 + a2, a(1) = p + a1, a(-1) = p - a1.
+  v1[k] = _bigAdd(v1, a0, k, a2, h);
+  *neg_m1 = _bigSignedAdd(vm1, v1, false, a1, k, true, n);
+  _bigAdd(v1, v1, n, a1, k);
+
+  // a(-2) = (a(-1) + a2) * 2 - a0.
+  bool neg = _bigSignedAdd(vm2, vm1, *neg_m1, a2, h, false, n);
+  _bigShl(vm2, vm2, n, 1);
+  *neg_m2 = _bigSignedAdd(vm2, vm2, neg, a0, k, true, n);
+}
+
+// Toom-3 multiplication, the operands are split into 3 parts as polynomials
+// which are evaluated at 0, 1, -1, -2 and infinity, multiplied (5 products
+// instead of 9) and the product is interpolated with the sequence of Marco
+// Bodrato.
+static void _bigMulToom3(uint32_t* r, const uint32_t* a, size_t na,
+                         const uint32_t* b, size_t nb, uint32_t* scratch) {
+  const size_t k = (na + 2) / 3;
+  const size_t ha = na - 2 * k, hb = nb - 2 * k;
+  const size_t e = k + 1;      // Size of the evaluated values.
+  const size_t w = 2 * e + 1;  // Size of the products.
+
+  uint32_t* a1 = scratch;
+  uint32_t* am1 = a1 + e;
+  uint32_t* am2 = am1 + e;
+  uint32_t* b1 = am2 + e;
+  uint32_t* bm1 = b1 + e;
+  uint32_t* bm2 = bm1 + e;
+  uint32_t* r1 = bm2 + e;
+  uint32_t* rm1 = r1 + w;
+  uint32_t* rm2 = rm1 + w;
+  uint32_t* t = rm2 + w;
+  uint32_t* next = t + w;
+
+  bool neg_am1, neg_am2, neg_bm1, neg_bm2;
+  _bigToomEval(a, k, ha, a1, am1, am2, &neg_am1, &neg_am2);
+  _bigToomEval(b, k, hb, b1, bm1, bm2, &neg_bm1, &neg_bm2);
+
+  // r(0) and r(inf) are written to their place in the result.
+  const uint32_t* r0 = r;
+  const uint32_t* rinf = r + 4 * k;
+  const size_t ninf = ha + hb;
+  _bigMulRec(r, a, k, b, k, next);
+  _bigMulRec(r + 4 * k, a + 2 * k, ha, b + 2 * k, hb, next);
+  memset(r + 2 * k, 0, 2 * k * sizeof(uint32_t));
+
+  _bigMulFixed(r1, a1, e, b1, e, w, next);
+  _bigMulFixed(rm1, am1, e, bm1, e, w, next);
+  _bigMulFixed(rm2, am2, e, bm2, e, w, next);
+  bool s1 = false, s2, s3;
+  bool neg_rm1 = neg_am1 != neg_bm1;
+  bool neg_rm2 = neg_am2 != neg_bm2;
+
+  // r3 = (r(-2) - r(1)) / 3
+  s3 = _bigSignedAdd(rm2, rm2, neg_rm2, r1, w, true, w);
+  _bigDiv1(rm2, rm2, w, 3);
+
+  // r1 = (r(1) - r(-1)) / 2
+  s1 = _bigSignedAdd(r1, r1, s1, rm1, w, !neg_rm1, w);
+  _bigShr(r1, r1, w, 1);
+
+  // r2 = r(-1) - r(0)
+  s2 = _bigSignedAdd(rm1, rm1, neg_rm1, r0, 2 * k, true, w);
+
+  // r3 = (r2 - r3) / 2 + 2 * r(inf)
+  s3 = _bigSignedAdd(rm2, rm2, !s3, rm1, w, s2, w);
+  _bigShr(rm2, rm2, w, 1);
+  memcpy(t, rinf, ninf * sizeof(uint32_t));
+  memset(t + ninf, 0, (w - ninf) * sizeof(uint32_t));
+  _bigShl(t, t, w, 1);
+  s3 = _bigSignedAdd(rm2, rm2, s3, t, w, false, w);
+
+  // r2 = r2 + r1 - r(inf)
+  s2 = _bigSignedAdd(rm1, rm1, s2, r1, w, s1, w);
+  _bigSignedAdd(rm1, rm1, s2, rinf, ninf, true, w);
+
+  // r1 = r1 - r3
+  _bigSignedAdd(r1, r1, s1, rm2, w, !s3, w);
+
+  // The coefficients r1, r2, r3 are non negative now.
+  _bigAddTo(r + k, na + nb - k, r1, w);
+  _bigAddTo(r + 2 * k, na + nb - 2 * k, rm1, w);
+  _bigAddTo(r + 3 * k, na + nb - 3 * k, rm2, w);
+}
+
+// r = a * b with [na] + [nb] limbs, the method is chosen by the sizes. The
+// [scratch] should have at least _bigMulScratch(max(na, nb)) limbs.
+static void _bigMulRec(uint32_t* r, const uint32_t* a, size_t na,
+                       const uint32_t* b, size_t nb, uint32_t* scratch) {
+  if (na < nb) {
+    const uint32_t* tmp = a; a = b; b = tmp;
+    size_t ntmp = na; na = nb; nb = ntmp;
+  }
+
+  if (nb == 0) {
+    memset(r, 0, na * sizeof(uint32_t));
+  } else if (nb < KARATSUBA_THRESHOLD) {
+    _bigMulBasecase(r, a, na, b, nb);
+  } else if (2 * nb <= na + 1) {
+    _bigMulUnbalanced(r, a, na, b, nb, scratch);
+  } else if (na >= TOOM3_THRESHOLD && nb > 2 * ((na + 2) / 3)) {
+    _bigMulToom3(r, a, na, b, nb, scratch);
+  } else {
+    _bigMulKaratsuba(r, a, na, b, nb, scratch);
+  }
+}
+
+// Returns the number of the scratch limbs required to multiply numbers of at
+// most [n] limbs. Each level of the recursion uses less than 8n + 32 limbs
+// and the next level is at most the half of it.
+static size_t _bigMulScratch(size_t n) {
+  size_t size = 0;
+  while (n >= KARATSUBA_THRESHOLD) {
+    size += 8 * n + 32;
+    n = n / 2 + 2;
+  }
+  return size;
+}
+
+// r = a * b with [na] + [nb] limbs.
+static void _bigMul(PKVM* vm, uint32_t* r, const uint32_t* a, size_t na,
+                    const uint32_t* b, size_t nb) {
+  size_t size = _bigMulScratch((na > nb) ? na : nb);
+  uint32_t* scratch = NULL;
+  if (size > 0) scratch = ALLOCATE_ARRAY(vm, uint32_t, size);
+  _bigMulRec(r, a, na, b, nb, scratch);
+  if (scratch != NULL) DEALLOCATE(vm, scratch);
+}
+
+/*****************************************************************************/
+/* DIVISION                                                                  */
+/*****************************************************************************/
+
+// Divide [a] by [b] with the Knuth's algorithm D (The Art of Computer
+// Programming, Vol. 2, 4.3.1). The operands should be normalized and [na] >=
+// [nb] >= 1. The quotient [q] has [na] - [nb] + 1 limbs and the remainder
+// [rem] (could be NULL) has [nb] limbs.
+static void _bigDivRem(PKVM* vm, uint32_t* q, uint32_t* rem,
+                       const uint32_t* a, size_t na,
+                       const uint32_t* b, size_t nb) {
+  if (nb == 1) {
+    uint32_t r = _bigDiv1(q, a, na, b[0]);
+    if (rem != NULL) rem[0] = r;
+    return;
+  }
+
+  // Normalize the divisor to have its highest bit set so the estimated
+  // digits of the quotient are off by at most 2.
+  int shift = 0;
+  while ((b[nb - 1] << shift) < 0x80000000u) shift++;
+
+  uint32_t* u = ALLOCATE_ARRAY(vm, uint32_t, na + 1 + nb);
+  uint32_t* v = u + na + 1;
+  if (shift > 0) {
+    _bigShl(v, b, nb, shift);
+    u[na] = _bigShl(u, a, na, shift);
+  } else {
+    memcpy(v, b, nb * sizeof(uint32_t));
+    memcpy(u, a, na * sizeof(uint32_t));
+    u[na] = 0;
+  }
+
+  const uint64_t vtop = v[nb - 1], vnext = v[nb - 2];
+  for (size_t j = na - nb + 1; j-- > 0;) {
+    uint64_t num = ((uint64_t)u[j + nb] << 32) | u[j + nb - 1];
+    uint64_t qhat = num / vtop;
+    uint64_t rhat = num % vtop;
+    while (qhat > UINT32_MAX ||
+           qhat * vnext > ((rhat << 32) | u[j + nb - 2])) {
+      qhat--;
+      rhat += vtop;
+      if (rhat > UINT32_MAX) break;
+    }
+
+    // u[j .. j + nb] -= qhat * v
+    uint64_t carry = 0;
+    uint32_t borrow = 0;
+    for (size_t i = 0; i < nb; i++) {
+      uint64_t product = qhat * v[i] + carry;
+      carry = product >> 32;
+      uint64_t diff = (uint64_t)u[i + j] - (uint32_t)product - borrow;
+      u[i + j] = (uint32_t)diff;
+      borrow = (uint32_t)(diff >> 63);
+    }
+    uint64_t diff = (uint64_t)u[j + nb] - carry - borrow;
+    u[j + nb] = (uint32_t)diff;
+
+    // The estimate was one too large, add the divisor back.
+    if ((diff >> 63) != 0) {
+      qhat--;
+      u[j + nb] += _bigAdd(u + j, u + j, nb, v, nb);
+    }
+    q[j] = (uint32_t)qhat;
+  }
+
+  if (rem != NULL) {
+    if (shift > 0) {
+      _bigShr(rem, u, nb, shift);
+    } else {
+      memcpy(rem, u, nb * sizeof(uint32_t));
+    }
+  }
+
+  DEALLOCATE(vm, u);
+}
+
+/*****************************************************************************/
+/* BASE CONVERSION                                                           */
+/*****************************************************************************/
+
+// The powers 10^(9 * 2^i) which are computed as they're needed while
+// converting a large number.
+typedef struct {
+  uint32_t* limbs[32];
+  size_t sizes[32];
+  int count;
+} BigPowers;
+
+static void _bigPowersInit(BigPowers* self) {
+  self->count = 0;
+}
+
+static void _bigPowersClear(PKVM* vm, BigPowers* self) {
+  for (int i = 0; i < self->count; i++) DEALLOCATE(vm, self->limbs[i]);
+  self->count = 0;
+}
+
+// Returns the power 10^(9 * 2^index) and set its size to [size].
+static const uint32_t* _bigPowersGet(PKVM* vm, BigPowers* self, int index,
+                                     size_t* size) {
+  while (self->count <= index) {
+    int i = self->count;
+    if (i == 0) {
+      self->limbs[0] = ALLOCATE_ARRAY(vm, uint32_t, 1);
+      self->limbs[0][0] = DECIMAL_BASE;
+      self->sizes[0] = 1;
+    } else {
+      size_t n = self->sizes[i - 1];
+      uint32_t* limbs = ALLOCATE_ARRAY(vm, uint32_t, 2 * n);
+      _bigMul(vm, limbs, self->limbs[i - 1], n, self->limbs[i - 1], n);
+      self->limbs[i] = limbs;
+      self->sizes[i] = _bigNorm(limbs, 2 * n);
+    }
+    self->count++;
+  }
+  *size = self->sizes[index];
+  return self->limbs[index];
+}
+
+// Parse the decimal [digits] into [out] which should have at least
+// [count] / 9 + 2 limbs and returns the number of limbs.
+static size_t _bigFromDecimal(PKVM* vm, const char* digits, size_t count,
+                              BigPowers* powers, uint32_t* out) {
+  if (count <= DECIMAL_DIGITS * CONVERT_THRESHOLD) {
+    size_t n = 0, i = 0;
+    while (i < count) {
+      // The first chunk is the remaining digits so the rest are 9 digits.
+      size_t length = (i == 0 && count % DECIMAL_DIGITS != 0)
+                    ? count % DECIMAL_DIGITS : DECIMAL_DIGITS;
+      uint32_t chunk = 0;
+      for (size_t j = 0; j < length; j++) {
+        chunk = chunk * 10 + (uint32_t)(digits[i + j] - '0');
+      }
+      i += length;
+      uint32_t carry = _bigMulAdd1(out, out, n, _pow10[length], chunk);
+      if (carry != 0) out[n++] = carry;
+    }
+    return n;
+  }
+
+  // Split the digits as high * 10^(9 * 2^index) + low where the low part is
+  // the largest power of two number of chunks.
+  size_t chunks = (count + DECIMAL_DIGITS - 1) / DECIMAL_DIGITS;
+  int index = 0;
+  while (((size_t)2 << index) < chunks) index++;
+  size_t low_count = DECIMAL_DIGITS * ((size_t)1 << index);
+  size_t high_count = count - low_count;
+
+  size_t high_size = high_count / DECIMAL_DIGITS + 2;
+  size_t low_size = low_count / DECIMAL_DIGITS + 2;
+  uint32_t* high = ALLOCATE_ARRAY(vm, uint32_t, high_size + low_size);
+  uint32_t* low = high + high_size;
+
+  size_t nh = _bigFromDecimal(vm, digits, high_count, powers, high);
+  size_t nl = _bigFromDecimal(vm, digits + high_count, low_count, powers,
+                              low);
+
+  size_t n;
+  if (nh == 0) {
+    memcpy(out, low, nl * sizeof(uint32_t));
+    n = nl;
+  } else {
+    size_t np;
+    const uint32_t* power = _bigPowersGet(vm, powers, index, &np);
+    _bigMul(vm, out, high, nh, power, np);
+    _bigAddTo(out, nh + np, low, nl);
+    n = _bigNorm(out, nh + np);
+  }
+
+  DEALLOCATE(vm, high);
+  return n;
+}
+
+// Write the decimal digits of [a] to [out] and returns the end of the
+// written digits. If [width] is not zero, exactly [width] digits are written
+// with the leading zeros otherwise without them.
+static char* _bigToDecimal(PKVM* vm, const uint32_t* a, size_t n,
+                           size_t width, BigPowers* powers, char* out) {
+  n = _bigNorm(a, n);
+
+  if (n <= CONVERT_THRESHOLD) {
+    uint32_t limbs[CONVERT_THRESHOLD];
+    uint32_t chunks[2 * CONVERT_THRESHOLD];
+    int count = 0;
+
+    memcpy(limbs, a, n * sizeof(uint32_t));
+    while (n > 0) {
+      chunks[count++] = _bigDiv1(limbs, limbs, n, DECIMAL_BASE);
+      n = _bigNorm(limbs, n);
+    }
+
+    char digits[2 * CONVERT_THRESHOLD * DECIMAL_DIGITS + 1];
+    size_t length = 0;
+    for (int i = count - 1; i >= 0; i--) {
+      size_t size = sizeof(digits) - length;
+      int written = (i == count - 1)
+                  ? snprintf(digits + length, size, "%u", chunks[i])
+                  : snprintf(digits + length, size, "%09u", chunks[i]);
+      length += (size_t)written;
+    }
+
+    if (width > length) {
+      memset(out, '0', width - length);
+      out += width - length;
+    }
+    memcpy(out, digits, length);
+    return out + length;
+  }
+
+  // Split the number as high * 10^(9 * 2^index) + low where the power is at
+  // most the half of the number.
+  int index = 0;
+  size_t np;
+  while (_bigPowersGet(vm, powers, index + 1, &np) && 2 * np <= n) index++;
+  const uint32_t* power = _bigPowersGet(vm, powers, index, &np);
+  size_t low_width = DECIMAL_DIGITS * ((size_t)1 << index);
+
+  uint32_t* high = ALLOCATE_ARRAY(vm, uint32_t, n + 1);
+  uint32_t* low = high + (n - np + 1);
+  _bigDivRem(vm, high, low, a, n, power, np);
+
+  out = _bigToDecimal(vm, high, n - np + 1,
+                      (width > 0) ? width - low_width : 0, powers, out);
+  out = _bigToDecimal(vm, low, np, low_width, powers, out);
+
+  DEALLOCATE(vm, high);
+  return out;
+}
+
+/*****************************************************************************/
+/* BIGINT                                                                    */
+/*****************************************************************************/
+
+// Remove the leading zero limbs of the [self], zero is always positive.
+static void _bigTrim(BigInt* self) {
+  self->count = (uint32_t)_bigNorm(self->limbs, self->count);
+  if (self->count == 0) self->negative = false;
+}
+
+// Set the magnitude of the [value] (a finite whole number) to the [limbs]
+// which should have at least 36 limbs and returns the number of limbs.
+static size_t _bigFromDouble(double value, uint32_t* limbs) {
+  value = fabs(value);
+  if (value < 18446744073709551616.0) { // 2^64
+    uint64_t integer = (uint64_t)value;
+    limbs[0] = (uint32_t)integer;
+    limbs[1] = (uint32_t)(integer >> 32);
+    return _bigNorm(limbs, 2);
+  }
+
+  // value = mantissa * 2^shift where the mantissa is 64 bits.
+  int exponent;
+  double fraction = frexp(value, &exponent);
+  uint64_t mantissa = (uint64_t)ldexp(fraction, 64);
+  int shift = exponent - 64;
+  size_t word = (size_t)(shift / 32);
+  int bits = shift % 32;
+
+  memset(limbs, 0, word * sizeof(uint32_t));
+  uint32_t lo = (uint32_t)mantissa, hi = (uint32_t)(mantissa >> 32);
+  if (bits == 0) {
+    limbs[word] = lo;
+    limbs[word + 1] = hi;
+    limbs[word + 2] = 0;
+  } else {
+    limbs[word] = lo << bits;
+    limbs[word + 1] = (hi << bits) | (lo >> (32 - bits));
+    limbs[word + 2] = hi >> (32 - bits);
+  }
+  return _bigNorm(limbs, word + 3);
+}
+
+// Returns a new BigInt of the magnitude [limbs] with the sign [negative].
+static BigInt* _bigNew(PKVM* vm, const uint32_t* limbs, size_t count,
+                       bool negative) {
+  BigInt* self = newBigInt(vm, (uint32_t)count);
+  memcpy(self->limbs, limbs, count * sizeof(uint32_t));
+  self->negative = negative;
+  _bigTrim(self);
+  return self;
+}
+
+BigInt* bigIntFromInt(PKVM* vm, int64_t value) {
+  uint64_t magnitude = (value < 0) ? (uint64_t)0 - (uint64_t)value
+                                   : (uint64_t)value;
+  uint32_t limbs[2] = { (uint32_t)magnitude, (uint32_t)(magnitude >> 32) };
+  return _bigNew(vm, limbs, 2, value < 0);
+}
+
+BigInt* bigIntFromDouble(PKVM* vm, double value) {
+  uint32_t limbs[36];
+  size_t count = _bigFromDouble(value, limbs);
+  return _bigNew(vm, limbs, count, value < 0);
+}
+
+BigInt* bigIntParse(PKVM* vm, const char* str, uint32_t length) {
+  const char* end = str + length;
+  bool negative = false;
+  if (str < end && (*str == '-' || *str == '+')) negative = (*str++ == '-');
+
+  int bits = 0; // Bits per digit of the power of two bases.
+  if (end - str > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+    bits = 4;
+    str += 2;
+  } else if (end - str > 2 && str[0] == '0' &&
+             (str[1] == 'b' || str[1] == 'B')) {
+    bits = 1;
+    str += 2;
+  }
+
+  size_t count = (size_t)(end - str);
+  if (count == 0) return NULL;
+
+  // Validate the digits.
+  for (const char* c = str; c < end; c++) {
+    if (bits == 4 && isxdigit((unsigned char)*c)) continue;
+    if (bits == 1 && (*c == '0' || *c == '1')) continue;
+    if (bits == 0 && utilIsDigit(*c)) continue;
+    return NULL;
+  }
+
+  BigInt* self;
+  if (bits != 0) {
+    self = newBigInt(vm, (uint32_t)((count * bits + 31) / 32));
+    memset(self->limbs, 0, self->count * sizeof(uint32_t));
+    size_t position = 0; // Bit position of the current digit.
+    for (const char* c = end; c-- > str;) {
+      uint32_t digit = utilIsDigit(*c) ? (uint32_t)(*c - '0')
+                     : (uint32_t)((*c | 0x20) - 'a' + 10);
+      self->limbs[position / 32] |= digit << (position % 32);
+      position += bits;
+    }
+
+  } else {
+    BigPowers powers;
+    _bigPowersInit(&powers);
+    uint32_t* limbs = ALLOCATE_ARRAY(vm, uint32_t,
+                                     count / DECIMAL_DIGITS + 2);
+    size_t n = _bigFromDecimal(vm, str, count, &powers, limbs);
+    _bigPowersClear(vm, &powers);
+
+    self = newBigInt(vm, (uint32_t)n);
+    memcpy(self->limbs, limbs, n * sizeof(uint32_t));
+    DEALLOCATE(vm, limbs);
+  }
+
+  self->negative = negative;
+  _bigTrim(self);
+  return self;
+}
+
+double bigIntToDouble(const BigInt* self) {
+  size_t n = self->count;
+  if (n == 0) return 0;
+
+  // The top 3 limbs have at least 65 significant bits.
+  size_t low = (n > 3) ? n - 3 : 0;
+  double value = 0;
+  for (size_t i = n; i-- > low;) {
+    value = value * 4294967296.0 + self->limbs[i];
+  }
+  value = ldexp(value, (int)(32 * low));
+  return self->negative ? -value : value;
+}
+
+bool bigIntToInt64(const BigInt* self, int64_t* value) {
+  if (self->count > 2) return false;
+  uint64_t magnitude = 0;
+  if (self->count > 0) magnitude = self->limbs[0];
+  if (self->count > 1) magnitude |= (uint64_t)self->limbs[1] << 32;
+
+  // The magnitude of INT64_MIN is one more than INT64_MAX.
+  if (magnitude > (uint64_t)INT64_MAX + (self->negative ? 1 : 0)) {
+    return false;
+  }
+  *value = self->negative ? (int64_t)((uint64_t)0 - magnitude)
+                          : (int64_t)magnitude;
+  return true;
+}
+
+bool bigIntIsDouble(const BigInt* self) {
+  if (self->count == 0) return true;
+
+  size_t high = 32 * (self->count - 1), low = 0;
+  uint32_t top = self->limbs[self->count - 1];
+  while (top != 0) {
+    high++;
+    top >>= 1;
+  }
+
+  size_t i = 0;
+  while (self->limbs[i] == 0) i++;
+  uint32_t limb = self->limbs[i];
+  low = 32 * i;
+  while ((limb & 1) == 0) {
+    low++;
+    limb >>= 1;
+  }
+
+  // The significant bits should fit in the 53 bits of the mantissa.
+  return high <= 1024 && high - low <= 53;
+}
+
+int bigIntCompare(const BigInt* a, const BigInt* b) {
+  if (a->negative != b->negative) return a->negative ? -1 : 1;
+  int cmp = _bigCmp(a->limbs, a->count, b->limbs, b->count);
+  return a->negative ? -cmp : cmp;
+}
+
+int bigIntCompareNumber(const BigInt* self, double value) {
+  if (isinf(value)) return (value > 0) ? -1 : 1;
+
+  // If the value has a fraction, compare with its floor and if they're
+  // equal, the BigInt is smaller.
+  double whole = floor(value);
+  int fraction = (whole != value) ? -1 : 0;
+
+  bool negative = whole < 0;
+  uint32_t limbs[36];
+  size_t count = _bigFromDouble(whole, limbs);
+  if (count == 0) negative = false;
+
+  int cmp;
+  if (self->negative != negative) {
+    cmp = self->negative ? -1 : 1;
+  } else {
+    cmp = _bigCmp(self->limbs, self->count, limbs, count);
+    if (negative) cmp = -cmp;
+  }
+  return (cmp != 0) ? cmp : fraction;
+}
+
+uint32_t bigIntHash(const BigInt* self) {
+  if (bigIntIsDouble(self)) return utilHashNumber(bigIntToDouble(self));
+
+  uint64_t hash = 14695981039346656037u;
+  for (uint32_t i = 0; i < self->count; i++) {
+    hash ^= self->limbs[i];
+    hash *= 1099511628211u;
+  }
+  if (self->negative) hash = ~hash;
+  return utilHashBits(hash);
+}
+
+BigInt* bigIntNegate(PKVM* vm, const BigInt* self) {
+  return _bigNew(vm, self->limbs, self->count, !self->negative);
+}
+
+// Returns a new BigInt of [a] + [b] or [a] - [b] if [subtract] is true.
+static BigInt* _bigAddSigned(PKVM* vm, const BigInt* a, const BigInt* b,
+                             bool subtract) {
+  bool neg_b = b->negative != subtract;
+  size_t na = a->count, nb = b->count;
+
+  BigInt* result = newBigInt(vm, (uint32_t)(((na > nb) ? na : nb) + 1));
+  if (a->negative == neg_b) {
+    if (na >= nb) {
+      result->limbs[na] = _bigAdd(result->limbs, a->limbs, na, b->limbs, nb);
+    } else {
+      result->limbs[nb] = _bigAdd(result->limbs, b->limbs, nb, a->limbs, na);
+    }
+    result->negative = a->negative;
+
+  } else if (_bigCmp(a->limbs, na, b->limbs, nb) >= 0) {
+    _bigSub(result->limbs, a->limbs, na, b->limbs, nb);
+    result->count = (uint32_t)na;
+    result->negative = a->negative;
+
+  } else {
+    _bigSub(result->limbs, b->limbs, nb, a->limbs, na);
+    result->count = (uint32_t)nb;
+    result->negative = neg_b;
+  }
+
+  _bigTrim(result);
+  return result;
+}
+
+BigInt* bigIntAdd(PKVM* vm, const BigInt* a, const BigInt* b) {
+  return _bigAddSigned(vm, a, b, false);
+}
+
+BigInt* bigIntSubtract(PKVM* vm, const BigInt* a, const BigInt* b) {
+  return _bigAddSigned(vm, a, b, true);
+}
+
+BigInt* bigIntMultiply(PKVM* vm, const BigInt* a, const BigInt* b) {
+  if (a->count == 0 || b->count == 0) return newBigInt(vm, 0);
+
+  BigInt* result = newBigInt(vm, a->count + b->count);
+  vmPushTempRef(vm, &result->_super); // result.
+  _bigMul(vm, result->limbs, a->limbs, a->count, b->limbs, b->count);
+  vmPopTempRef(vm); // result.
+
+  result->negative = a->negative != b->negative;
+  _bigTrim(result);
+  return result;
+}
+
+void bigIntDivide(PKVM* vm, const BigInt* a, const BigInt* b,
+                  BigInt** quotient, BigInt** remainder) {
+  ASSERT(b->count != 0, "Division by zero.");
+
+  BigInt *q, *r;
+  if (_bigCmp(a->limbs, a->count, b->limbs, b->count) < 0) {
+    q = newBigInt(vm, 0);
+    vmPushTempRef(vm, &q->_super); // q.
+    r = _bigNew(vm, a->limbs, a->count, a->negative);
+    vmPopTempRef(vm); // q.
+
+  } else {
+    q = newBigInt(vm, a->count - b->count + 1);
+    vmPushTempRef(vm, &q->_super); // q.
+    r = newBigInt(vm, b->count);
+    vmPushTempRef(vm, &r->_super); // r.
+    _bigDivRem(vm, q->limbs, r->limbs, a->limbs, a->count,
+               b->limbs, b->count);
+    vmPopTempRef(vm); // r.
+    vmPopTempRef(vm); // q.
+
+    q->negative = a->negative != b->negative;
+    r->negative = a->negative;
+    _bigTrim(q);
+    _bigTrim(r);
+  }
+
+  if (quotient != NULL) *quotient = q;
+  if (remainder != NULL) *remainder = r;
+}
+
+BigInt* bigIntPow(PKVM* vm, const BigInt* base, uint32_t exponent) {
+  bool negative = base->negative && (exponent & 1) != 0;
+  if (exponent == 0) {
+    uint32_t one = 1;
+    return _bigNew(vm, &one, 1, false);
+  }
+  if (base->count <= 1 && (base->count == 0 || base->limbs[0] == 1)) {
+    return _bigNew(vm, base->limbs, base->count, negative);
+  }
+
+  // The squares and the products are written with the sum of the limbs of
+  // the operands, which is at most 2 more than the result.
+  uint64_t bits = 32 * (uint64_t)(base->count - 1);
+  for (uint32_t top = base->limbs[base->count - 1]; top != 0; top >>= 1) {
+    bits++;
+  }
+  uint64_t size = (bits * exponent) / 32 + 2;
+  if (size > MAX_RESULT_LIMBS) return NULL;
+
+  uint32_t* result = ALLOCATE_ARRAY(vm, uint32_t, 2 * size);
+  uint32_t* product = result + size;
+  size_t n = base->count;
+  memcpy(result, base->limbs, n * sizeof(uint32_t));
+
+  // Left to right binary exponentiation.
+  int bit = 31;
+  while ((exponent >> bit) == 0) bit--;
+  while (bit-- > 0) {
+    _bigMul(vm, product, result, n, result, n);
+    n = _bigNorm(product, 2 * n);
+
+    if ((exponent >> bit) & 1) {
+      _bigMul(vm, result, product, n, base->limbs, base->count);
+      n = _bigNorm(result, n + base->count);
+    } else {
+      memcpy(result, product, n * sizeof(uint32_t));
+    }
+  }
+
+  BigInt* self = _bigNew(vm, result, n, negative);
+  DEALLOCATE(vm, result);
+  return self;
+}
+
+// Returns the [i]th limb of [self] in two's complement with infinite sign
+// extension, where [carry] is the carry of the negation (should start at 1
+// and be updated for each limb in order).
+static inline uint32_t _bigTwosLimb(const BigInt* self, size_t i,
+                                    uint32_t* carry) {
+  uint32_t limb = (i < self->count) ? self->limbs[i] : 0;
+  if (!self->negative) return limb;
+  uint64_t sum = (uint64_t)(uint32_t)~limb + *carry;
+  *carry = (uint32_t)(sum >> 32);
+  return (uint32_t)sum;
+}
+
+BigInt* bigIntBitwise(PKVM* vm, const BigInt* a, const BigInt* b, char op) {
+  // One more limb for the sign bit of the result.
+  size_t n = ((a->count > b->count) ? a->count : b->count) + 1;
+  BigInt* result = newBigInt(vm, (uint32_t)n);
+
+  bool negative;
+  switch (op) {
+    case '&': negative = a->negative && b->negative; break;
+    case '|': negative = a->negative || b->negative; break;
+    case '^': negative = a->negative != b->negative; break;
+    default:
+      UNREACHABLE();
+  }
+
+  uint32_t carry_a = 1, carry_b = 1;
+  for (size_t i = 0; i < n; i++) {
+    uint32_t x = _bigTwosLimb(a, i, &carry_a);
+    uint32_t y = _bigTwosLimb(b, i, &carry_b);
+    result->limbs[i] = (op == '&') ? (x & y) : (op == '|') ? (x | y)
+                                                            : (x ^ y);
+  }
+
+  // Convert the two's complement result back to the magnitude.
+  if (negative) _bigComplement(result->limbs, n);
+  result->negative = negative;
+  _bigTrim(result);
+  return result;
+}
+
+BigInt* bigIntBitNot(PKVM* vm, const BigInt* self) {
+  // ~x == -x - 1, which is -(x + 1) for positive and |x| - 1 for negative.
+  size_t n = self->count;
+  BigInt* result = newBigInt(vm, (uint32_t)(n + 1));
+  memcpy(result->limbs, self->limbs, n * sizeof(uint32_t));
+  result->limbs[n] = 0;
+
+  if (self->negative) {
+    const uint32_t one = 1;
+    _bigSub(result->limbs, result->limbs, n + 1, &one, 1);
+  } else {
+    _bigIncr(result->limbs, n + 1, 1);
+  }
+  result->negative = !self->negative;
+  _bigTrim(result);
+  return result;
+}
+
+BigInt* bigIntShift(PKVM* vm, const BigInt* self, int64_t shift) {
+  size_t n = self->count;
+  if (n == 0) return newBigInt(vm, 0);
+
+  if (shift >= 0) {
+    if ((uint64_t)shift / 32 + n + 1 > MAX_RESULT_LIMBS) return NULL;
+    size_t words = (size_t)(shift / 32);
+    int bits = (int)(shift % 32);
+
+    BigInt* result = newBigInt(vm, (uint32_t)(words + n + 1));
+    memset(result->limbs, 0, words * sizeof(uint32_t));
+    if (bits == 0) {
+      memcpy(result->limbs + words, self->limbs, n * sizeof(uint32_t));
+      result->limbs[words + n] = 0;
+    } else {
+      result->limbs[words + n] = _bigShl(result->limbs + words, self->limbs,
+                                         n, bits);
+    }
+    result->negative = self->negative;
+    _bigTrim(result);
+    return result;
+  }
+
+  // The right shift is rounded towards negative infinity, so for negative
+  // values the magnitude is incremented if any of the discarded bits is set.
+  uint64_t amount = (uint64_t)0 - (uint64_t)shift;
+  if (amount >= 32 * (uint64_t)n) {
+    if (!self->negative) return newBigInt(vm, 0);
+    const uint32_t one = 1;
+    return _bigNew(vm, &one, 1, true);
+  }
+
+  size_t words = (size_t)(amount / 32);
+  int bits = (int)(amount % 32);
+  size_t count = n - words;
+
+  bool inexact = (bits != 0) &&
+                 (self->limbs[words] & (((uint32_t)1 << bits) - 1)) != 0;
+  for (size_t i = 0; i < words && !inexact; i++) {
+    inexact = self->limbs[i] != 0;
+  }
+
+  BigInt* result = newBigInt(vm, (uint32_t)(count + 1));
+  if (bits == 0) {
+    memcpy(result->limbs, self->limbs + words, count * sizeof(uint32_t));
+  } else {
+    _bigShr(result->limbs, self->limbs + words, count, bits);
+  }
+  result->limbs[count] = 0;
+
+  if (self->negative && inexact) _bigIncr(result->limbs, count + 1, 1);
+  result->negative = self->negative;
+  _bigTrim(result);
+  return result;
+}
+
+void bigIntWrite(PKVM* vm, const BigInt* self, int base, const char* prefix,
+                 pkByteBuffer* buff) {
+  if (self->negative) pkByteBufferWrite(buff, vm, '-');
+  if (prefix != NULL) {
+    pkByteBufferAddString(buff, vm, prefix, (uint32_t)strlen(prefix));
+  }
+
+  if (self->count == 0) {
+    pkByteBufferWrite(buff, vm, '0');
+    return;
+  }
+
+  if (base == 10) {
+    // 10 digits for each 32 bits is enough.
+    BigPowers powers;
+    _bigPowersInit(&powers);
+    char* digits = ALLOCATE_ARRAY(vm, char, 10 * (size_t)self->count);
+    char* end = _bigToDecimal(vm, self->limbs, self->count, 0, &powers,
+                              digits);
+    _bigPowersClear(vm, &powers);
+    pkByteBufferAddString(buff, vm, digits, (uint32_t)(end - digits));
+    DEALLOCATE(vm, digits);
+    return;
+  }
+
+  ASSERT(base == 2 || base == 16, OOPS);
+  const int bits = (base == 16) ? 4 : 1;
+  const uint32_t mask = (uint32_t)base - 1;
+  static const char* digits = "0123456789abcdef";
+
+  // Skip the leading zero digits of the top limb.
+  int shift = 32 - bits;
+  uint32_t top = self->limbs[self->count - 1];
+  while (((top >> shift) & mask) == 0) shift -= bits;
+
+  pkByteBufferReserve(buff, vm,
+                      buff->count + (size_t)self->count * (32 / bits));
+  for (uint32_t i = self->count; i-- > 0;) {
+    uint32_t limb = self->limbs[i];
+    for (; shift >= 0; shift -= bits) {
+      buff->data[buff->count++] = (uint8_t)digits[(limb >> shift) & mask];
+    }
+    shift = 32 - bits;
+  }
+}
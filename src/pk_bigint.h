@@ -0,0 +1,94 @@
+/*
+ *  Copyright (c) 2020-2021 Thakee Nathees
+ *  Distributed Under The MIT License
+ */
+
+#ifndef BIGINT_H
+#define BIGINT_H
+
+#include "pk_internal.h"
+#include "pk_var.h"
+
+// Arbitrary precision integers. The magnitude is an array of 32 bit limbs
+// (least significant first) with a separate sign. The multiplication is done
+// with the schoolbook method for small numbers, Karatsuba and Toom-3 for the
+// larger ones (chosen by the size of the operands). The division is Knuth's
+// algorithm D and the conversions to and from decimal strings are divide and
+// conquer with the powers of 10^9 for the large numbers.
+//
+// BigInt objects are immutable, the operations allocate a new object for the
+// result and the operands should be reachable by the garbage collector (on
+// the stack or pushed as temp references).
+
+// Returns a new BigInt of the [value].
+BigInt* bigIntFromInt(PKVM* vm, int64_t value);
+
+// Returns a new BigInt of the [value] which should be a finite whole number
+// (the conversion is exact).
+BigInt* bigIntFromDouble(PKVM* vm, double value);
+
+// Parse the integer literal [str] (an optional sign followed by decimal
+// digits or the hex digits with the 0x prefix or the binary digits with the
+// 0b prefix) and return a new BigInt. Returns NULL if the string is invalid.
+BigInt* bigIntParse(PKVM* vm, const char* str, uint32_t length);
+
+// Returns the nearest double value of the BigInt.
+double bigIntToDouble(const BigInt* self);
+
+// If the BigInt fits in a 64 bit signed integer set [value] and returns true.
+bool bigIntToInt64(const BigInt* self, int64_t* value);
+
+// Returns true if the BigInt is exactly representable as a double.
+bool bigIntIsDouble(const BigInt* self);
+
+// Compare two BigInts and returns a negative number if [a] < [b], 0 if they're
+// equal, a positive number otherwise.
+int bigIntCompare(const BigInt* a, const BigInt* b);
+
+// Compare the BigInt with the number [value] (which shouldn't be NaN) exactly
+// and returns the same as bigIntCompare().
+int bigIntCompareNumber(const BigInt* self, double value);
+
+// Returns the hash value of the BigInt, if the value is representable as a
+// double, the hash will be the same as the number.
+uint32_t bigIntHash(const BigInt* self);
+
+// Returns a new BigInt of -[self].
+BigInt* bigIntNegate(PKVM* vm, const BigInt* self);
+
+// Returns a new BigInt of [a] + [b].
+BigInt* bigIntAdd(PKVM* vm, const BigInt* a, const BigInt* b);
+
+// Returns a new BigInt of [a] - [b].
+BigInt* bigIntSubtract(PKVM* vm, const BigInt* a, const BigInt* b);
+
+// Returns a new BigInt of [a] * [b].
+BigInt* bigIntMultiply(PKVM* vm, const BigInt* a, const BigInt* b);
+
+// Divide [a] by [b] (which should not be zero) and set the quotient rounded
+// towards zero to [quotient] and the remainder (which has the sign of [a]) to
+// [remainder]. Either of them could be NULL if not needed.
+void bigIntDivide(PKVM* vm, const BigInt* a, const BigInt* b,
+                  BigInt** quotient, BigInt** remainder);
+
+// Returns a new BigInt of [base] raised to the power [exponent].
+BigInt* bigIntPow(PKVM* vm, const BigInt* base, uint32_t exponent);
+
+// Returns a new BigInt of the bitwise [op] (one of '&', '|', '^') of [a] and
+// [b] as if they're in two's complement with infinite sign extension.
+BigInt* bigIntBitwise(PKVM* vm, const BigInt* a, const BigInt* b, char op);
+
+// Returns a new BigInt of ~[self] which is -[self] - 1.
+BigInt* bigIntBitNot(PKVM* vm, const BigInt* self);
+
+// Returns a new BigInt of [self] shifted to the left by [shift] bits (to the
+// right if it's negative, which is rounded towards negative infinity).
+// Returns NULL if the result is too large.
+BigInt* bigIntShift(PKVM* vm, const BigInt* self, int64_t shift);
+
+// Write the BigInt to the buffer in the [base] (2, 10 or 16), the [prefix]
+// (like "0x") is written after the sign if it's not NULL.
+void bigIntWrite(PKVM* vm, const BigInt* self, int base, const char* prefix,
+                 pkByteBuffer* buff);
+
+#endif // BIGINT_H
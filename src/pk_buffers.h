@@ -15,7 +15,8 @@
 // capacity of 'Tbuffer.capacity' as 'T* Tbuffer.data'. When the capacity is
 // filled with 'T' values (ie. Tbuffer.count == Tbuffer.capacity) the buffer's
 // internal data array will be reallocate to a capacity of 'GROW_FACTOR' times
-// it's last capacity.
+// it's last capacity. Large buffers are allocated with vmReallocBuffer() to
+// grow them without copying (see LARGE_BUFFER_SIZE).
 
 #define DECLARE_BUFFER(m_name, m_type)                                        \
   typedef struct {                                                            \
@@ -57,7 +58,7 @@
                                                                               \
   void pk##m_name##BufferClear(pk##m_name##Buffer* self,                      \
               PKVM* vm) {                                                     \
-    vmRealloc(vm, self->data, self->capacity * sizeof(m_type), 0);            \
+    vmReallocBuffer(vm, self->data, self->capacity * sizeof(m_type), 0);      \
     self->data = NULL;                                                        \
     self->count = 0;                                                          \
     self->capacity = 0;                                                       \
@@ -68,7 +69,7 @@
     if (self->capacity < size) {                                              \
       int capacity = utilPowerOf2Ceil((int)size);                             \
       if (capacity < MIN_CAPACITY) capacity = MIN_CAPACITY;                   \
-      self->data = (m_type*)vmRealloc(vm, self->data,                         \
+      self->data = (m_type*)vmReallocBuffer(vm, self->data,                   \
         self->capacity * sizeof(m_type), capacity * sizeof(m_type));          \
       self->capacity = capacity;                                              \
     }                                                                         \
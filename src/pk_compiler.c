@@ -5,6 +5,9 @@
 
 #include "pk_compiler.h"
 
+#include <math.h>
+
+#include "pk_bigint.h"
 #include "pk_core.h"
 #include "pk_buffers.h"
 #include "pk_utils.h"
@@ -39,9 +42,23 @@
 // Max number of break statement in a loop statement to patch.
 #define MAX_BREAK_PATCH 256
 
+// The minimum number of constant cases an if-elsif chain (which compares the
+// same variable) should have to be lowered into a single dispatch instruction.
+#define MIN_SWITCH_CHAIN 4
+
 // The name of a literal function.
 #define LITERAL_FN_NAME "$(LiteralFn)"
 
+// The name of the function of a compiled expression.
+#define EXPRESSION_FN_NAME "$(Expression)"
+
+// The size of a chunk of the compiler's arena, a larger allocation will get a
+// chunk of it's own size.
+#define ARENA_CHUNK_SIZE (4 * 1024)
+
+// The arena allocations are aligned to 8 bytes (the size of a Var).
+#define ARENA_ALIGN(size) (((size) + 7) & ~(size_t)7)
+
 /*****************************************************************************/
 /* TOKENS                                                                    */
 /*****************************************************************************/
@@ -110,6 +127,7 @@ typedef enum {
   TK_IMPORT,     // import
   TK_AS,         // as
   TK_DEF,        // def
+  TK_CONST,      // const
   TK_NATIVE,     // native (C function declaration)
   TK_FUNC,       // func (literal function)
   TK_END,        // end
@@ -129,6 +147,8 @@ typedef enum {
   TK_IF,         // if
   TK_ELSIF,      // elsif
   TK_ELSE,       // else
+  TK_MATCH,      // match
+  TK_CASE,       // case
   TK_BREAK,      // break
   TK_CONTINUE,   // continue
   TK_RETURN,     // return
@@ -174,6 +194,7 @@ static _Keyword _keywords[] = {
   { "import",   6, TK_IMPORT   },
   { "as",       2, TK_AS       },
   { "def",      3, TK_DEF      },
+  { "const",    5, TK_CONST    },
   { "native",   6, TK_NATIVE   },
   { "func",     4, TK_FUNC     },
   { "end",      3, TK_END      },
@@ -191,6 +212,8 @@ static _Keyword _keywords[] = {
   { "if",       2, TK_IF       },
   { "elsif",    5, TK_ELSIF    },
   { "else",     4, TK_ELSE     },
+  { "match",    5, TK_MATCH    },
+  { "case",     4, TK_CASE     },
   { "break",    5, TK_BREAK    },
   { "continue", 8, TK_CONTINUE },
   { "return",   6, TK_RETURN   },
@@ -198,6 +221,59 @@ static _Keyword _keywords[] = {
   { NULL,       0, (TokenType)(0) }, // Sentinel to mark the end of the array
 };
 
+// The keywords are looked up with a perfect hash of their first and last
+// chars and the length, the slots has the index of the keyword in the above
+// array or -1. If a keyword is added, the multipliers should be searched
+// again so that the hashes of all the keywords are still unique.
+#define KEYWORD_HASH(first, last, length) \
+  (((first) * 12 + (last) * 3 + (length)) & 63)
+
+#define KEYWORD_MIN_LENGTH 2
+#define KEYWORD_MAX_LENGTH 8
+
+static const int8_t _keyword_slots[64] = {
+  -1, -1,  1, -1, -1,  6, -1, 14, 19, -1, -1, -1, 13, -1,  3, -1,
+  -1,  0, -1,  2, -1, -1, -1, 25, -1, 24, -1, 27, -1,  7, 26, -1,
+  21, 20, -1, 15, -1,  5, -1,  4, 28, -1, -1,  9, -1, -1, -1, 23,
+  10, -1, -1, 22, -1,  8, -1, -1, 11, -1, -1, 12, 16, -1, 18, 17,
+};
+
+// The classes of the chars for the lexer, the bytes of the source are
+// scanned with a lookup in the table below instead of comparisons.
+#define CHAR_NAME   0x01 //< a-z, A-Z and _
+#define CHAR_DIGIT  0x02 //< 0-9
+#define CHAR_SPACE  0x04 //< Space, tab and carriage return.
+#define CHAR_EOL    0x08 //< New line and the null byte.
+#define CHAR_QUOTE  0x10 //< Quotes and backslash (ends a run of a string).
+
+#define N CHAR_NAME
+#define D CHAR_DIGIT
+#define S CHAR_SPACE
+#define E CHAR_EOL
+#define Q CHAR_QUOTE
+
+// The non ASCII bytes (not initialized below) are all 0.
+static const uint8_t _char_classes[256] = {
+  E, 0, 0, 0, 0, 0, 0, 0, 0, S, E, 0, 0, S, 0, 0, // 0x00
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x10
+  S, 0, Q, 0, 0, 0, 0, Q, 0, 0, 0, 0, 0, 0, 0, 0, //  !"#$%&'()*+,-./
+  D, D, D, D, D, D, D, D, D, D, 0, 0, 0, 0, 0, 0, // 0123456789:;<=>?
+  0, N, N, N, N, N, N, N, N, N, N, N, N, N, N, N, // @ABCDEFGHIJKLMNO
+  N, N, N, N, N, N, N, N, N, N, N, 0, Q, 0, 0, N, // PQRSTUVWXYZ[\]^_
+  0, N, N, N, N, N, N, N, N, N, N, N, N, N, N, N, // `abcdefghijklmno
+  N, N, N, N, N, N, N, N, N, N, N, 0, 0, 0, 0, 0, // pqrstuvwxyz{|}~
+};
+
+#undef N
+#undef D
+#undef S
+#undef E
+#undef Q
+
+#define CHAR_CLASS(c) (_char_classes[(uint8_t)(c)])
+#define IS_NAME_CHAR(c) ((CHAR_CLASS(c) & (CHAR_NAME | CHAR_DIGIT)) != 0)
+#define IS_DIGIT_CHAR(c) ((CHAR_CLASS(c) & CHAR_DIGIT) != 0)
+
 /*****************************************************************************/
 /* COMPILER INTERNAL TYPES                                                   */
 /*****************************************************************************/
@@ -250,11 +326,16 @@ typedef enum {
   FN_LITERAL,   //< Literal functions defined with 'function(){...}'
 } FuncType;
 
+// A static type known at compile time is a PkVarType, and TYPE_ANY if the
+// type is only known at runtime.
+#define TYPE_ANY -1
+
 typedef struct {
   const char* name; //< Directly points into the source string.
   uint32_t length;  //< Length of the name.
   int depth;        //< The depth the local is defined in.
   int line;         //< The line variable declared for debugging.
+  int type;         //< Annotated type of the local or TYPE_ANY.
 } Local;
 
 typedef struct sLoop {
@@ -301,6 +382,48 @@ typedef struct sForwardName {
 
 } ForwardName;
 
+// Constant cases of a match statement or an if-elsif chain, which will be
+// dispatched with a single TABLE_JUMP or MAP_JUMP instruction.
+typedef struct {
+  pkUintBuffer values;  //< Index of the case values in the script literals.
+  pkUintBuffer targets; //< Address of the case body for each value.
+} SwitchCases;
+
+// An if-elsif chain where the conditions are 'variable == constant'. ex:
+// 'if x == 1 ... elsif x == 2 ... end'. If it's long enough the comparisons
+// will be replaced with a single dispatch instruction.
+typedef struct {
+  SwitchCases cases;
+
+  int var_start;  //< Address of the first condition's variable push.
+  int var_length; //< Length of the variable push instruction.
+  int last_jump;  //< Address index of the last constant case's jump offset.
+  bool open;      //< False once we met a condition that isn't a case.
+} IfChain;
+
+// A chunk of the compiler's arena, the allocated memory follows the header.
+typedef struct sArenaChunk {
+  struct sArenaChunk* next; //< The next chunk (kept after a rewind).
+  size_t size;              //< Size of the chunk's memory.
+  size_t used;              //< Number of bytes allocated of the memory.
+} ArenaChunk;
+
+// A bump allocator for the transient data of the compiler (ex: the case
+// tables of a match statement) which is only needed till the statement is
+// compiled. The data of a statement is released all at once by rewinding the
+// arena to where it was before (see arenaMark()) and the chunks are reused
+// till the compilation is done.
+typedef struct {
+  ArenaChunk* first;   //< The first chunk of the arena.
+  ArenaChunk* current; //< The chunk of the last allocation (could be NULL).
+} Arena;
+
+// A position of the arena to be rewound to.
+typedef struct {
+  ArenaChunk* chunk;
+  size_t used;
+} ArenaMark;
+
 typedef struct sFunc {
 
   // Scope of the function. -2 for script body, -1 for top level function and
@@ -339,6 +462,10 @@ struct Compiler {
 
   const PkCompileOptions* options; //< To configure the compilation.
 
+  // The statistics of the compilation if the stats option is set, otherwise
+  // NULL (the times are in microseconds till it's done).
+  PkCompileStats* stats;
+
   // Current depth the compiler in (-1 means top level) 0 means function
   // level and > 0 is inner scope.
   int scope_depth;
@@ -357,6 +484,9 @@ struct Compiler {
   ForwardName forwards[MAX_FORWARD_NAMES];
   int forwards_count;
 
+  // The arena of the transient data of the compilation.
+  Arena arena;
+
   // True if the last statement is a new local variable assignment. Because
   // the assignment is different than regular assignment and use this boolean
   // to tell the compiler that dont pop it's assigned value because the value
@@ -379,8 +509,25 @@ struct Compiler {
   // call. Which is usefull to check if a return expression is function call
   // to perform a tail call optimization.
   bool is_last_call;
+
+  // Address of the first instruction of the left operand, set before calling
+  // an infix rule. Which is used to fold the constant operands.
+  int left_start;
+
+  // Static type of the last compiled expression, it's only valid if the
+  // expression ends at the address [type_end] (see compilerExprType()).
+  int expr_type;
+  int type_end;
 };
 
+// A snapshot of the current function's bytecode, used to discard the code
+// emitted after it (ex: dead branches and folded constant expressions).
+typedef struct {
+  int address;        //< Number of opcodes emitted.
+  int forwards_count; //< Number of forward names.
+  int patch_count;    //< Number of break patches of the current loop.
+} CodeSnapshot;
+
 typedef struct {
   int params;
   int stack;
@@ -392,6 +539,119 @@ static OpInfo opcode_info[] = {
   #undef OPCODE
 };
 
+/*****************************************************************************/
+/* ARENA                                                                     */
+/*****************************************************************************/
+
+// Returns the first byte of the [chunk]'s memory.
+#define ARENA_DATA(chunk) ((uint8_t*)(chunk) + ARENA_ALIGN(sizeof(ArenaChunk)))
+
+// Allocate [size] bytes from the compiler's arena.
+static void* arenaAlloc(Compiler* compiler, size_t size) {
+  Arena* arena = &compiler->arena;
+  size = ARENA_ALIGN(size);
+
+  ArenaChunk* chunk = arena->current;
+  if (chunk == NULL || chunk->used + size > chunk->size) {
+
+    // Move to the next chunk (left from a rewind) if it's large enough,
+    // otherwise insert a new one before it.
+    ArenaChunk* next = (chunk != NULL) ? chunk->next : arena->first;
+    if (next == NULL || next->size < size) {
+      size_t chunk_size = (size > ARENA_CHUNK_SIZE) ? size : ARENA_CHUNK_SIZE;
+      ArenaChunk* new_chunk = (ArenaChunk*)vmRealloc(compiler->vm, NULL, 0,
+                            ARENA_ALIGN(sizeof(ArenaChunk)) + chunk_size);
+      new_chunk->size = chunk_size;
+      new_chunk->next = next;
+      if (chunk != NULL) chunk->next = new_chunk;
+      else arena->first = new_chunk;
+      next = new_chunk;
+    }
+
+    next->used = 0;
+    chunk = arena->current = next;
+  }
+
+  void* memory = ARENA_DATA(chunk) + chunk->used;
+  chunk->used += size;
+  return memory;
+}
+
+// Grow the array [data] of [*capacity] elements of [size] bytes and returns
+// the new array. If it's the last allocation of the arena
+// it'll be extended in place.
+static void* arenaGrowArray(Compiler* compiler, void* data,
+                            uint32_t* capacity, size_t size) {
+  size_t old_size = ARENA_ALIGN(*capacity * size);
+  uint32_t new_capacity = (*capacity == 0) ? MIN_CAPACITY
+                                           : *capacity * GROW_FACTOR;
+  size_t new_size = ARENA_ALIGN(new_capacity * size);
+  *capacity = new_capacity;
+
+  ArenaChunk* chunk = compiler->arena.current;
+  if (data != NULL && chunk != NULL &&
+      (uint8_t*)data + old_size == ARENA_DATA(chunk) + chunk->used &&
+      chunk->used - old_size + new_size <= chunk->size) {
+    chunk->used += new_size - old_size;
+    return data;
+  }
+
+  void* memory = arenaAlloc(compiler, new_size);
+  if (old_size > 0) memcpy(memory, data, old_size);
+  return memory;
+}
+
+// Append the [value] to the [buff] (a pkBuffer which is allocated in the
+// compiler's arena, and initialized with pk<Type>BufferInit()).
+#define ARENA_WRITE(compiler, buff, value)                                  \
+  do {                                                                      \
+    if ((buff)->count == (buff)->capacity) {                                \
+      (buff)->data = arenaGrowArray(compiler, (buff)->data,                 \
+                                    &(buff)->capacity,                      \
+                                    sizeof(*(buff)->data));                 \
+    }                                                                       \
+    (buff)->data[(buff)->count++] = (value);                                \
+  } while (false)
+
+// Append the [length] bytes of the [data] to the [buff] (allocated in the
+// compiler's arena).
+static void arenaWriteBytes(Compiler* compiler, pkByteBuffer* buff,
+                            const char* data, uint32_t length) {
+  if (length == 0) return;
+  while (buff->capacity < buff->count + length) {
+    buff->data = arenaGrowArray(compiler, buff->data, &buff->capacity, 1);
+  }
+  memcpy(buff->data + buff->count, data, length);
+  buff->count += length;
+}
+
+// Returns the current position of the arena, everything allocated after it
+// will be released with arenaRewind().
+static ArenaMark arenaMark(Compiler* compiler) {
+  ArenaMark mark;
+  mark.chunk = compiler->arena.current;
+  mark.used = (mark.chunk != NULL) ? mark.chunk->used : 0;
+  return mark;
+}
+
+// Release all the allocations made after the [mark] (the chunks are kept to
+// be reused).
+static void arenaRewind(Compiler* compiler, ArenaMark mark) {
+  compiler->arena.current = mark.chunk;
+  if (mark.chunk != NULL) mark.chunk->used = mark.used;
+}
+
+// Free all the chunks of the compiler's arena.
+static void arenaFree(Compiler* compiler) {
+  ArenaChunk* chunk = compiler->arena.first;
+  while (chunk != NULL) {
+    ArenaChunk* next = chunk->next;
+    vmRealloc(compiler->vm, chunk, 0, 0);
+    chunk = next;
+  }
+  compiler->arena.first = compiler->arena.current = NULL;
+}
+
 /*****************************************************************************/
 /* ERROR HANDLERS                                                            */
 /*****************************************************************************/
@@ -476,47 +736,77 @@ static bool matchChar(Compiler* compiler, char c);
 static bool matchLine(Compiler* compiler);
 
 static void eatString(Compiler* compiler, bool single_quote) {
+  ArenaMark mark = arenaMark(compiler);
   pkByteBuffer buff;
   pkByteBufferInit(&buff);
 
   char quote = (single_quote) ? '\'' : '"';
 
+  // The chars between the escapes are scanned and copied as a run at once.
+  // If there isn't any escape, the string is made from the source directly.
+  const char* run = compiler->current_char;
+  const char* c = run;
+  bool escaped = false;
+
   while (true) {
-    char c = eatChar(compiler);
+    while ((CHAR_CLASS(*c) & (CHAR_QUOTE | CHAR_EOL)) == 0) c++;
 
-    if (c == quote) break;
+    if (*c == '\n') {
+      compiler->current_line++;
+      c++;
+      continue;
+    }
 
-    if (c == '\0') {
-      lexError(compiler, "Non terminated string.");
+    if (*c == quote || *c == '\0') break;
 
-      // Null byte is required by TK_EOF.
-      compiler->current_char--;
-      break;
+    if (*c != '\\') { // The other quote.
+      c++;
+      continue;
     }
 
-    if (c == '\\') {
-      switch (eatChar(compiler)) {
-        case '"':  pkByteBufferWrite(&buff, compiler->vm, '"'); break;
-        case '\'': pkByteBufferWrite(&buff, compiler->vm, '\''); break;
-        case '\\': pkByteBufferWrite(&buff, compiler->vm, '\\'); break;
-        case 'n':  pkByteBufferWrite(&buff, compiler->vm, '\n'); break;
-        case 'r':  pkByteBufferWrite(&buff, compiler->vm, '\r'); break;
-        case 't':  pkByteBufferWrite(&buff, compiler->vm, '\t'); break;
-
-        default:
-          lexError(compiler, "Error: invalid escape character");
-          break;
-      }
-    } else {
-      pkByteBufferWrite(&buff, compiler->vm, c);
+    arenaWriteBytes(compiler, &buff, run, (uint32_t)(c - run));
+    escaped = true;
+    c++; // Consume the backslash.
+
+    switch (*c) {
+      case '"':  ARENA_WRITE(compiler, &buff, '"'); break;
+      case '\'': ARENA_WRITE(compiler, &buff, '\''); break;
+      case '\\': ARENA_WRITE(compiler, &buff, '\\'); break;
+      case 'n':  ARENA_WRITE(compiler, &buff, '\n'); break;
+      case 'r':  ARENA_WRITE(compiler, &buff, '\r'); break;
+      case 't':  ARENA_WRITE(compiler, &buff, '\t'); break;
+
+      default:
+        if (*c == '\n') compiler->current_line++;
+        compiler->current_char = c;
+        lexError(compiler, "Error: invalid escape character");
+        break;
     }
+
+    if (*c != '\0') c++;
+    run = c;
+  }
+
+  const char* data = run;
+  uint32_t length = (uint32_t)(c - run);
+  if (escaped) {
+    arenaWriteBytes(compiler, &buff, run, length);
+    data = (const char*)buff.data;
+    length = buff.count;
+  }
+
+  // The null byte isn't consumed, it's required by TK_EOF.
+  compiler->current_char = c;
+  if (*c == '\0') {
+    lexError(compiler, "Non terminated string.");
+  } else {
+    compiler->current_char++; // Consume the closing quote.
   }
 
   // '\0' will be added by varNewSring();
-  Var string = VAR_OBJ(newStringLength(compiler->vm, (const char*)buff.data,
-                       (uint32_t)buff.count));
+  Var string = VAR_OBJ(newStringLength(compiler->vm, data, length));
 
-  pkByteBufferClear(&buff, compiler->vm);
+  arenaRewind(compiler, mark);
 
   setNextValueToken(compiler, TK_STRING, string);
 }
@@ -540,31 +830,48 @@ static char eatChar(Compiler* compiler) {
   return c;
 }
 
-// Complete lexing an identifier name.
-static void eatName(Compiler* compiler) {
+// Returns the type of the keyword [name] or TK_NAME if it's not a keyword.
+static TokenType keywordType(const char* name, int length) {
+  if (length < KEYWORD_MIN_LENGTH || length > KEYWORD_MAX_LENGTH) {
+    return TK_NAME;
+  }
 
-  char c = peekChar(compiler);
-  while (utilIsName(c) || utilIsDigit(c)) {
-    eatChar(compiler);
-    c = peekChar(compiler);
+  uint8_t first = (uint8_t)name[0], last = (uint8_t)name[length - 1];
+  int slot = _keyword_slots[KEYWORD_HASH(first, last, length)];
+  if (slot == -1) return TK_NAME;
+
+  const _Keyword* keyword = &_keywords[slot];
+  if (keyword->length != length ||
+      memcmp(name, keyword->identifier, length) != 0) {
+    return TK_NAME;
   }
+  return keyword->tk_type;
+}
 
-  const char* name_start = compiler->token_start;
+// Complete lexing an identifier name.
+static void eatName(Compiler* compiler) {
 
-  TokenType type = TK_NAME;
+  // A name can't have a new line, so the line doesn't need to be counted.
+  const char* c = compiler->current_char;
+  while (IS_NAME_CHAR(*c)) c++;
+  compiler->current_char = c;
 
+  const char* name_start = compiler->token_start;
   int length = (int)(compiler->current_char - name_start);
-  for (int i = 0; _keywords[i].identifier != NULL; i++) {
-    if (_keywords[i].length == length &&
-      strncmp(name_start, _keywords[i].identifier, length) == 0) {
-      type = _keywords[i].tk_type;
-      break;
-    }
-  }
+  setNextToken(compiler, keywordType(name_start, length));
+}
 
-  setNextToken(compiler, type);
+// Consume the decimal digits (if any) at the current char.
+static void eatDigits(Compiler* compiler) {
+  const char* c = compiler->current_char;
+  while (IS_DIGIT_CHAR(*c)) c++;
+  compiler->current_char = c;
 }
 
+// The integer literals larger than this (2^53) cannot be represented as a
+// number without loosing precision and they're promoted to BigInt.
+#define MAX_EXACT_INTEGER 9007199254740992.0
+
 // Complete lexing a number literal.
 static void eatNumber(Compiler* compiler) {
 
@@ -577,6 +884,9 @@ static void eatNumber(Compiler* compiler) {
   Var value = VAR_NULL; // The number value.
   char c = *compiler->token_start;
 
+  // Set to true if the literal is an integer that's too large for a number.
+  bool is_big = false;
+
   // Binary literal.
   if (c == '0' && peekChar(compiler) == 'b') {
     eatChar(compiler); // Consume '0b'
@@ -593,18 +903,16 @@ static void eatNumber(Compiler* compiler) {
         if (!IS_BIN_CHAR(c)) break;
         eatChar(compiler);
 
-        // Check the length of the binary literal.
-        int length = (int)(compiler->current_char - compiler->token_start);
-        if (length > STR_BIN_BUFF_SIZE - 2) { // -2: '-\0' 0b is in both side.
-          lexError(compiler, "Binary literal is too long.");
-          break;
-        }
+        // Once the value doesn't fit in the 53 bits the literal will be
+        // parsed as a BigInt.
+        if (bin > ((uint64_t)1 << 52)) is_big = true;
 
         // "Append" the next digit at the end.
         bin = (bin << 1) | (c - '0');
 
       } while (true);
     }
+    is_big = is_big || (bin > ((uint64_t)1 << 53));
     value = VAR_NUM((double)bin);
 
   } else if (c == '0' && peekChar(compiler) == 'x') {
@@ -624,12 +932,9 @@ static void eatNumber(Compiler* compiler) {
         if (!IS_HEX_CHAR(c)) break;
         eatChar(compiler);
 
-        // Check the length of the binary literal.
-        int length = (int)(compiler->current_char - compiler->token_start);
-        if (length > STR_HEX_BUFF_SIZE - 2) { // -2: '-\0' 0x is in both side.
-          lexError(compiler, "Hex literal is too long.");
-          break;
-        }
+        // Once the value doesn't fit in the 53 bits the literal will be
+        // parsed as a BigInt.
+        if (hex > ((uint64_t)1 << 49)) is_big = true;
 
         // "Append" the next digit at the end.
         uint8_t append_val = ('0' <= c && c <= '9')
@@ -639,39 +944,43 @@ static void eatNumber(Compiler* compiler) {
 
       } while (true);
 
+      is_big = is_big || (hex > ((uint64_t)1 << 53));
       value = VAR_NUM((double)hex);
     }
 
   } else { // Regular number literal.
-    while (utilIsDigit(peekChar(compiler))) {
-      eatChar(compiler);
-    }
+    bool is_integer = true;
+    eatDigits(compiler);
 
-    if (peekChar(compiler) == '.' && utilIsDigit(peekNextChar(compiler))) {
+    if (peekChar(compiler) == '.' && IS_DIGIT_CHAR(peekNextChar(compiler))) {
       matchChar(compiler, '.');
-      while (utilIsDigit(peekChar(compiler))) {
-        eatChar(compiler);
-      }
+      is_integer = false;
+      eatDigits(compiler);
     }
 
     // Parse if in scientific notation format (MeN == M * 10 ** N).
     if (matchChar(compiler, 'e') || matchChar(compiler, 'E')) {
+      is_integer = false;
 
       if (peekChar(compiler) == '+' || peekChar(compiler) == '-') {
         eatChar(compiler);
       }
 
-      if (!utilIsDigit(peekChar(compiler))) {
+      if (!IS_DIGIT_CHAR(peekChar(compiler))) {
         lexError(compiler, "Invalid number literal.");
 
       } else { // Eat the exponent.
-        while (utilIsDigit(peekChar(compiler))) eatChar(compiler);
+        eatDigits(compiler);
       }
     }
 
     errno = 0;
     value = VAR_NUM(atof(compiler->token_start));
-    if (errno == ERANGE) {
+    bool is_large = (errno == ERANGE || AS_NUM(value) >= MAX_EXACT_INTEGER);
+    if (is_integer && is_large) {
+      is_big = true;
+
+    } else if (errno == ERANGE) {
       const char* start = compiler->token_start;
       int len = (int)(compiler->current_char - start);
       lexError(compiler, "Number literal is too large (%.*s).", len, start);
@@ -679,6 +988,14 @@ static void eatNumber(Compiler* compiler) {
     }
   }
 
+  if (is_big) {
+    const char* start = compiler->token_start;
+    uint32_t len = (uint32_t)(compiler->current_char - start);
+    BigInt* big = bigIntParse(compiler->vm, start, len);
+    ASSERT(big != NULL, OOPS);
+    value = VAR_OBJ(big);
+  }
+
   setNextValueToken(compiler, TK_NUMBER, value);
 #undef IS_BIN_CHAR
 #undef IS_HEX_CHAR
@@ -686,12 +1003,10 @@ static void eatNumber(Compiler* compiler) {
 
 // Read and ignore chars till it reach new line or EOF.
 static void skipLineComment(Compiler* compiler) {
-  char c;
-  while ((c = peekChar(compiler)) != '\0') {
-    // Don't eat new line it's not part of the comment.
-    if (c == '\n') return;
-    eatChar(compiler);
-  }
+  // Don't eat new line it's not part of the comment.
+  const char* c = compiler->current_char;
+  while ((CHAR_CLASS(*c) & CHAR_EOL) == 0) c++;
+  compiler->current_char = c;
 }
 
 // If the current char is [c] consume it and advance char by 1 and returns
@@ -728,8 +1043,8 @@ static void setNextValueToken(Compiler* compiler, TokenType type, Var value) {
   compiler->next.value = value;
 }
 
-// Lex the next token and set it as the next token.
-static void lexToken(Compiler* compiler) {
+// Scan the next token and set it as the next token.
+static void scanToken(Compiler* compiler) {
   compiler->previous = compiler->current;
   compiler->current = compiler->next;
 
@@ -773,18 +1088,16 @@ static void lexToken(Compiler* compiler) {
       case ' ':
       case '\t':
       case '\r': {
-        c = peekChar(compiler);
-        while (c == ' ' || c == '\t' || c == '\r') {
-          eatChar(compiler);
-          c = peekChar(compiler);
-        }
+        const char* space = compiler->current_char;
+        while (CHAR_CLASS(*space) & CHAR_SPACE) space++;
+        compiler->current_char = space;
         break;
       }
 
       case '.':
         if (matchChar(compiler, '.')) {
           setNextToken(compiler, TK_DOTDOT); // '..'
-        } else if (utilIsDigit(peekChar(compiler))) {
+        } else if (IS_DIGIT_CHAR(peekChar(compiler))) {
           eatChar(compiler);   // Consume the decimal point.
           eatNumber(compiler); // Consume the rest of the number
         } else {
@@ -852,10 +1165,10 @@ static void lexToken(Compiler* compiler) {
 
       default: {
 
-        if (utilIsDigit(c)) {
+        if (IS_DIGIT_CHAR(c)) {
           eatNumber(compiler);
 
-        } else if (utilIsName(c)) {
+        } else if (CHAR_CLASS(c) & CHAR_NAME) {
           eatName(compiler);
 
         } else {
@@ -875,6 +1188,20 @@ static void lexToken(Compiler* compiler) {
   compiler->next.start = compiler->current_char;
 }
 
+// Lex the next token and set it as the next token (and count the token and
+// it's time if the statistics are collected).
+static void lexToken(Compiler* compiler) {
+  if (compiler->stats == NULL) {
+    scanToken(compiler);
+    return;
+  }
+
+  double start = traceNow();
+  scanToken(compiler);
+  compiler->stats->lex_time += traceNow() - start;
+  if (compiler->next.type != TK_EOF) compiler->stats->tokens++;
+}
+
 /*****************************************************************************/
 /* PARSING                                                                   */
 /*****************************************************************************/
@@ -949,7 +1276,7 @@ static bool matchEndStatement(Compiler* compiler) {
   // In the below statement we don't require any new lines or semicolons.
   // 'if cond then stmnt1 elsif cond2 then stmnt2 else stmnt3 end'
   if (peek(compiler) == TK_END || peek(compiler) == TK_ELSE ||
-      peek(compiler) == TK_ELSIF)
+      peek(compiler) == TK_ELSIF || peek(compiler) == TK_CASE)
     return true;
 
   return false;
@@ -1009,6 +1336,7 @@ typedef enum {
   NAME_NOT_DEFINED,
   NAME_LOCAL_VAR,  //< Including parameter.
   NAME_GLOBAL_VAR,
+  NAME_CONSTANT,   //< Global constant, it's value is known at compile time.
   NAME_FUNCTION,
   NAME_CLASS,
   NAME_BUILTIN,    //< Native builtin function.
@@ -1059,6 +1387,9 @@ static NameSearchResult compilerSearchName(Compiler* compiler,
   index = scriptGetGlobals(compiler->script, name, length);
   if (index != -1) {
     result.type = NAME_GLOBAL_VAR;
+    if (scriptIsConstant(compiler->script, (uint32_t)index)) {
+      result.type = NAME_CONSTANT;
+    }
     result.index = index;
     return result;
   }
@@ -1100,7 +1431,9 @@ static int emitByte(Compiler* compiler, int byte);
 static int emitShort(Compiler* compiler, int arg);
 
 static void emitLoopJump(Compiler* compiler);
+static Opcode assignmentOpcode(TokenType assignment);
 static void emitAssignment(Compiler* compiler, TokenType assignment);
+static void emitConstant(Compiler* compiler, Var value);
 static void emitFunctionEnd(Compiler* compiler);
 
 static void patchJump(Compiler* compiler, int addr_index);
@@ -1111,6 +1444,12 @@ static int compilerAddVariable(Compiler* compiler, const char* name,
                                uint32_t length, int line);
 static void compilerAddForward(Compiler* compiler, int instruction, Fn* fn,
                                const char* name, int length, int line);
+static void compilerChangeStack(Compiler* compiler, int num);
+
+static void compilerSnapshot(Compiler* compiler, CodeSnapshot* snapshot);
+static void compilerDiscardCode(Compiler* compiler, CodeSnapshot* snapshot);
+static bool compilerConstantAt(Compiler* compiler, int address, int end,
+                               Var* value);
 
 // Forward declaration of grammar functions.
 static void parsePrecedence(Compiler* compiler, Precedence precedence);
@@ -1194,6 +1533,7 @@ GrammarRule rules[] = {  // Prefix       Infix             Infix Precedence
   /* TK_IMPORT     */   NO_RULE,
   /* TK_AS         */   NO_RULE,
   /* TK_DEF        */   NO_RULE,
+  /* TK_CONST      */   NO_RULE,
   /* TK_EXTERN     */   NO_RULE,
   /* TK_FUNC       */ { exprFunc,      NULL,             NO_INFIX },
   /* TK_END        */   NO_RULE,
@@ -1211,6 +1551,8 @@ GrammarRule rules[] = {  // Prefix       Infix             Infix Precedence
   /* TK_IF         */   NO_RULE,
   /* TK_ELSIF      */   NO_RULE,
   /* TK_ELSE       */   NO_RULE,
+  /* TK_MATCH      */   NO_RULE,
+  /* TK_CASE       */   NO_RULE,
   /* TK_BREAK      */   NO_RULE,
   /* TK_CONTINUE   */   NO_RULE,
   /* TK_RETURN     */   NO_RULE,
@@ -1254,11 +1596,94 @@ static void emitPushVariable(Compiler* compiler, int index, bool global) {
   }
 }
 
+// Set the static [type] of the expression which was just compiled.
+static void compilerSetType(Compiler* compiler, int type) {
+  compiler->expr_type = type;
+  compiler->type_end = (int)_FN->opcodes.count;
+}
+
+// Returns the static type of the expression which was just compiled. If any
+// instruction was emitted after the type was set (ex: a call or an attribute
+// access of a typed expression), the type is unknown.
+static int compilerExprType(Compiler* compiler) {
+  if (compiler->type_end != (int)_FN->opcodes.count) return TYPE_ANY;
+  return compiler->expr_type;
+}
+
+// Returns the static type of the result of the binary operator [op] (could be
+// an assignment operator) where the operands are of type [left] and [right].
+static int binaryOpType(TokenType op, int left, int right) {
+  bool numbers = (left == PK_NUMBER && right == PK_NUMBER);
+
+  switch (op) {
+    case TK_PLUS:
+    case TK_PLUSEQ:
+      if (left == PK_STRING && right == PK_STRING) return PK_STRING;
+      return (numbers) ? PK_NUMBER : TYPE_ANY;
+
+    case TK_MINUS:   case TK_MINUSEQ:
+    case TK_STAR:    case TK_STAREQ:
+    case TK_FSLASH:  case TK_DIVEQ:
+    case TK_PERCENT: case TK_MODEQ:
+      return (numbers) ? PK_NUMBER : TYPE_ANY;
+
+    // The result of the bitwise operators could be a BigInt if it's too
+    // large for a number.
+    case TK_AMP:     case TK_ANDEQ:
+    case TK_PIPE:    case TK_OREQ:
+    case TK_CARET:   case TK_XOREQ:
+    case TK_SRIGHT:  case TK_SRIGHTEQ:
+    case TK_SLEFT:   case TK_SLEFTEQ:
+      return TYPE_ANY;
+
+    case TK_GT:
+    case TK_LT:
+    case TK_EQEQ:
+    case TK_NOTEQ:
+    case TK_GTEQ:
+    case TK_LTEQ:
+    case TK_IN:
+      return PK_BOOL;
+
+    case TK_DOTDOT:
+      return PK_RANGE;
+
+    default:
+      return TYPE_ANY;
+  }
+}
+
+// Returns the instruction of the binary operator [op] (could be an assignment
+// operator) specialized for numbers, or OP_END if there isn't any.
+static Opcode specializedNumOp(TokenType op) {
+  switch (op) {
+    case TK_PLUS:   case TK_PLUSEQ:  return OP_ADD_NUM;
+    case TK_MINUS:  case TK_MINUSEQ: return OP_SUBTRACT_NUM;
+    case TK_STAR:   case TK_STAREQ:  return OP_MULTIPLY_NUM;
+    case TK_FSLASH: case TK_DIVEQ:   return OP_DIVIDE_NUM;
+    case TK_LT:                      return OP_LT_NUM;
+    case TK_LTEQ:                    return OP_LTEQ_NUM;
+    case TK_GT:                      return OP_GT_NUM;
+    case TK_GTEQ:                    return OP_GTEQ_NUM;
+    default:
+      return OP_END;
+  }
+}
+
+// Emit a type check of the stack top value if it's static type [type] isn't
+// the annotated type [expected].
+static void emitTypeCheck(Compiler* compiler, int type, int expected) {
+  if (expected == TYPE_ANY || type == expected) return;
+  emitOpcode(compiler, OP_CHECK_TYPE);
+  emitByte(compiler, expected);
+}
+
 static void exprLiteral(Compiler* compiler) {
   Token* value = &compiler->previous;
   int index = compilerAddConstant(compiler, value->value);
   emitOpcode(compiler, OP_PUSH_CONSTANT);
   emitShort(compiler, index);
+  compilerSetType(compiler, pkGetValueType((PkVar)&value->value));
 
   compiler->is_last_call = false;
 }
@@ -1317,23 +1742,57 @@ static void exprName(Compiler* compiler) {
       case NAME_GLOBAL_VAR: {
         const bool is_global = result.type == NAME_GLOBAL_VAR;
 
+        // Only the locals could be annotated with a type.
+        int type = TYPE_ANY;
+        if (!is_global) type = compiler->locals[result.index].type;
+
         if (compiler->l_value && matchAssignment(compiler)) {
           skipNewLines(compiler);
 
+          int value_type;
           TokenType assignment = compiler->previous.type;
           if (assignment != TK_EQ) {
             emitPushVariable(compiler, result.index, is_global);
             compileExpression(compiler);
-            emitAssignment(compiler, assignment);
+
+            int right = compilerExprType(compiler);
+            Opcode num_op = OP_END;
+            if (type == PK_NUMBER && right == PK_NUMBER) {
+              num_op = specializedNumOp(assignment);
+            }
+            if (num_op != OP_END) {
+              emitOpcode(compiler, num_op);
+            } else {
+              emitAssignment(compiler, assignment);
+            }
+            value_type = binaryOpType(assignment, type, right);
 
           } else {
             compileExpression(compiler);
+            value_type = compilerExprType(compiler);
           }
 
+          emitTypeCheck(compiler, value_type, type);
           emitStoreVariable(compiler, result.index, is_global);
+          compilerSetType(compiler, (type != TYPE_ANY) ? type : value_type);
 
         } else {
           emitPushVariable(compiler, result.index, is_global);
+          compilerSetType(compiler, type);
+        }
+        break;
+      }
+
+      case NAME_CONSTANT: {
+        if (compiler->l_value && matchAssignment(compiler)) {
+          parseError(compiler, "Cannot assign to the constant '%.*s'.",
+                     length, start);
+          skipNewLines(compiler);
+          compileExpression(compiler);
+
+        } else {
+          // Constants are inlined since it's value is known at compile time.
+          emitConstant(compiler, compiler->script->globals.data[result.index]);
         }
         break;
       }
@@ -1361,6 +1820,99 @@ static void exprName(Compiler* compiler) {
   compiler->is_last_call = false;
 }
 
+// Returns true if the [value] is a whole number that can be represented as a
+// 64 bit integer without loosing precision and set it to [integer].
+static bool foldInteger(Var value, int64_t* integer) {
+  if (!IS_NUM(value)) return false;
+  double number = AS_NUM(value);
+  if (floor(number) != number) return false;
+  if (number < -9007199254740992.0 || 9007199254740992.0 < number) {
+    return false;
+  }
+  *integer = (int64_t)number;
+  return true;
+}
+
+// Evaluate the binary operation [op] on the constants [v1] and [v2] at compile
+// time and set the [result]. Returns false if the operation cannot be folded
+// (ex: if it'll be a runtime error) and it should be evaluated at runtime.
+static bool foldBinaryOp(Compiler* compiler, TokenType op, Var v1, Var v2,
+                         Var* result) {
+
+  // Equality is defined for all the constants.
+  if (op == TK_EQEQ || op == TK_NOTEQ) {
+    bool equal = isValuesEqual(v1, v2);
+    *result = VAR_BOOL((op == TK_EQEQ) ? equal : !equal);
+    return true;
+  }
+
+  if (op == TK_PLUS && IS_OBJ_TYPE(v1, OBJ_STRING) &&
+      IS_OBJ_TYPE(v2, OBJ_STRING)) {
+    *result = varAdd(compiler->vm, v1, v2);
+    return true;
+  }
+
+  if (!IS_NUM(v1) || !IS_NUM(v2)) return false;
+
+  switch (op) {
+    case TK_PLUS:    *result = varAdd(compiler->vm, v1, v2);      return true;
+    case TK_MINUS:   *result = varSubtract(compiler->vm, v1, v2); return true;
+    case TK_STAR:    *result = varMultiply(compiler->vm, v1, v2); return true;
+    case TK_FSLASH:  *result = varDivide(compiler->vm, v1, v2);   return true;
+    case TK_PERCENT: *result = varModulo(compiler->vm, v1, v2);  return true;
+
+    case TK_GT: *result = VAR_BOOL(varGreater(v1, v2)); return true;
+    case TK_LT: *result = VAR_BOOL(varLesser(v1, v2));  return true;
+    case TK_GTEQ:
+      *result = VAR_BOOL(varGreater(v1, v2) || isValuesEqual(v1, v2));
+      return true;
+
+    case TK_LTEQ:
+      *result = VAR_BOOL(varLesser(v1, v2) || isValuesEqual(v1, v2));
+      return true;
+
+    default:
+      break;
+  }
+
+  // Bitwise operations are only folded if the operands are integers, and the
+  // shift operations are only folded if it won't overflow.
+  int64_t i1, i2;
+  if (!foldInteger(v1, &i1) || !foldInteger(v2, &i2)) return false;
+
+  switch (op) {
+    case TK_AMP:   *result = varBitAnd(compiler->vm, v1, v2); return true;
+    case TK_PIPE:  *result = varBitOr(compiler->vm, v1, v2);  return true;
+    case TK_CARET: *result = varBitXor(compiler->vm, v1, v2); return true;
+
+    case TK_SLEFT:
+      if (i1 < 0 || i2 < 0 || i2 > 63 || i1 > (INT64_MAX >> i2)) return false;
+      *result = varBitLshift(compiler->vm, v1, v2);
+      return true;
+
+    case TK_SRIGHT:
+      if (i2 < 0 || i2 > 63) return false;
+      *result = varBitRshift(compiler->vm, v1, v2);
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+// Replace the code of the current function from the address [start] to the
+// end, which pushes [count] constants with a single push of the [value].
+static void compilerFoldConstant(Compiler* compiler, int start, int count,
+                                 Var value) {
+  CodeSnapshot snapshot;
+  compilerSnapshot(compiler, &snapshot);
+  snapshot.address = start;
+  compilerDiscardCode(compiler, &snapshot);
+  compilerChangeStack(compiler, -count);
+
+  emitConstant(compiler, value);
+}
+
 /*           a or b:             |        a and b:
                                  |
             (...)                |           (...)
@@ -1373,7 +1925,63 @@ static void exprName(Compiler* compiler) {
      '----> (...)                |    '----> (...)
 */
 
+// Compile the right operand of a logical 'and' / 'or' where the left operand
+// (starting at the address [left_start]) is the constant [left]. If the left
+// operand short circuits the right operand will be compiled and discarded,
+// otherwise the result is the right operand converted to a boolean.
+static void compileConstantLogical(Compiler* compiler, int left_start,
+                                   Var left, bool is_or) {
+  Precedence precedence = (is_or) ? PREC_LOGICAL_OR : PREC_LOGICAL_AND;
+
+  if (toBool(left) == is_or) {
+    parsePrecedence(compiler, precedence);
+    compilerFoldConstant(compiler, left_start, 2, VAR_BOOL(is_or));
+    compiler->is_last_call = false;
+    return;
+  }
+
+  CodeSnapshot snapshot;
+  compilerSnapshot(compiler, &snapshot);
+  snapshot.address = left_start;
+  compilerDiscardCode(compiler, &snapshot);
+  compilerChangeStack(compiler, -1);
+
+  int right_start = (int)_FN->opcodes.count;
+  parsePrecedence(compiler, precedence);
+
+  Var right;
+  if (compilerConstantAt(compiler, right_start, (int)_FN->opcodes.count,
+                         &right)) {
+    compilerFoldConstant(compiler, right_start, 1, VAR_BOOL(toBool(right)));
+    compiler->is_last_call = false;
+    return;
+  }
+
+  emitOpcode(compiler, (is_or) ? OP_JUMP_IF : OP_JUMP_IF_NOT);
+  int offset = emitShort(compiler, 0xffff); //< Will be patched.
+
+  emitOpcode(compiler, (is_or) ? OP_PUSH_FALSE : OP_PUSH_TRUE);
+  emitOpcode(compiler, OP_JUMP);
+  int end_offset = emitShort(compiler, 0xffff); //< Will be patched.
+
+  patchJump(compiler, offset);
+  emitOpcode(compiler, (is_or) ? OP_PUSH_TRUE : OP_PUSH_FALSE);
+
+  patchJump(compiler, end_offset);
+  compilerSetType(compiler, PK_BOOL);
+
+  compiler->is_last_call = false;
+}
+
 void exprOr(Compiler* compiler) {
+  Var left;
+  int left_start = compiler->left_start;
+  if (compilerConstantAt(compiler, left_start, (int)_FN->opcodes.count,
+                         &left)) {
+    compileConstantLogical(compiler, left_start, left, true);
+    return;
+  }
+
   emitOpcode(compiler, OP_JUMP_IF);
   int true_offset_a = emitShort(compiler, 0xffff); //< Will be patched.
 
@@ -1390,11 +1998,20 @@ void exprOr(Compiler* compiler) {
   emitOpcode(compiler, OP_PUSH_TRUE);
 
   patchJump(compiler, end_offset);
+  compilerSetType(compiler, PK_BOOL);
 
   compiler->is_last_call = false;
 }
 
 void exprAnd(Compiler* compiler) {
+  Var left;
+  int left_start = compiler->left_start;
+  if (compilerConstantAt(compiler, left_start, (int)_FN->opcodes.count,
+                         &left)) {
+    compileConstantLogical(compiler, left_start, left, false);
+    return;
+  }
+
   emitOpcode(compiler, OP_JUMP_IF_NOT);
   int false_offset_a = emitShort(compiler, 0xffff); //< Will be patched.
 
@@ -1411,6 +2028,7 @@ void exprAnd(Compiler* compiler) {
   emitOpcode(compiler, OP_PUSH_FALSE);
 
   patchJump(compiler, end_offset);
+  compilerSetType(compiler, PK_BOOL);
 
   compiler->is_last_call = false;
 }
@@ -1445,8 +2063,34 @@ static void exprChainCall(Compiler* compiler) {
 
 static void exprBinaryOp(Compiler* compiler) {
   TokenType op = compiler->previous.type;
+  int left_start = compiler->left_start;
+  int left_type = compilerExprType(compiler);
   skipNewLines(compiler);
+
+  int right_start = (int)_FN->opcodes.count;
   parsePrecedence(compiler, (Precedence)(getRule(op)->precedence + 1));
+  int right_end = (int)_FN->opcodes.count;
+  int right_type = compilerExprType(compiler);
+
+  // If both the operands are constants, evaluate it at compile time.
+  Var v1, v2, result;
+  if (compilerConstantAt(compiler, left_start, right_start, &v1) &&
+      compilerConstantAt(compiler, right_start, right_end, &v2) &&
+      foldBinaryOp(compiler, op, v1, v2, &result)) {
+    compilerFoldConstant(compiler, left_start, 2, result);
+    compiler->is_last_call = false;
+    return;
+  }
+
+  // If both the operands are known to be numbers, emit the specialized
+  // instruction which won't check the types at runtime.
+  if (left_type == PK_NUMBER && right_type == PK_NUMBER &&
+      specializedNumOp(op) != OP_END) {
+    emitOpcode(compiler, specializedNumOp(op));
+    compilerSetType(compiler, binaryOpType(op, left_type, right_type));
+    compiler->is_last_call = false;
+    return;
+  }
 
   switch (op) {
     case TK_DOTDOT:  emitOpcode(compiler, OP_RANGE);      break;
@@ -1470,6 +2114,7 @@ static void exprBinaryOp(Compiler* compiler) {
     default:
       UNREACHABLE();
   }
+  compilerSetType(compiler, binaryOpType(op, left_type, right_type));
 
   compiler->is_last_call = false;
 }
@@ -1477,8 +2122,35 @@ static void exprBinaryOp(Compiler* compiler) {
 static void exprUnaryOp(Compiler* compiler) {
   TokenType op = compiler->previous.type;
   skipNewLines(compiler);
+
+  int start = (int)_FN->opcodes.count;
   parsePrecedence(compiler, (Precedence)(PREC_UNARY + 1));
 
+  // Fold the operation if the operand is a constant.
+  Var value;
+  int64_t integer;
+  if (compilerConstantAt(compiler, start, (int)_FN->opcodes.count, &value)) {
+    bool folded = true;
+    if (op == TK_NOT) {
+      value = VAR_BOOL(!toBool(value));
+    } else if (op == TK_MINUS && IS_NUM(value)) {
+      value = VAR_NUM(-AS_NUM(value));
+    } else if (op == TK_MINUS && IS_OBJ_TYPE(value, OBJ_BIGINT)) {
+      value = VAR_OBJ(bigIntNegate(compiler->vm, (BigInt*)AS_OBJ(value)));
+    } else if (op == TK_TILD && foldInteger(value, &integer)) {
+      value = varBitNot(compiler->vm, value);
+    } else {
+      folded = false;
+    }
+
+    if (folded) {
+      compilerFoldConstant(compiler, start, 1, value);
+      compiler->is_last_call = false;
+      return;
+    }
+  }
+
+  int type = compilerExprType(compiler);
   switch (op) {
     case TK_TILD:  emitOpcode(compiler, OP_BIT_NOT); break;
     case TK_MINUS: emitOpcode(compiler, OP_NEGATIVE); break;
@@ -1486,6 +2158,9 @@ static void exprUnaryOp(Compiler* compiler) {
     default:
       UNREACHABLE();
   }
+  compilerSetType(compiler, (op == TK_NOT) ? PK_BOOL :
+                            (op == TK_MINUS && type == PK_NUMBER) ? PK_NUMBER
+                                                                  : TYPE_ANY);
 
   compiler->is_last_call = false;
 }
@@ -1499,17 +2174,59 @@ static void exprGrouping(Compiler* compiler) {
   compiler->is_last_call = false;
 }
 
+// Replace the code of a list or map literal (from the address [start] to the
+// end) with a single CLONE_CONSTANT of the [container] which is already built
+// at compile time from the constant elements.
+static void compilerCloneConstant(Compiler* compiler, int start,
+                                  Var container) {
+  int index = compilerAddConstant(compiler, container);
+
+  CodeSnapshot snapshot;
+  compilerSnapshot(compiler, &snapshot);
+  snapshot.address = start;
+  compilerDiscardCode(compiler, &snapshot);
+  compilerChangeStack(compiler, -1);
+
+  emitOpcode(compiler, OP_CLONE_CONSTANT);
+  emitShort(compiler, index);
+}
+
+// Compile an element of a list or map literal. If it's a constant, it'll be
+// written to the [constants] otherwise [is_constant] will be set to false.
+static void compileLiteralElement(Compiler* compiler, pkVarBuffer* constants,
+                                  bool* is_constant) {
+  int start = (int)_FN->opcodes.count;
+  compileExpression(compiler);
+
+  Var value;
+  if (*is_constant && compilerConstantAt(compiler, start,
+                                         (int)_FN->opcodes.count, &value)) {
+    ARENA_WRITE(compiler, constants, value);
+  } else {
+    *is_constant = false;
+  }
+}
+
 static void exprList(Compiler* compiler) {
 
+  int start = (int)_FN->opcodes.count;
   emitOpcode(compiler, OP_PUSH_LIST);
   int size_index = emitShort(compiler, 0);
 
+  // If all the elements are constants, the list will be built here and
+  // cloned at runtime. The values are either not objects or already in the
+  // script's literals (so they won't be garbage collected).
+  ArenaMark mark = arenaMark(compiler);
+  pkVarBuffer constants;
+  pkVarBufferInit(&constants);
+  bool is_constant = true;
+
   int size = 0;
   do {
     skipNewLines(compiler);
     if (peek(compiler) == TK_RBRACKET) break;
 
-    compileExpression(compiler);
+    compileLiteralElement(compiler, &constants, &is_constant);
     emitOpcode(compiler, OP_LIST_APPEND);
     size++;
 
@@ -1522,21 +2239,40 @@ static void exprList(Compiler* compiler) {
   _FN->opcodes.data[size_index] = (size >> 8) & 0xff;
   _FN->opcodes.data[size_index + 1] = size & 0xff;
 
+  if (is_constant && size > 0 && !compiler->has_errors) {
+    List* list = newList(compiler->vm, (uint32_t)size);
+    pkVarBufferConcat(&list->elements, compiler->vm, &constants);
+    compilerCloneConstant(compiler, start, VAR_OBJ(list));
+  }
+  arenaRewind(compiler, mark);
+
   compiler->is_last_call = false;
 }
 
 static void exprMap(Compiler* compiler) {
+  int start = (int)_FN->opcodes.count;
   emitOpcode(compiler, OP_PUSH_MAP);
+  int size_index = emitShort(compiler, 0);
+
+  // Keys and values of the map one after another, if they're all constants
+  // (see exprList()).
+  ArenaMark mark = arenaMark(compiler);
+  pkVarBuffer constants;
+  pkVarBufferInit(&constants);
+  bool is_constant = true;
+
+  int size = 0;
 
   do {
     skipNewLines(compiler);
     if (peek(compiler) == TK_RBRACE) break;
 
-    compileExpression(compiler);
+    compileLiteralElement(compiler, &constants, &is_constant);
     consume(compiler, TK_COLLON, "Expected ':' after map's key.");
-    compileExpression(compiler);
+    compileLiteralElement(compiler, &constants, &is_constant);
 
     emitOpcode(compiler, OP_MAP_INSERT);
+    size++;
 
     skipNewLines(compiler);
   } while (match(compiler, TK_COMMA));
@@ -1544,6 +2280,26 @@ static void exprMap(Compiler* compiler) {
   skipNewLines(compiler);
   consume(compiler, TK_RBRACE, "Expected '}' after map elements.");
 
+  _FN->opcodes.data[size_index] = (size >> 8) & 0xff;
+  _FN->opcodes.data[size_index + 1] = size & 0xff;
+
+  // An unhashable key is a runtime error of the MAP_INSERT.
+  for (uint32_t i = 0; is_constant && i < constants.count; i += 2) {
+    Var key = constants.data[i];
+    if (IS_OBJ(key) && !isObjectHashable(AS_OBJ(key)->type)) {
+      is_constant = false;
+    }
+  }
+
+  if (is_constant && constants.count > 0 && !compiler->has_errors) {
+    Map* map = newMap(compiler->vm);
+    for (uint32_t i = 0; i < constants.count; i += 2) {
+      mapSet(compiler->vm, map, constants.data[i], constants.data[i + 1]);
+    }
+    compilerCloneConstant(compiler, start, VAR_OBJ(map));
+  }
+  arenaRewind(compiler, mark);
+
   compiler->is_last_call = false;
 }
 
@@ -1568,6 +2324,7 @@ static void exprCall(Compiler* compiler) {
 }
 
 static void exprAttrib(Compiler* compiler) {
+  int type = compilerExprType(compiler);
   consume(compiler, TK_NAME, "Expected an attribute name after '.'.");
   const char* name = compiler->previous.start;
   int length = compiler->previous.length;
@@ -1591,6 +2348,12 @@ static void exprAttrib(Compiler* compiler) {
     emitOpcode(compiler, OP_SET_ATTRIB);
     emitShort(compiler, index);
 
+  } else if (type == PK_STRING && length == 6 &&
+             strncmp(name, "length", 6) == 0) {
+    // The length of a string, known at compile time, is a number.
+    emitOpcode(compiler, OP_STR_LENGTH);
+    compilerSetType(compiler, PK_NUMBER);
+
   } else {
     emitOpcode(compiler, OP_GET_ATTRIB);
     emitShort(compiler, index);
@@ -1606,18 +2369,20 @@ static void exprSubscript(Compiler* compiler) {
   if (compiler->l_value && matchAssignment(compiler)) {
     skipNewLines(compiler);
 
+    // The subscript value is read before the value is evaluated (like the
+    // other compound assignments), the update applies the operator and
+    // stores the result.
     TokenType assignment = compiler->previous.type;
     if (assignment != TK_EQ) {
       emitOpcode(compiler, OP_GET_SUBSCRIPT_KEEP);
       compileExpression(compiler);
-      emitAssignment(compiler, assignment);
-
+      emitOpcode(compiler, OP_SUBSCRIPT_UPDATE);
+      emitByte(compiler, assignmentOpcode(assignment));
     } else {
       compileExpression(compiler);
+      emitOpcode(compiler, OP_SET_SUBSCRIPT);
     }
 
-    emitOpcode(compiler, OP_SET_SUBSCRIPT);
-
   } else {
     emitOpcode(compiler, OP_GET_SUBSCRIPT);
   }
@@ -1633,6 +2398,7 @@ static void exprValue(Compiler* compiler) {
     default:
       UNREACHABLE();
   }
+  compilerSetType(compiler, (op == TK_NULL) ? PK_NULL : PK_BOOL);
 
   compiler->is_last_call = false;
 }
@@ -1651,11 +2417,13 @@ static void parsePrecedence(Compiler* compiler, Precedence precedence) {
   compiler->is_last_call = false;
   compiler->l_value = precedence <= PREC_LOWEST;
 
+  int start = (int)_FN->opcodes.count;
   prefix(compiler);
 
   while (getRule(compiler->current.type)->precedence >= precedence) {
     lexToken(compiler);
     GrammarFn infix = getRule(compiler->previous.type)->infix;
+    compiler->left_start = start;
     infix(compiler);
   }
 }
@@ -1676,6 +2444,7 @@ static void compilerInit(Compiler* compiler, PKVM* vm, const char* source,
   compiler->has_errors = false;
   compiler->need_more_lines = false;
   compiler->options = options;
+  compiler->stats = NULL;
 
   compiler->current_char = source;
   compiler->current_line = 1;
@@ -1693,8 +2462,12 @@ static void compilerInit(Compiler* compiler, PKVM* vm, const char* source,
   compiler->func = NULL;
 
   compiler->forwards_count = 0;
+  compiler->arena.first = compiler->arena.current = NULL;
   compiler->new_local = false;
   compiler->is_last_call = false;
+  compiler->left_start = 0;
+  compiler->expr_type = TYPE_ANY;
+  compiler->type_end = -1;
 }
 
 // Add a variable and return it's index to the context. Assumes that the
@@ -1735,6 +2508,7 @@ static int compilerAddVariable(Compiler* compiler, const char* name,
     local->length = length;
     local->depth = compiler->scope_depth;
     local->line = line;
+    local->type = TYPE_ANY;
     return compiler->local_count++;
   }
 
@@ -1777,6 +2551,34 @@ static int compilerAddConstant(Compiler* compiler, Var value) {
   return (int)literals->count - 1;
 }
 
+// Define a global constant with the [value] in the current script. It's an
+// error if the name already exists, unless it's the same constant (ex: the
+// same constant imported twice).
+static void compilerDefineConstant(Compiler* compiler, const char* name,
+                                   uint32_t length, int line, Var value) {
+  ASSERT(compiler->scope_depth == DEPTH_GLOBAL, OOPS);
+
+  Script* script = compiler->script;
+  NameSearchResult result = compilerSearchName(compiler, name, length);
+
+  if (result.type == NAME_CONSTANT &&
+      isValuesEqual(script->globals.data[result.index], value)) {
+    return;
+  }
+
+  if (result.type != NAME_NOT_DEFINED) {
+    parseError(compiler, "Name '%.*s' already exists.", length, name);
+    return;
+  }
+
+  int index = compilerAddVariable(compiler, name, length, line);
+  if (index == -1) return;
+
+  // Constants are initialized at compile time and never be stored again.
+  script->globals.data[index] = value;
+  pkUintBufferWrite(&script->constants, compiler->vm, (uint32_t)index);
+}
+
 // Enters inside a block.
 static void compilerEnterBlock(Compiler* compiler) {
   compiler->scope_depth++;
@@ -1797,13 +2599,77 @@ static void compilerChangeStack(Compiler* compiler, int num) {
   }
 }
 
-// Write instruction to pop all the locals at the current [depth] or higher,
-// but it won't change the stack size of locals count because this function
-// is called by break/continue statements at the middle of a scope, so we need
-// those locals till the scope ends. This will returns the number of locals
-// that were popped.
-static int compilerPopLocals(Compiler* compiler, int depth) {
-  ASSERT(depth > (int)DEPTH_GLOBAL, "Cannot pop global variables.");
+// Take a snapshot of the current function's bytecode.
+static void compilerSnapshot(Compiler* compiler, CodeSnapshot* snapshot) {
+  snapshot->address = (int)_FN->opcodes.count;
+  snapshot->forwards_count = compiler->forwards_count;
+  snapshot->patch_count = (compiler->loop) ? compiler->loop->patch_count : 0;
+}
+
+// Discard the bytecode of the current function emitted after the [snapshot].
+// Note that the stack size should be updated by the caller.
+static void compilerDiscardCode(Compiler* compiler, CodeSnapshot* snapshot) {
+  ASSERT(snapshot->address <= (int)_FN->opcodes.count, OOPS);
+
+  // The names used in the discarded code should still be defined, but there
+  // is no instruction to patch.
+  for (int i = snapshot->forwards_count; i < compiler->forwards_count; i++) {
+    ForwardName* forward = &compiler->forwards[i];
+    if (forward->func == _FN && forward->instruction >= snapshot->address) {
+      forward->instruction = -1;
+    }
+  }
+
+  // Break statements in the discarded code.
+  if (compiler->loop != NULL) {
+    compiler->loop->patch_count = snapshot->patch_count;
+  }
+
+  _FN->opcodes.count = snapshot->address;
+  _FN->oplines.count = snapshot->address;
+
+  // The discarded code could end with a call, which is not the last call now.
+  compiler->is_last_call = false;
+  compiler->type_end = -1;
+}
+
+// If the code of the current function from the [address] to the [end] is a
+// single instruction which pushes a constant, set [value] to the constant
+// and return true.
+static bool compilerConstantAt(Compiler* compiler, int address, int end,
+                               Var* value) {
+  if (address >= end) return false;
+
+  uint8_t* code = _FN->opcodes.data + address;
+  switch ((Opcode)code[0]) {
+    case OP_PUSH_CONSTANT:
+    {
+      if (address + 3 != end) return false;
+      int index = (code[1] << 8) | code[2];
+      ASSERT_INDEX((uint32_t)index, compiler->script->literals.count);
+      *value = compiler->script->literals.data[index];
+      return true;
+    }
+
+    case OP_PUSH_NULL:  *value = VAR_NULL;   break;
+    case OP_PUSH_0:     *value = VAR_NUM(0); break;
+    case OP_PUSH_TRUE:  *value = VAR_TRUE;   break;
+    case OP_PUSH_FALSE: *value = VAR_FALSE;  break;
+
+    default:
+      return false;
+  }
+
+  return address + 1 == end;
+}
+
+// Write instruction to pop all the locals at the current [depth] or higher,
+// but it won't change the stack size of locals count because this function
+// is called by break/continue statements at the middle of a scope, so we need
+// those locals till the scope ends. This will returns the number of locals
+// that were popped.
+static int compilerPopLocals(Compiler* compiler, int depth) {
+  ASSERT(depth > (int)DEPTH_GLOBAL, "Cannot pop global variables.");
 
   int local = compiler->local_count - 1;
   while (local >= 0 && compiler->locals[local].depth >= depth) {
@@ -1864,6 +2730,13 @@ static int emitShort(Compiler* compiler, int arg) {
   return emitByte(compiler, arg & 0xff) - 1;
 }
 
+// Emit an OP_COVER for the line of the statement that is about to compile
+// (the current token's line, not the previous one as emitByte() does).
+static void emitCover(Compiler* compiler) {
+  pkByteBufferWrite(&_FN->opcodes, compiler->vm, (uint8_t)OP_COVER);
+  pkUintBufferWrite(&_FN->oplines, compiler->vm, compiler->current.line);
+}
+
 // Emits an instruction and update stack size (variable stack size opcodes
 // should be handled).
 static void emitOpcode(Compiler* compiler, Opcode opcode) {
@@ -1878,22 +2751,44 @@ static void emitLoopJump(Compiler* compiler) {
   emitShort(compiler, offset);
 }
 
-static void emitAssignment(Compiler* compiler, TokenType assignment) {
+// Returns the opcode of the binary operator of the compound [assignment].
+static Opcode assignmentOpcode(TokenType assignment) {
   switch (assignment) {
-    case TK_PLUSEQ:   emitOpcode(compiler, OP_ADD);        break;
-    case TK_MINUSEQ:  emitOpcode(compiler, OP_SUBTRACT);   break;
-    case TK_STAREQ:   emitOpcode(compiler, OP_MULTIPLY);   break;
-    case TK_DIVEQ:    emitOpcode(compiler, OP_DIVIDE);     break;
-    case TK_MODEQ:    emitOpcode(compiler, OP_MOD);        break;
-    case TK_ANDEQ:    emitOpcode(compiler, OP_BIT_AND);    break;
-    case TK_OREQ:     emitOpcode(compiler, OP_BIT_OR);     break;
-    case TK_XOREQ:    emitOpcode(compiler, OP_BIT_XOR);    break;
-    case TK_SRIGHTEQ: emitOpcode(compiler, OP_BIT_RSHIFT); break;
-    case TK_SLEFTEQ:  emitOpcode(compiler, OP_BIT_LSHIFT); break;
+    case TK_PLUSEQ:   return OP_ADD;
+    case TK_MINUSEQ:  return OP_SUBTRACT;
+    case TK_STAREQ:   return OP_MULTIPLY;
+    case TK_DIVEQ:    return OP_DIVIDE;
+    case TK_MODEQ:    return OP_MOD;
+    case TK_ANDEQ:    return OP_BIT_AND;
+    case TK_OREQ:     return OP_BIT_OR;
+    case TK_XOREQ:    return OP_BIT_XOR;
+    case TK_SRIGHTEQ: return OP_BIT_RSHIFT;
+    case TK_SLEFTEQ:  return OP_BIT_LSHIFT;
     default:
       UNREACHABLE();
       break;
   }
+  return OP_ADD;
+}
+
+static void emitAssignment(Compiler* compiler, TokenType assignment) {
+  emitOpcode(compiler, assignmentOpcode(assignment));
+}
+
+// Emit an instruction to push the constant [value] on the stack.
+static void emitConstant(Compiler* compiler, Var value) {
+  if (IS_NULL(value)) {
+    emitOpcode(compiler, OP_PUSH_NULL);
+  } else if (IS_TRUE(value)) {
+    emitOpcode(compiler, OP_PUSH_TRUE);
+  } else if (IS_FALSE(value)) {
+    emitOpcode(compiler, OP_PUSH_FALSE);
+  } else {
+    int index = compilerAddConstant(compiler, value);
+    emitOpcode(compiler, OP_PUSH_CONSTANT);
+    emitShort(compiler, index);
+  }
+  compilerSetType(compiler, pkGetValueType((PkVar)&value));
 }
 
 static void emitFunctionEnd(Compiler* compiler) {
@@ -1921,6 +2816,87 @@ static void patchForward(Compiler* compiler, Fn* fn, int index, int name) {
   fn->opcodes.data[index] = name & 0xff;
 }
 
+// Returns true if the [value] is already a case in the [cases].
+static bool switchHasCase(Compiler* compiler, SwitchCases* cases, Var value) {
+  for (uint32_t i = 0; i < cases->values.count; i++) {
+    Var case_value = compiler->script->literals.data[cases->values.data[i]];
+    if (isValuesEqual(case_value, value)) return true;
+  }
+  return false;
+}
+
+// Write a dispatch instruction at the address [dispatch] which jumps to the
+// target of the case matching the stack top value or to [default_target]. If
+// all the case values are dense integers it'll be a TABLE_JUMP otherwise a
+// MAP_JUMP, and the jump table will be added to the script's literals.
+static void patchSwitch(Compiler* compiler, int dispatch, SwitchCases* cases,
+                        int default_target) {
+
+  PKVM* vm = compiler->vm;
+  pkVarBuffer* literals = &compiler->script->literals;
+  uint32_t count = cases->values.count;
+
+  // Jump offsets are relative to the end of the dispatch instruction.
+  int base = dispatch + 5;
+  ASSERT(default_target - base < MAX_JUMP, "Too large address offset to "
+                                            "jump to.");
+
+  // Check if the case values are integers and at least half of the integers
+  // in their range are cases. The values are compared by their bits (-0 is
+  // not equal to 0) so a -0 case can't be in the table.
+  bool dense = count > 0;
+  double min = 0, max = 0;
+  for (uint32_t i = 0; i < count && dense; i++) {
+    Var value = literals->data[cases->values.data[i]];
+    double num = IS_NUM(value) ? AS_NUM(value) : 0.5;
+    if (!(INT32_MIN <= num && num <= INT32_MAX) ||
+        num != (double)(int32_t)num || (num == 0 && signbit(num))) {
+      dense = false;
+      break;
+    }
+    if (i == 0 || num < min) min = num;
+    if (i == 0 || num > max) max = num;
+  }
+  if (dense && (max - min + 1) > 2 * (double)count) dense = false;
+
+  Var table;
+  if (dense) {
+    uint32_t size = (uint32_t)(max - min) + 1;
+    List* list = newList(vm, size + 1);
+    table = VAR_OBJ(list);
+
+    pkVarBufferWrite(&list->elements, vm, VAR_NUM(min));
+    pkVarBufferFill(&list->elements, vm, VAR_NUM(default_target - base),
+                    size);
+    for (uint32_t i = 0; i < count; i++) {
+      Var value = literals->data[cases->values.data[i]];
+      uint32_t index = (uint32_t)(AS_NUM(value) - min) + 1;
+      int offset = (int)cases->targets.data[i] - base;
+      list->elements.data[index] = VAR_NUM(offset);
+    }
+
+  } else {
+    Map* map = newMap(vm);
+    table = VAR_OBJ(map);
+
+    for (uint32_t i = 0; i < count; i++) {
+      Var value = literals->data[cases->values.data[i]];
+      int offset = (int)cases->targets.data[i] - base;
+      mapSet(vm, map, value, VAR_NUM(offset));
+    }
+  }
+
+  int index = compilerAddConstant(compiler, table);
+
+  int default_offset = default_target - base;
+  uint8_t* code = _FN->opcodes.data + dispatch;
+  code[0] = (uint8_t)((dense) ? OP_TABLE_JUMP : OP_MAP_JUMP);
+  code[1] = (index >> 8) & 0xff;
+  code[2] = index & 0xff;
+  code[3] = (default_offset >> 8) & 0xff;
+  code[4] = default_offset & 0xff;
+}
+
 /*****************************************************************************/
 /* COMPILING (PARSE TOPLEVEL)                                                */
 /*****************************************************************************/
@@ -1930,6 +2906,7 @@ typedef enum {
   BLOCK_LOOP,
   BLOCK_IF,
   BLOCK_ELSE,
+  BLOCK_CASE,
 } BlockType;
 
 static void compileStatement(Compiler* compiler);
@@ -2023,6 +3000,38 @@ static int compileType(Compiler* compiler) {
   return -1; // TODO;
 }
 
+// Names of the types which could be used in type annotations.
+static struct {
+  const char* name;
+  int length;
+  PkVarType type;
+} _type_names[] = {
+  { "bool", 4, PK_BOOL   },
+  { "num",  3, PK_NUMBER },
+  { "str",  3, PK_STRING },
+  { "list", 4, PK_LIST   },
+  { "map",  3, PK_MAP    },
+
+  { NULL,   0, PK_NULL   }, // Sentinel to mark the end of the array.
+};
+
+// Compile a type annotation after the ':' and return the PkVarType.
+static int compileTypeAnnotation(Compiler* compiler) {
+  consume(compiler, TK_NAME, "Expected a type name after ':'.");
+  const char* name = compiler->previous.start;
+  int length = compiler->previous.length;
+
+  for (int i = 0; _type_names[i].name != NULL; i++) {
+    if (_type_names[i].length == length &&
+        strncmp(_type_names[i].name, name, length) == 0) {
+      return _type_names[i].type;
+    }
+  }
+
+  parseError(compiler, "Unknown type '%.*s'.", length, name);
+  return TYPE_ANY;
+}
+
 // Compile a function and return it's index in the script's function buffer.
 static int compileFunction(Compiler* compiler, FuncType fn_type) {
 
@@ -2083,8 +3092,14 @@ static int compileFunction(Compiler* compiler, FuncType fn_type) {
         parseError(compiler, "Multiple definition of a parameter.");
       }
 
-      compilerAddVariable(compiler, param_name, param_len,
-                          compiler->previous.line);
+      int index = compilerAddVariable(compiler, param_name, param_len,
+                                      compiler->previous.line);
+
+      // Optional type annotation of the parameter.
+      if (match(compiler, TK_COLLON)) {
+        int type = compileTypeAnnotation(compiler);
+        if (index != -1) compiler->locals[index].type = type;
+      }
 
     } while (match(compiler, TK_COMMA));
 
@@ -2095,6 +3110,17 @@ static int compileFunction(Compiler* compiler, FuncType fn_type) {
   compilerChangeStack(compiler, argc);
 
   if (fn_type != FN_NATIVE) {
+
+    // The annotated parameters are checked once when the function is called,
+    // and the body is specialized for the types.
+    int first_param = compiler->local_count - argc;
+    for (int i = first_param; i < compiler->local_count; i++) {
+      if (compiler->locals[i].type == TYPE_ANY) continue;
+      emitPushVariable(compiler, i, false);
+      emitTypeCheck(compiler, TYPE_ANY, compiler->locals[i].type);
+      emitOpcode(compiler, OP_POP);
+    }
+
     compileBlockBody(compiler, BLOCK_FUNC);
 
     // Tail call optimization disabled at debug mode.
@@ -2133,7 +3159,7 @@ static void compileBlockBody(Compiler* compiler, BlockType type) {
 
   compilerEnterBlock(compiler);
 
-  if (type == BLOCK_IF) {
+  if (type == BLOCK_IF || type == BLOCK_CASE) {
     consumeStartBlock(compiler, TK_THEN);
     skipNewLines(compiler);
 
@@ -2151,8 +3177,9 @@ static void compileBlockBody(Compiler* compiler, BlockType type) {
   }
 
   TokenType next = peek(compiler);
-  while (!(next == TK_END || next == TK_EOF || (
-    (type == BLOCK_IF) && (next == TK_ELSE || next == TK_ELSIF)))) {
+  while (!(next == TK_END || next == TK_EOF ||
+    ((type == BLOCK_IF) && (next == TK_ELSE || next == TK_ELSIF)) ||
+    ((type == BLOCK_CASE) && (next == TK_ELSE || next == TK_CASE)))) {
 
     compileStatement(compiler);
     skipNewLines(compiler);
@@ -2216,9 +3243,7 @@ static Script* importFile(Compiler* compiler, const char* path) {
 
   // Make a new script and to compile it.
   Script* scr = newScript(vm, path_name, false);
-  vmPushTempRef(vm, &scr->_super); // scr.
   mapSet(vm, vm->scripts, VAR_OBJ(path_name), VAR_OBJ(scr));
-  vmPopTempRef(vm); // scr.
 
   // Push the script on the stack.
   emitOpcode(compiler, OP_IMPORT);
@@ -2231,8 +3256,10 @@ static Script* importFile(Compiler* compiler, const char* path) {
   options.repl_mode = false;
 
   // Compile the source to the script and clean the source.
+  double start = (compiler->stats != NULL) ? traceNow() : 0;
   PkResult result = compile(vm, scr, source.string, &options);
   if (source.on_done != NULL) source.on_done(vm, source);
+  if (start != 0) compiler->stats->import_time += traceNow() - start;
 
   if (result != PK_RESULT_SUCCESS) {
     parseError(compiler, "Compilation of imported script '%s' failed",
@@ -2310,6 +3337,7 @@ static int compilerImportName(Compiler* compiler, int line,
     case NAME_GLOBAL_VAR:
       return result.index;
 
+    case NAME_CONSTANT:
     case NAME_FUNCTION:
     case NAME_CLASS:
     case NAME_BUILTIN:
@@ -2372,6 +3400,13 @@ static void compilerImportAll(Compiler* compiler, Script* script) {
     ASSERT(script->global_names.data[i] < script->names.count, OOPS);
     const String* name = script->names.data[script->global_names.data[i]];
 
+    // Constants are imported at compile time.
+    if (scriptIsConstant(script, i)) {
+      compilerDefineConstant(compiler, name->data, name->length,
+                             compiler->previous.line, script->globals.data[i]);
+      continue;
+    }
+
     compilerImportSingleEntry(compiler, name->data, name->length);
   }
 }
@@ -2400,14 +3435,20 @@ static void compileFromImport(Compiler* compiler) {
       uint32_t length = (uint32_t)compiler->previous.length;
       int line = compiler->previous.line;
 
+      // If the symbol is a constant, it'll be imported at compile time.
+      int constant = -1;
+      if (lib_from) {
+        constant = scriptGetGlobals(lib_from, name, length);
+        if (constant != -1 &&
+            !scriptIsConstant(lib_from, (uint32_t)constant)) {
+          constant = -1;
+        }
+      }
+
       // Add the name of the symbol to the names buffer.
       int name_index = (int)scriptAddName(compiler->script, compiler->vm,
                                           name, length);
 
-      // Don't pop the lib since it'll be used for the next entry.
-      emitOpcode(compiler, OP_GET_ATTRIB_KEEP);
-      emitShort(compiler, name_index); //< Name of the attrib.
-
       // Check if it has an alias.
       if (match(compiler, TK_AS)) {
         // Consuming it'll update the previous token which would be the name of
@@ -2421,6 +3462,16 @@ static void compileFromImport(Compiler* compiler) {
       length = (uint32_t)compiler->previous.length;
       line = compiler->previous.line;
 
+      if (constant != -1) {
+        compilerDefineConstant(compiler, name, length, line,
+                               lib_from->globals.data[constant]);
+        continue;
+      }
+
+      // Don't pop the lib since it'll be used for the next entry.
+      emitOpcode(compiler, OP_GET_ATTRIB_KEEP);
+      emitShort(compiler, name_index); //< Name of the attrib.
+
       // Get the variable to bind the imported symbol, if we already have a
       // variable with that name override it, otherwise use a new variable.
       int var_index = compilerImportName(compiler, line, name, length);
@@ -2503,42 +3554,160 @@ static void compileExpression(Compiler* compiler) {
   parsePrecedence(compiler, PREC_LOWEST);
 }
 
-static void compileIfStatement(Compiler* compiler, bool elsif) {
+// Check if the condition compiled from the address [cond_start] to the jump
+// offset at [jump] compares the chain's variable with a constant, if so add
+// it to the [chain] as a case.
+static void compilerIfChainCase(Compiler* compiler, IfChain* chain,
+                                int cond_start, int jump) {
+  if (!chain->open) return;
+
+  uint8_t* code = _FN->opcodes.data + cond_start;
+  int length = jump - cond_start; //< Length of the condition + 1 (jump op).
+
+  int var_length = 0;
+  if (OP_PUSH_LOCAL_0 <= code[0] && code[0] <= OP_PUSH_LOCAL_8) {
+    var_length = 1;
+  } else if (code[0] == OP_PUSH_LOCAL_N || code[0] == OP_PUSH_GLOBAL) {
+    var_length = 2;
+  }
+
+  // The condition should be: push variable, PUSH_CONSTANT [index], EQEQ.
+  if (var_length == 0 || length != var_length + 5 ||
+      code[var_length] != OP_PUSH_CONSTANT ||
+      code[var_length + 3] != OP_EQEQ) {
+    chain->open = false;
+    return;
+  }
+
+  // All the conditions should compare the same variable.
+  if (chain->cases.values.count == 0) {
+    chain->var_start = cond_start;
+    chain->var_length = var_length;
+
+  } else if (chain->var_length != var_length ||
+             memcmp(_FN->opcodes.data + chain->var_start, code,
+                    var_length) != 0) {
+    chain->open = false;
+    return;
+  }
+
+  int index = (code[var_length + 1] << 8) | code[var_length + 2];
+  Var value = compiler->script->literals.data[index];
+  if (IS_OBJ(value) && !IS_OBJ_TYPE(value, OBJ_STRING)) {
+    chain->open = false;
+    return;
+  }
+
+  chain->last_jump = jump;
+
+  // A repeated case is unreachable, no need to dispatch it.
+  if (switchHasCase(compiler, &chain->cases, value)) return;
+
+  ARENA_WRITE(compiler, &chain->cases.values, index);
+  ARENA_WRITE(compiler, &chain->cases.targets, (uint32_t)(jump + 2));
+}
+
+// Replace the first comparison of the if-elsif [chain] with a dispatch
+// instruction which will jump to the body of the matching case directly, if
+// it has enough cases.
+static void compilerLowerIfChain(Compiler* compiler, IfChain* chain) {
+  if (chain->cases.values.count < MIN_SWITCH_CHAIN) return;
+
+  // If none of the cases match, jump to where the last case jumps if it's
+  // condition is false.
+  uint8_t* jump = _FN->opcodes.data + chain->last_jump;
+  int default_target = chain->last_jump + 2 + ((jump[0] << 8) | jump[1]);
+
+  // The dispatch instruction overrides the PUSH_CONSTANT and EQEQ of the
+  // first condition and the rest of the bytes (JUMP_IF_NOT's offset) are
+  // padded. The comparisons of the other cases will never be reached.
+  int dispatch = chain->var_start + chain->var_length;
+  patchSwitch(compiler, dispatch, &chain->cases, default_target);
+  _FN->opcodes.data[dispatch + 5] = OP_NOP;
+  _FN->opcodes.data[dispatch + 6] = OP_NOP;
+}
+
+static void compileIfStatement(Compiler* compiler, bool elsif,
+                               IfChain* chain) {
+
+  // The top most if statement owns the chain of it's elsif cases.
+  IfChain if_chain;
+  ArenaMark mark = arenaMark(compiler);
+  if (!elsif) {
+    chain = &if_chain;
+    pkUintBufferInit(&chain->cases.values);
+    pkUintBufferInit(&chain->cases.targets);
+    chain->open = true;
+  }
 
   skipNewLines(compiler);
+  int cond_start = (int)_FN->opcodes.count;
   compileExpression(compiler); //< Condition.
-  emitOpcode(compiler, OP_JUMP_IF_NOT);
-  int ifpatch = emitShort(compiler, 0xffff); //< Will be patched.
 
-  compileBlockBody(compiler, BLOCK_IF);
+  // If the condition is a constant, only the branch that will be taken is
+  // emitted and the other branch is compiled (for errors) and discarded.
+  Var condition;
+  if (compilerConstantAt(compiler, cond_start, (int)_FN->opcodes.count,
+                         &condition)) {
+    CodeSnapshot snapshot;
+    compilerSnapshot(compiler, &snapshot);
+    snapshot.address = cond_start;
+    compilerDiscardCode(compiler, &snapshot);
+    compilerChangeStack(compiler, -1);
+
+    // The discarded cases can't be dispatched.
+    chain->open = false;
+
+    bool taken = toBool(condition);
+    compileBlockBody(compiler, BLOCK_IF);
+    if (!taken) compilerDiscardCode(compiler, &snapshot);
+
+    compilerSnapshot(compiler, &snapshot);
+    if (match(compiler, TK_ELSIF)) {
+      compilerEnterBlock(compiler);
+      compileIfStatement(compiler, true, chain);
+      compilerExitBlock(compiler);
+
+    } else if (match(compiler, TK_ELSE)) {
+      compileBlockBody(compiler, BLOCK_ELSE);
+    }
+    if (taken) compilerDiscardCode(compiler, &snapshot);
 
-  if (match(compiler, TK_ELSIF)) {
+  } else {
+    emitOpcode(compiler, OP_JUMP_IF_NOT);
+    int ifpatch = emitShort(compiler, 0xffff); //< Will be patched.
+    compilerIfChainCase(compiler, chain, cond_start, ifpatch);
 
-    // Jump pass else.
-    emitOpcode(compiler, OP_JUMP);
-    int exit_jump = emitShort(compiler, 0xffff); //< Will be patched.
+    compileBlockBody(compiler, BLOCK_IF);
 
-    // if (false) jump here.
-    patchJump(compiler, ifpatch);
+    if (match(compiler, TK_ELSIF)) {
 
-    compilerEnterBlock(compiler);
-    compileIfStatement(compiler, true);
-    compilerExitBlock(compiler);
+      // Jump pass else.
+      emitOpcode(compiler, OP_JUMP);
+      int exit_jump = emitShort(compiler, 0xffff); //< Will be patched.
 
-    patchJump(compiler, exit_jump);
+      // if (false) jump here.
+      patchJump(compiler, ifpatch);
 
-  } else if (match(compiler, TK_ELSE)) {
+      compilerEnterBlock(compiler);
+      compileIfStatement(compiler, true, chain);
+      compilerExitBlock(compiler);
 
-    // Jump pass else.
-    emitOpcode(compiler, OP_JUMP);
-    int exit_jump = emitShort(compiler, 0xffff); //< Will be patched.
+      patchJump(compiler, exit_jump);
 
-    patchJump(compiler, ifpatch);
-    compileBlockBody(compiler, BLOCK_ELSE);
-    patchJump(compiler, exit_jump);
+    } else if (match(compiler, TK_ELSE)) {
 
-  } else {
-    patchJump(compiler, ifpatch);
+      // Jump pass else.
+      emitOpcode(compiler, OP_JUMP);
+      int exit_jump = emitShort(compiler, 0xffff); //< Will be patched.
+
+      patchJump(compiler, ifpatch);
+      compileBlockBody(compiler, BLOCK_ELSE);
+      patchJump(compiler, exit_jump);
+
+    } else {
+      patchJump(compiler, ifpatch);
+    }
   }
 
   // elsif will not consume the 'end' keyword as it'll be leaved to be consumed
@@ -2546,7 +3715,118 @@ static void compileIfStatement(Compiler* compiler, bool elsif) {
   if (!elsif) {
     skipNewLines(compiler);
     consume(compiler, TK_END, "Expected 'end' after statement end.");
+
+    if (!compiler->has_errors) compilerLowerIfChain(compiler, chain);
+    arenaRewind(compiler, mark);
+  }
+}
+
+// Compile a match case value, which should be a constant literal and return
+// it's index in the script's literals (-1 on failure).
+static int compileCaseValue(Compiler* compiler) {
+  Var value;
+
+  if (match(compiler, TK_NUMBER) || match(compiler, TK_STRING)) {
+    value = compiler->previous.value;
+
+  } else if (match(compiler, TK_MINUS)) {
+    consume(compiler, TK_NUMBER, "Expected a number after '-'.");
+    if (compiler->previous.type != TK_NUMBER) return -1;
+    value = compiler->previous.value;
+    if (IS_OBJ_TYPE(value, OBJ_BIGINT)) {
+      value = VAR_OBJ(bigIntNegate(compiler->vm, (BigInt*)AS_OBJ(value)));
+    } else {
+      value = VAR_NUM(-AS_NUM(value));
+    }
+
+  } else if (match(compiler, TK_NULL)) {
+    value = VAR_NULL;
+
+  } else if (match(compiler, TK_TRUE)) {
+    value = VAR_TRUE;
+
+  } else if (match(compiler, TK_FALSE)) {
+    value = VAR_FALSE;
+
+  } else {
+    parseError(compiler, "Expected a constant value for the case.");
+    return -1;
+  }
+
+  return compilerAddConstant(compiler, value);
+}
+
+//  match value                       |    (value)
+//    case 1, 2 then (...)            |    map_jump/table_jump [table] [def]
+//    case "foo" then (...)           |    (...)       <-- 1, 2
+//    else (...)                      |    jump [exit]
+//  end                               |    (...)       <-- "foo"
+//                                    |    jump [exit]
+//                                    |    (...)       <-- default
+static void compileMatchStatement(Compiler* compiler) {
+
+  compileExpression(compiler); //< Value to match.
+  consumeEndStatement(compiler);
+  skipNewLines(compiler);
+
+  // Pop the value and jump to the matching case (will be patched).
+  int dispatch = (int)_FN->opcodes.count;
+  emitOpcode(compiler, OP_MAP_JUMP);
+  emitShort(compiler, 0xffff);
+  emitShort(compiler, 0xffff);
+
+  ArenaMark mark = arenaMark(compiler);
+  SwitchCases cases;
+  pkUintBufferInit(&cases.values);
+  pkUintBufferInit(&cases.targets);
+
+  // Address indexes of the jumps at the end of each case body.
+  pkUintBuffer exits;
+  pkUintBufferInit(&exits);
+
+  while (match(compiler, TK_CASE)) {
+    do {
+      skipNewLines(compiler);
+      int index = compileCaseValue(compiler);
+      if (index == -1) continue;
+
+      Var value = compiler->script->literals.data[index];
+      if (switchHasCase(compiler, &cases, value)) {
+        parseError(compiler, "Duplicate case value in match statement.");
+      }
+      ARENA_WRITE(compiler, &cases.values, (uint32_t)index);
+    } while (match(compiler, TK_COMMA));
+
+    // All the values of the case will jump to it's body.
+    uint32_t target = _FN->opcodes.count;
+    while (cases.targets.count < cases.values.count) {
+      ARENA_WRITE(compiler, &cases.targets, target);
+    }
+
+    compileBlockBody(compiler, BLOCK_CASE);
+
+    emitOpcode(compiler, OP_JUMP);
+    int exit_jump = emitShort(compiler, 0xffff); //< Will be patched.
+    ARENA_WRITE(compiler, &exits, (uint32_t)exit_jump);
   }
+
+  int default_target = (int)_FN->opcodes.count;
+  if (match(compiler, TK_ELSE)) {
+    compileBlockBody(compiler, BLOCK_ELSE);
+  }
+
+  skipNewLines(compiler);
+  consume(compiler, TK_END, "Expected 'end' after match statement end.");
+
+  for (uint32_t i = 0; i < exits.count; i++) {
+    patchJump(compiler, exits.data[i]);
+  }
+
+  if (!compiler->has_errors) {
+    patchSwitch(compiler, dispatch, &cases, default_target);
+  }
+
+  arenaRewind(compiler, mark);
 }
 
 static void compileWhileStatement(Compiler* compiler) {
@@ -2631,10 +3911,53 @@ static void compileForStatement(Compiler* compiler) {
   compilerExitBlock(compiler); //< Iterator scope.
 }
 
+// Compile a local variable declaration with a type annotation, the assigned
+// value is checked against the type and the type of the local is recorded.
+// name : type = expression
+static void compileTypedLocal(Compiler* compiler) {
+  consume(compiler, TK_NAME, "Expected a variable name.");
+  const char* name = compiler->previous.start;
+  uint32_t length = (uint32_t)compiler->previous.length;
+  int line = compiler->previous.line;
+
+  consume(compiler, TK_COLLON, "Expected ':' after the variable name.");
+  int type = compileTypeAnnotation(compiler);
+
+  bool is_local = compiler->scope_depth != DEPTH_GLOBAL;
+  if (!is_local) {
+    parseError(compiler, "Only the local variables can be annotated.");
+
+  } else if (compilerSearchName(compiler, name, length).type !=
+             NAME_NOT_DEFINED) {
+    parseError(compiler, "Name '%.*s' already exists.", length, name);
+  }
+
+  consume(compiler, TK_EQ, "Expected '=' after the type annotation.");
+  skipNewLines(compiler);
+
+  compileExpression(compiler);
+  emitTypeCheck(compiler, compilerExprType(compiler), type);
+  consumeEndStatement(compiler);
+
+  // The assigned value on the stack itself is the new local.
+  if (is_local) {
+    int index = compilerAddVariable(compiler, name, length, line);
+    if (index != -1) {
+      compiler->locals[index].type = type;
+      emitStoreVariable(compiler, index, false);
+    }
+  }
+}
+
 // Compiles a statement. Assignment could be an assignment statement or a new
 // variable declaration, which will be handled.
 static void compileStatement(Compiler* compiler) {
 
+  // Record the line of the statement for the coverage.
+  if (compiler->options && compiler->options->coverage) {
+    emitCover(compiler);
+  }
+
   // is_temproary will be set to true if the statement is an temporary
   // expression, it'll used to be pop from the stack.
   bool is_temproary = false;
@@ -2703,8 +4026,18 @@ static void compileStatement(Compiler* compiler) {
       consumeEndStatement(compiler);
       emitOpcode(compiler, OP_RETURN);
     }
+  } else if (match(compiler, TK_CONST)) {
+    parseError(compiler, "Constants can only be defined at the top level.");
+    return;
+
+  } else if (peek(compiler) == TK_NAME && compiler->next.type == TK_COLLON) {
+    compileTypedLocal(compiler);
+
   } else if (match(compiler, TK_IF)) {
-    compileIfStatement(compiler, false);
+    compileIfStatement(compiler, false, NULL);
+
+  } else if (match(compiler, TK_MATCH)) {
+    compileMatchStatement(compiler);
 
   } else if (match(compiler, TK_WHILE)) {
     compileWhileStatement(compiler);
@@ -2733,6 +4066,42 @@ static void compileStatement(Compiler* compiler) {
   if (is_temproary) emitOpcode(compiler, OP_POP);
 }
 
+// Compile a constant declaration, the value is evaluated at compile time and
+// the name is replaced with it wherever it's used.
+// const NAME = expression
+static void compileConstDeclaration(Compiler* compiler) {
+  ASSERT(compiler->scope_depth == DEPTH_GLOBAL, OOPS);
+
+  consume(compiler, TK_NAME, "Expected a name for the constant.");
+  const char* name = compiler->previous.start;
+  uint32_t length = (uint32_t)compiler->previous.length;
+  int line = compiler->previous.line;
+
+  consume(compiler, TK_EQ, "Expected '=' after the constant name.");
+  skipNewLines(compiler);
+
+  // The value should be evaluated at compile time, so the code of the
+  // expression is discarded once it's compiled.
+  CodeSnapshot snapshot;
+  compilerSnapshot(compiler, &snapshot);
+  compileExpression(compiler);
+
+  Var value;
+  bool is_constant = compilerConstantAt(compiler, snapshot.address,
+                                        (int)_FN->opcodes.count, &value);
+  compilerDiscardCode(compiler, &snapshot);
+  compilerChangeStack(compiler, -1);
+
+  if (!is_constant) {
+    parseError(compiler, "Expected a constant expression for '%.*s'.",
+               length, name);
+    return;
+  }
+
+  compilerDefineConstant(compiler, name, length, line, value);
+  consumeEndStatement(compiler);
+}
+
 // Compile statements that are only valid at the top level of the script. Such
 // as import statement, function define, and if we're running REPL mode top
 // level expression's evaluated value will be printed.
@@ -2750,6 +4119,9 @@ static void compileTopLevelStatement(Compiler* compiler) {
   } else if (match(compiler, TK_DEF)) {
     compileFunction(compiler, FN_SCRIPT);
 
+  } else if (match(compiler, TK_CONST)) {
+    compileConstDeclaration(compiler);
+
   } else if (match(compiler, TK_FROM)) {
     compileFromImport(compiler);
 
@@ -2765,12 +4137,79 @@ static void compileTopLevelStatement(Compiler* compiler) {
   }
 }
 
+DEFINE_BUFFER(CompileStats, PkCompileStats)
+
+// Finish the statistics of the compilation (the counters of the script's
+// buffers are set by the caller) and store them at the [index] of the vm's
+// statistics.
+static void compilerStoreStats(Compiler* compiler, uint32_t index) {
+  PKVM* vm = compiler->vm;
+  Script* script = compiler->script;
+  PkCompileStats* stats = compiler->stats;
+
+  stats->source = (uint32_t)(compiler->current_char - compiler->source);
+
+  // The body is recompiled every time, and the new functions are at the end.
+  stats->bytecode = script->body->fn->opcodes.count;
+  uint32_t first = script->functions.count - stats->functions;
+  for (uint32_t i = first; i < script->functions.count; i++) {
+    const Function* fn = script->functions.data[i];
+    if (!fn->is_native && fn != script->body) {
+      stats->bytecode += fn->fn->opcodes.count;
+    }
+  }
+
+  // Convert the times to seconds, the time of the parsing is what's left of
+  // the total.
+  stats->total_time = traceNow() - stats->total_time;
+  stats->parse_time = stats->total_time - stats->lex_time -
+                      stats->resolve_time - stats->import_time;
+  stats->total_time /= 1e6;
+  stats->parse_time /= 1e6;
+  stats->lex_time /= 1e6;
+  stats->resolve_time /= 1e6;
+  stats->import_time /= 1e6;
+
+  uint32_t length = script->path->length;
+  char* path = ALLOCATE_ARRAY(vm, char, length + 1);
+  memcpy(path, script->path->data, length + 1);
+  stats->path = path;
+
+  vm->compile_stats.data[index] = *stats;
+}
+
+// Resolve the forward names (function names that are used before defined) of
+// the compiled script.
+static void compilerResolveForwards(Compiler* compiler) {
+  for (int i = 0; i < compiler->forwards_count; i++) {
+    ForwardName* forward = &compiler->forwards[i];
+    const char* name = forward->name;
+    int length = forward->length;
+    int index = scriptGetFunc(compiler->script, name, (uint32_t)length);
+    if (index != -1) {
+      // The instruction could be discarded if it was in a dead code.
+      if (forward->instruction != -1) {
+        patchForward(compiler, forward->func, forward->instruction, index);
+      }
+    } else {
+      // need_more_lines is only true for unexpected EOF errors. For syntax
+      // errors it'll be false by now but. Here it's a semantic errors, so
+      // we're overriding it to false.
+      compiler->need_more_lines = false;
+      resolveError(compiler, forward->line, "Name '%.*s' is not defined.",
+                   length, name);
+    }
+  }
+}
+
 PkResult compile(PKVM* vm, Script* script, const char* source,
                  const PkCompileOptions* options) {
 
   // Skip utf8 BOM if there is any.
   if (strncmp(source, "\xEF\xBB\xBF", 3) == 0) source += 3;
 
+  double start = TRACE_NOW(vm);
+
   Compiler _compiler;
   Compiler* compiler = &_compiler; //< Compiler pointer for quick access.
   compilerInit(compiler, vm, source, script, options);
@@ -2781,6 +4220,18 @@ PkResult compile(PKVM* vm, Script* script, const char* source,
   compiler->next_compiler = vm->compiler;
   vm->compiler = compiler;
 
+  // Reserve the entry of the statistics, so the scripts imported by this one
+  // will be after it.
+  PkCompileStats stats;
+  uint32_t stats_index = 0;
+  if (options && options->stats) {
+    memset(&stats, 0, sizeof(stats));
+    stats.total_time = traceNow();
+    stats_index = vm->compile_stats.count;
+    pkCompileStatsBufferWrite(&vm->compile_stats, vm, stats);
+    compiler->stats = &stats;
+  }
+
   // If the script doesn't has a body by default, it's probably was created by
   // the native api function (pkNewModule() that'll return a module without a
   // main function) so just create and add the function here.
@@ -2789,6 +4240,7 @@ PkResult compile(PKVM* vm, Script* script, const char* source,
   // If we're compiling for a script that was already compiled (when running
   // REPL or evaluating an expression) we don't need the old main anymore.
   // just use the globals and functions of the script and use a new body func.
+  if (vm->debugger.sites.count > 0) debugForgetFunction(vm, script->body);
   pkByteBufferClear(&script->body->fn->opcodes, vm);
 
   // Remember the count of the globals, functions and types, If the compilation
@@ -2796,6 +4248,8 @@ PkResult compile(PKVM* vm, Script* script, const char* source,
   uint32_t globals_count = script->globals.count;
   uint32_t functions_count = script->functions.count;
   uint32_t types_count = script->classes.count;
+  uint32_t literals_count = script->literals.count;
+  uint32_t names_count = script->names.count;
 
   Func curr_fn;
   curr_fn.depth = DEPTH_SCRIPT;
@@ -2833,28 +4287,42 @@ PkResult compile(PKVM* vm, Script* script, const char* source,
   emitFunctionEnd(compiler);
 
   // Resolve forward names (function names that are used before defined).
-  for (int i = 0; i < compiler->forwards_count; i++) {
-    ForwardName* forward = &compiler->forwards[i];
-    const char* name = forward->name;
-    int length = forward->length;
-    int index = scriptGetFunc(script, name, (uint32_t)length);
-    if (index != -1) {
-      patchForward(compiler, forward->func, forward->instruction, index);
-    } else {
-      // need_more_lines is only true for unexpected EOF errors. For syntax
-      // errors it'll be false by now but. Here it's a semantic errors, so
-      // we're overriding it to false.
-      compiler->need_more_lines = false;
-      resolveError(compiler, forward->line, "Name '%.*s' is not defined.",
-                   length, name);
+  double resolve_start = (compiler->stats != NULL) ? traceNow() : 0;
+  compilerResolveForwards(compiler);
+  if (compiler->stats != NULL) {
+    stats.resolve_time = traceNow() - resolve_start;
+  }
+
+  // Collect the coverage lines of the compiled functions. (The body of a
+  // script could be compiled multiple times which is before the new ones.)
+  if (!compiler->has_errors && options && options->coverage) {
+    coverageInitFunction(vm, script->body);
+    for (uint32_t i = functions_count; i < script->functions.count; i++) {
+      Function* fn = script->functions.data[i];
+      if (!fn->is_native && fn != script->body) {
+        coverageInitFunction(vm, fn);
+      }
     }
   }
 
+  if (compiler->stats != NULL) {
+    stats.functions = script->functions.count - functions_count;
+    stats.constants = script->literals.count - literals_count;
+    stats.names = script->names.count - names_count;
+    compilerStoreStats(compiler, stats_index);
+  }
+
+  arenaFree(compiler);
   vm->compiler = compiler->next_compiler;
 
   // If compilation failed, discard all the invalid functions and globals.
   if (compiler->has_errors) {
     script->globals.count = script->global_names.count = globals_count;
+    while (script->constants.count > 0 &&
+           script->constants.data[script->constants.count - 1] >=
+             globals_count) {
+      script->constants.count--;
+    }
     script->functions.count = functions_count;
     script->classes.count = types_count;
   }
@@ -2867,6 +4335,8 @@ PkResult compile(PKVM* vm, Script* script, const char* source,
   pkByteBufferClear(&buff, vm);
 #endif
 
+  if (start != 0) traceCompile(vm, script->path->data, start);
+
   // Return the compilation result.
   if (compiler->has_errors) {
     if (compiler->options && compiler->options->repl_mode &&
@@ -2875,9 +4345,64 @@ PkResult compile(PKVM* vm, Script* script, const char* source,
     }
     return PK_RESULT_COMPILE_ERROR;
   }
+
+  // Set the breakpoints of the script (if any) now that it's compiled.
+  debugPatchScript(vm, script);
+
   return PK_RESULT_SUCCESS;
 }
 
+Function* compileExpressionFn(PKVM* vm, Script* script, const char* source,
+                              int count, const char** names) {
+  Compiler _compiler;
+  Compiler* compiler = &_compiler; //< Compiler pointer for quick access.
+  compilerInit(compiler, vm, source, script, NULL);
+  compiler->next_compiler = vm->compiler;
+  vm->compiler = compiler;
+
+  Func body_fn;
+  body_fn.depth = DEPTH_SCRIPT;
+  body_fn.ptr = script->body;
+  body_fn.outer_func = NULL;
+  compiler->func = &body_fn;
+
+  Function* func = newFunction(vm, EXPRESSION_FN_NAME,
+                               (int)strlen(EXPRESSION_FN_NAME), script, false,
+                               NULL);
+  Func curr_fn;
+  compilerPushFunc(compiler, &curr_fn, func,
+                   (int)script->functions.count - 1);
+
+  // The variables are the parameters of the function.
+  compilerEnterBlock(compiler); // Parameter depth.
+  for (int i = 0; i < count; i++) {
+    compilerAddVariable(compiler, names[i], (uint32_t)strlen(names[i]), 1);
+  }
+  func->arity = count;
+  compilerChangeStack(compiler, count);
+
+  lexToken(compiler);
+  lexToken(compiler);
+  skipNewLines(compiler);
+
+  compileExpression(compiler);
+  skipNewLines(compiler);
+  consume(compiler, TK_EOF, "Expected the end of the expression.");
+  emitOpcode(compiler, OP_RETURN);
+
+  compilerExitBlock(compiler); // Parameter depth.
+  emitFunctionEnd(compiler);
+  compilerPopFunc(compiler);
+
+  // An expression can only call the builtin functions.
+  compilerResolveForwards(compiler);
+
+  arenaFree(compiler);
+  vm->compiler = compiler->next_compiler;
+  if (compiler->has_errors) return NULL;
+  return func;
+}
+
 PkResult pkCompileModule(PKVM* vm, PkHandle* module, PkStringPtr source,
                          const PkCompileOptions* options) {
   __ASSERT(module != NULL, "Argument module was NULL.");
@@ -2890,18 +4415,7 @@ PkResult pkCompileModule(PKVM* vm, PkHandle* module, PkStringPtr source,
   return result;
 }
 
-void compilerMarkObjects(PKVM* vm, Compiler* compiler) {
-
-  // Mark the script which is currently being compiled.
-  markObject(vm, &compiler->script->_super);
-
-  // Mark the string literals (they haven't added to the script's literal
-  // buffer yet).
-  markValue(vm, compiler->current.value);
-  markValue(vm, compiler->previous.value);
-  markValue(vm, compiler->next.value);
-
-  if (compiler->next_compiler != NULL) {
-    compilerMarkObjects(vm, compiler->next_compiler);
-  }
+const PkCompileStats* pkGetCompileStats(const PKVM* vm, int* count) {
+  *count = (int)vm->compile_stats.count;
+  return vm->compile_stats.data;
 }
@@ -6,6 +6,7 @@
 #ifndef COMPILER_H
 #define COMPILER_H
 
+#include "pk_buffers.h"
 #include "pk_internal.h"
 #include "pk_var.h"
 
@@ -25,16 +26,24 @@ typedef enum {
 // (unlike C/Python).
 typedef struct Compiler Compiler;
 
+// The statistics of the compilations with the stats option, a member of the
+// PKVM (the paths are allocated copies).
+DECLARE_BUFFER(CompileStats, PkCompileStats)
+
 // This will take source code as a cstring, compiles it to pocketlang bytecodes
 // and append them to the script's implicit main function ("$(SourceBody)").
 // On a successfull compilation it'll return PK_RESULT_SUCCESS, otherwise it'll
 // return PK_RESULT_COMPILE_ERROR but if repl_mode set in the [options],  and
 // we've reached and unexpected EOF it'll return PK_RESULT_UNEXPECTED_EOF.
+// The garbage collection is deferred till the compilation is done, so the
+// [script] should be reachable once it returns.
 PkResult compile(PKVM* vm, Script* script, const char* source,
                  const PkCompileOptions* options);
 
-// Mark the heap allocated objects of the compiler at the garbage collection
-// called at the marking phase of vmCollectGarbage().
-void compilerMarkObjects(PKVM* vm, Compiler* compiler);
+// Compile the [source] as a single expression to a new function of the
+// [script], which parameters are the [count] variables of the [names] and
+// returns the value of the expression. Returns NULL if the compilation failed.
+Function* compileExpressionFn(PKVM* vm, Script* script, const char* source,
+                              int count, const char** names);
 
 #endif // COMPILER_H
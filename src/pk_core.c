@@ -10,7 +10,11 @@
 #include <math.h>
 #include <time.h>
 
+#include "pk_bigint.h"
 #include "pk_debug.h"
+#include "pk_hash.h"
+#include "pk_lz4.h"
+#include "pk_re.h"
 #include "pk_utils.h"
 #include "pk_var.h"
 #include "pk_vm.h"
@@ -93,6 +97,19 @@ PkHandle* pkGetFunction(PKVM* vm, PkHandle* module,
   return NULL;
 }
 
+PkHandle* pkGetModule(PKVM* vm, const char* path) {
+  __ASSERT(path != NULL, "Argument path was NULL.");
+
+  String* key = newString(vm, path);
+  vmPushTempRef(vm, &key->_super); // key.
+  Var scr = mapGet(vm->scripts, VAR_OBJ(key));
+  if (IS_UNDEF(scr)) scr = mapGet(vm->core_libs, VAR_OBJ(key));
+  vmPopTempRef(vm); // key.
+
+  if (IS_UNDEF(scr)) return NULL;
+  return vmNewHandle(vm, scr);
+}
+
 // A convenient macro to get the nth (1 based) argument of the current
 // function.
 #define ARG(n) (vm->fiber->ret[n])
@@ -257,7 +274,7 @@ bool pkGetArgValue(PKVM* vm, int arg, PkVarType type, PkVar* value) {
     return false;
   }
 
-  *value = (PkVar)&val;
+  *value = (PkVar)&ARG(arg);
   return true;
 }
 
@@ -330,7 +347,8 @@ bool pkFiberIsDone(const PkHandle* fiber) {
 // Evaluated to true of the [num] is in byte range.
 #define IS_NUM_BYTE(num) ((CHAR_MIN <= (num)) && ((num) <= CHAR_MAX))
 
-// Check if [var] is a numeric value (bool/number) and set [value].
+// Check if [var] is a numeric value (bool/number/BigInt) and set [value]. A
+// BigInt is converted to the nearest number.
 static inline bool isNumeric(Var var, double* value) {
   if (IS_NUM(var)) {
     *value = AS_NUM(var);
@@ -340,17 +358,24 @@ static inline bool isNumeric(Var var, double* value) {
     *value = AS_BOOL(var);
     return true;
   }
+  if (IS_OBJ_TYPE(var, OBJ_BIGINT)) {
+    *value = bigIntToDouble((BigInt*)AS_OBJ(var));
+    return true;
+  }
   return false;
 }
 
-// Check if [var] is a numeric value (bool/number) and set [value].
+// Check if [var] is a whole number (or a BigInt) that fits in a 64 bit
+// integer and set [value].
 static inline bool isInteger(Var var, int64_t* value) {
   double number;
+  if (IS_OBJ_TYPE(var, OBJ_BIGINT)) {
+    return bigIntToInt64((BigInt*)AS_OBJ(var), value);
+  }
   if (isNumeric(var, &number)) {
-    // TODO: check if the number is larger for a 64 bit integer.
-    if (floor(number) == number) {
-      ASSERT(INT64_MIN <= number && number <= INT64_MAX,
-        "TODO: Large numbers haven't handled yet. Please report!");
+    // 2^63 is the first whole number that doesn't fit in an int64.
+    if (floor(number) == number && -9223372036854775808.0 <= number &&
+        number < 9223372036854775808.0) {
       *value = (int64_t)(number);
       return true;
     }
@@ -358,6 +383,26 @@ static inline bool isInteger(Var var, int64_t* value) {
   return false;
 }
 
+// The fast path of isInteger() for the number values, which doesn't call
+// floor() since the casted value is the same only for the whole numbers.
+static inline bool isNumInteger(Var var, int64_t* value) {
+  if (!IS_NUM(var)) return false;
+  double number = AS_NUM(var);
+  if (!(-9223372036854775808.0 <= number && number < 9223372036854775808.0)) {
+    return false;
+  }
+  *value = (int64_t)number;
+  return (double)*value == number;
+}
+
+// Returns true if the [var] is a whole number or a BigInt.
+static inline bool isWholeNumber(Var var) {
+  double number;
+  if (IS_OBJ_TYPE(var, OBJ_BIGINT)) return true;
+  return isNumeric(var, &number) && isfinite(number) &&
+         floor(number) == number;
+}
+
 // Check if [var] is bool/number. If not set error and return false.
 static inline bool validateNumeric(PKVM* vm, Var var, double* value,
                                    const char* name) {
@@ -366,7 +411,7 @@ static inline bool validateNumeric(PKVM* vm, Var var, double* value,
   return false;
 }
 
-// Check if [var] is 32 bit integer. If not set error and return false.
+// Check if [var] is 64 bit integer. If not set error and return false.
 static inline bool validateInteger(PKVM* vm, Var var, int64_t* value,
                                    const char* name) {
   if (isInteger(var, value)) return true;
@@ -385,6 +430,24 @@ static inline bool validateIndex(PKVM* vm, int64_t index, uint32_t size,
   return true;
 }
 
+// The maximum capacity that could be reserved for a list or a map. Buffer
+// capacities are powers of 2 which should fit in an int.
+#define MAX_RESERVE_CAPACITY (1 << 30)
+
+// Check if [var] is a valid capacity to reserve for a container. If not set
+// error and return false.
+static inline bool validateCapacity(PKVM* vm, Var var, uint32_t* value,
+                                    const char* name) {
+  int64_t capacity;
+  if (!validateInteger(vm, var, &capacity, name)) return false;
+  if (capacity < 0 || capacity > MAX_RESERVE_CAPACITY) {
+    VM_SET_ERROR(vm, stringFormat(vm, "$ is not a valid capacity.", name));
+    return false;
+  }
+  *value = (uint32_t)capacity;
+  return true;
+}
+
 // Check if [var] is string for argument at [arg]. If not set error and
 // return false.
 #define VALIDATE_ARG_OBJ(m_class, m_type, m_name)                            \
@@ -395,6 +458,7 @@ static inline bool validateIndex(PKVM* vm, int64_t index, uint32_t size,
       char buff[12]; sprintf(buff, "%d", arg);                               \
       VM_SET_ERROR(vm, stringFormat(vm, "Expected a " m_name                 \
                    " at argument $.", buff, false));                         \
+      return false;                                                          \
     }                                                                        \
     *value = (m_class*)AS_OBJ(var);                                          \
     return true;                                                             \
@@ -404,6 +468,8 @@ static inline bool validateIndex(PKVM* vm, int64_t index, uint32_t size,
  VALIDATE_ARG_OBJ(Map, OBJ_MAP, "map")
  VALIDATE_ARG_OBJ(Function, OBJ_FUNC, "function")
  VALIDATE_ARG_OBJ(Fiber, OBJ_FIBER, "fiber")
+ VALIDATE_ARG_OBJ(Automaton, OBJ_AUTOMATON, "automaton")
+ VALIDATE_ARG_OBJ(Hasher, OBJ_HASHER, "hasher")
 
 /*****************************************************************************/
 /* SHARED FUNCTIONS                                                          */
@@ -512,62 +578,75 @@ DEF(coreAssert,
   }
 }
 
-DEF(coreBin,
-  "bin(value:num) -> string\n"
-  "Returns as a binary value string with '0x' prefix.") {
-
-  int64_t value;
-  if (!validateInteger(vm, ARG(1), &value, "Argument 1")) return;
-
-  char buff[STR_BIN_BUFF_SIZE];
-
-  bool negative = (value < 0) ? true : false;
-  if (negative) value = -value;
+// Returns the integer [value] (a whole number or a BigInt) as a string in
+// the [base] (2 or 16) with the [prefix] after the sign. If the value isn't
+// an integer, set error and returns NULL.
+static String* integerToString(PKVM* vm, Var value, int base,
+                               const char* prefix) {
+  int64_t integer;
+  if (!IS_OBJ_TYPE(value, OBJ_BIGINT) && isInteger(value, &integer)) {
+    // Large enough for the sign, the prefix and 64 binary digits.
+    char buff[STR_BIN_BUFF_SIZE];
+    char* ptr = buff + STR_BIN_BUFF_SIZE;
+
+    const int bits = (base == 16) ? 4 : 1;
+    const uint64_t mask = (uint64_t)base - 1;
+    uint64_t magnitude = (integer < 0) ? (uint64_t)0 - (uint64_t)integer
+                                       : (uint64_t)integer;
+    do {
+      *--ptr = "0123456789abcdef"[magnitude & mask];
+      magnitude >>= bits;
+    } while (magnitude != 0);
+
+    size_t length = strlen(prefix);
+    ptr -= length;
+    memcpy(ptr, prefix, length);
+    if (integer < 0) *--ptr = '-';
+
+    return newStringLength(vm, ptr,
+                           (uint32_t)((buff + STR_BIN_BUFF_SIZE) - ptr));
+  }
 
-  char* ptr = buff + STR_BIN_BUFF_SIZE - 1;
-  *ptr-- = '\0'; // NULL byte at the end of the string.
+  if (!isWholeNumber(value)) {
+    VM_SET_ERROR(vm, newString(vm, "Argument 1 must be a whole number."));
+    return NULL;
+  }
 
-  if (value != 0) {
-    while (value > 0) {
-      *ptr-- = '0' + (value & 1);
-      value >>= 1;
-    }
+  BigInt* big;
+  if (IS_OBJ_TYPE(value, OBJ_BIGINT)) {
+    big = (BigInt*)AS_OBJ(value);
   } else {
-    *ptr-- = '0';
+    double number;
+    isNumeric(value, &number);
+    big = bigIntFromDouble(vm, number);
   }
 
-  *ptr-- = 'b'; *ptr-- = '0';
-  if (negative) *ptr-- = '-';
+  vmPushTempRef(vm, &big->_super); // big.
+  pkByteBuffer buff;
+  pkByteBufferInit(&buff);
+  bigIntWrite(vm, big, base, prefix, &buff);
+  String* str = newStringLength(vm, (const char*)buff.data, buff.count);
+  pkByteBufferClear(&buff, vm);
+  vmPopTempRef(vm); // big.
+  return str;
+}
+
+DEF(coreBin,
+  "bin(value:num) -> string\n"
+  "Returns as a binary value string with '0b' prefix.") {
 
-  uint32_t length = (uint32_t)((buff + STR_BIN_BUFF_SIZE - 1) - (ptr + 1));
-  RET(VAR_OBJ(newStringLength(vm, ptr + 1, length)));
+  String* str = integerToString(vm, ARG(1), 2, "0b");
+  if (str == NULL) return;
+  RET(VAR_OBJ(str));
 }
 
 DEF(coreHex,
   "hex(value:num) -> string\n"
   "Returns as a hexadecimal value string with '0x' prefix.") {
 
-  int64_t value;
-  if (!validateInteger(vm, ARG(1), &value, "Argument 1")) return;
-
-  char buff[STR_HEX_BUFF_SIZE];
-
-  char* ptr = buff;
-  if (value < 0) *ptr++ = '-';
-  *ptr++ = '0'; *ptr++ = 'x';
-
-  if (value > UINT32_MAX || value < -(int64_t)(UINT32_MAX)) {
-    VM_SET_ERROR(vm, newString(vm, "Integer is too large."));
-    RET(VAR_NULL);
-  }
-
-  // TODO: spritnf limits only to 8 character hex value, we need to do it
-  // outself for a maximum of 16 character long (see bin() for reference).
-  uint32_t _x = (uint32_t)((value < 0) ? -value : value);
-  int length = sprintf(ptr, "%x", _x);
-
-  RET(VAR_OBJ(newStringLength(vm, buff,
-    (uint32_t)((ptr + length) - (char*)(buff)))));
+  String* str = integerToString(vm, ARG(1), 16, "0x");
+  if (str == NULL) return;
+  RET(VAR_OBJ(str));
 }
 
 DEF(coreYield,
@@ -708,6 +787,36 @@ DEF(coreStrOrd,
   }
 }
 
+DEF(coreStrJoin,
+  "str_join(parts:List, [sep:string]) -> string\n"
+  "Returns a string of all the strings in the list [parts] joined with the "
+  "optional separator [sep]. Collecting the parts in a list (which could be "
+  "reserved with list_reserve()) and joining them at once is much faster "
+  "than concatenating strings in a loop.") {
+
+  int argc = ARGC;
+  if (argc != 1 && argc != 2) {
+    RET_ERR(newString(vm, "Invalid argument count."));
+  }
+
+  List* parts;
+  String* sep = NULL;
+  if (!validateArgList(vm, 1, &parts)) return;
+  if (argc == 2 && !validateArgString(vm, 2, &sep)) return;
+
+  for (uint32_t i = 0; i < parts->elements.count; i++) {
+    if (!IS_OBJ_TYPE(parts->elements.data[i], OBJ_STRING)) {
+      RET_ERR(newString(vm, "Expected a list of strings."));
+    }
+  }
+
+  String* joined = stringJoinList(vm, parts, sep);
+  if (joined == NULL) {
+    RET_ERR(newString(vm, "Result of the join is too large."));
+  }
+  RET(VAR_OBJ(joined));
+}
+
 // List functions.
 // ---------------
 
@@ -723,6 +832,21 @@ DEF(coreListAppend,
   RET(VAR_OBJ(list));
 }
 
+DEF(coreListReserve,
+  "list_reserve(self:List, capacity:num) -> List\n"
+  "Reserve the list [self] to hold [capacity] elements without growing and "
+  "return the list.") {
+
+  List* list;
+  uint32_t capacity;
+  if (!validateArgList(vm, 1, &list)) return;
+  if (!validateCapacity(vm, ARG(2), &capacity, "Argument 2")) return;
+
+  pkVarBufferReserve(&list->elements, vm, capacity);
+  if (capacity > list->reserved) list->reserved = capacity;
+  RET(VAR_OBJ(list));
+}
+
 // Map functions.
 // --------------
 
@@ -738,6 +862,58 @@ DEF(coreMapRemove,
   RET(mapRemoveKey(vm, map, key));
 }
 
+// Check if the [key] could be a key of a map, otherwise set an error and
+// return false.
+static bool validateKey(PKVM* vm, Var key) {
+  if (IS_OBJ(key) && !isObjectHashable(AS_OBJ(key)->type)) {
+    VM_SET_ERROR(vm, stringFormat(vm, "$ type is not hashable.",
+                                  varTypeName(key)));
+    return false;
+  }
+  return true;
+}
+
+DEF(coreMapGet,
+  "map_get(self:map, key:var, default:var) -> var\n"
+  "Returns the value of the [key] in the map [self] if the key exists, "
+  "otherwise it'll return the [default] value.") {
+
+  Map* map;
+  if (!validateArgMap(vm, 1, &map)) return;
+  Var key = ARG(2);
+  if (!validateKey(vm, key)) return;
+
+  Var value = mapGet(map, key);
+  RET(IS_UNDEF(value) ? ARG(3) : value);
+}
+
+DEF(coreMapSetDefault,
+  "map_setdefault(self:map, key:var, default:var) -> var\n"
+  "Returns the value of the [key] in the map [self] if the key exists, "
+  "otherwise it'll insert the [default] value for the key and return it.") {
+
+  Map* map;
+  if (!validateArgMap(vm, 1, &map)) return;
+  Var key = ARG(2);
+  if (!validateKey(vm, key)) return;
+
+  RET(mapSetDefault(vm, map, key, ARG(3)));
+}
+
+DEF(coreMapReserve,
+  "map_reserve(self:map, capacity:num) -> map\n"
+  "Reserve the map [self] to hold [capacity] entries without re-hashing and "
+  "return the map.") {
+
+  Map* map;
+  uint32_t capacity;
+  if (!validateArgMap(vm, 1, &map)) return;
+  if (!validateCapacity(vm, ARG(2), &capacity, "Argument 2")) return;
+
+  mapReserve(vm, map, capacity);
+  RET(VAR_OBJ(map));
+}
+
 /*****************************************************************************/
 /* CORE MODULE METHODS                                                       */
 /*****************************************************************************/
@@ -1065,184 +1241,1155 @@ DEF(stdMathRound,
   RET(VAR_NUM(round(num)));
 }
 
-// 'Fiber' module methods.
-// -----------------------
-
-DEF(stdFiberNew,
-  "new(fn:Function) -> fiber\n"
-  "Create and return a new fiber from the given function [fn].") {
-
-  Function* fn;
-  if (!validateArgFunction(vm, 1, &fn)) return;
-  RET(VAR_OBJ(newFiber(vm, fn)));
+// 're' library methods.
+// ---------------------
+
+// Compile the [pattern] and return the regex. On failure it'll set the error
+// and return NULL.
+static Regex* compileRegex(PKVM* vm, String* pattern) {
+  const char* error;
+  uint32_t error_pos;
+  Regex* re = regexCompile(vm, pattern->data, pattern->length,
+                           &error, &error_pos);
+  if (re == NULL) {
+    char buff[12]; sprintf(buff, "%u", error_pos);
+    VM_SET_ERROR(vm, stringFormat(vm, "Invalid pattern (at $): $",
+                                  buff, error));
+  }
+  return re;
 }
 
-DEF(stdFiberRun,
-  "run(fb:Fiber, ...) -> var\n"
-  "Runs the fiber's function with the provided arguments and returns it's "
-  "return value or the yielded value if it's yielded.") {
+// Returns the compiled regex of the [pattern] from the VM's cache, or compile
+// and add it to the cache. On failure it'll set the error and return NULL.
+static Regex* getRegex(PKVM* vm, String* pattern) {
+  for (int i = 0; i < REGEX_CACHE_SIZE; i++) {
+    Regex* re = vm->regex_cache[i];
+    if (re != NULL && regexIsPattern(re, pattern->data, pattern->length)) {
+      return re;
+    }
+  }
 
-  int argc = ARGC;
-  if (argc == 0) // Missing the fiber argument.
-    RET_ERR(newString(vm, "Missing argument - fiber."));
+  Regex* re = compileRegex(vm, pattern);
+  if (re == NULL) return NULL;
 
-  Fiber* fb;
-  if (!validateArgFiber(vm, 1, &fb)) return;
+  int index = vm->regex_cache_next;
+  if (vm->regex_cache[index] != NULL) {
+    regexFree(vm, vm->regex_cache[index]);
+  }
+  vm->regex_cache[index] = re;
+  vm->regex_cache_next = (index + 1) % REGEX_CACHE_SIZE;
 
-  // Buffer of argument to call vmPrepareFiber().
-  Var* args[MAX_ARGC];
+  return re;
+}
 
-  // ARG(1) is fiber, function arguments are ARG(2), ARG(3), ... ARG(argc).
-  for (int i = 1; i < argc; i++) {
-    args[i - 1] = &ARG(i + 1);
-  }
+// Returns the compiled regex of the argument at [arg] which could be a
+// Pattern returned by re.compile() or a pattern string (compiled and cached
+// by getRegex()). On failure it'll set the error and return NULL.
+static Regex* validateArgRegex(PKVM* vm, int arg) {
+  Var var = ARG(arg);
+  if (IS_OBJ_TYPE(var, OBJ_PATTERN)) return ((Pattern*)AS_OBJ(var))->regex;
 
-  // Switch fiber and start execution.
-  if (vmPrepareFiber(vm, fb, argc - 1, args)) {
-    ASSERT(fb == vm->fiber, OOPS);
-    fb->state = FIBER_RUNNING;
+  if (!IS_OBJ_TYPE(var, OBJ_STRING)) {
+    char buff[12]; sprintf(buff, "%d", arg);
+    VM_SET_ERROR(vm, stringFormat(vm, "Expected a pattern or a string at "
+                                  "argument $.", buff));
+    return NULL;
+  }
+  return getRegex(vm, (String*)AS_OBJ(var));
+}
+
+// Returns the substring of [str] captured at the [group] of the [captures]
+// or null if the group didn't participate in the match.
+static Var newCapturedString(PKVM* vm, String* str, const int* captures,
+                             int group) {
+  int start = captures[2 * group], end = captures[2 * group + 1];
+  if (start < 0 || end < 0) return VAR_NULL;
+  return VAR_OBJ(newStringLength(vm, str->data + start,
+                                 (uint32_t)(end - start)));
+}
+
+// Append the captured string at the [group] to the [list].
+static void listAppendCaptured(PKVM* vm, List* list, String* str,
+                               const int* captures, int group) {
+  Var value = newCapturedString(vm, str, captures, group);
+  if (IS_OBJ(value)) vmPushTempRef(vm, AS_OBJ(value));
+  listAppend(vm, list, value);
+  if (IS_OBJ(value)) vmPopTempRef(vm);
+}
+
+// Returns a list of the matched string followed by it's groups.
+static List* newMatchList(PKVM* vm, String* str, const int* captures,
+                          int groups) {
+  List* list = newList(vm, groups + 1);
+  vmPushTempRef(vm, &list->_super);
+  for (int i = 0; i <= groups; i++) {
+    listAppendCaptured(vm, list, str, captures, i);
   }
+  vmPopTempRef(vm);
+  return list;
 }
 
-DEF(stdFiberResume,
-  "fiber_resume(fb:Fiber) -> var\n"
-  "Resumes a yielded function from a previous call of fiber_run() function. "
-  "Return it's return value or the yielded value if it's yielded.") {
-
-  int argc = ARGC;
-  if (argc == 0) // Missing the fiber argument.
-    RET_ERR(newString(vm, "Expected at least 1 argument(s)."));
-  if (argc > 2) // Can only accept 1 argument for resume.
-    RET_ERR(newString(vm, "Expected at most 2 argument(s)."));
+// Returns the position to continue searching after the match, an empty
+// match will skip a character to avoid matching at the same place forever.
+static inline uint32_t nextSearchPos(const int* captures) {
+  return (uint32_t)captures[1] + ((captures[0] == captures[1]) ? 1 : 0);
+}
 
-  Fiber* fb;
-  if (!validateArgFiber(vm, 1, &fb)) return;
+// Write the [length] bytes at [data] to the byte buffer.
+static void byteBufferAddBytes(PKVM* vm, pkByteBuffer* buff,
+                               const char* data, uint32_t length) {
+  if (length == 0) return;
+  pkByteBufferReserve(buff, vm, buff->count + length);
+  memcpy(buff->data + buff->count, data, length);
+  buff->count += length;
+}
 
-  Var value = (argc == 1) ? VAR_NULL : ARG(2);
+// Common implementation of re.match() and re.search().
+static void reMatch(PKVM* vm, bool anchored) {
+  String* str;
+  Regex* re = validateArgRegex(vm, 1);
+  if (re == NULL) return;
+  if (!validateArgString(vm, 2, &str)) return;
 
-  // Switch fiber and resume execution.
-  if (vmSwitchFiber(vm, fb, &value)) {
-    ASSERT(fb == vm->fiber, OOPS);
-    fb->state = FIBER_RUNNING;
+  int captures[2 * (REGEX_MAX_GROUPS + 1)];
+  if (!regexSearch(re, str->data, str->length, 0, anchored, captures)) {
+    RET(VAR_NULL);
   }
+  RET(VAR_OBJ(newMatchList(vm, str, captures, regexGroupCount(re))));
 }
 
-/*****************************************************************************/
-/* CORE INITIALIZATION                                                       */
-/*****************************************************************************/
-
-static void initializeBuiltinFN(PKVM* vm, BuiltinFn* bfn, const char* name,
-                                int length, int arity, pkNativeFn ptr,
-                                const char* docstring) {
-  bfn->name = name;
-  bfn->length = length;
+DEF(stdReCompile,
+  "compile(pattern:String) -> Pattern\n"
+  "Compile the regular expression [pattern] and return the compiled Pattern "
+  "which could be used instead of the pattern string in the other functions "
+  "of the module. It's an error if the pattern is invalid.") {
 
-  bfn->fn = newFunction(vm, name, length, NULL, true, docstring);
-  bfn->fn->arity = arity;
-  bfn->fn->native = ptr;
+  String* pattern;
+  if (!validateArgString(vm, 1, &pattern)) return;
+  Regex* re = compileRegex(vm, pattern);
+  if (re == NULL) return;
+  RET(VAR_OBJ(newPattern(vm, pattern, re)));
 }
 
-void initializeCore(PKVM* vm) {
-
-#define INITIALIZE_BUILTIN_FN(name, fn, argc)                        \
-  initializeBuiltinFN(vm, &vm->builtins[vm->builtins_count++], name, \
-                      (int)strlen(name), argc, fn, DOCSTRING(fn));
+DEF(stdReMatch,
+  "match_start(pattern:Pattern|String, str:String) -> List\n"
+  "Match the [pattern] at the beginning of the [str] and return a list of "
+  "the matched string followed by the groups (null for a group which didn't "
+  "match), returns null if it's not matching.") {
 
-#define MODULE_ADD_FN(module, name, fn, argc) \
-  moduleAddFunctionInternal(vm, module, name, fn, argc, DOCSTRING(fn))
+  reMatch(vm, true);
+}
 
-  // Initialize builtin functions.
-  INITIALIZE_BUILTIN_FN("type_name",   coreTypeName,   1);
+DEF(stdReSearch,
+  "search(pattern:Pattern|String, str:String) -> List\n"
+  "Search the first match of the [pattern] in the [str] and return a list "
+  "of the matched string followed by the groups (null for a group which "
+  "didn't match), returns null if there is no match.") {
 
-  // TODO: Add is keyword with modules for builtin types.
-  // ex: val is Num; val is null; val is List; val is Range
-  //     List.append(l, e) # List is implicitly imported core module.
-  //     String.lower(s)
+  reMatch(vm, false);
+}
 
-  INITIALIZE_BUILTIN_FN("help",        coreHelp,      -1);
-  INITIALIZE_BUILTIN_FN("assert",      coreAssert,    -1);
-  INITIALIZE_BUILTIN_FN("bin",         coreBin,        1);
-  INITIALIZE_BUILTIN_FN("hex",         coreHex,        1);
-  INITIALIZE_BUILTIN_FN("yield",       coreYield,     -1);
-  INITIALIZE_BUILTIN_FN("to_string",   coreToString,   1);
-  INITIALIZE_BUILTIN_FN("print",       corePrint,     -1);
-  INITIALIZE_BUILTIN_FN("input",       coreInput,     -1);
-  INITIALIZE_BUILTIN_FN("exit",        coreExit,      -1);
+DEF(stdReFindAll,
+  "findall(pattern:Pattern|String, str:String) -> List\n"
+  "Returns a list of all the non overlapping matches of the [pattern] in "
+  "the [str]. If the pattern has a single group the group is returned "
+  "instead of the match and if it has more groups, a list of the groups "
+  "is returned for each match.") {
 
-  // String functions.
-  INITIALIZE_BUILTIN_FN("str_sub",     coreStrSub,     3);
-  INITIALIZE_BUILTIN_FN("str_chr",     coreStrChr,     1);
-  INITIALIZE_BUILTIN_FN("str_ord",     coreStrOrd,     1);
+  String* str;
+  Regex* re = validateArgRegex(vm, 1);
+  if (re == NULL) return;
+  if (!validateArgString(vm, 2, &str)) return;
+  int groups = regexGroupCount(re);
 
-  // List functions.
-  INITIALIZE_BUILTIN_FN("list_append", coreListAppend, 2);
+  List* matches = newList(vm, 0);
+  vmPushTempRef(vm, &matches->_super);
 
-  // Map functions.
-  INITIALIZE_BUILTIN_FN("map_remove",  coreMapRemove,  2);
+  int captures[2 * (REGEX_MAX_GROUPS + 1)];
+  uint32_t pos = 0;
+  while (pos <= str->length &&
+         regexSearch(re, str->data, str->length, pos, false, captures)) {
 
-  // Core Modules /////////////////////////////////////////////////////////////
+    if (groups <= 1) {
+      listAppendCaptured(vm, matches, str, captures, groups);
 
-  Script* lang = newModuleInternal(vm, "lang");
-  MODULE_ADD_FN(lang, "clock", stdLangClock,  0);
-  MODULE_ADD_FN(lang, "gc",    stdLangGC,     0);
-  MODULE_ADD_FN(lang, "disas", stdLangDisas,  1);
-  MODULE_ADD_FN(lang, "write", stdLangWrite, -1);
-#ifdef DEBUG
-  MODULE_ADD_FN(lang, "debug_break", stdLangDebugBreak, 0);
-#endif
+    } else {
+      List* list = newList(vm, groups);
+      vmPushTempRef(vm, &list->_super);
+      for (int i = 1; i <= groups; i++) {
+        listAppendCaptured(vm, list, str, captures, i);
+      }
+      listAppend(vm, matches, VAR_OBJ(list));
+      vmPopTempRef(vm); // list.
+    }
 
-  Script* math = newModuleInternal(vm, "math");
-  MODULE_ADD_FN(math, "floor", stdMathFloor,       1);
-  MODULE_ADD_FN(math, "ceil",  stdMathCeil,        1);
-  MODULE_ADD_FN(math, "pow",   stdMathPow,         2);
-  MODULE_ADD_FN(math, "sqrt",  stdMathSqrt,        1);
-  MODULE_ADD_FN(math, "abs",   stdMathAbs,         1);
-  MODULE_ADD_FN(math, "sign",  stdMathSign,        1);
-  MODULE_ADD_FN(math, "hash",  stdMathHash,        1);
-  MODULE_ADD_FN(math, "sin",   stdMathSine,        1);
-  MODULE_ADD_FN(math, "cos",   stdMathCosine,      1);
-  MODULE_ADD_FN(math, "tan",   stdMathTangent,     1);
-  MODULE_ADD_FN(math, "sinh",  stdMathSinh,        1);
-  MODULE_ADD_FN(math, "cosh",  stdMathCosh,        1);
-  MODULE_ADD_FN(math, "tanh",  stdMathTanh,        1);
-  MODULE_ADD_FN(math, "asin",  stdMathArcSine,     1);
-  MODULE_ADD_FN(math, "acos",  stdMathArcCosine,   1);
-  MODULE_ADD_FN(math, "atan",  stdMathArcTangent,  1);
-  MODULE_ADD_FN(math, "log10", stdMathLog10,       1);
-  MODULE_ADD_FN(math, "round", stdMathRound,       1);
+    pos = nextSearchPos(captures);
+  }
 
-  // Note that currently it's mutable (since it's a global variable, not
-  // constant and pocketlang doesn't support constant) so the user shouldn't
-  // modify the PI, like in python.
-  // TODO: at varSetAttrib() we can detect if the user try to change an
-  // attribute of a core module and we can throw an error.
-  moduleAddGlobalInternal(vm, math, "PI", VAR_NUM(M_PI));
+  vmPopTempRef(vm); // matches.
+  RET(VAR_OBJ(matches));
+}
 
-  Script* fiber = newModuleInternal(vm, "Fiber");
-  MODULE_ADD_FN(fiber, "new",      stdFiberNew,     1);
-  MODULE_ADD_FN(fiber, "run",      stdFiberRun,    -1);
-  MODULE_ADD_FN(fiber, "resume",   stdFiberResume, -1);
+DEF(stdReSplit,
+  "split(pattern:Pattern|String, str:String) -> List\n"
+  "Split the [str] at the matches of the [pattern] and return the list of "
+  "the parts. Empty matches are ignored.") {
 
-}
+  String* str;
+  Regex* re = validateArgRegex(vm, 1);
+  if (re == NULL) return;
+  if (!validateArgString(vm, 2, &str)) return;
+
+  List* parts = newList(vm, 0);
+  vmPushTempRef(vm, &parts->_super);
+
+  // [last] is the end of the previous separator.
+  int captures[2 * (REGEX_MAX_GROUPS + 1)];
+  uint32_t pos = 0, last = 0;
+  while (pos <= str->length &&
+         regexSearch(re, str->data, str->length, pos, false, captures)) {
+
+    if (captures[0] != captures[1]) {
+      int part[2] = { (int)last, captures[0] };
+      listAppendCaptured(vm, parts, str, part, 0);
+      last = (uint32_t)captures[1];
+    }
+    pos = nextSearchPos(captures);
+  }
 
-/*****************************************************************************/
-/* OPERATORS                                                                 */
-/*****************************************************************************/
+  int tail[2] = { (int)last, (int)str->length };
+  listAppendCaptured(vm, parts, str, tail, 0);
 
-#define UNSUPPORTED_OPERAND_TYPES(op)                                  \
-  VM_SET_ERROR(vm, stringFormat(vm, "Unsupported operand types for "   \
-    "operator '" op "' $ and $", varTypeName(v1), varTypeName(v2)))
+  vmPopTempRef(vm); // parts.
+  RET(VAR_OBJ(parts));
+}
 
-#define RIGHT_OPERAND "Right operand"
+DEF(stdReSub,
+  "sub(pattern:Pattern|String, repl:String, str:String, [count:num]) -> "
+  "String\n"
+  "Returns the [str] with the non overlapping matches of the [pattern] "
+  "replaced by the [repl], where \\0 to \\9 in the [repl] are the match and "
+  "it's groups. If the [count] is given and greater than 0, only the first "
+  "[count] matches will be replaced.") {
 
-Var varAdd(PKVM* vm, Var v1, Var v2) {
-  double d1, d2;
+  int argc = ARGC;
+  if (argc != 3 && argc != 4) {
+    RET_ERR(newString(vm, "Invalid argument count."));
+  }
 
-  if (isNumeric(v1, &d1)) {
-    if (validateNumeric(vm, v2, &d2, RIGHT_OPERAND)) {
-      return VAR_NUM(d1 + d2);
+  String *repl, *str;
+  int64_t count = 0;
+  Regex* re = validateArgRegex(vm, 1);
+  if (re == NULL) return;
+  if (!validateArgString(vm, 2, &repl)) return;
+  if (!validateArgString(vm, 3, &str)) return;
+  if (argc == 4 && !validateInteger(vm, ARG(4), &count, "Argument 4")) return;
+  int groups = regexGroupCount(re);
+
+  for (uint32_t i = 0; i + 1 < repl->length; i++) {
+    if (repl->data[i] != '\\') continue;
+    char c = repl->data[++i];
+    if (utilIsDigit(c) && c - '0' > groups) {
+      RET_ERR(newString(vm, "Invalid group reference in the replacement."));
     }
-    return VAR_NULL;
+  }
+
+  pkByteBuffer buff;
+  pkByteBufferInit(&buff);
+
+  int captures[2 * (REGEX_MAX_GROUPS + 1)];
+  uint32_t pos = 0, last = 0;
+  int64_t replaced = 0;
+  while ((count <= 0 || replaced < count) && pos <= str->length &&
+         regexSearch(re, str->data, str->length, pos, false, captures)) {
+
+    byteBufferAddBytes(vm, &buff, str->data + last,
+                       (uint32_t)captures[0] - last);
+
+    for (uint32_t i = 0; i < repl->length; i++) {
+      char c = repl->data[i];
+      char next = (i + 1 < repl->length) ? repl->data[i + 1] : '\0';
+
+      if (c == '\\' && utilIsDigit(next)) {
+        int group = next - '0';
+        int start = captures[2 * group], end = captures[2 * group + 1];
+        if (start >= 0 && end >= 0) {
+          byteBufferAddBytes(vm, &buff, str->data + start,
+                             (uint32_t)(end - start));
+        }
+        i++;
+
+      } else if (c == '\\' && next == '\\') {
+        pkByteBufferWrite(&buff, vm, '\\');
+        i++;
+
+      } else {
+        pkByteBufferWrite(&buff, vm, (uint8_t)c);
+      }
+    }
+
+    last = (uint32_t)captures[1];
+    pos = nextSearchPos(captures);
+    replaced++;
+  }
+
+  byteBufferAddBytes(vm, &buff, str->data + last, str->length - last);
+
+  String* result = newStringLength(vm, (const char*)buff.data, buff.count);
+  pkByteBufferClear(&buff, vm);
+  RET(VAR_OBJ(result));
+}
+
+// 'hash' library methods.
+// -----------------------
+
+// The data to hash could be a string or a list of strings (the consecutive
+// parts of the data), so a large data could be hashed part by part without
+// joining them. If the argument at [arg] is not a valid data, set error and
+// return false.
+static bool validateArgData(PKVM* vm, int arg) {
+  Var data = ARG(arg);
+  if (IS_OBJ_TYPE(data, OBJ_STRING)) return true;
+
+  if (IS_OBJ_TYPE(data, OBJ_LIST)) {
+    List* parts = (List*)AS_OBJ(data);
+    uint32_t i = 0;
+    while (i < parts->elements.count &&
+           IS_OBJ_TYPE(parts->elements.data[i], OBJ_STRING)) i++;
+    if (i == parts->elements.count) return true;
+  }
+
+  char buff[STR_INT_BUFF_SIZE]; sprintf(buff, "%d", arg);
+  VM_SET_ERROR(vm, stringFormat(vm, "Expected a string or a list of strings "
+                                "at argument $.", buff));
+  return false;
+}
+
+// Returns the number of the parts of a (validated) data.
+static inline uint32_t hashDataCount(Var data) {
+  if (IS_OBJ_TYPE(data, OBJ_STRING)) return 1;
+  return ((List*)AS_OBJ(data))->elements.count;
+}
+
+// Returns the part of a (validated) data at the [index].
+static inline String* hashDataPart(Var data, uint32_t index) {
+  if (IS_OBJ_TYPE(data, OBJ_STRING)) return (String*)AS_OBJ(data);
+  return (String*)AS_OBJ(((List*)AS_OBJ(data))->elements.data[index]);
+}
+
+// Returns the 64 bit [hash] as a hex string of 16 digits.
+static String* newHash64String(PKVM* vm, uint64_t hash) {
+  char buff[STR_HEX_BUFF_SIZE];
+  int length = snprintf(buff, sizeof(buff), "%08x%08x",
+                        (unsigned int)(hash >> 32), (unsigned int)hash);
+  return newStringLength(vm, buff, (uint32_t)length);
+}
+
+// Returns the SHA-256 [digest] as a hex string of 64 digits.
+static String* newDigestString(PKVM* vm,
+                               const uint8_t digest[SHA256_DIGEST_SIZE]) {
+  static const char* digits = "0123456789abcdef";
+  char hex[SHA256_DIGEST_SIZE * 2];
+  for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+    hex[2 * i] = digits[digest[i] >> 4];
+    hex[2 * i + 1] = digits[digest[i] & 0xf];
+  }
+  return newStringLength(vm, hex, sizeof(hex));
+}
+
+// Validate the optional 32 bit checksum to continue a crc32c at the argument
+// [arg] and set it to [crc] or set error and return false.
+static bool validateArgCrc(PKVM* vm, int arg, uint32_t* crc) {
+  int64_t value;
+  char name[STR_INT_BUFF_SIZE + 9];
+  sprintf(name, "Argument %d", arg);
+  if (!validateInteger(vm, ARG(arg), &value, name)) return false;
+  if (value < 0 || value > UINT32_MAX) {
+    VM_SET_ERROR(vm, newString(vm, "Expected a 32 bit unsigned checksum."));
+    return false;
+  }
+  *crc = (uint32_t)value;
+  return true;
+}
+
+DEF(stdHashCrc32c,
+  "crc32c(data:String|List, [crc:num]) -> num\n"
+  "Returns the CRC-32C checksum of the [data] which is a string or a list "
+  "of strings. To continue a checksum with more data pass the previous "
+  "checksum as [crc].") {
+
+  int argc = ARGC;
+  if (argc != 1 && argc != 2) {
+    RET_ERR(newString(vm, "Invalid argument count."));
+  }
+
+  if (!validateArgData(vm, 1)) return;
+
+  uint32_t checksum = 0;
+  if (argc == 2 && !validateArgCrc(vm, 2, &checksum)) return;
+
+  for (uint32_t i = 0; i < hashDataCount(ARG(1)); i++) {
+    String* part = hashDataPart(ARG(1), i);
+    checksum = hashCrc32c(checksum, (const uint8_t*)part->data,
+                          part->length);
+  }
+
+  RET(VAR_NUM((double)checksum));
+}
+
+DEF(stdHashWyhash,
+  "wyhash(data:String|List, [seed:num]) -> String\n"
+  "Returns the 64 bit wyhash of the [data] (a string or a list of strings) "
+  "with the optional [seed] as a hex string of 16 digits. It's a fast non "
+  "cryptographic hash.") {
+
+  int argc = ARGC;
+  if (argc != 1 && argc != 2) {
+    RET_ERR(newString(vm, "Invalid argument count."));
+  }
+
+  if (!validateArgData(vm, 1)) return;
+
+  int64_t seed = 0;
+  if (argc == 2 && !validateInteger(vm, ARG(2), &seed, "Argument 2")) return;
+
+  uint64_t hash;
+  if (IS_OBJ_TYPE(ARG(1), OBJ_STRING)) {
+    String* data = (String*)AS_OBJ(ARG(1));
+    hash = hashWyhash((const uint8_t*)data->data, data->length,
+                      (uint64_t)seed);
+
+  } else {
+    Wyhash wyhash;
+    wyhashInit(&wyhash, (uint64_t)seed);
+    for (uint32_t i = 0; i < hashDataCount(ARG(1)); i++) {
+      String* part = hashDataPart(ARG(1), i);
+      wyhashUpdate(&wyhash, (const uint8_t*)part->data, part->length);
+    }
+    hash = wyhashFinal(&wyhash);
+  }
+
+  RET(VAR_OBJ(newHash64String(vm, hash)));
+}
+
+DEF(stdHashSha256,
+  "sha256(data:String|List) -> String\n"
+  "Returns the SHA-256 digest of the [data] (a string or a list of strings) "
+  "as a hex string of 64 digits.") {
+
+  if (!validateArgData(vm, 1)) return;
+
+  Sha256 sha;
+  sha256Init(&sha);
+  for (uint32_t i = 0; i < hashDataCount(ARG(1)); i++) {
+    String* part = hashDataPart(ARG(1), i);
+    sha256Update(&sha, (const uint8_t*)part->data, part->length);
+  }
+
+  uint8_t digest[SHA256_DIGEST_SIZE];
+  sha256Final(&sha, digest);
+  RET(VAR_OBJ(newDigestString(vm, digest)));
+}
+
+DEF(stdHashNew,
+  "new(algorithm:String, [seed:num]) -> Hasher\n"
+  "Returns a new Hasher of the [algorithm] which is one of 'crc32c', "
+  "'wyhash' and 'sha256', to hash a data part by part with update() and "
+  "get the digest with digest(). The [seed] is the seed of the wyhash or "
+  "the checksum to continue of the crc32c.") {
+
+  int argc = ARGC;
+  if (argc != 1 && argc != 2) {
+    RET_ERR(newString(vm, "Invalid argument count."));
+  }
+
+  String* name;
+  if (!validateArgString(vm, 1, &name)) return;
+
+  HashAlgorithm algorithm;
+  if (strcmp(name->data, "crc32c") == 0) {
+    algorithm = HASH_CRC32C;
+  } else if (strcmp(name->data, "wyhash") == 0) {
+    algorithm = HASH_WYHASH;
+  } else if (strcmp(name->data, "sha256") == 0) {
+    algorithm = HASH_SHA256;
+  } else {
+    RET_ERR(stringFormat(vm, "Unknown hash algorithm '@'.", name));
+  }
+
+  uint64_t seed = 0;
+  if (argc == 2) {
+    if (algorithm == HASH_SHA256) {
+      RET_ERR(newString(vm, "The sha256 doesn't take a seed."));
+
+    } else if (algorithm == HASH_CRC32C) {
+      uint32_t crc;
+      if (!validateArgCrc(vm, 2, &crc)) return;
+      seed = crc;
+
+    } else {
+      int64_t value;
+      if (!validateInteger(vm, ARG(2), &value, "Argument 2")) return;
+      seed = (uint64_t)value;
+    }
+  }
+
+  RET(VAR_OBJ(newHasher(vm, algorithm, seed)));
+}
+
+DEF(stdHashUpdate,
+  "update(self:Hasher, data:String|List) -> Hasher\n"
+  "Hash the [data] (a string or a list of strings) after the data already "
+  "hashed by the hasher and return the hasher.") {
+
+  Hasher* hasher;
+  if (!validateArgHasher(vm, 1, &hasher)) return;
+  if (!validateArgData(vm, 2)) return;
+
+  for (uint32_t i = 0; i < hashDataCount(ARG(2)); i++) {
+    String* part = hashDataPart(ARG(2), i);
+    const uint8_t* data = (const uint8_t*)part->data;
+    switch (hasher->algorithm) {
+      case HASH_CRC32C:
+        hasher->crc = hashCrc32c(hasher->crc, data, part->length);
+        break;
+      case HASH_WYHASH:
+        wyhashUpdate(&hasher->wyhash, data, part->length);
+        break;
+      case HASH_SHA256:
+        sha256Update(&hasher->sha256, data, part->length);
+        break;
+    }
+    hasher->length += part->length;
+  }
+
+  RET(ARG(1));
+}
+
+DEF(stdHashDigest,
+  "digest(self:Hasher) -> num|String\n"
+  "Returns the digest of the data hashed so far in the same format of the "
+  "crc32c(), wyhash() and sha256() functions. The hasher could be updated "
+  "after that to continue the hash.") {
+
+  Hasher* hasher;
+  if (!validateArgHasher(vm, 1, &hasher)) return;
+
+  switch (hasher->algorithm) {
+    case HASH_CRC32C:
+      RET(VAR_NUM((double)hasher->crc));
+
+    case HASH_WYHASH:
+      RET(VAR_OBJ(newHash64String(vm, wyhashFinal(&hasher->wyhash))));
+
+    case HASH_SHA256:
+    {
+      // The state is copied since the padding is added by the final.
+      Sha256 sha = hasher->sha256;
+      uint8_t digest[SHA256_DIGEST_SIZE];
+      sha256Final(&sha, digest);
+      RET(VAR_OBJ(newDigestString(vm, digest)));
+    }
+  }
+
+  UNREACHABLE();
+}
+
+// 'compress' module methods.
+// --------------------------
+
+// Write the (validated) data at the argument [arg] to the byte buffer, the
+// parts of a list are joined since they're compressed as a single content.
+static void compressDataWrite(PKVM* vm, int arg, pkByteBuffer* buff) {
+  for (uint32_t i = 0; i < hashDataCount(ARG(arg)); i++) {
+    String* part = hashDataPart(ARG(arg), i);
+    byteBufferAddBytes(vm, buff, part->data, part->length);
+  }
+}
+
+// Validate the optional compression level argument at [arg] and set it to
+// [level] or set error and return false.
+static bool validateArgLevel(PKVM* vm, int arg, int* level) {
+  *level = LZ4_LEVEL_FAST;
+  if (ARGC < arg) return true;
+
+  int64_t value;
+  if (!validateInteger(vm, ARG(arg), &value, "Compression level")) {
+    return false;
+  }
+  if (value < LZ4_LEVEL_FAST || value > LZ4_LEVEL_MAX) {
+    VM_SET_ERROR(vm, newString(vm, "Compression level should be in the "
+                               "range 1 to 12."));
+    return false;
+  }
+  *level = (int)value;
+  return true;
+}
+
+DEF(stdCompressCompress,
+  "compress(data:String|List, [level:num]) -> String\n"
+  "Compress the [data] (a string or a list of strings) and returns an LZ4 "
+  "frame, which could be decompressed with the lz4 tool. The [level] is "
+  "from 1 (fastest, default) to 12 (best compression).") {
+
+  int argc = ARGC;
+  if (argc != 1 && argc != 2) {
+    RET_ERR(newString(vm, "Invalid argument count."));
+  }
+
+  int level;
+  if (!validateArgData(vm, 1)) return;
+  if (!validateArgLevel(vm, 2, &level)) return;
+
+  pkByteBuffer frame;
+  pkByteBufferInit(&frame);
+
+  if (IS_OBJ_TYPE(ARG(1), OBJ_STRING)) {
+    String* data = (String*)AS_OBJ(ARG(1));
+    lz4CompressFrame(vm, (const uint8_t*)data->data, data->length, level,
+                     &frame);
+  } else {
+    pkByteBuffer buff;
+    pkByteBufferInit(&buff);
+    compressDataWrite(vm, 1, &buff);
+    lz4CompressFrame(vm, buff.data, buff.count, level, &frame);
+    pkByteBufferClear(&buff, vm);
+  }
+
+  String* result = newStringLength(vm, (const char*)frame.data, frame.count);
+  pkByteBufferClear(&frame, vm);
+  RET(VAR_OBJ(result));
+}
+
+DEF(stdCompressDecompress,
+  "decompress(data:String) -> String\n"
+  "Decompress the LZ4 frames (concatenated frames are joined) of the [data] "
+  "and returns the content.") {
+
+  String* data;
+  if (!validateArgString(vm, 1, &data)) return;
+
+  pkByteBuffer buff;
+  pkByteBufferInit(&buff);
+  const char* error = lz4DecompressFrame(vm, (const uint8_t*)data->data,
+                                         data->length, &buff);
+  if (error != NULL) {
+    pkByteBufferClear(&buff, vm);
+    RET_ERR(newString(vm, error));
+  }
+
+  String* result = newStringLength(vm, (const char*)buff.data, buff.count);
+  pkByteBufferClear(&buff, vm);
+  RET(VAR_OBJ(result));
+}
+
+DEF(stdCompressCompressBlock,
+  "compress_block(data:String|List, [level:num]) -> String\n"
+  "Compress the [data] into a single LZ4 block without the frame. The size "
+  "of the data should be known to decompress the block.") {
+
+  int argc = ARGC;
+  if (argc != 1 && argc != 2) {
+    RET_ERR(newString(vm, "Invalid argument count."));
+  }
+
+  int level;
+  if (!validateArgData(vm, 1)) return;
+  if (!validateArgLevel(vm, 2, &level)) return;
+
+  pkByteBuffer buff;
+  pkByteBufferInit(&buff);
+  compressDataWrite(vm, 1, &buff);
+
+  pkByteBuffer block;
+  pkByteBufferInit(&block);
+  pkByteBufferReserve(&block, vm, LZ4_COMPRESS_BOUND(buff.count));
+  block.count = (uint32_t)lz4CompressBlock(vm, buff.data, buff.count,
+                                           block.data, level);
+  pkByteBufferClear(&buff, vm);
+
+  String* result = newStringLength(vm, (const char*)block.data, block.count);
+  pkByteBufferClear(&block, vm);
+  RET(VAR_OBJ(result));
+}
+
+DEF(stdCompressDecompressBlock,
+  "decompress_block(data:String, size:num) -> String\n"
+  "Decompress the LZ4 block [data] of the content which is [size] bytes.") {
+
+  String* data;
+  uint32_t size;
+  if (!validateArgString(vm, 1, &data)) return;
+  if (!validateCapacity(vm, ARG(2), &size, "Size")) return;
+
+  pkByteBuffer buff;
+  pkByteBufferInit(&buff);
+  pkByteBufferReserve(&buff, vm, size);
+  int64_t written = lz4DecompressBlock((const uint8_t*)data->data,
+                                       data->length, buff.data, 0, size);
+  if (written != (int64_t)size) {
+    pkByteBufferClear(&buff, vm);
+    RET_ERR(newString(vm, "Invalid compressed block."));
+  }
+
+  String* result = newStringLength(vm, (const char*)buff.data, size);
+  pkByteBufferClear(&buff, vm);
+  RET(VAR_OBJ(result));
+}
+
+// 'BigInt' module methods.
+// ------------------------
+
+// Check if the argument at [arg] is a BigInt or a whole number (which will be
+// converted to a BigInt) and set [value]. If not set error and return false.
+static bool validateArgBigInt(PKVM* vm, int arg, BigInt** value) {
+  Var var = ARG(arg);
+  if (IS_OBJ_TYPE(var, OBJ_BIGINT)) {
+    *value = (BigInt*)AS_OBJ(var);
+    return true;
+  }
+
+  double number;
+  if (isNumeric(var, &number) && isfinite(number) &&
+      floor(number) == number) {
+    *value = bigIntFromDouble(vm, number);
+    return true;
+  }
+
+  char buff[12]; sprintf(buff, "%d", arg);
+  VM_SET_ERROR(vm, stringFormat(vm, "Expected an integer at argument $.",
+                                buff));
+  return false;
+}
+
+DEF(stdBigIntNew,
+  "new(value:num|String) -> BigInt\n"
+  "Returns a new BigInt of the whole number or the integer string [value] "
+  "(decimal, or hexadecimal and binary with the '0x' and '0b' prefix).") {
+
+  Var value = ARG(1);
+  if (IS_OBJ_TYPE(value, OBJ_STRING)) {
+    String* str = (String*)AS_OBJ(value);
+    BigInt* result = bigIntParse(vm, str->data, str->length);
+    if (result == NULL) {
+      RET_ERR(stringFormat(vm, "Invalid integer literal \"@\".", str));
+    }
+    RET(VAR_OBJ(result));
+  }
+
+  BigInt* result;
+  if (!validateArgBigInt(vm, 1, &result)) return;
+  RET(VAR_OBJ(result));
+}
+
+DEF(stdBigIntPow,
+  "pow(base:BigInt, exponent:num) -> BigInt\n"
+  "Returns the [base] raised to the non negative integer [exponent].") {
+
+  BigInt* base;
+  int64_t exponent;
+  if (!validateArgBigInt(vm, 1, &base)) return;
+  vmPushTempRef(vm, &base->_super); // base.
+  bool valid = validateInteger(vm, ARG(2), &exponent, "Argument 2");
+  BigInt* result = NULL;
+  if (valid && (exponent < 0 || exponent > UINT32_MAX)) {
+    VM_SET_ERROR(vm, newString(vm, "Invalid exponent."));
+  } else if (valid) {
+    result = bigIntPow(vm, base, (uint32_t)exponent);
+    if (result == NULL) {
+      VM_SET_ERROR(vm, newString(vm, "Result of the pow is too large."));
+    }
+  }
+  vmPopTempRef(vm); // base.
+
+  if (result == NULL) return;
+  RET(VAR_OBJ(result));
+}
+
+DEF(stdBigIntToNumber,
+  "to_number(value:BigInt) -> num\n"
+  "Returns the nearest number of the BigInt [value], which is exact if the "
+  "value is less than 2^53 in magnitude.") {
+
+  BigInt* value;
+  if (!validateArgBigInt(vm, 1, &value)) return;
+  RET(VAR_NUM(bigIntToDouble(value)));
+}
+
+// 'Automaton' module methods.
+// ---------------------------
+
+DEF(stdAutomatonNew,
+  "new(patterns:List) -> Automaton\n"
+  "Build and return an Aho-Corasick automaton from the list of non empty "
+  "strings [patterns], which finds all of them in a string with a single "
+  "pass. Build it once and reuse it since building takes time.") {
+
+  List* patterns;
+  if (!validateArgList(vm, 1, &patterns)) return;
+
+  for (uint32_t i = 0; i < patterns->elements.count; i++) {
+    Var pattern = patterns->elements.data[i];
+    if (!IS_OBJ_TYPE(pattern, OBJ_STRING)) {
+      RET_ERR(newString(vm, "Expected a list of strings."));
+    }
+    if (((String*)AS_OBJ(pattern))->length == 0) {
+      RET_ERR(newString(vm, "A pattern cannot be an empty string."));
+    }
+  }
+
+  RET(VAR_OBJ(newAutomaton(vm, patterns)));
+}
+
+DEF(stdAutomatonFind,
+  "find(self:Automaton, text:String) -> List\n"
+  "Returns a list of all the occurrences of the patterns in the [text] as "
+  "[start, index] lists, where the index is the position of the pattern in "
+  "the list used to build the automaton. The matches could be overlapping "
+  "and ordered by their end position.") {
+
+  Automaton* automaton;
+  String* text;
+  if (!validateArgAutomaton(vm, 1, &automaton)) return;
+  if (!validateArgString(vm, 2, &text)) return;
+
+  List* matches = newList(vm, 0);
+  vmPushTempRef(vm, &matches->_super); // matches.
+  automatonFindAll(vm, automaton, text, matches);
+  vmPopTempRef(vm); // matches.
+
+  RET(VAR_OBJ(matches));
+}
+
+DEF(stdAutomatonTest,
+  "test(self:Automaton, text:String) -> Bool\n"
+  "Returns true if any of the patterns occurs in the [text]. It stops at the "
+  "first match without allocating anything.") {
+
+  Automaton* automaton;
+  String* text;
+  if (!validateArgAutomaton(vm, 1, &automaton)) return;
+  if (!validateArgString(vm, 2, &text)) return;
+
+  RET(VAR_BOOL(automatonContains(automaton, text->data, text->length)));
+}
+
+// 'Fiber' module methods.
+// -----------------------
+
+DEF(stdFiberNew,
+  "new(fn:Function) -> fiber\n"
+  "Create and return a new fiber from the given function [fn].") {
+
+  Function* fn;
+  if (!validateArgFunction(vm, 1, &fn)) return;
+  RET(VAR_OBJ(newFiber(vm, fn)));
+}
+
+DEF(stdFiberRun,
+  "run(fb:Fiber, ...) -> var\n"
+  "Runs the fiber's function with the provided arguments and returns it's "
+  "return value or the yielded value if it's yielded.") {
+
+  int argc = ARGC;
+  if (argc == 0) // Missing the fiber argument.
+    RET_ERR(newString(vm, "Missing argument - fiber."));
+
+  Fiber* fb;
+  if (!validateArgFiber(vm, 1, &fb)) return;
+
+  // Buffer of argument to call vmPrepareFiber().
+  Var* args[MAX_ARGC];
+
+  // ARG(1) is fiber, function arguments are ARG(2), ARG(3), ... ARG(argc).
+  for (int i = 1; i < argc; i++) {
+    args[i - 1] = &ARG(i + 1);
+  }
+
+  // Switch fiber and start execution.
+  if (vmPrepareFiber(vm, fb, argc - 1, args)) {
+    ASSERT(fb == vm->fiber, OOPS);
+    fb->state = FIBER_RUNNING;
+  }
+}
+
+DEF(stdFiberResume,
+  "fiber_resume(fb:Fiber) -> var\n"
+  "Resumes a yielded function from a previous call of fiber_run() function. "
+  "Return it's return value or the yielded value if it's yielded.") {
+
+  int argc = ARGC;
+  if (argc == 0) // Missing the fiber argument.
+    RET_ERR(newString(vm, "Expected at least 1 argument(s)."));
+  if (argc > 2) // Can only accept 1 argument for resume.
+    RET_ERR(newString(vm, "Expected at most 2 argument(s)."));
+
+  Fiber* fb;
+  if (!validateArgFiber(vm, 1, &fb)) return;
+
+  Var value = (argc == 1) ? VAR_NULL : ARG(2);
+
+  // Switch fiber and resume execution.
+  if (vmSwitchFiber(vm, fb, &value)) {
+    ASSERT(fb == vm->fiber, OOPS);
+    fb->state = FIBER_RUNNING;
+  }
+}
+
+/*****************************************************************************/
+/* CORE INITIALIZATION                                                       */
+/*****************************************************************************/
+
+static void initializeBuiltinFN(PKVM* vm, BuiltinFn* bfn, const char* name,
+                                int length, int arity, pkNativeFn ptr,
+                                const char* docstring) {
+  bfn->name = name;
+  bfn->length = length;
+
+  bfn->fn = newFunction(vm, name, length, NULL, true, docstring);
+  bfn->fn->arity = arity;
+  bfn->fn->native = ptr;
+}
+
+void initializeCore(PKVM* vm) {
+
+#define INITIALIZE_BUILTIN_FN(name, fn, argc)                        \
+  initializeBuiltinFN(vm, &vm->builtins[vm->builtins_count++], name, \
+                      (int)strlen(name), argc, fn, DOCSTRING(fn));
+
+#define MODULE_ADD_FN(module, name, fn, argc) \
+  moduleAddFunctionInternal(vm, module, name, fn, argc, DOCSTRING(fn))
+
+  // Initialize builtin functions.
+  INITIALIZE_BUILTIN_FN("type_name",   coreTypeName,   1);
+
+  // TODO: Add is keyword with modules for builtin types.
+  // ex: val is Num; val is null; val is List; val is Range
+  //     List.append(l, e) # List is implicitly imported core module.
+  //     String.lower(s)
+
+  INITIALIZE_BUILTIN_FN("help",        coreHelp,      -1);
+  INITIALIZE_BUILTIN_FN("assert",      coreAssert,    -1);
+  INITIALIZE_BUILTIN_FN("bin",         coreBin,        1);
+  INITIALIZE_BUILTIN_FN("hex",         coreHex,        1);
+  INITIALIZE_BUILTIN_FN("yield",       coreYield,     -1);
+  INITIALIZE_BUILTIN_FN("to_string",   coreToString,   1);
+  INITIALIZE_BUILTIN_FN("print",       corePrint,     -1);
+  INITIALIZE_BUILTIN_FN("input",       coreInput,     -1);
+  INITIALIZE_BUILTIN_FN("exit",        coreExit,      -1);
+
+  // String functions.
+  INITIALIZE_BUILTIN_FN("str_sub",     coreStrSub,     3);
+  INITIALIZE_BUILTIN_FN("str_chr",     coreStrChr,     1);
+  INITIALIZE_BUILTIN_FN("str_ord",     coreStrOrd,     1);
+  INITIALIZE_BUILTIN_FN("str_join",    coreStrJoin,   -1);
+
+  // List functions.
+  INITIALIZE_BUILTIN_FN("list_append", coreListAppend, 2);
+  INITIALIZE_BUILTIN_FN("list_reserve", coreListReserve, 2);
+
+  // Map functions.
+  INITIALIZE_BUILTIN_FN("map_get",        coreMapGet,        3);
+  INITIALIZE_BUILTIN_FN("map_setdefault", coreMapSetDefault, 3);
+  INITIALIZE_BUILTIN_FN("map_remove",     coreMapRemove,     2);
+  INITIALIZE_BUILTIN_FN("map_reserve",    coreMapReserve,    2);
+
+  // Core Modules /////////////////////////////////////////////////////////////
+
+  Script* lang = newModuleInternal(vm, "lang");
+  MODULE_ADD_FN(lang, "clock", stdLangClock,  0);
+  MODULE_ADD_FN(lang, "gc",    stdLangGC,     0);
+  MODULE_ADD_FN(lang, "disas", stdLangDisas,  1);
+  MODULE_ADD_FN(lang, "write", stdLangWrite, -1);
+#ifdef DEBUG
+  MODULE_ADD_FN(lang, "debug_break", stdLangDebugBreak, 0);
+#endif
+
+  Script* math = newModuleInternal(vm, "math");
+  MODULE_ADD_FN(math, "floor", stdMathFloor,       1);
+  MODULE_ADD_FN(math, "ceil",  stdMathCeil,        1);
+  MODULE_ADD_FN(math, "pow",   stdMathPow,         2);
+  MODULE_ADD_FN(math, "sqrt",  stdMathSqrt,        1);
+  MODULE_ADD_FN(math, "abs",   stdMathAbs,         1);
+  MODULE_ADD_FN(math, "sign",  stdMathSign,        1);
+  MODULE_ADD_FN(math, "hash",  stdMathHash,        1);
+  MODULE_ADD_FN(math, "sin",   stdMathSine,        1);
+  MODULE_ADD_FN(math, "cos",   stdMathCosine,      1);
+  MODULE_ADD_FN(math, "tan",   stdMathTangent,     1);
+  MODULE_ADD_FN(math, "sinh",  stdMathSinh,        1);
+  MODULE_ADD_FN(math, "cosh",  stdMathCosh,        1);
+  MODULE_ADD_FN(math, "tanh",  stdMathTanh,        1);
+  MODULE_ADD_FN(math, "asin",  stdMathArcSine,     1);
+  MODULE_ADD_FN(math, "acos",  stdMathArcCosine,   1);
+  MODULE_ADD_FN(math, "atan",  stdMathArcTangent,  1);
+  MODULE_ADD_FN(math, "log10", stdMathLog10,       1);
+  MODULE_ADD_FN(math, "round", stdMathRound,       1);
+
+  // Note that currently it's mutable (since it's a global variable, not
+  // constant and pocketlang doesn't support constant) so the user shouldn't
+  // modify the PI, like in python.
+  // TODO: at varSetAttrib() we can detect if the user try to change an
+  // attribute of a core module and we can throw an error.
+  moduleAddGlobalInternal(vm, math, "PI", VAR_NUM(M_PI));
+
+  Script* re = newModuleInternal(vm, "re");
+  MODULE_ADD_FN(re, "compile", stdReCompile,  1);
+  MODULE_ADD_FN(re, "match_start", stdReMatch, 2);
+  MODULE_ADD_FN(re, "search",  stdReSearch,   2);
+  MODULE_ADD_FN(re, "findall", stdReFindAll,  2);
+  MODULE_ADD_FN(re, "split",   stdReSplit,    2);
+  MODULE_ADD_FN(re, "sub",     stdReSub,     -1);
+
+  Script* fiber = newModuleInternal(vm, "Fiber");
+  MODULE_ADD_FN(fiber, "new",      stdFiberNew,     1);
+  MODULE_ADD_FN(fiber, "run",      stdFiberRun,    -1);
+  MODULE_ADD_FN(fiber, "resume",   stdFiberResume, -1);
+
+  Script* hash = newModuleInternal(vm, "hash");
+  MODULE_ADD_FN(hash, "crc32c", stdHashCrc32c, -1);
+  MODULE_ADD_FN(hash, "wyhash", stdHashWyhash, -1);
+  MODULE_ADD_FN(hash, "sha256", stdHashSha256,  1);
+  MODULE_ADD_FN(hash, "new",    stdHashNew,    -1);
+  MODULE_ADD_FN(hash, "update", stdHashUpdate,  2);
+  MODULE_ADD_FN(hash, "digest", stdHashDigest,  1);
+
+  Script* compress = newModuleInternal(vm, "compress");
+  MODULE_ADD_FN(compress, "compress",   stdCompressCompress,  -1);
+  MODULE_ADD_FN(compress, "decompress", stdCompressDecompress, 1);
+  MODULE_ADD_FN(compress, "compress_block",   stdCompressCompressBlock,  -1);
+  MODULE_ADD_FN(compress, "decompress_block", stdCompressDecompressBlock, 2);
+
+  Script* bigint = newModuleInternal(vm, "BigInt");
+  MODULE_ADD_FN(bigint, "new",       stdBigIntNew,      1);
+  MODULE_ADD_FN(bigint, "pow",       stdBigIntPow,      2);
+  MODULE_ADD_FN(bigint, "to_number", stdBigIntToNumber, 1);
+
+  Script* automaton = newModuleInternal(vm, "Automaton");
+  MODULE_ADD_FN(automaton, "new",  stdAutomatonNew,  1);
+  MODULE_ADD_FN(automaton, "find", stdAutomatonFind, 2);
+  MODULE_ADD_FN(automaton, "test", stdAutomatonTest, 2);
+
+}
+
+/*****************************************************************************/
+/* OPERATORS                                                                 */
+/*****************************************************************************/
+
+#define UNSUPPORTED_OPERAND_TYPES(op)                                  \
+  VM_SET_ERROR(vm, stringFormat(vm, "Unsupported operand types for "   \
+    "operator '" op "' $ and $", varTypeName(v1), varTypeName(v2)))
+
+#define RIGHT_OPERAND "Right operand"
+
+// Convert the operand [var] of an arithmetic with a BigInt to a BigInt and
+// set [value], if it's a whole number a new BigInt will be allocated and
+// pushed as a temp reference (and [pushed] will be incremented). Returns
+// false if the operand isn't an integer.
+static bool bigIntOperand(PKVM* vm, Var var, BigInt** value, int* pushed) {
+  if (IS_OBJ_TYPE(var, OBJ_BIGINT)) {
+    *value = (BigInt*)AS_OBJ(var);
+    return true;
+  }
+
+  double number;
+  if (!isWholeNumber(var)) return false;
+  isNumeric(var, &number);
+  *value = bigIntFromDouble(vm, number);
+  vmPushTempRef(vm, &(*value)->_super);
+  (*pushed)++;
+  return true;
+}
+
+// If any of the operands are BigInt perform the arithmetic [op] (one of
+// '+', '-', '*', '/', '%') and set [result] and return true. If the other
+// operand is a number with a fraction the operation is done with doubles.
+// The division is rounded towards zero and the remainder has the sign of the
+// dividend like fmod(). Returns false if there is no BigInt operand or the
+// other operand isn't numeric to fallback to the default behavior.
+static bool bigIntArithmetic(PKVM* vm, Var v1, Var v2, char op,
+                             Var* result) {
+  if (!IS_OBJ_TYPE(v1, OBJ_BIGINT) && !IS_OBJ_TYPE(v2, OBJ_BIGINT)) {
+    return false;
+  }
+
+  int pushed = 0;
+  BigInt *b1, *b2;
+  if (!bigIntOperand(vm, v1, &b1, &pushed) ||
+      !bigIntOperand(vm, v2, &b2, &pushed)) {
+    while (pushed-- > 0) vmPopTempRef(vm);
+
+    double d1, d2;
+    if (IS_OBJ_TYPE(v1, OBJ_BIGINT)) d1 = bigIntToDouble((BigInt*)AS_OBJ(v1));
+    else if (!isNumeric(v1, &d1)) return false;
+    if (IS_OBJ_TYPE(v2, OBJ_BIGINT)) d2 = bigIntToDouble((BigInt*)AS_OBJ(v2));
+    else if (!isNumeric(v2, &d2)) return false;
+
+    switch (op) {
+      case '+': *result = VAR_NUM(d1 + d2); break;
+      case '-': *result = VAR_NUM(d1 - d2); break;
+      case '*': *result = VAR_NUM(d1 * d2); break;
+      case '/': *result = VAR_NUM(d1 / d2); break;
+      case '%': *result = VAR_NUM(fmod(d1, d2)); break;
+      default: UNREACHABLE();
+    }
+    return true;
+  }
+
+  BigInt* value = NULL;
+  switch (op) {
+    case '+': value = bigIntAdd(vm, b1, b2); break;
+    case '-': value = bigIntSubtract(vm, b1, b2); break;
+    case '*': value = bigIntMultiply(vm, b1, b2); break;
+
+    case '/':
+    case '%':
+      if (b2->count == 0) {
+        VM_SET_ERROR(vm, newString(vm, "Integer division by zero."));
+        break;
+      }
+      if (op == '/') bigIntDivide(vm, b1, b2, &value, NULL);
+      else bigIntDivide(vm, b1, b2, NULL, &value);
+      break;
+
+    default:
+      UNREACHABLE();
+  }
+
+  while (pushed-- > 0) vmPopTempRef(vm);
+  *result = (value != NULL) ? VAR_OBJ(value) : VAR_NULL;
+  return true;
+}
+
+// If any of the values are BigInt compare them and set [order] (see
+// bigIntCompare()) and return true. Returns false if they're not comparable
+// (NaN or non numeric values).
+static bool bigIntOrder(Var v1, Var v2, int* order) {
+  double number;
+  if (IS_OBJ_TYPE(v1, OBJ_BIGINT) && IS_OBJ_TYPE(v2, OBJ_BIGINT)) {
+    *order = bigIntCompare((BigInt*)AS_OBJ(v1), (BigInt*)AS_OBJ(v2));
+    return true;
+  }
+  if (IS_OBJ_TYPE(v1, OBJ_BIGINT)) {
+    if (!isNumeric(v2, &number) || isnan(number)) return false;
+    *order = bigIntCompareNumber((BigInt*)AS_OBJ(v1), number);
+    return true;
+  }
+  if (!isNumeric(v1, &number) || isnan(number)) return false;
+  *order = -bigIntCompareNumber((BigInt*)AS_OBJ(v2), number);
+  return true;
+}
+
+Var varAdd(PKVM* vm, Var v1, Var v2) {
+  double d1, d2;
+
+  Var result;
+  if (bigIntArithmetic(vm, v1, v2, '+', &result)) return result;
+
+  if (isNumeric(v1, &d1)) {
+    if (validateNumeric(vm, v2, &d2, RIGHT_OPERAND)) {
+      return VAR_NUM(d1 + d2);
+    }
+    return VAR_NULL;
   }
 
   if (IS_OBJ(v1) && IS_OBJ(v2)) {
@@ -1270,6 +2417,10 @@ Var varAdd(PKVM* vm, Var v1, Var v2) {
       case OBJ_FIBER:
       case OBJ_CLASS:
       case OBJ_INST:
+      case OBJ_AUTOMATON:
+      case OBJ_BIGINT:
+      case OBJ_PATTERN:
+      case OBJ_HASHER:
         break;
     }
   }
@@ -1281,6 +2432,9 @@ Var varAdd(PKVM* vm, Var v1, Var v2) {
 Var varSubtract(PKVM* vm, Var v1, Var v2) {
   double d1, d2;
 
+  Var result;
+  if (bigIntArithmetic(vm, v1, v2, '-', &result)) return result;
+
   if (isNumeric(v1, &d1)) {
     if (validateNumeric(vm, v2, &d2, RIGHT_OPERAND)) {
       return VAR_NUM(d1 - d2);
@@ -1295,6 +2449,9 @@ Var varSubtract(PKVM* vm, Var v1, Var v2) {
 Var varMultiply(PKVM* vm, Var v1, Var v2) {
   double d1, d2;
 
+  Var result;
+  if (bigIntArithmetic(vm, v1, v2, '*', &result)) return result;
+
   if (isNumeric(v1, &d1)) {
     if (validateNumeric(vm, v2, &d2, RIGHT_OPERAND)) {
       return VAR_NUM(d1 * d2);
@@ -1309,6 +2466,9 @@ Var varMultiply(PKVM* vm, Var v1, Var v2) {
 Var varDivide(PKVM* vm, Var v1, Var v2) {
   double d1, d2;
 
+  Var result;
+  if (bigIntArithmetic(vm, v1, v2, '/', &result)) return result;
+
   if (isNumeric(v1, &d1)) {
     if (validateNumeric(vm, v2, &d2, RIGHT_OPERAND)) {
       return VAR_NUM(d1 / d2);
@@ -1323,6 +2483,9 @@ Var varDivide(PKVM* vm, Var v1, Var v2) {
 Var varModulo(PKVM* vm, Var v1, Var v2) {
   double d1, d2;
 
+  Var result;
+  if (bigIntArithmetic(vm, v1, v2, '%', &result)) return result;
+
   if (isNumeric(v1, &d1)) {
     if (validateNumeric(vm, v2, &d2, RIGHT_OPERAND)) {
       return VAR_NUM(fmod(d1, d2));
@@ -1339,71 +2502,126 @@ Var varModulo(PKVM* vm, Var v1, Var v2) {
   return VAR_NULL;
 }
 
-Var varBitAnd(PKVM* vm, Var v1, Var v2) {
-  int64_t i1, i2;
+// Returns the integer [value] as a number if it's exactly representable (in
+// the range of +/- 2^53) otherwise as a new BigInt.
+static Var integerToVar(PKVM* vm, int64_t value) {
+  const int64_t max_exact = (int64_t)1 << 53;
+  if (-max_exact <= value && value <= max_exact) {
+    return VAR_NUM((double)value);
+  }
+  return VAR_OBJ(bigIntFromInt(vm, value));
+}
 
-  if (isInteger(v1, &i1)) {
-    if (validateInteger(vm, v2, &i2, RIGHT_OPERAND)) {
-      return VAR_NUM((double)(i1 & i2));
+// Perform the bitwise [op] (one of '&', '|', '^') on the integers and set
+// [result]. The operation is exact as if the values are in two's complement
+// and the result is a BigInt if any of the operands are BigInt or it's too
+// large for a number. Returns false if the left operand isn't an integer.
+static bool bitwiseOp(PKVM* vm, Var v1, Var v2, char op, Var* result) {
+  int64_t i1, i2;
+  if (isNumInteger(v1, &i1) && isNumInteger(v2, &i2)) {
+    switch (op) {
+      case '&': *result = integerToVar(vm, i1 & i2); break;
+      case '|': *result = integerToVar(vm, i1 | i2); break;
+      case '^': *result = integerToVar(vm, i1 ^ i2); break;
+      default: UNREACHABLE();
     }
-    return VAR_NULL;
+    return true;
   }
 
-  UNSUPPORTED_OPERAND_TYPES("&");
-  return VAR_NULL;
+  if (!isWholeNumber(v1)) return false;
+  *result = VAR_NULL;
+  if (!isWholeNumber(v2)) {
+    VM_SET_ERROR(vm, newString(vm, RIGHT_OPERAND " must be a whole number."));
+    return true;
+  }
+
+  int pushed = 0;
+  BigInt *b1, *b2;
+  bigIntOperand(vm, v1, &b1, &pushed);
+  bigIntOperand(vm, v2, &b2, &pushed);
+  *result = VAR_OBJ(bigIntBitwise(vm, b1, b2, op));
+  while (pushed-- > 0) vmPopTempRef(vm);
+  return true;
 }
 
-Var varBitOr(PKVM* vm, Var v1, Var v2) {
+// Shift the integer [v1] to the left by [v2] bits (to the right if [left] is
+// false, rounded towards negative infinity) and set [result]. The result is a
+// BigInt if [v1] is a BigInt or it's too large for a number. Returns false if
+// the left operand isn't an integer.
+static bool shiftOp(PKVM* vm, Var v1, Var v2, bool left, Var* result) {
   int64_t i1, i2;
+  bool small = isNumInteger(v1, &i1) && isNumInteger(v2, &i2) && i2 >= 0;
 
-  if (isInteger(v1, &i1)) {
-    if (validateInteger(vm, v2, &i2, RIGHT_OPERAND)) {
-      return VAR_NUM((double)(i1 | i2));
-    }
-    return VAR_NULL;
+  if (small && !left) {
+    int shift = (i2 > 63) ? 63 : (int)i2;
+    *result = integerToVar(vm, (i1 >= 0) ? (i1 >> shift) : ~(~i1 >> shift));
+    return true;
+  }
+  if (small && i2 < 63 && -(INT64_MAX >> i2) <= i1 &&
+      i1 <= (INT64_MAX >> i2)) {
+    *result = integerToVar(vm, i1 * ((int64_t)1 << i2));
+    return true;
+  }
+
+  if (!isWholeNumber(v1)) return false;
+  *result = VAR_NULL;
+
+  if (!validateInteger(vm, v2, &i2, RIGHT_OPERAND)) return true;
+  if (i2 < 0) {
+    VM_SET_ERROR(vm, newString(vm, "Negative shift count."));
+    return true;
+  }
+
+  // Shift the large values as BigInt.
+  int pushed = 0;
+  BigInt* value;
+  bigIntOperand(vm, v1, &value, &pushed);
+  BigInt* shifted = bigIntShift(vm, value, left ? i2 : -i2);
+  while (pushed-- > 0) vmPopTempRef(vm);
+
+  if (shifted == NULL) {
+    VM_SET_ERROR(vm, newString(vm, "Result of the shift is too large."));
+    return true;
   }
+  *result = VAR_OBJ(shifted);
+  return true;
+}
+
+Var varBitAnd(PKVM* vm, Var v1, Var v2) {
+  Var result;
+  if (bitwiseOp(vm, v1, v2, '&', &result)) return result;
+
+  UNSUPPORTED_OPERAND_TYPES("&");
+  return VAR_NULL;
+}
+
+Var varBitOr(PKVM* vm, Var v1, Var v2) {
+  Var result;
+  if (bitwiseOp(vm, v1, v2, '|', &result)) return result;
 
   UNSUPPORTED_OPERAND_TYPES("|");
   return VAR_NULL;
 }
 
 Var varBitXor(PKVM* vm, Var v1, Var v2) {
-  int64_t i1, i2;
-
-  if (isInteger(v1, &i1)) {
-    if (validateInteger(vm, v2, &i2, RIGHT_OPERAND)) {
-      return VAR_NUM((double)(i1 ^ i2));
-    }
-    return VAR_NULL;
-  }
+  Var result;
+  if (bitwiseOp(vm, v1, v2, '^', &result)) return result;
 
   UNSUPPORTED_OPERAND_TYPES("^");
   return VAR_NULL;
 }
 
 Var varBitLshift(PKVM* vm, Var v1, Var v2) {
-  int64_t i1, i2;
-
-  if (isInteger(v1, &i1)) {
-    if (validateInteger(vm, v2, &i2, RIGHT_OPERAND)) {
-      return VAR_NUM((double)(i1 << i2));
-    }
-    return VAR_NULL;
-  }
+  Var result;
+  if (shiftOp(vm, v1, v2, true, &result)) return result;
 
   UNSUPPORTED_OPERAND_TYPES("<<");
   return VAR_NULL;
 }
 
 Var varBitRshift(PKVM* vm, Var v1, Var v2) {
-  int64_t i1, i2;
-
-  if (isInteger(v1, &i1)) {
-    if (validateInteger(vm, v2, &i2, RIGHT_OPERAND)) {
-      return VAR_NUM((double)(i1 >> i2));
-    }
-    return VAR_NULL;
-  }
+  Var result;
+  if (shiftOp(vm, v1, v2, false, &result)) return result;
 
   UNSUPPORTED_OPERAND_TYPES(">>");
   return VAR_NULL;
@@ -1411,13 +2629,34 @@ Var varBitRshift(PKVM* vm, Var v1, Var v2) {
 
 Var varBitNot(PKVM* vm, Var v) {
   int64_t i;
-  if (!validateInteger(vm, v, &i, "Unary operand")) return VAR_NULL;
-  return VAR_NUM((double)(~i));
+  if (isNumInteger(v, &i)) return integerToVar(vm, ~i);
+  if (IS_OBJ_TYPE(v, OBJ_BIGINT)) {
+    return VAR_OBJ(bigIntBitNot(vm, (BigInt*)AS_OBJ(v)));
+  }
+  if (isInteger(v, &i)) return integerToVar(vm, ~i);
+
+  // Whole numbers too large for an int64.
+  if (!isWholeNumber(v)) {
+    VM_SET_ERROR(vm, newString(vm, "Unary operand must be a whole number."));
+    return VAR_NULL;
+  }
+  double number;
+  isNumeric(v, &number);
+  BigInt* value = bigIntFromDouble(vm, number);
+  vmPushTempRef(vm, &value->_super); // value.
+  Var result = VAR_OBJ(bigIntBitNot(vm, value));
+  vmPopTempRef(vm); // value.
+  return result;
 }
 
 bool varGreater(Var v1, Var v2) {
   double d1, d2;
 
+  if (IS_OBJ_TYPE(v1, OBJ_BIGINT) || IS_OBJ_TYPE(v2, OBJ_BIGINT)) {
+    int order;
+    return bigIntOrder(v1, v2, &order) && order > 0;
+  }
+
   if (isNumeric(v1, &d1) && isNumeric(v2, &d2)) {
     return d1 > d2;
   }
@@ -1429,6 +2668,11 @@ bool varGreater(Var v1, Var v2) {
 bool varLesser(Var v1, Var v2) {
   double d1, d2;
 
+  if (IS_OBJ_TYPE(v1, OBJ_BIGINT) || IS_OBJ_TYPE(v2, OBJ_BIGINT)) {
+    int order;
+    return bigIntOrder(v1, v2, &order) && order < 0;
+  }
+
   if (isNumeric(v1, &d1) && isNumeric(v2, &d2)) {
     return d1 < d2;
   }
@@ -1456,9 +2700,7 @@ bool varContains(PKVM* vm, Var elem, Var container) {
 
       String* sub = (String*)AS_OBJ(elem);
       String* str = (String*)AS_OBJ(container);
-      if (sub->length > str->length) return false;
-
-      TODO;
+      return stringFind(str, sub, 0) >= 0;
 
     } break;
 
@@ -1481,6 +2723,10 @@ bool varContains(PKVM* vm, Var elem, Var container) {
     case OBJ_FIBER:
     case OBJ_CLASS:
     case OBJ_INST:
+    case OBJ_AUTOMATON:
+    case OBJ_BIGINT:
+    case OBJ_PATTERN:
+    case OBJ_HASHER:
       TODO;
   }
   UNREACHABLE();
@@ -1662,6 +2908,61 @@ Var varGetAttrib(PKVM* vm, Var on, String* attrib) {
       return value;
     }
 
+    case OBJ_AUTOMATON:
+    {
+      Automaton* automaton = (Automaton*)obj;
+      switch (attrib->hash) {
+
+        case CHECK_HASH("length", 0x83d03615):
+          return VAR_NUM((double)automaton->pattern_count);
+
+        default:
+          ERR_NO_ATTRIB(vm, on, attrib);
+          return VAR_NULL;
+      }
+      UNREACHABLE();
+    }
+
+    case OBJ_BIGINT:
+      ERR_NO_ATTRIB(vm, on, attrib);
+      return VAR_NULL;
+
+    case OBJ_PATTERN:
+    {
+      Pattern* pattern = (Pattern*)obj;
+      switch (attrib->hash) {
+
+        case CHECK_HASH("pattern", 0x873d0129):
+          return VAR_OBJ(pattern->source);
+
+        case CHECK_HASH("groups", 0xaf6bcb6d):
+          return VAR_NUM((double)regexGroupCount(pattern->regex));
+
+        default:
+          ERR_NO_ATTRIB(vm, on, attrib);
+          return VAR_NULL;
+      }
+      UNREACHABLE();
+    }
+
+    case OBJ_HASHER:
+    {
+      Hasher* hasher = (Hasher*)obj;
+      switch (attrib->hash) {
+
+        case CHECK_HASH("algorithm", 0x1c45696a):
+          return VAR_OBJ(newString(vm, hashAlgorithmName(hasher->algorithm)));
+
+        case CHECK_HASH("length", 0x83d03615):
+          return VAR_NUM((double)hasher->length);
+
+        default:
+          ERR_NO_ATTRIB(vm, on, attrib);
+          return VAR_NULL;
+      }
+      UNREACHABLE();
+    }
+
     default:
       UNREACHABLE();
   }
@@ -1720,10 +3021,14 @@ do {                                                                          \
     case OBJ_SCRIPT: {
       Script* scr = (Script*)obj;
 
-      // Check globals.
+      // Check globals (constants are immutable).
       int index = scriptGetGlobals(scr, attrib->data, attrib->length);
       if (index != -1) {
         ASSERT_INDEX((uint32_t)index, scr->globals.count);
+        if (scriptIsConstant(scr, (uint32_t)index)) {
+          ATTRIB_IMMUTABLE(attrib->data);
+          return;
+        }
         scr->globals.data[index] = value;
         return;
       }
@@ -1777,6 +3082,27 @@ do {                                                                          \
       return;
     }
 
+    case OBJ_AUTOMATON:
+      ATTRIB_IMMUTABLE("length");
+      ERR_NO_ATTRIB(vm, on, attrib);
+      return;
+
+    case OBJ_BIGINT:
+      ERR_NO_ATTRIB(vm, on, attrib);
+      return;
+
+    case OBJ_PATTERN:
+      ATTRIB_IMMUTABLE("pattern");
+      ATTRIB_IMMUTABLE("groups");
+      ERR_NO_ATTRIB(vm, on, attrib);
+      return;
+
+    case OBJ_HASHER:
+      ATTRIB_IMMUTABLE("algorithm");
+      ATTRIB_IMMUTABLE("length");
+      ERR_NO_ATTRIB(vm, on, attrib);
+      return;
+
     default:
       UNREACHABLE();
   }
@@ -1847,6 +3173,10 @@ Var varGetSubscript(PKVM* vm, Var on, Var key) {
     case OBJ_FIBER:
     case OBJ_CLASS:
     case OBJ_INST:
+    case OBJ_AUTOMATON:
+    case OBJ_BIGINT:
+    case OBJ_PATTERN:
+    case OBJ_HASHER:
       TODO;
       UNREACHABLE();
 
@@ -1857,6 +3187,44 @@ Var varGetSubscript(PKVM* vm, Var on, Var key) {
   UNREACHABLE();
 }
 
+Var varGetSubscriptKeep(PKVM* vm, Var on, Var key) {
+  SubscriptSlot* slot = &vm->subscript_slot;
+  slot->on = NULL;
+
+  if (IS_OBJ_TYPE(on, OBJ_LIST)) {
+    List* list = (List*)AS_OBJ(on);
+    int64_t index;
+    if (validateInteger(vm, key, &index, "List index") &&
+        validateIndex(vm, index, list->elements.count, "List")) {
+      slot->on = &list->_super;
+      slot->key = key;
+      slot->entry_key = key;
+      slot->data = list->elements.data;
+      slot->capacity = list->elements.capacity;
+      slot->index = (uint32_t)index;
+      return list->elements.data[index];
+    }
+    return VAR_NULL;
+  }
+
+  if (IS_OBJ_TYPE(on, OBJ_MAP)) {
+    Map* map = (Map*)AS_OBJ(on);
+    MapEntry* entry = mapGetEntry(map, key);
+    if (entry != NULL) {
+      slot->on = &map->_super;
+      slot->key = key;
+      slot->entry_key = entry->key;
+      slot->data = map->entries;
+      slot->capacity = map->capacity;
+      slot->index = (uint32_t)(entry - map->entries);
+      return entry->value;
+    }
+  }
+
+  // Not a list or a map, or the key doesn't exists (which sets the error).
+  return varGetSubscript(vm, on, key);
+}
+
 void varsetSubscript(PKVM* vm, Var on, Var key, Var value) {
   if (!IS_OBJ(on)) {
     VM_SET_ERROR(vm, stringFormat(vm, "$ type is not subscriptable.",
@@ -1897,6 +3265,10 @@ void varsetSubscript(PKVM* vm, Var on, Var key, Var value) {
     case OBJ_FIBER:
     case OBJ_CLASS:
     case OBJ_INST:
+    case OBJ_AUTOMATON:
+    case OBJ_BIGINT:
+    case OBJ_PATTERN:
+    case OBJ_HASHER:
       TODO;
       UNREACHABLE();
 
@@ -1907,6 +3279,79 @@ void varsetSubscript(PKVM* vm, Var on, Var key, Var value) {
   UNREACHABLE();
 }
 
+// Returns [v1] op [v2] where [op] is the opcode of a binary operator of a
+// compound assignment.
+static Var varBinaryOp(PKVM* vm, Opcode op, Var v1, Var v2) {
+  switch (op) {
+    case OP_ADD:        return varAdd(vm, v1, v2);
+    case OP_SUBTRACT:   return varSubtract(vm, v1, v2);
+    case OP_MULTIPLY:   return varMultiply(vm, v1, v2);
+    case OP_DIVIDE:     return varDivide(vm, v1, v2);
+    case OP_MOD:        return varModulo(vm, v1, v2);
+    case OP_BIT_AND:    return varBitAnd(vm, v1, v2);
+    case OP_BIT_OR:     return varBitOr(vm, v1, v2);
+    case OP_BIT_XOR:    return varBitXor(vm, v1, v2);
+    case OP_BIT_LSHIFT: return varBitLshift(vm, v1, v2);
+    case OP_BIT_RSHIFT: return varBitRshift(vm, v1, v2);
+    default:
+      UNREACHABLE();
+  }
+  return VAR_NULL;
+}
+
+// Store the [result] through the slot recorded by the varGetSubscriptKeep()
+// and returns true. The slot is invalid if the value evaluation or a garbage
+// collection has changed the container (ex: the list was shrunk, the map was
+// resized or the entry was removed) or if it's the slot of another subscript,
+// then returns false and the key should be looked up again.
+static bool _storeSubscriptSlot(PKVM* vm, Var on, Var key, Var result) {
+  SubscriptSlot slot = vm->subscript_slot;
+  vm->subscript_slot.on = NULL;
+
+  if (!IS_OBJ(on) || slot.on != AS_OBJ(on) || slot.key != key) return false;
+
+  if (slot.on->type == OBJ_LIST) {
+    pkVarBuffer* elems = &((List*)slot.on)->elements;
+    if (elems->data != slot.data || elems->capacity != slot.capacity ||
+        slot.index >= elems->count) {
+      return false;
+    }
+    elems->data[slot.index] = result;
+    return true;
+  }
+
+  Map* map = (Map*)slot.on;
+  if (map->entries != slot.data || map->capacity != slot.capacity ||
+      map->entries[slot.index].key != slot.entry_key) {
+    return false;
+  }
+  map->entries[slot.index].value = result;
+  return true;
+}
+
+Var varUpdateSubscript(PKVM* vm, Var on, Var key, Opcode op, Var current,
+                       Var value) {
+
+  // The operator could allocate (ex: a string concatenation) and trigger a
+  // garbage collection.
+  if (IS_OBJ(on)) vmPushTempRef(vm, AS_OBJ(on)); // on.
+  if (IS_OBJ(current)) vmPushTempRef(vm, AS_OBJ(current)); // current.
+  Var result = varBinaryOp(vm, op, current, value);
+  if (IS_OBJ(current)) vmPopTempRef(vm); // current.
+
+  if (VM_HAS_ERROR(vm)) {
+    vm->subscript_slot.on = NULL;
+
+  } else if (!_storeSubscriptSlot(vm, on, key, result)) {
+    if (IS_OBJ(result)) vmPushTempRef(vm, AS_OBJ(result)); // result.
+    varsetSubscript(vm, on, key, result);
+    if (IS_OBJ(result)) vmPopTempRef(vm); // result.
+  }
+
+  if (IS_OBJ(on)) vmPopTempRef(vm); // on.
+  return result;
+}
+
 #undef IS_NUM_BYTE
 
 #undef DOCSTRING
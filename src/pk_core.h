@@ -6,6 +6,7 @@
 #ifndef CORE_H
 #define CORE_H
 
+#include "pk_compiler.h"
 #include "pk_internal.h"
 #include "pk_var.h"
 
@@ -59,7 +60,18 @@ void varSetAttrib(PKVM* vm, Var on, String* name, Var value);
 // Returns the subscript value (ie. on[key]).
 Var varGetSubscript(PKVM* vm, Var on, Var key);
 
+// Same as varGetSubscript() but records the element's slot in the vm, for
+// the varUpdateSubscript() which follows it.
+Var varGetSubscriptKeep(PKVM* vm, Var on, Var key);
+
 // Set subscript [value] with the [key] (ie. on[key] = value).
 void varsetSubscript(PKVM* vm, Var on, Var key, Var value);
 
+// Apply the binary operator of the opcode [op] to the [current] subscript
+// value (read before the [value] was evaluated) and the [value], store the
+// result (ie. on[key] op= value) and returns it. The result is stored through
+// the slot of the varGetSubscriptKeep() unless the container was changed.
+Var varUpdateSubscript(PKVM* vm, Var on, Var key, Opcode op, Var current,
+                       Var value);
+
 #endif // CORE_H
@@ -7,6 +7,7 @@
 
 #include <stdio.h>
 #include "pk_core.h"
+#include "pk_utils.h"
 #include "pk_var.h"
 #include "pk_vm.h"
 
@@ -33,7 +34,7 @@ void dumpFunctionCode(PKVM* vm, Function* func, pkByteBuffer* buff) {
 
 #define INDENTATION "  "
 #define ADD_CHAR(vm, buff, c) pkByteBufferWrite(buff, vm, c)
-#define INT_WIDTH 5
+#define DUMP_INT_WIDTH 5
 #define ADD_INTEGER(vm, buff, value, width)                          \
   do {                                                               \
     char sbuff[STR_INT_BUFF_SIZE];                                   \
@@ -62,13 +63,13 @@ void dumpFunctionCode(PKVM* vm, Function* func, pkByteBuffer* buff) {
 #define NO_ARGS() ADD_CHAR(vm, buff, '\n')
 #define BYTE_ARG()                                 \
   do {                                             \
-    ADD_INTEGER(vm, buff, READ_BYTE(), INT_WIDTH); \
+    ADD_INTEGER(vm, buff, READ_BYTE(), DUMP_INT_WIDTH); \
     ADD_CHAR(vm, buff, '\n');                      \
   } while (false)
 
 #define SHORT_ARG()                                 \
   do {                                              \
-    ADD_INTEGER(vm, buff, READ_SHORT(), INT_WIDTH); \
+    ADD_INTEGER(vm, buff, READ_SHORT(), DUMP_INT_WIDTH); \
     ADD_CHAR(vm, buff, '\n');                       \
   } while (false)
 
@@ -80,7 +81,7 @@ void dumpFunctionCode(PKVM* vm, Function* func, pkByteBuffer* buff) {
     if (line != last_line) {
       last_line = line;
       pkByteBufferAddString(buff, vm, STR_AND_LEN(INDENTATION));
-      ADD_INTEGER(vm, buff, line, INT_WIDTH - 1);
+      ADD_INTEGER(vm, buff, line, DUMP_INT_WIDTH - 1);
       ADD_CHAR(vm, buff, ':');
 
     } else {
@@ -90,26 +91,29 @@ void dumpFunctionCode(PKVM* vm, Function* func, pkByteBuffer* buff) {
     // Prints: INDENTATION "%4d  %-16s"
 
     pkByteBufferAddString(buff, vm, STR_AND_LEN(INDENTATION));
-    ADD_INTEGER(vm, buff, i, INT_WIDTH - 1);
+    ADD_INTEGER(vm, buff, i, DUMP_INT_WIDTH - 1);
     pkByteBufferAddString(buff, vm, STR_AND_LEN("  "));
 
-    const char* op_name = op_names[opcodes[i]];
+    // If there is a breakpoint the original opcode will be printed.
+    Opcode op = debugGetOpcode(vm, func, i++);
+
+    const char* op_name = op_names[op];
     uint32_t op_length = (uint32_t)strlen(op_name);
     pkByteBufferAddString(buff, vm, op_name, op_length);
     for (uint32_t j = 0; j < 16 - op_length; j++) { // Padding.
       ADD_CHAR(vm, buff, ' ');
     }
 
-    Opcode op = (Opcode)func->fn->opcodes.data[i++];
     switch (op) {
       case OP_PUSH_CONSTANT:
+      case OP_CLONE_CONSTANT:
       {
         int index = READ_SHORT();
         ASSERT_INDEX((uint32_t)index, func->owner->literals.count);
         Var value = func->owner->literals.data[index];
 
         // Prints: %5d [val]\n
-        ADD_INTEGER(vm, buff, index, INT_WIDTH);
+        ADD_INTEGER(vm, buff, index, DUMP_INT_WIDTH);
         ADD_CHAR(vm, buff, ' ');
         dumpValue(vm, value, buff);
         ADD_CHAR(vm, buff, '\n');
@@ -134,13 +138,13 @@ void dumpFunctionCode(PKVM* vm, Function* func, pkByteBuffer* buff) {
         String* ty_name = func->owner->names.data[name_ind];
 
         // Prints: %5d [Ty:%s]\n
-        ADD_INTEGER(vm, buff, ty_index, INT_WIDTH);
+        ADD_INTEGER(vm, buff, ty_index, DUMP_INT_WIDTH);
         pkByteBufferAddString(buff, vm, STR_AND_LEN(" [Ty:"));
         pkByteBufferAddString(buff, vm, ty_name->data, ty_name->length);
         pkByteBufferAddString(buff, vm, STR_AND_LEN("]\n"));
         break;
       }
-      case OP_PUSH_MAP:      NO_ARGS();   break;
+      case OP_PUSH_MAP:      SHORT_ARG(); break;
       case OP_LIST_APPEND:   NO_ARGS();   break;
       case OP_MAP_INSERT:    NO_ARGS();   break;
       case OP_INST_APPEND:   NO_ARGS();   break;
@@ -160,11 +164,11 @@ void dumpFunctionCode(PKVM* vm, Function* func, pkByteBuffer* buff) {
         int arg;
         if (op == OP_PUSH_LOCAL_N) {
           arg = READ_BYTE();
-          ADD_INTEGER(vm, buff, arg, INT_WIDTH);
+          ADD_INTEGER(vm, buff, arg, DUMP_INT_WIDTH);
 
         } else {
           arg = (int)(op - OP_PUSH_LOCAL_0);
-          for (int j = 0; j < INT_WIDTH; j++) ADD_CHAR(vm, buff, ' ');
+          for (int j = 0; j < DUMP_INT_WIDTH; j++) ADD_CHAR(vm, buff, ' ');
         }
 
         if (arg < func->arity) {
@@ -193,11 +197,11 @@ void dumpFunctionCode(PKVM* vm, Function* func, pkByteBuffer* buff) {
         int arg;
         if (op == OP_STORE_LOCAL_N) {
           arg = READ_BYTE();
-          ADD_INTEGER(vm, buff, arg, INT_WIDTH);
+          ADD_INTEGER(vm, buff, arg, DUMP_INT_WIDTH);
 
         } else {
           arg = (int)(op - OP_STORE_LOCAL_0);
-          for (int j = 0; j < INT_WIDTH; j++) ADD_CHAR(vm, buff, ' ');
+          for (int j = 0; j < DUMP_INT_WIDTH; j++) ADD_CHAR(vm, buff, ' ');
         }
 
         if (arg < func->arity) {
@@ -220,7 +224,7 @@ void dumpFunctionCode(PKVM* vm, Function* func, pkByteBuffer* buff) {
         String* name = func->owner->names.data[name_index];
 
         // Prints: %5d '%s'\n
-        ADD_INTEGER(vm, buff, index, INT_WIDTH);
+        ADD_INTEGER(vm, buff, index, DUMP_INT_WIDTH);
         pkByteBufferAddString(buff, vm, STR_AND_LEN(" '"));
         pkByteBufferAddString(buff, vm, name->data, name->length);
         pkByteBufferAddString(buff, vm, STR_AND_LEN("'\n"));
@@ -233,7 +237,7 @@ void dumpFunctionCode(PKVM* vm, Function* func, pkByteBuffer* buff) {
         const char* name = func->owner->functions.data[fn_index]->name;
 
         // Prints: %5d [Fn:%s]\n
-        ADD_INTEGER(vm, buff, fn_index, INT_WIDTH);
+        ADD_INTEGER(vm, buff, fn_index, DUMP_INT_WIDTH);
         pkByteBufferAddString(buff, vm, STR_AND_LEN(" [Fn:"));
         pkByteBufferAddString(buff, vm, STR_AND_LEN(name));
         pkByteBufferAddString(buff, vm, STR_AND_LEN("]\n"));
@@ -249,7 +253,7 @@ void dumpFunctionCode(PKVM* vm, Function* func, pkByteBuffer* buff) {
         String* ty_name = func->owner->names.data[name_ind];
 
         // Prints: %5d [Ty:%s]\n
-        ADD_INTEGER(vm, buff, ty_index, INT_WIDTH);
+        ADD_INTEGER(vm, buff, ty_index, DUMP_INT_WIDTH);
         pkByteBufferAddString(buff, vm, STR_AND_LEN(" [Ty:"));
         pkByteBufferAddString(buff, vm, ty_name->data, ty_name->length);
         pkByteBufferAddString(buff, vm, STR_AND_LEN("]\n"));
@@ -263,7 +267,7 @@ void dumpFunctionCode(PKVM* vm, Function* func, pkByteBuffer* buff) {
         const char* name = getBuiltinFunctionName(vm, index);
 
         // Prints: %5d [Fn:%s]\n
-        ADD_INTEGER(vm, buff, index, INT_WIDTH);
+        ADD_INTEGER(vm, buff, index, DUMP_INT_WIDTH);
         pkByteBufferAddString(buff, vm, STR_AND_LEN(" [Fn:"));
         pkByteBufferAddString(buff, vm, STR_AND_LEN(name));
         pkByteBufferAddString(buff, vm, STR_AND_LEN("]\n"));
@@ -277,7 +281,7 @@ void dumpFunctionCode(PKVM* vm, Function* func, pkByteBuffer* buff) {
         String* name = func->owner->names.data[index];
 
         // Prints: %5d '%s'\n
-        ADD_INTEGER(vm, buff, index, INT_WIDTH);
+        ADD_INTEGER(vm, buff, index, DUMP_INT_WIDTH);
         pkByteBufferAddString(buff, vm, STR_AND_LEN(" '"));
         pkByteBufferAddString(buff, vm, name->data, name->length);
         pkByteBufferAddString(buff, vm, STR_AND_LEN("'\n"));
@@ -286,13 +290,13 @@ void dumpFunctionCode(PKVM* vm, Function* func, pkByteBuffer* buff) {
 
       case OP_CALL:
         // Prints: %5d (argc)\n
-        ADD_INTEGER(vm, buff, READ_BYTE(), INT_WIDTH);
+        ADD_INTEGER(vm, buff, READ_BYTE(), DUMP_INT_WIDTH);
         pkByteBufferAddString(buff, vm, STR_AND_LEN(" (argc)\n"));
         break;
 
       case OP_TAIL_CALL:
         // Prints: %5d (argc)\n
-        ADD_INTEGER(vm, buff, READ_BYTE(), INT_WIDTH);
+        ADD_INTEGER(vm, buff, READ_BYTE(), DUMP_INT_WIDTH);
         pkByteBufferAddString(buff, vm, STR_AND_LEN(" (argc)\n"));
         break;
 
@@ -306,19 +310,36 @@ void dumpFunctionCode(PKVM* vm, Function* func, pkByteBuffer* buff) {
         int offset = READ_SHORT();
 
         // Prints: %5d (ip:%d)\n
-        ADD_INTEGER(vm, buff, offset, INT_WIDTH);
+        ADD_INTEGER(vm, buff, offset, DUMP_INT_WIDTH);
         pkByteBufferAddString(buff, vm, STR_AND_LEN(" (ip:"));
         ADD_INTEGER(vm, buff, i + offset, 0);
         pkByteBufferAddString(buff, vm, STR_AND_LEN(")\n"));
         break;
       }
 
+      case OP_TABLE_JUMP:
+      case OP_MAP_JUMP:
+      {
+        int index = READ_SHORT();
+        int offset = READ_SHORT();
+
+        // Prints: %5d (default ip:%d)\n
+        ADD_INTEGER(vm, buff, index, DUMP_INT_WIDTH);
+        pkByteBufferAddString(buff, vm, STR_AND_LEN(" (default ip:"));
+        ADD_INTEGER(vm, buff, i + offset, 0);
+        pkByteBufferAddString(buff, vm, STR_AND_LEN(")\n"));
+        break;
+      }
+
+      case OP_NOP:   NO_ARGS(); break;
+      case OP_COVER: NO_ARGS(); break;
+
       case OP_LOOP:
       {
         int offset = READ_SHORT();
 
         // Prints: %5d (ip:%d)\n
-        ADD_INTEGER(vm, buff, -offset, INT_WIDTH);
+        ADD_INTEGER(vm, buff, -offset, DUMP_INT_WIDTH);
         pkByteBufferAddString(buff, vm, STR_AND_LEN(" (ip:"));
         ADD_INTEGER(vm, buff, i - offset, 0);
         pkByteBufferAddString(buff, vm, STR_AND_LEN(")\n"));
@@ -335,7 +356,7 @@ void dumpFunctionCode(PKVM* vm, Function* func, pkByteBuffer* buff) {
         String* name = func->owner->names.data[index];
 
         // Prints: %5d '%s'\n
-        ADD_INTEGER(vm, buff, index, INT_WIDTH);
+        ADD_INTEGER(vm, buff, index, DUMP_INT_WIDTH);
         pkByteBufferAddString(buff, vm, STR_AND_LEN(" '"));
         pkByteBufferAddString(buff, vm, name->data, name->length);
         pkByteBufferAddString(buff, vm, STR_AND_LEN("'\n"));
@@ -347,6 +368,18 @@ void dumpFunctionCode(PKVM* vm, Function* func, pkByteBuffer* buff) {
         NO_ARGS();
         break;
 
+      case OP_SUBSCRIPT_UPDATE:
+      {
+        int operator = READ_BYTE();
+
+        // Prints: %5d (%s)\n
+        ADD_INTEGER(vm, buff, operator, DUMP_INT_WIDTH);
+        pkByteBufferAddString(buff, vm, STR_AND_LEN(" ("));
+        pkByteBufferAddString(buff, vm, STR_AND_LEN(op_names[operator]));
+        pkByteBufferAddString(buff, vm, STR_AND_LEN(")\n"));
+        break;
+      }
+
       case OP_NEGATIVE:
       case OP_NOT:
       case OP_BIT_NOT:
@@ -368,11 +401,33 @@ void dumpFunctionCode(PKVM* vm, Function* func, pkByteBuffer* buff) {
       case OP_GTEQ:
       case OP_RANGE:
       case OP_IN:
+      case OP_ADD_NUM:
+      case OP_SUBTRACT_NUM:
+      case OP_MULTIPLY_NUM:
+      case OP_DIVIDE_NUM:
+      case OP_LT_NUM:
+      case OP_LTEQ_NUM:
+      case OP_GT_NUM:
+      case OP_GTEQ_NUM:
+      case OP_STR_LENGTH:
       case OP_REPL_PRINT:
       case OP_END:
         NO_ARGS();
         break;
 
+      case OP_CHECK_TYPE:
+      {
+        int type = READ_BYTE();
+        const char* name = getPkVarTypeName((PkVarType)type);
+
+        // Prints: %5d [Ty:%s]\n
+        ADD_INTEGER(vm, buff, type, DUMP_INT_WIDTH);
+        pkByteBufferAddString(buff, vm, STR_AND_LEN(" [Ty:"));
+        pkByteBufferAddString(buff, vm, STR_AND_LEN(name));
+        pkByteBufferAddString(buff, vm, STR_AND_LEN("]\n"));
+        break;
+      }
+
       default:
         UNREACHABLE();
         break;
@@ -455,4 +510,592 @@ void dumpStackFrame(PKVM* vm) {
   }
 }
 
+/*****************************************************************************/
+/* DEBUGGER                                                                  */
+/*****************************************************************************/
+
+DEFINE_BUFFER(BreakSite, BreakSite)
+DEFINE_BUFFER(Breakpoint, Breakpoint)
+
+// The size of the parameters of the opcodes in bytes.
+static const int op_param_sizes[] = {
+  #define OPCODE(name, params, stack) params,
+  #include "pk_opcodes.h"
+  #undef OPCODE
+};
+
+void debuggerInit(PKVM* vm) {
+  Debugger* debugger = &vm->debugger;
+  pkBreakpointBufferInit(&debugger->breakpoints);
+  pkBreakSiteBufferInit(&debugger->sites);
+  debugger->next_id = 1;
+  debugger->step = PK_DEBUG_CONTINUE;
+  debugger->step_fiber = NULL;
+  debugger->step_depth = 0;
+}
+
+void debuggerFree(PKVM* vm) {
+  Debugger* debugger = &vm->debugger;
+  for (uint32_t i = 0; i < debugger->breakpoints.count; i++) {
+    DEALLOCATE(vm, debugger->breakpoints.data[i].file);
+  }
+  pkBreakpointBufferClear(&debugger->breakpoints, vm);
+  pkBreakSiteBufferClear(&debugger->sites, vm);
+}
+
+// Returns the break site at the [offset] of the function [fn] or NULL if the
+// instruction isn't patched.
+static BreakSite* findSite(Debugger* debugger, const Function* fn,
+                           uint32_t offset) {
+  for (uint32_t i = 0; i < debugger->sites.count; i++) {
+    BreakSite* site = &debugger->sites.data[i];
+    if (site->fn == fn && site->offset == offset) return site;
+  }
+  return NULL;
+}
+
+// Restore the instruction of the break site at the [index] and remove it.
+static void removeSite(Debugger* debugger, uint32_t index) {
+  BreakSite* site = &debugger->sites.data[index];
+  site->fn->fn->opcodes.data[site->offset] = site->opcode;
+  debugger->sites.data[index] = debugger->sites.data[--debugger->sites.count];
+}
+
+// Patch the instruction at the [offset] of the function [fn] as a break site
+// of the [breakpoint], if it's 0 the site will be a temporary one of a step.
+static void patchSite(PKVM* vm, const Function* fn, uint32_t offset,
+                      int breakpoint) {
+  Debugger* debugger = &vm->debugger;
+
+  BreakSite* site = findSite(debugger, fn, offset);
+  if (site == NULL) {
+    BreakSite new_site;
+    new_site.fn = fn;
+    new_site.offset = offset;
+    new_site.opcode = fn->fn->opcodes.data[offset];
+    new_site.breakpoint = 0;
+    new_site.temporary = false;
+    pkBreakSiteBufferWrite(&debugger->sites, vm, new_site);
+
+    site = &debugger->sites.data[debugger->sites.count - 1];
+    fn->fn->opcodes.data[offset] = OP_BREAKPOINT;
+  }
+
+  if (breakpoint != 0) site->breakpoint = breakpoint;
+  else site->temporary = true;
+}
+
+Opcode debugGetOpcode(PKVM* vm, const Function* fn, uint32_t offset) {
+  uint8_t opcode = fn->fn->opcodes.data[offset];
+  if (opcode != OP_BREAKPOINT) return (Opcode)opcode;
+
+  BreakSite* site = findSite(&vm->debugger, fn, offset);
+  ASSERT(site != NULL, OOPS);
+  return (Opcode)site->opcode;
+}
+
+void debugForgetFunction(PKVM* vm, const Function* fn) {
+  Debugger* debugger = &vm->debugger;
+  uint32_t i = 0;
+  while (i < debugger->sites.count) {
+    if (debugger->sites.data[i].fn == fn) {
+      debugger->sites.data[i] = debugger->sites.data[--debugger->sites.count];
+    } else {
+      i++;
+    }
+  }
+}
+
+// Returns the offset of the instruction next to the one at the [offset].
+static uint32_t nextInstruction(PKVM* vm, const Function* fn,
+                                uint32_t offset) {
+  Opcode opcode = debugGetOpcode(vm, fn, offset);
+  return offset + 1 + (uint32_t)op_param_sizes[opcode];
+}
+
+// Patch a temporary break site at the first instruction of every line of the
+// function [fn].
+static void patchLineStarts(PKVM* vm, const Function* fn) {
+  const Fn* code = fn->fn;
+  uint32_t last_line = 0;
+
+  uint32_t i = 0;
+  while (i < code->opcodes.count) {
+    uint32_t line = code->oplines.data[i];
+    if (line != last_line && debugGetOpcode(vm, fn, i) != OP_END) {
+      patchSite(vm, fn, i, 0);
+    }
+    last_line = line;
+    i = nextInstruction(vm, fn, i);
+  }
+}
+
+// Patch the line starts of all the functions of the [script].
+static void patchScriptLines(PKVM* vm, Script* script) {
+  for (uint32_t i = 0; i < script->functions.count; i++) {
+    const Function* fn = script->functions.data[i];
+    if (!fn->is_native) patchLineStarts(vm, fn);
+  }
+}
+
+// Call the function [fn] for all the scripts and the modules of the VM.
+static void forEachScript(PKVM* vm, void (*fn)(PKVM* vm, Script* script)) {
+  Map* maps[] = { vm->scripts, vm->core_libs };
+  for (int i = 0; i < 2; i++) {
+    for (uint32_t j = 0; j < maps[i]->capacity; j++) {
+      if (IS_UNDEF(maps[i]->entries[j].key)) continue;
+      fn(vm, (Script*)AS_OBJ(maps[i]->entries[j].value));
+    }
+  }
+}
+
+// Patch a temporary break site at the return address of the caller of the
+// current frame (if there is one) to pause once the function returns.
+static void patchReturn(PKVM* vm) {
+  const Fiber* fiber = vm->fiber;
+  if (fiber == NULL || fiber->frame_count < 2) return;
+
+  const CallFrame* caller = &fiber->frames[fiber->frame_count - 2];
+  const uint8_t* opcodes = caller->fn->fn->opcodes.data;
+  patchSite(vm, caller->fn, (uint32_t)(caller->ip - opcodes), 0);
+}
+
+// Restore the temporary break sites of the last step.
+static void clearStep(Debugger* debugger) {
+  uint32_t i = 0;
+  while (i < debugger->sites.count) {
+    BreakSite* site = &debugger->sites.data[i];
+    if (site->temporary) {
+      site->temporary = false;
+      if (site->breakpoint == 0) {
+        removeSite(debugger, i);
+        continue;
+      }
+    }
+    i++;
+  }
+  debugger->step = PK_DEBUG_CONTINUE;
+}
+
+// Start the [step] from the current frame of the paused fiber.
+static void startStep(PKVM* vm, PkDebugAction step) {
+  Debugger* debugger = &vm->debugger;
+  if (step == PK_DEBUG_CONTINUE) return;
+
+  const Fiber* fiber = vm->fiber;
+  if (step == PK_DEBUG_STEP) {
+    forEachScript(vm, patchScriptLines);
+
+  } else if (step == PK_DEBUG_NEXT && fiber != NULL) {
+    patchLineStarts(vm, fiber->frames[fiber->frame_count - 1].fn);
+  }
+  patchReturn(vm);
+
+  debugger->step = step;
+  debugger->step_fiber = fiber;
+  debugger->step_depth = (fiber != NULL) ? fiber->frame_count : 0;
+}
+
+Opcode debugBreak(PKVM* vm, const Function* fn, uint32_t offset) {
+  Debugger* debugger = &vm->debugger;
+
+  BreakSite* site = findSite(debugger, fn, offset);
+  ASSERT(site != NULL, OOPS);
+
+  // The sites could be changed once paused, so keep the values here.
+  Opcode opcode = (Opcode)site->opcode;
+  int breakpoint = site->breakpoint;
+
+  bool pause = (breakpoint != 0);
+  if (!pause && site->temporary) {
+    const Fiber* fiber = vm->fiber;
+    bool same_fiber = (fiber == debugger->step_fiber);
+    switch (debugger->step) {
+      case PK_DEBUG_CONTINUE:
+        break;
+
+      case PK_DEBUG_STEP:
+        pause = true;
+        break;
+
+      // Lines of the deeper calls (recursion) of the function are skipped.
+      case PK_DEBUG_NEXT:
+        pause = !same_fiber || fiber->frame_count <= debugger->step_depth;
+        break;
+
+      case PK_DEBUG_FINISH:
+        pause = !same_fiber || fiber->frame_count < debugger->step_depth;
+        break;
+    }
+  }
+
+  if (!pause || vm->config.debug_fn == NULL) return opcode;
+
+  clearStep(debugger);
+  PkDebugAction action = vm->config.debug_fn(vm, breakpoint);
+  startStep(vm, action);
+
+  return opcode;
+}
+
+// Returns true if the [path] of a script ends with the [file] of a breakpoint
+// (as a whole path component).
+static bool pathMatches(const char* path, const char* file) {
+  size_t path_length = strlen(path), file_length = strlen(file);
+  if (file_length > path_length) return false;
+
+  const char* tail = path + path_length - file_length;
+  if (strcmp(tail, file) != 0) return false;
+  return tail == path || tail[-1] == '/' || tail[-1] == '\\';
+}
+
+// Set the break sites of the [breakpoint] in the [script] if it's path
+// matches. The sites are the first instructions of the breakpoint's line (or
+// the next line that has instructions) in every function of the script.
+static void resolveBreakpoint(PKVM* vm, const Breakpoint* breakpoint,
+                              Script* script) {
+  if (!pathMatches(script->path->data, breakpoint->file)) return;
+
+  uint32_t line = UINT32_MAX;
+  for (uint32_t i = 0; i < script->functions.count; i++) {
+    const Function* fn = script->functions.data[i];
+    if (fn->is_native) continue;
+
+    for (uint32_t j = 0; j < fn->fn->opcodes.count;
+         j = nextInstruction(vm, fn, j)) {
+      uint32_t op_line = fn->fn->oplines.data[j];
+      if (op_line >= (uint32_t)breakpoint->line && op_line < line &&
+          debugGetOpcode(vm, fn, j) != OP_END) {
+        line = op_line;
+      }
+    }
+  }
+  if (line == UINT32_MAX) return;
+
+  for (uint32_t i = 0; i < script->functions.count; i++) {
+    const Function* fn = script->functions.data[i];
+    if (fn->is_native) continue;
+
+    for (uint32_t j = 0; j < fn->fn->opcodes.count;
+         j = nextInstruction(vm, fn, j)) {
+      if (fn->fn->oplines.data[j] == line &&
+          debugGetOpcode(vm, fn, j) != OP_END) {
+        patchSite(vm, fn, j, breakpoint->id);
+        break;
+      }
+    }
+  }
+}
+
+void debugPatchScript(PKVM* vm, Script* script) {
+  Debugger* debugger = &vm->debugger;
+  for (uint32_t i = 0; i < debugger->breakpoints.count; i++) {
+    resolveBreakpoint(vm, &debugger->breakpoints.data[i], script);
+  }
+
+  // If it's stepping into the calls, the script could be called.
+  if (debugger->step == PK_DEBUG_STEP) patchScriptLines(vm, script);
+}
+
+// Returns the call frame of the paused fiber at the [depth] (0 is the top
+// most one) or NULL if it's out of range.
+static const CallFrame* getFrame(const PKVM* vm, int depth) {
+  const Fiber* fiber = vm->fiber;
+  if (fiber == NULL || depth < 0 || depth >= fiber->frame_count) return NULL;
+  return &fiber->frames[fiber->frame_count - 1 - depth];
+}
+
+// pkDebugSetBreakpoint implementation (see pocketlang.h for description).
+int pkDebugSetBreakpoint(PKVM* vm, const char* file, int line) {
+  __ASSERT(file != NULL, "Argument file was NULL.");
+  Debugger* debugger = &vm->debugger;
+
+  size_t length = strlen(file);
+  Breakpoint breakpoint;
+  breakpoint.id = debugger->next_id++;
+  breakpoint.line = line;
+  breakpoint.file = ALLOCATE_ARRAY(vm, char, length + 1);
+  memcpy(breakpoint.file, file, length + 1);
+  pkBreakpointBufferWrite(&debugger->breakpoints, vm, breakpoint);
+
+  // Resolve it in the scripts which are already compiled.
+  forEachScript(vm, debugPatchScript);
+
+  return breakpoint.id;
+}
+
+// pkDebugRemoveBreakpoint implementation (see pocketlang.h for description).
+bool pkDebugRemoveBreakpoint(PKVM* vm, int id) {
+  Debugger* debugger = &vm->debugger;
+
+  uint32_t index = 0;
+  while (index < debugger->breakpoints.count &&
+         debugger->breakpoints.data[index].id != id) {
+    index++;
+  }
+  if (index == debugger->breakpoints.count) return false;
+
+  DEALLOCATE(vm, debugger->breakpoints.data[index].file);
+  memmove(debugger->breakpoints.data + index,
+          debugger->breakpoints.data + index + 1,
+          sizeof(Breakpoint) * (debugger->breakpoints.count - index - 1));
+  debugger->breakpoints.count--;
+
+  uint32_t i = 0;
+  while (i < debugger->sites.count) {
+    BreakSite* site = &debugger->sites.data[i];
+    if (site->breakpoint == id) {
+      site->breakpoint = 0;
+      if (!site->temporary) {
+        removeSite(debugger, i);
+        continue;
+      }
+    }
+    i++;
+  }
+
+  // Another breakpoint could be resolved to the same sites, set them again.
+  if (debugger->breakpoints.count > 0) forEachScript(vm, debugPatchScript);
+
+  return true;
+}
+
+// pkDebugPause implementation (see pocketlang.h for description).
+void pkDebugPause(PKVM* vm) {
+  clearStep(&vm->debugger);
+  startStep(vm, PK_DEBUG_STEP);
+}
+
+// pkDebugGetFrameCount implementation (see pocketlang.h for description).
+int pkDebugGetFrameCount(const PKVM* vm) {
+  return (vm->fiber != NULL) ? vm->fiber->frame_count : 0;
+}
+
+// pkDebugGetFrame implementation (see pocketlang.h for description).
+bool pkDebugGetFrame(const PKVM* vm, int depth, PkDebugFrame* frame) {
+  const CallFrame* call = getFrame(vm, depth);
+  if (call == NULL) return false;
+
+  // The ip points to the next byte of the current instruction's opcode (or
+  // after the call instruction for the callers).
+  const Function* fn = call->fn;
+  uint32_t offset = (uint32_t)(call->ip - fn->fn->opcodes.data);
+  if (offset > 0) offset--;
+
+  // The slots of the frame ends where the frame above it starts.
+  const Var* end = (depth == 0) ? vm->fiber->sp
+                                 : getFrame(vm, depth - 1)->rbp;
+
+  frame->name = fn->name;
+  frame->file = fn->owner->path->data;
+  frame->line = (int)fn->fn->oplines.data[offset];
+  frame->arity = fn->arity;
+  frame->slots = (int)(end - (call->rbp + 1));
+  return true;
+}
+
+// pkDebugGetSlot implementation (see pocketlang.h for description).
+PkVar pkDebugGetSlot(const PKVM* vm, int depth, int index) {
+  PkDebugFrame frame;
+  if (!pkDebugGetFrame(vm, depth, &frame)) return NULL;
+  if (index < 0 || index >= frame.slots) return NULL;
+
+  // rbp[0] is the return value, the slots starts from rbp[1].
+  return &getFrame(vm, depth)->rbp[index + 1];
+}
+
+// pkDebugGetGlobal implementation (see pocketlang.h for description).
+PkVar pkDebugGetGlobal(const PKVM* vm, int depth, int index,
+                       const char** name) {
+  const CallFrame* call = getFrame(vm, depth);
+  if (call == NULL) return NULL;
+
+  Script* script = call->fn->owner;
+  if (index < 0 || (uint32_t)index >= script->globals.count) return NULL;
+
+  if (name != NULL) {
+    *name = script->names.data[script->global_names.data[index]]->data;
+  }
+  return &script->globals.data[index];
+}
+
+// pkDebugWriteValue implementation (see pocketlang.h for description).
+void pkDebugWriteValue(PKVM* vm, PkVar value) {
+  __ASSERT(value != NULL, "Argument value was NULL.");
+  if (vm->config.write_fn == NULL) return;
+
+  String* repr = toRepr(vm, *(Var*)value);
+  vmPushTempRef(vm, &repr->_super); // repr.
+  vm->config.write_fn(vm, repr->data);
+  vmPopTempRef(vm); // repr.
+}
+
+/*****************************************************************************/
+/* COVERAGE                                                                  */
+/*****************************************************************************/
+
+// Compare function of qsort() for the line numbers.
+static int compareLines(const void* a, const void* b) {
+  uint32_t line_a = *(const uint32_t*)a, line_b = *(const uint32_t*)b;
+  return (line_a > line_b) - (line_a < line_b);
+}
+
+void coverageInitFunction(PKVM* vm, const Function* fn) {
+  Fn* code = fn->fn;
+  pkUintBufferClear(&code->cover_lines, vm);
+  pkByteBufferClear(&code->cover_bits, vm);
+
+  for (uint32_t i = 0; i < code->opcodes.count;
+       i = nextInstruction(vm, fn, i)) {
+    if (debugGetOpcode(vm, fn, i) == OP_COVER) {
+      pkUintBufferWrite(&code->cover_lines, vm, code->oplines.data[i]);
+    }
+  }
+
+  // Sort the lines and remove the duplicates (a line could have multiple
+  // statements) so the line of a hit could be binary searched.
+  uint32_t* lines = code->cover_lines.data;
+  uint32_t count = code->cover_lines.count;
+  if (count == 0) return;
+
+  qsort(lines, count, sizeof(uint32_t), compareLines);
+  uint32_t unique = 1;
+  for (uint32_t i = 1; i < count; i++) {
+    if (lines[i] != lines[unique - 1]) lines[unique++] = lines[i];
+  }
+  code->cover_lines.count = unique;
+
+  pkByteBufferFill(&code->cover_bits, vm, 0, (int)(unique + 7) / 8);
+}
+
+void coverageHit(const Function* fn, uint32_t offset) {
+  Fn* code = fn->fn;
+  uint32_t line = code->oplines.data[offset];
+
+  uint32_t low = 0, high = code->cover_lines.count;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (code->cover_lines.data[mid] < line) low = mid + 1;
+    else high = mid;
+  }
+
+  if (low < code->cover_lines.count && code->cover_lines.data[low] == line) {
+    code->cover_bits.data[low / 8] |= (uint8_t)(1 << (low % 8));
+  }
+}
+
+// Write the coverage of the [script] to the [buff] in the [format], if none
+// of it's functions are compiled with the coverage option nothing will be
+// written. [first] is true if it's the first script of the report.
+static void writeScriptCoverage(PKVM* vm, Script* script,
+                                PkCoverageFormat format, bool* first,
+                                pkByteBuffer* buff) {
+
+  // The lines of all the functions are collected as (line << 1 | hit) and
+  // sorted, the same line could be in multiple functions (lambdas).
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < script->functions.count; i++) {
+    const Function* fn = script->functions.data[i];
+    if (!fn->is_native) count += fn->fn->cover_lines.count;
+  }
+  if (count == 0) return;
+
+  uint32_t* lines = ALLOCATE_ARRAY(vm, uint32_t, count);
+  count = 0;
+  for (uint32_t i = 0; i < script->functions.count; i++) {
+    const Function* fn = script->functions.data[i];
+    if (fn->is_native) continue;
+
+    const Fn* code = fn->fn;
+    for (uint32_t j = 0; j < code->cover_lines.count; j++) {
+      uint32_t hit = (code->cover_bits.data[j / 8] >> (j % 8)) & 1;
+      lines[count++] = code->cover_lines.data[j] << 1 | hit;
+    }
+  }
+  qsort(lines, count, sizeof(uint32_t), compareLines);
+
+  // Merge the entries of the same line, it's executed if any of them is.
+  uint32_t unique = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    if (unique > 0 && (lines[unique - 1] >> 1) == (lines[i] >> 1)) {
+      lines[unique - 1] |= lines[i] & 1;
+    } else {
+      lines[unique++] = lines[i];
+    }
+  }
+
+  const char* path = script->path->data;
+  char num[64];
+
+  if (format == PK_COVERAGE_LCOV) {
+    pkByteBufferAddString(buff, vm, "SF:", 3);
+    pkByteBufferAddString(buff, vm, path, script->path->length);
+
+    uint32_t hits = 0;
+    for (uint32_t i = 0; i < unique; i++) {
+      hits += lines[i] & 1;
+      int length = sprintf(num, "\nDA:%u,%u", lines[i] >> 1, lines[i] & 1);
+      pkByteBufferAddString(buff, vm, num, (uint32_t)length);
+    }
+
+    int length = sprintf(num, "\nLF:%u\nLH:%u\n", unique, hits);
+    pkByteBufferAddString(buff, vm, num, (uint32_t)length);
+    pkByteBufferAddString(buff, vm, "end_of_record\n", 14);
+
+  } else {
+    if (!*first) pkByteBufferWrite(buff, vm, ',');
+    pkByteBufferAddString(buff, vm, "\n  \"", 4);
+    for (const char* c = path; *c != '\0'; c++) {
+      if (*c == '"' || *c == '\\') pkByteBufferWrite(buff, vm, '\\');
+      pkByteBufferWrite(buff, vm, (uint8_t)*c);
+    }
+    pkByteBufferAddString(buff, vm, "\": {", 4);
+
+    for (uint32_t i = 0; i < unique; i++) {
+      int length = sprintf(num, "%s\"%u\": %u", (i == 0) ? "" : ", ",
+                           lines[i] >> 1, lines[i] & 1);
+      pkByteBufferAddString(buff, vm, num, (uint32_t)length);
+    }
+    pkByteBufferWrite(buff, vm, '}');
+  }
+
+  *first = false;
+  DEALLOCATE(vm, lines);
+}
+
+// pkGetCoverage implementation (see pocketlang.h for description).
+PkHandle* pkGetCoverage(PKVM* vm, PkCoverageFormat format) {
+  pkByteBuffer buff;
+  pkByteBufferInit(&buff);
+
+  if (format == PK_COVERAGE_LCOV) {
+    pkByteBufferAddString(&buff, vm, "TN:\n", 4);
+  } else {
+    pkByteBufferWrite(&buff, vm, '{');
+  }
+
+  bool first = true;
+  Map* maps[] = { vm->scripts, vm->core_libs };
+  for (int i = 0; i < 2; i++) {
+    for (uint32_t j = 0; j < maps[i]->capacity; j++) {
+      if (IS_UNDEF(maps[i]->entries[j].key)) continue;
+      Script* script = (Script*)AS_OBJ(maps[i]->entries[j].value);
+      writeScriptCoverage(vm, script, format, &first, &buff);
+    }
+  }
+
+  if (format == PK_COVERAGE_JSON) {
+    if (!first) pkByteBufferWrite(&buff, vm, '\n');
+    pkByteBufferAddString(&buff, vm, "}\n", 2);
+  }
+
+  String* report = newStringLength(vm, (const char*)buff.data, buff.count);
+  pkByteBufferClear(&buff, vm);
+
+  vmPushTempRef(vm, &report->_super); // report.
+  PkHandle* handle = vmNewHandle(vm, VAR_OBJ(report));
+  vmPopTempRef(vm); // report.
+  return handle;
+}
+
 #undef _STR_AND_LEN
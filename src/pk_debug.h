@@ -6,9 +6,87 @@
 #ifndef DEBUG_H
 #define DEBUG_H
 
+#include "pk_compiler.h"
 #include "pk_internal.h"
 #include "pk_var.h"
 
+// The debugger sets a breakpoint by writing OP_BREAKPOINT over the first byte
+// of an instruction (a break site) and keeps the original opcode in the side
+// table below, so the code without any breakpoints runs without any overhead.
+// Single stepping is done the same way with temporary break sites at the
+// start of the lines (and the return address of the caller) which are
+// restored once the execution is paused.
+
+// A patched instruction of a function.
+typedef struct {
+  const Function* fn; //< The function of the instruction.
+  uint32_t offset;    //< Offset of the instruction in the opcodes.
+  uint8_t opcode;     //< The original opcode of the instruction.
+  int breakpoint;     //< Id of the breakpoint of the site (0 if none).
+  bool temporary;     //< True if it's a break site of a step.
+} BreakSite;
+
+// A breakpoint set by the host. The [file] is matched with the end of the
+// script paths so it's resolved once a matching script is compiled.
+typedef struct {
+  int id;      //< Id of the breakpoint (> 0).
+  char* file;  //< Path (or the end of it) of the script.
+  int line;    //< Line number of the breakpoint.
+} Breakpoint;
+
+DECLARE_BUFFER(BreakSite, BreakSite)
+DECLARE_BUFFER(Breakpoint, Breakpoint)
+
+// The state of the debugger, a member of the PKVM.
+typedef struct {
+  pkBreakpointBuffer breakpoints;
+  pkBreakSiteBuffer sites;
+
+  // The id of the next breakpoint.
+  int next_id;
+
+  // The step which is in progress, the fiber and it's frame count when the
+  // step was started (the fiber is only used to compare).
+  PkDebugAction step;
+  const Fiber* step_fiber;
+  int step_depth;
+} Debugger;
+
+// Initialize the debugger of the [vm].
+void debuggerInit(PKVM* vm);
+
+// Free the breakpoints and the break sites of the [vm] (the patched functions
+// won't be restored).
+void debuggerFree(PKVM* vm);
+
+// Called by the VM when it executes an OP_BREAKPOINT at the [offset] of the
+// function [fn]. It'll pause the execution if it should (by calling the
+// host's debug callback) and returns the original opcode to be executed.
+Opcode debugBreak(PKVM* vm, const Function* fn, uint32_t offset);
+
+// Returns the original opcode of the instruction at the [offset] of the
+// function [fn] (the byte could be OP_BREAKPOINT if it's patched).
+Opcode debugGetOpcode(PKVM* vm, const Function* fn, uint32_t offset);
+
+// Remove the break sites of the function [fn] without restoring them (called
+// before the function is freed or it's opcodes are discarded).
+void debugForgetFunction(PKVM* vm, const Function* fn);
+
+// Set the break sites of the breakpoints matching the [script] once it's
+// compiled.
+void debugPatchScript(PKVM* vm, Script* script);
+
+// If a script is compiled with the coverage option, an OP_COVER is emitted at
+// the start of every statement which sets the bit of it's line in the bitmap
+// of the function and rewrite itself into OP_NOP.
+
+// Collect the lines of the OP_COVER instructions of the function [fn] once
+// it's compiled and clear its bitmap.
+void coverageInitFunction(PKVM* vm, const Function* fn);
+
+// Set the line of the OP_COVER at the [offset] of the function [fn] executed.
+void coverageHit(const Function* fn, uint32_t offset);
+
 // Dump the value of the [value] without a new line at the end to the buffer
 // [buff]. Note that this will not write a null byte at of the buffer
 // (unlike dumpFunctionCode).
@@ -0,0 +1,1298 @@
+/*
+ *  Copyright (c) 2020-2021 Thakee Nathees
+ *  Distributed Under The MIT License
+ */
+
+// Ahead of time translation of the compiled bytecode into C. Every named
+// function of a script is translated into a C function where the stack slots
+// of the function live on the fiber's stack (so the garbage collector can see
+// them), the jumps become labels and gotos, and the instructions become direct
+// calls to the same runtime helpers the VM uses, with the number fast paths
+// inlined. The result is a native module, which can be compiled along with the
+// pocketlang sources and registered to a VM with a single function call.
+//
+// Only the functions which are "self contained" can be translated, ie. the
+// ones which doesn't use globals, imports, iterators, classes and lambdas and
+// only calls builtin functions or other translated functions of the same
+// script. Other functions are skipped and listed at the top of the generated
+// source.
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "pk_core.h"
+#include "pk_utils.h"
+#include "pk_vm.h"
+
+// Slot tag of a value which isn't a function we know at compile time.
+#define TAG_NONE -1
+
+// Slot tag of a value which could be different functions depending on the
+// path the execution reached the instruction.
+#define TAG_MIXED -2
+
+// Slot tags of the builtin functions, script functions are tagged with their
+// index in the script's function buffer.
+#define TAG_BUILTIN(index) (-3 - (index))
+#define IS_TAG_BUILTIN(tag) ((tag) <= -3)
+
+// Number of parameter bytes of each opcodes.
+static const int op_params[] = {
+  #define OPCODE(name, params, stack) params,
+  #include "pk_opcodes.h"
+  #undef OPCODE
+};
+
+// The result of the bytecode analysis of a function.
+typedef struct {
+  bool supported;  //< True if the function can be translated.
+  int frame_size;  //< Number of stack slots the function needs.
+
+  int* depths;     //< Stack depth before each instruction, -1 = unreachable.
+  int* tags;       //< [frame_size] slot tags before each instruction.
+  bool* targets;   //< True if the instruction is a jump target.
+
+  bool self_tail_call; //< True if the function has a tail call to itself.
+} FnInfo;
+
+typedef struct {
+  PKVM* vm;
+  Script* script;
+  FnInfo* infos;         //< Analysis result of each function of the script.
+
+  pkByteBuffer out;      //< The generated C source.
+  pkStringBuffer strings; //< String literals and names used by the source.
+  pkUintBuffer builtins; //< Indexes of the builtin functions used.
+} EmitC;
+
+/*****************************************************************************/
+/* ANALYSIS                                                                  */
+/*****************************************************************************/
+
+// Returns true if the function is a named function which could be registered
+// to the native module (not the script body, lambdas or constructors).
+static bool isNamedFunction(const Function* fn) {
+  return !fn->is_native && fn->name[0] != '$' && fn->arity >= 0;
+}
+
+// Merge the [depth] and [tags] to the instruction at [ip] and add it to the
+// worklist if it's state has been changed. Returns false if the stack depth
+// isn't the same as it reached from another path.
+static bool analyzeMerge(FnInfo* info, int ip, int depth, const int* tags,
+                         int* worklist, int* worklist_count) {
+  int* target = info->tags + ip * info->frame_size;
+
+  if (info->depths[ip] == -1) {
+    info->depths[ip] = depth;
+    memcpy(target, tags, sizeof(int) * depth);
+    worklist[(*worklist_count)++] = ip;
+    return true;
+  }
+
+  if (info->depths[ip] != depth) return false;
+
+  bool changed = false;
+  for (int i = 0; i < depth; i++) {
+    if (target[i] != tags[i] && target[i] != TAG_MIXED) {
+      target[i] = TAG_MIXED;
+      changed = true;
+    }
+  }
+  if (changed) worklist[(*worklist_count)++] = ip;
+  return true;
+}
+
+// Walk through all the reachable instructions of the function and compute
+// the stack depth and the slot tags before each of them. Returns false if the
+// function uses an instruction or a value that can't be translated.
+// Returns true if the [value] can be written as a C expression in the
+// generated code (see emitValue()).
+static bool isTranslatableValue(Var value) {
+  return IS_NULL(value) || IS_BOOL(value) || IS_NUM(value) ||
+         IS_OBJ_TYPE(value, OBJ_STRING);
+}
+
+// Returns true if all the elements of the list or map constant [value] of a
+// CLONE_CONSTANT instruction are translatable values.
+static bool isTranslatableContainer(Var value) {
+  if (IS_OBJ_TYPE(value, OBJ_LIST)) {
+    const List* list = (const List*)AS_OBJ(value);
+    for (uint32_t i = 0; i < list->elements.count; i++) {
+      if (!isTranslatableValue(list->elements.data[i])) return false;
+    }
+    return true;
+  }
+
+  const Map* map = (const Map*)AS_OBJ(value);
+  for (uint32_t i = 0; i < map->capacity; i++) {
+    const MapEntry* entry = &map->entries[i];
+    if (IS_UNDEF(entry->key)) continue;
+    if (!isTranslatableValue(entry->key)) return false;
+    if (!isTranslatableValue(entry->value)) return false;
+  }
+  return true;
+}
+
+static bool analyzeFunction(EmitC* emitter, const Function* func,
+                            FnInfo* info) {
+  PKVM* vm = emitter->vm;
+  Script* script = emitter->script;
+
+  const uint8_t* opcodes = func->fn->opcodes.data;
+  int count = (int)func->fn->opcodes.count;
+
+  info->frame_size = func->fn->stack_size + 1;
+  if (info->frame_size <= func->arity) info->frame_size = func->arity + 1;
+
+  info->depths = ALLOCATE_ARRAY(vm, int, count);
+  info->tags = ALLOCATE_ARRAY(vm, int, count * info->frame_size);
+  info->targets = ALLOCATE_ARRAY(vm, bool, count);
+  for (int i = 0; i < count; i++) {
+    info->depths[i] = -1;
+    info->targets[i] = false;
+  }
+
+  if (!isNamedFunction(func)) return false;
+
+  // Every state change pushes one entry and a slot tag could only change once
+  // (to TAG_MIXED) so this bounds the worklist size.
+  int worklist_size = count * (info->frame_size + 1) + 1;
+  int* worklist = ALLOCATE_ARRAY(vm, int, worklist_size);
+  int worklist_count = 0;
+
+  int* tags = ALLOCATE_ARRAY(vm, int, info->frame_size + 1);
+  for (int i = 0; i < func->arity; i++) tags[i] = TAG_NONE;
+
+  bool supported = analyzeMerge(info, 0, func->arity, tags,
+                                worklist, &worklist_count);
+
+  while (supported && worklist_count > 0) {
+    int ip = worklist[--worklist_count];
+    int depth = info->depths[ip];
+    memcpy(tags, info->tags + ip * info->frame_size, sizeof(int) * depth);
+
+    Opcode op = (Opcode)opcodes[ip];
+    int next = ip + 1 + op_params[op];
+
+#define SHORT_ARG(offset) \
+  ((uint16_t)((opcodes[ip + (offset)] << 8) | opcodes[ip + (offset) + 1]))
+
+    // The number of stack top values the instruction reads, pops and pushes.
+    int reads = 0, pops = 0, pushes = 0, push_tag = TAG_NONE;
+    bool falls_through = true; //< The next instruction is a successor.
+
+    // The jump targets of the instruction (other than the next one).
+    int jump_targets[2] = { 0, 0 }, jump_count = 0;
+    const List* table = NULL;
+
+    switch (op) {
+      case OP_PUSH_CONSTANT:
+      {
+        Var value = script->literals.data[SHORT_ARG(1)];
+        if (!IS_NUM(value) && !IS_OBJ_TYPE(value, OBJ_STRING)) {
+          supported = false;
+        }
+        pushes = 1;
+      } break;
+
+      case OP_PUSH_NULL:
+      case OP_PUSH_0:
+      case OP_PUSH_TRUE:
+      case OP_PUSH_FALSE:
+      case OP_PUSH_LIST:
+      case OP_PUSH_MAP:
+        pushes = 1;
+        break;
+
+      case OP_CLONE_CONSTANT:
+      {
+        Var value = script->literals.data[SHORT_ARG(1)];
+        if (!isTranslatableContainer(value)) supported = false;
+        pushes = 1;
+      } break;
+
+      case OP_SWAP:
+      {
+        if (depth < 2) { supported = false; break; }
+        int tmp = tags[depth - 1];
+        tags[depth - 1] = tags[depth - 2];
+        tags[depth - 2] = tmp;
+      } break;
+
+      case OP_LIST_APPEND: reads = 2; pops = 1; break;
+      case OP_MAP_INSERT:  reads = 3; pops = 2; break;
+
+      case OP_PUSH_LOCAL_0:
+      case OP_PUSH_LOCAL_1:
+      case OP_PUSH_LOCAL_2:
+      case OP_PUSH_LOCAL_3:
+      case OP_PUSH_LOCAL_4:
+      case OP_PUSH_LOCAL_5:
+      case OP_PUSH_LOCAL_6:
+      case OP_PUSH_LOCAL_7:
+      case OP_PUSH_LOCAL_8:
+      case OP_PUSH_LOCAL_N:
+      {
+        int index = (op == OP_PUSH_LOCAL_N) ? opcodes[ip + 1]
+                                            : (int)(op - OP_PUSH_LOCAL_0);
+        if (index >= depth || tags[index] != TAG_NONE) supported = false;
+        pushes = 1;
+      } break;
+
+      case OP_STORE_LOCAL_0:
+      case OP_STORE_LOCAL_1:
+      case OP_STORE_LOCAL_2:
+      case OP_STORE_LOCAL_3:
+      case OP_STORE_LOCAL_4:
+      case OP_STORE_LOCAL_5:
+      case OP_STORE_LOCAL_6:
+      case OP_STORE_LOCAL_7:
+      case OP_STORE_LOCAL_8:
+      case OP_STORE_LOCAL_N:
+      {
+        int index = (op == OP_STORE_LOCAL_N) ? opcodes[ip + 1]
+                                             : (int)(op - OP_STORE_LOCAL_0);
+        if (index >= depth) supported = false;
+        else tags[index] = TAG_NONE;
+        reads = 1;
+      } break;
+
+      case OP_PUSH_FN:
+        pushes = 1;
+        push_tag = opcodes[ip + 1];
+        break;
+
+      case OP_PUSH_BUILTIN_FN:
+      {
+        // yield() switches the running fiber which we can't do in the middle
+        // of a C function.
+        int index = opcodes[ip + 1];
+        if (strcmp(getBuiltinFunctionName(vm, index), "yield") == 0) {
+          supported = false;
+        }
+        pushes = 1;
+        push_tag = TAG_BUILTIN(index);
+      } break;
+
+      case OP_POP: pops = 1; break;
+
+      case OP_CALL:
+      case OP_TAIL_CALL:
+      {
+        int argc = opcodes[ip + 1];
+        if (depth < argc + 1) { supported = false; break; }
+
+        int tag = tags[depth - argc - 1];
+        if (tag < 0 && !IS_TAG_BUILTIN(tag)) supported = false;
+
+        if (tag >= 0 && op == OP_TAIL_CALL && argc == func->arity &&
+            script->functions.data[tag] == func) {
+          info->self_tail_call = true;
+        }
+
+        // The callable isn't a read, it's been resolved at compile time.
+        tags[depth - argc - 1] = TAG_NONE;
+        reads = argc; pops = argc + 1; pushes = 1;
+
+        // The tail call returns the callee's return value.
+        if (op == OP_TAIL_CALL) falls_through = false;
+      } break;
+
+      case OP_JUMP:
+        jump_targets[jump_count++] = next + SHORT_ARG(1);
+        falls_through = false;
+        break;
+
+      case OP_LOOP:
+        jump_targets[jump_count++] = next - SHORT_ARG(1);
+        falls_through = false;
+        break;
+
+      case OP_JUMP_IF:
+      case OP_JUMP_IF_NOT:
+        jump_targets[jump_count++] = next + SHORT_ARG(1);
+        reads = 1; pops = 1;
+        break;
+
+      case OP_TABLE_JUMP:
+      {
+        Var literal = script->literals.data[SHORT_ARG(1)];
+        ASSERT(IS_OBJ_TYPE(literal, OBJ_LIST), OOPS);
+        table = (const List*)AS_OBJ(literal);
+        jump_targets[jump_count++] = next + SHORT_ARG(3);
+        falls_through = false;
+        reads = 1; pops = 1;
+      } break;
+
+      case OP_NOP:
+        break;
+
+      case OP_RETURN:
+        if (depth > 0) reads = 1;
+        falls_through = false;
+        break;
+
+      case OP_END:
+        falls_through = false;
+        break;
+
+      case OP_GET_ATTRIB:         reads = 1; break;
+      case OP_GET_ATTRIB_KEEP:    reads = 1; pushes = 1; break;
+      case OP_SET_ATTRIB:         reads = 2; pops = 1; break;
+      case OP_GET_SUBSCRIPT:      reads = 2; pops = 1; break;
+      case OP_GET_SUBSCRIPT_KEEP: reads = 2; pushes = 1; break;
+      case OP_SET_SUBSCRIPT:      reads = 3; pops = 2; break;
+      case OP_SUBSCRIPT_UPDATE:   reads = 4; pops = 3; break;
+
+      case OP_NEGATIVE:
+      case OP_NOT:
+      case OP_BIT_NOT:
+      case OP_STR_LENGTH:
+      case OP_CHECK_TYPE:
+        reads = 1;
+        break;
+
+      case OP_ADD:
+      case OP_SUBTRACT:
+      case OP_MULTIPLY:
+      case OP_DIVIDE:
+      case OP_MOD:
+      case OP_BIT_AND:
+      case OP_BIT_OR:
+      case OP_BIT_XOR:
+      case OP_BIT_LSHIFT:
+      case OP_BIT_RSHIFT:
+      case OP_EQEQ:
+      case OP_NOTEQ:
+      case OP_LT:
+      case OP_LTEQ:
+      case OP_GT:
+      case OP_GTEQ:
+      case OP_RANGE:
+      case OP_IN:
+      case OP_ADD_NUM:
+      case OP_SUBTRACT_NUM:
+      case OP_MULTIPLY_NUM:
+      case OP_DIVIDE_NUM:
+      case OP_LT_NUM:
+      case OP_LTEQ_NUM:
+      case OP_GT_NUM:
+      case OP_GTEQ_NUM:
+        reads = 2; pops = 1;
+        break;
+
+      // Globals, imports, iterators, classes and instances are not supported.
+      default:
+        supported = false;
+        break;
+    }
+
+#undef SHORT_ARG
+
+    if (!supported) break;
+
+    // Functions can only be called, using them as a value isn't supported.
+    if (depth < reads || depth < pops) { supported = false; break; }
+    for (int i = depth - reads; i < depth; i++) {
+      if (tags[i] != TAG_NONE) supported = false;
+    }
+    if (!supported) break;
+
+    depth -= pops;
+    if (depth + pushes >= info->frame_size) { supported = false; break; }
+    for (int i = 0; i < pushes; i++) tags[depth++] = push_tag;
+
+    if (table != NULL) {
+      for (uint32_t i = 1; i < table->elements.count && supported; i++) {
+        int target = next + (int)AS_NUM(table->elements.data[i]);
+        info->targets[target] = true;
+        supported = analyzeMerge(info, target, depth, tags,
+                                 worklist, &worklist_count);
+      }
+    }
+
+    for (int i = 0; i < jump_count && supported; i++) {
+      info->targets[jump_targets[i]] = true;
+      supported = analyzeMerge(info, jump_targets[i], depth, tags,
+                               worklist, &worklist_count);
+    }
+
+    if (falls_through && supported) {
+      if (next >= count) supported = false;
+      else supported = analyzeMerge(info, next, depth, tags,
+                                    worklist, &worklist_count);
+    }
+
+    ASSERT(worklist_count < worklist_size, OOPS);
+  }
+
+  DEALLOCATE(vm, tags);
+  DEALLOCATE(vm, worklist);
+  return supported;
+}
+
+// Returns the index of the callee function of the call at [ip].
+static int getCallee(const FnInfo* info, const uint8_t* opcodes, int ip) {
+  int argc = opcodes[ip + 1];
+  int depth = info->depths[ip];
+  return info->tags[ip * info->frame_size + depth - argc - 1];
+}
+
+// A function which calls an untranslated function can't be translated either.
+// Since removing a function could affect it's callers, repeat it till nothing
+// more to remove.
+static void analyzeCalls(EmitC* emitter) {
+  Script* script = emitter->script;
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+
+    for (uint32_t i = 0; i < script->functions.count; i++) {
+      FnInfo* info = &emitter->infos[i];
+      if (!info->supported) continue;
+
+      const Fn* fn = script->functions.data[i]->fn;
+      for (uint32_t ip = 0; ip < fn->opcodes.count; ip++) {
+        if (info->depths[ip] == -1) continue;
+        Opcode op = (Opcode)fn->opcodes.data[ip];
+        if (op != OP_CALL && op != OP_TAIL_CALL) continue;
+
+        int callee = getCallee(info, fn->opcodes.data, ip);
+        if (callee >= 0 && !emitter->infos[callee].supported) {
+          info->supported = false;
+          changed = true;
+          break;
+        }
+      }
+    }
+  }
+}
+
+/*****************************************************************************/
+/* SOURCE GENERATION                                                         */
+/*****************************************************************************/
+
+// Write the formatted string to the generated source.
+static void emit(EmitC* emitter, const char* fmt, ...) {
+  va_list args, args_copy;
+  va_start(args, fmt);
+
+  va_copy(args_copy, args);
+  int length = vsnprintf(NULL, 0, fmt, args_copy);
+  va_end(args_copy);
+  __ASSERT(length >= 0, "Emit buffer failed at vsnprintf().");
+
+  pkByteBuffer* out = &emitter->out;
+  pkByteBufferReserve(out, emitter->vm, out->count + length + 1);
+  vsnprintf((char*)out->data + out->count, length + 1, fmt, args);
+  out->count += length;
+
+  va_end(args);
+}
+
+// Returns the index of the [str] in the emitter's strings table and add it if
+// it doesn't exists.
+static int emitterAddString(EmitC* emitter, String* str) {
+  for (uint32_t i = 0; i < emitter->strings.count; i++) {
+    if (isValuesEqual(VAR_OBJ(emitter->strings.data[i]), VAR_OBJ(str))) {
+      return (int)i;
+    }
+  }
+  pkStringBufferWrite(&emitter->strings, emitter->vm, str);
+  return (int)emitter->strings.count - 1;
+}
+
+// Returns the index of the builtin function in the emitter's builtins table
+// and add it if it doesn't exists.
+static int emitterAddBuiltin(EmitC* emitter, uint32_t index) {
+  for (uint32_t i = 0; i < emitter->builtins.count; i++) {
+    if (emitter->builtins.data[i] == index) return (int)i;
+  }
+  pkUintBufferWrite(&emitter->builtins, emitter->vm, index);
+  return (int)emitter->builtins.count - 1;
+}
+
+// Write the [str] as a C string literal. Octal escapes are used for the non
+// printable characters since they're at most 3 digits long (hex escapes would
+// consume the following hex digits).
+static void emitStringLiteral(EmitC* emitter, const char* str,
+                              uint32_t length) {
+  emit(emitter, "\"");
+  for (uint32_t i = 0; i < length; i++) {
+    unsigned char c = (unsigned char)str[i];
+    if (c == '"' || c == '\\') emit(emitter, "\\%c", c);
+    else if (c >= 32 && c < 127) emit(emitter, "%c", c);
+    else emit(emitter, "\\%03o", c);
+  }
+  emit(emitter, "\"");
+}
+
+// Write the number [value] as a C expression of type double.
+static void emitNumber(EmitC* emitter, double value) {
+  if (isnan(value)) emit(emitter, "NAN");
+  else if (isinf(value)) emit(emitter, (value > 0) ? "INFINITY" : "-INFINITY");
+  else emit(emitter, "%.17g", value);
+}
+
+// Write the translatable [value] (see isTranslatableValue()) as a C
+// expression of type Var.
+static void emitValue(EmitC* emitter, Var value) {
+  if (IS_NULL(value)) emit(emitter, "VAR_NULL");
+  else if (IS_TRUE(value)) emit(emitter, "VAR_TRUE");
+  else if (IS_FALSE(value)) emit(emitter, "VAR_FALSE");
+  else if (IS_NUM(value)) {
+    emit(emitter, "VAR_NUM(");
+    emitNumber(emitter, AS_NUM(value));
+    emit(emitter, ")");
+  } else {
+    int index = emitterAddString(emitter, (String*)AS_OBJ(value));
+    emit(emitter, "VAR_OBJ(_pk_strings[%d])", index);
+  }
+}
+
+// Name of the translated C implementation of the function.
+#define IMPL_NAME "_pk_%s"
+
+static void emitPreamble(EmitC* emitter, const char* module) {
+  Script* script = emitter->script;
+
+  emit(emitter,
+    "// Generated from \"%s\" with pocket --emit-c, don't edit.\n"
+    "//\n"
+    "// Compile this file along with the pocketlang sources (add src/ to the\n"
+    "// include path) and call registerModule_%s(vm) to register the module\n"
+    "// '%s' to the VM before running the scripts which import it.\n",
+    script->path->data, module, module);
+
+  bool skipped = false;
+  for (uint32_t i = 0; i < script->functions.count; i++) {
+    const Function* fn = script->functions.data[i];
+    if (!isNamedFunction(fn) || emitter->infos[i].supported) continue;
+    if (!skipped) {
+      emit(emitter, "//\n// Functions that couldn't be translated:\n");
+      skipped = true;
+    }
+    emit(emitter, "//   %s()\n", fn->name);
+  }
+
+  emit(emitter,
+    "\n"
+    "#include <math.h>\n"
+    "#include <stddef.h>\n"
+    "\n"
+    "#include \"pk_bigint.h\"\n"
+    "#include \"pk_core.h\"\n"
+    "#include \"pk_vm.h\"\n"
+    "\n"
+    "#define S(i) (rbp[i])\n"
+    "\n"
+    "#define CHECK_ERROR()                  \\\n"
+    "  do {                                 \\\n"
+    "    if (VM_HAS_ERROR(vm)) goto L_return; \\\n"
+    "  } while (false)\n"
+    "\n"
+    "#define RUNTIME_ERROR(err) \\\n"
+    "  do {                   \\\n"
+    "    VM_SET_ERROR(vm, err); \\\n"
+    "    goto L_return;       \\\n"
+    "  } while (false)\n"
+    "\n"
+    "// Arithmetic operators with the number fast path inlined.\n"
+    "#define NUM_BINARY_OP(a, b, op, fn)          \\\n"
+    "  do {                                     \\\n"
+    "    if (IS_NUM(a) && IS_NUM(b)) {          \\\n"
+    "      a = VAR_NUM(AS_NUM(a) op AS_NUM(b)); \\\n"
+    "    } else {                               \\\n"
+    "      Var _result = fn(vm, a, b);          \\\n"
+    "      a = _result;                         \\\n"
+    "      CHECK_ERROR();                       \\\n"
+    "    }                                      \\\n"
+    "  } while (false)\n"
+    "\n"
+    "#define BINARY_OP(a, b, fn)        \\\n"
+    "  do {                           \\\n"
+    "    Var _result = fn(vm, a, b);  \\\n"
+    "    a = _result;                 \\\n"
+    "    CHECK_ERROR();               \\\n"
+    "  } while (false)\n"
+    "\n"
+    "// Comparison operators with the number fast path inlined.\n"
+    "#define COMPARE_OP(a, b, op, fn) \\\n"
+    "  (a = VAR_BOOL((IS_NUM(a) && IS_NUM(b)) ? \\\n"
+    "                AS_NUM(a) op AS_NUM(b) : fn(a, b)))\n"
+    "\n"
+    "#define COMPARE_EQ_OP(a, b, op, fn)                            \\\n"
+    "  (a = VAR_BOOL(((IS_NUM(a) && IS_NUM(b)) ?                   \\\n"
+    "                 AS_NUM(a) op AS_NUM(b) : fn(a, b)) ||        \\\n"
+    "                isValuesEqual(a, b)))\n"
+    "\n");
+
+  if (emitter->builtins.count > 0) {
+    emit(emitter,
+      "// Call the builtin function [fn] with the return value slot at the\n"
+      "// stack index [slot] followed by [argc] arguments and returns the\n"
+      "// result.\n"
+      "static Var _pkCallNative(PKVM* vm, Function* fn, ptrdiff_t slot, "
+      "int argc) {\n"
+      "  ptrdiff_t ret = vm->fiber->ret - vm->fiber->stack;\n"
+      "  ptrdiff_t sp = vm->fiber->sp - vm->fiber->stack;\n"
+      "\n"
+      "  vm->fiber->ret = vm->fiber->stack + slot;\n"
+      "  *vm->fiber->ret = VAR_NULL;\n"
+      "  vm->fiber->sp = vm->fiber->ret + argc + 1;\n"
+      "  fn->native(vm);\n"
+      "  Var result = *vm->fiber->ret;\n"
+      "\n"
+      "  vm->fiber->ret = vm->fiber->stack + ret;\n"
+      "  vm->fiber->sp = vm->fiber->stack + sp;\n"
+      "  return result;\n"
+      "}\n"
+      "\n");
+  }
+
+  if (emitter->strings.count > 0) {
+    emit(emitter, "static String* _pk_strings[%u];\n", emitter->strings.count);
+  }
+  if (emitter->builtins.count > 0) {
+    emit(emitter, "static Function* _pk_builtins[%u];\n",
+         emitter->builtins.count);
+  }
+
+  // Forward declarations, the functions could call each other.
+  for (uint32_t i = 0; i < script->functions.count; i++) {
+    if (!emitter->infos[i].supported) continue;
+    emit(emitter, "static Var " IMPL_NAME "(PKVM* vm, ptrdiff_t base);\n",
+         script->functions.data[i]->name);
+  }
+  emit(emitter, "\n");
+}
+
+// Write the call instruction at the stack depth [depth].
+static void emitCall(EmitC* emitter, const Function* func, const FnInfo* info,
+                     int ip, int depth) {
+  const uint8_t* opcodes = func->fn->opcodes.data;
+  Opcode op = (Opcode)opcodes[ip];
+  int argc = opcodes[ip + 1];
+  int callee = getCallee(info, opcodes, ip);
+  int slot = depth - argc - 1;
+
+  const Function* fn = NULL;
+  if (callee >= 0) {
+    fn = emitter->script->functions.data[callee];
+  } else {
+    fn = getBuiltinFunction(emitter->vm, TAG_BUILTIN(0) - callee);
+  }
+
+  if (fn->arity != -1 && fn->arity != argc) {
+    emit(emitter, "  RUNTIME_ERROR(newString(vm, "
+                  "\"Expected exactly %d argument(s).\"));\n", fn->arity);
+    return;
+  }
+
+  // Tail call to itself is a jump to the beginning of the function.
+  if (op == OP_TAIL_CALL && fn == func) {
+    for (int i = 0; i < argc; i++) {
+      emit(emitter, "  S(%d) = S(%d);\n", i, slot + 1 + i);
+    }
+    emit(emitter, "  goto L_begin;\n");
+    return;
+  }
+
+  emit(emitter, "  {\n");
+  if (callee >= 0) {
+    emit(emitter, "    Var _ret = " IMPL_NAME "(vm, base + %d);\n",
+         fn->name, slot + 1);
+  } else {
+    int index = emitterAddBuiltin(emitter, TAG_BUILTIN(0) - callee);
+    emit(emitter, "    Var _ret = _pkCallNative(vm, _pk_builtins[%d], "
+                  "base + %d, %d); // %s()\n", index, slot, argc, fn->name);
+  }
+  emit(emitter, "    rbp = vm->fiber->stack + base;\n");
+
+  if (op == OP_TAIL_CALL) {
+    emit(emitter, "    result = _ret;\n"
+                  "    goto L_return;\n"
+                  "  }\n");
+  } else {
+    emit(emitter, "    S(%d) = _ret;\n"
+                  "  }\n"
+                  "  CHECK_ERROR();\n", slot);
+  }
+}
+
+// Write the translation of the single instruction at [ip].
+static void emitInstruction(EmitC* emitter, const Function* func,
+                            const FnInfo* info, int ip) {
+  Script* script = emitter->script;
+  const uint8_t* opcodes = func->fn->opcodes.data;
+  Opcode op = (Opcode)opcodes[ip];
+  int next = ip + 1 + op_params[op];
+
+  // Stack top (a) and the one before (b) before the instruction.
+  int depth = info->depths[ip];
+  int a = depth - 1, b = depth - 2;
+
+#define SHORT_ARG(offset) \
+  ((uint16_t)((opcodes[ip + (offset)] << 8) | opcodes[ip + (offset) + 1]))
+
+  switch (op) {
+    case OP_PUSH_CONSTANT:
+    {
+      Var value = script->literals.data[SHORT_ARG(1)];
+      if (IS_NUM(value)) {
+        emit(emitter, "  S(%d) = VAR_NUM(", depth);
+        emitNumber(emitter, AS_NUM(value));
+        emit(emitter, ");\n");
+      } else {
+        int index = emitterAddString(emitter, (String*)AS_OBJ(value));
+        emit(emitter, "  S(%d) = VAR_OBJ(_pk_strings[%d]);\n", depth, index);
+      }
+    } break;
+
+    case OP_PUSH_NULL:  emit(emitter, "  S(%d) = VAR_NULL;\n", depth); break;
+    case OP_PUSH_0:     emit(emitter, "  S(%d) = VAR_NUM(0);\n", depth); break;
+    case OP_PUSH_TRUE:  emit(emitter, "  S(%d) = VAR_TRUE;\n", depth); break;
+    case OP_PUSH_FALSE: emit(emitter, "  S(%d) = VAR_FALSE;\n", depth); break;
+
+    case OP_SWAP:
+      emit(emitter, "  { Var _tmp = S(%d); S(%d) = S(%d); S(%d) = _tmp; }\n",
+           a, a, b, b);
+      break;
+
+    case OP_PUSH_LIST:
+      emit(emitter, "  { List* _list = newList(vm, %d); "
+                    "S(%d) = VAR_OBJ(_list); }\n", SHORT_ARG(1), depth);
+      break;
+
+    case OP_PUSH_MAP:
+      emit(emitter, "  { Map* _map = newMap(vm); S(%d) = VAR_OBJ(_map); }\n",
+           depth);
+      if (SHORT_ARG(1) > 0) {
+        emit(emitter, "  mapReserve(vm, (Map*)AS_OBJ(S(%d)), %d);\n",
+             depth, SHORT_ARG(1));
+      }
+      break;
+
+    // The container is built element by element since the strings of the
+    // generated code are only created when the module is registered.
+    case OP_CLONE_CONSTANT:
+    {
+      Var value = script->literals.data[SHORT_ARG(1)];
+      if (IS_OBJ_TYPE(value, OBJ_LIST)) {
+        const List* list = (const List*)AS_OBJ(value);
+        emit(emitter, "  { List* _list = newList(vm, %d); "
+                      "S(%d) = VAR_OBJ(_list); }\n",
+             (int)list->elements.count, depth);
+        for (uint32_t i = 0; i < list->elements.count; i++) {
+          emit(emitter, "  pkVarBufferWrite(&((List*)AS_OBJ(S(%d)))->"
+                        "elements, vm, ", depth);
+          emitValue(emitter, list->elements.data[i]);
+          emit(emitter, ");\n");
+        }
+
+      } else {
+        const Map* map = (const Map*)AS_OBJ(value);
+        emit(emitter, "  { Map* _map = newMap(vm); S(%d) = VAR_OBJ(_map); }\n",
+             depth);
+        for (uint32_t i = 0; i < map->capacity; i++) {
+          if (IS_UNDEF(map->entries[i].key)) continue;
+          emit(emitter, "  mapSet(vm, (Map*)AS_OBJ(S(%d)), ", depth);
+          emitValue(emitter, map->entries[i].key);
+          emit(emitter, ", ");
+          emitValue(emitter, map->entries[i].value);
+          emit(emitter, ");\n");
+        }
+      }
+    } break;
+
+    case OP_LIST_APPEND:
+      emit(emitter, "  pkVarBufferWrite(&((List*)AS_OBJ(S(%d)))->elements, "
+                    "vm, S(%d));\n", b, a);
+      break;
+
+    case OP_MAP_INSERT:
+      emit(emitter,
+        "  if (IS_OBJ(S(%d)) && !isObjectHashable(AS_OBJ(S(%d))->type)) {\n"
+        "    RUNTIME_ERROR(stringFormat(vm, \"$ type is not hashable.\",\n"
+        "                  varTypeName(S(%d))));\n"
+        "  }\n"
+        "  mapSet(vm, (Map*)AS_OBJ(S(%d)), S(%d), S(%d));\n",
+        b, b, b, depth - 3, b, a);
+      break;
+
+    case OP_PUSH_LOCAL_0:
+    case OP_PUSH_LOCAL_1:
+    case OP_PUSH_LOCAL_2:
+    case OP_PUSH_LOCAL_3:
+    case OP_PUSH_LOCAL_4:
+    case OP_PUSH_LOCAL_5:
+    case OP_PUSH_LOCAL_6:
+    case OP_PUSH_LOCAL_7:
+    case OP_PUSH_LOCAL_8:
+    case OP_PUSH_LOCAL_N:
+    {
+      int index = (op == OP_PUSH_LOCAL_N) ? opcodes[ip + 1]
+                                          : (int)(op - OP_PUSH_LOCAL_0);
+      emit(emitter, "  S(%d) = S(%d);\n", depth, index);
+    } break;
+
+    case OP_STORE_LOCAL_0:
+    case OP_STORE_LOCAL_1:
+    case OP_STORE_LOCAL_2:
+    case OP_STORE_LOCAL_3:
+    case OP_STORE_LOCAL_4:
+    case OP_STORE_LOCAL_5:
+    case OP_STORE_LOCAL_6:
+    case OP_STORE_LOCAL_7:
+    case OP_STORE_LOCAL_8:
+    case OP_STORE_LOCAL_N:
+    {
+      int index = (op == OP_STORE_LOCAL_N) ? opcodes[ip + 1]
+                                           : (int)(op - OP_STORE_LOCAL_0);
+      if (index != a) emit(emitter, "  S(%d) = S(%d);\n", index, a);
+    } break;
+
+    // The callee is resolved at compile time, nothing to do here.
+    case OP_PUSH_FN:
+    case OP_PUSH_BUILTIN_FN:
+    case OP_POP:
+    case OP_NOP:
+      break;
+
+    case OP_CALL:
+    case OP_TAIL_CALL:
+      emitCall(emitter, func, info, ip, depth);
+      break;
+
+    case OP_JUMP:
+      emit(emitter, "  goto L_%d;\n", next + SHORT_ARG(1));
+      break;
+
+    case OP_LOOP:
+      emit(emitter, "  goto L_%d;\n", next - SHORT_ARG(1));
+      break;
+
+    case OP_JUMP_IF:
+      emit(emitter, "  if (toBool(S(%d))) goto L_%d;\n",
+           a, next + SHORT_ARG(1));
+      break;
+
+    case OP_JUMP_IF_NOT:
+      emit(emitter, "  if (!toBool(S(%d))) goto L_%d;\n",
+           a, next + SHORT_ARG(1));
+      break;
+
+    case OP_TABLE_JUMP:
+    {
+      const List* table = (const List*)AS_OBJ(
+                            script->literals.data[SHORT_ARG(1)]);
+      double first = AS_NUM(table->elements.data[0]);
+      uint32_t size = table->elements.count - 1;
+
+      emit(emitter, "  if (IS_OBJ_TYPE(S(%d), OBJ_BIGINT)) {\n"
+        "    int64_t _integer;\n"
+        "    if (bigIntToInt64((BigInt*)AS_OBJ(S(%d)), &_integer)) {\n"
+        "      S(%d) = VAR_NUM((double)_integer);\n"
+        "    }\n"
+        "  }\n", a, a, a);
+      emit(emitter, "  if (IS_NUM(S(%d)) &&\n"
+        "      !(AS_NUM(S(%d)) == 0 && signbit(AS_NUM(S(%d))))) {\n"
+        "    double _index = AS_NUM(S(%d)) - (", a, a, a, a);
+      emitNumber(emitter, first);
+      emit(emitter, ");\n"
+        "    if (_index >= 0 && _index < %u &&\n"
+        "        _index == (double)(uint32_t)_index) {\n"
+        "      switch ((uint32_t)_index) {\n", size);
+      for (uint32_t i = 0; i < size; i++) {
+        int target = next + (int)AS_NUM(table->elements.data[i + 1]);
+        emit(emitter, "        case %u: goto L_%d;\n", i, target);
+      }
+      emit(emitter, "      }\n"
+                    "    }\n"
+                    "  }\n"
+                    "  goto L_%d;\n", next + SHORT_ARG(3));
+    } break;
+
+    case OP_RETURN:
+      if (depth > 0) emit(emitter, "  result = S(%d);\n", a);
+      emit(emitter, "  goto L_return;\n");
+      break;
+
+    case OP_END:
+      emit(emitter, "  goto L_return;\n");
+      break;
+
+    case OP_GET_ATTRIB:
+    case OP_GET_ATTRIB_KEEP:
+    {
+      int index = emitterAddString(emitter,
+                                   script->names.data[SHORT_ARG(1)]);
+      emit(emitter, "  {\n"
+        "    Var _result = varGetAttrib(vm, S(%d), _pk_strings[%d]);\n"
+        "    S(%d) = _result;\n"
+        "  }\n"
+        "  CHECK_ERROR();\n",
+        a, index, (op == OP_GET_ATTRIB) ? a : depth);
+    } break;
+
+    case OP_SET_ATTRIB:
+    {
+      int index = emitterAddString(emitter,
+                                   script->names.data[SHORT_ARG(1)]);
+      emit(emitter, "  varSetAttrib(vm, S(%d), _pk_strings[%d], S(%d));\n"
+                    "  S(%d) = S(%d);\n"
+                    "  CHECK_ERROR();\n", b, index, a, b, a);
+    } break;
+
+    case OP_GET_SUBSCRIPT:
+    case OP_GET_SUBSCRIPT_KEEP:
+      emit(emitter, "  {\n"
+        "    Var _result = %s(vm, S(%d), S(%d));\n"
+        "    S(%d) = _result;\n"
+        "  }\n"
+        "  CHECK_ERROR();\n",
+        (op == OP_GET_SUBSCRIPT) ? "varGetSubscript" : "varGetSubscriptKeep",
+        b, a, (op == OP_GET_SUBSCRIPT) ? b : depth);
+      break;
+
+    case OP_SET_SUBSCRIPT:
+      emit(emitter, "  varsetSubscript(vm, S(%d), S(%d), S(%d));\n"
+                    "  S(%d) = S(%d);\n"
+                    "  CHECK_ERROR();\n", depth - 3, b, a, depth - 3, a);
+      break;
+
+    case OP_SUBSCRIPT_UPDATE:
+      emit(emitter, "  {\n"
+        "    Var _result = varUpdateSubscript(vm, S(%d), S(%d), %d, S(%d), "
+        "S(%d));\n"
+        "    S(%d) = _result;\n"
+        "  }\n"
+        "  CHECK_ERROR();\n",
+        depth - 4, depth - 3, opcodes[ip + 1], b, a, depth - 4);
+      break;
+
+    case OP_NEGATIVE:
+      emit(emitter, "  if (!IS_NUM(S(%d))) {\n"
+        "    RUNTIME_ERROR(newString(vm, "
+        "\"Can not negate a non numeric value.\"));\n"
+        "  }\n"
+        "  S(%d) = VAR_NUM(-AS_NUM(S(%d)));\n", a, a, a);
+      break;
+
+    case OP_NOT:
+      emit(emitter, "  S(%d) = VAR_BOOL(!toBool(S(%d)));\n", a, a);
+      break;
+
+    case OP_BIT_NOT:
+      emit(emitter, "  {\n"
+                    "    Var _result = varBitNot(vm, S(%d));\n"
+                    "    S(%d) = _result;\n"
+                    "  }\n"
+                    "  CHECK_ERROR();\n", a, a);
+      break;
+
+    case OP_ADD:
+      emit(emitter, "  NUM_BINARY_OP(S(%d), S(%d), +, varAdd);\n", b, a);
+      break;
+    case OP_SUBTRACT:
+      emit(emitter, "  NUM_BINARY_OP(S(%d), S(%d), -, varSubtract);\n", b, a);
+      break;
+    case OP_MULTIPLY:
+      emit(emitter, "  NUM_BINARY_OP(S(%d), S(%d), *, varMultiply);\n", b, a);
+      break;
+    case OP_DIVIDE:
+      emit(emitter, "  NUM_BINARY_OP(S(%d), S(%d), /, varDivide);\n", b, a);
+      break;
+
+    case OP_MOD:
+      emit(emitter, "  BINARY_OP(S(%d), S(%d), varModulo);\n", b, a);
+      break;
+    case OP_BIT_AND:
+      emit(emitter, "  BINARY_OP(S(%d), S(%d), varBitAnd);\n", b, a);
+      break;
+    case OP_BIT_OR:
+      emit(emitter, "  BINARY_OP(S(%d), S(%d), varBitOr);\n", b, a);
+      break;
+    case OP_BIT_XOR:
+      emit(emitter, "  BINARY_OP(S(%d), S(%d), varBitXor);\n", b, a);
+      break;
+    case OP_BIT_LSHIFT:
+      emit(emitter, "  BINARY_OP(S(%d), S(%d), varBitLshift);\n", b, a);
+      break;
+    case OP_BIT_RSHIFT:
+      emit(emitter, "  BINARY_OP(S(%d), S(%d), varBitRshift);\n", b, a);
+      break;
+
+    case OP_EQEQ:
+      emit(emitter, "  S(%d) = VAR_BOOL(isValuesEqual(S(%d), S(%d)));\n",
+           b, b, a);
+      break;
+    case OP_NOTEQ:
+      emit(emitter, "  S(%d) = VAR_BOOL(!isValuesEqual(S(%d), S(%d)));\n",
+           b, b, a);
+      break;
+
+    case OP_LT:
+      emit(emitter, "  COMPARE_OP(S(%d), S(%d), <, varLesser);\n", b, a);
+      break;
+    case OP_GT:
+      emit(emitter, "  COMPARE_OP(S(%d), S(%d), >, varGreater);\n", b, a);
+      break;
+    case OP_LTEQ:
+      emit(emitter, "  COMPARE_EQ_OP(S(%d), S(%d), <, varLesser);\n", b, a);
+      break;
+    case OP_GTEQ:
+      emit(emitter, "  COMPARE_EQ_OP(S(%d), S(%d), >, varGreater);\n", b, a);
+      break;
+
+    case OP_RANGE:
+      emit(emitter, "  if (!IS_NUM(S(%d)) || !IS_NUM(S(%d))) {\n"
+        "    RUNTIME_ERROR(newString(vm, "
+        "\"Range arguments must be number.\"));\n"
+        "  }\n"
+        "  {\n"
+        "    Range* _range = newRange(vm, AS_NUM(S(%d)), AS_NUM(S(%d)));\n"
+        "    S(%d) = VAR_OBJ(_range);\n"
+        "  }\n", b, a, b, a, b);
+      break;
+
+    case OP_IN:
+      emit(emitter, "  {\n"
+                    "    bool _in = varContains(vm, S(%d), S(%d));\n"
+                    "    S(%d) = VAR_BOOL(_in);\n"
+                    "  }\n"
+                    "  CHECK_ERROR();\n", b, a, b);
+      break;
+
+    case OP_ADD_NUM:
+    case OP_SUBTRACT_NUM:
+    case OP_MULTIPLY_NUM:
+    case OP_DIVIDE_NUM:
+    {
+      const char* sym = (op == OP_ADD_NUM) ? "+" :
+                        (op == OP_SUBTRACT_NUM) ? "-" :
+                        (op == OP_MULTIPLY_NUM) ? "*" : "/";
+      emit(emitter, "  S(%d) = VAR_NUM(AS_NUM(S(%d)) %s AS_NUM(S(%d)));\n",
+           b, b, sym, a);
+    } break;
+
+    case OP_LT_NUM:
+    case OP_LTEQ_NUM:
+    case OP_GT_NUM:
+    case OP_GTEQ_NUM:
+    {
+      const char* sym = (op == OP_LT_NUM) ? "<" :
+                        (op == OP_LTEQ_NUM) ? "<=" :
+                        (op == OP_GT_NUM) ? ">" : ">=";
+      emit(emitter, "  S(%d) = VAR_BOOL(AS_NUM(S(%d)) %s AS_NUM(S(%d)));\n",
+           b, b, sym, a);
+    } break;
+
+    case OP_STR_LENGTH:
+      emit(emitter, "  S(%d) = VAR_NUM((double)((String*)AS_OBJ(S(%d)))"
+                    "->length);\n", a, a);
+      break;
+
+    case OP_CHECK_TYPE:
+    {
+      int type = opcodes[ip + 1];
+      emit(emitter,
+        "  if (pkGetValueType((PkVar)&S(%d)) != (PkVarType)%d) {\n"
+        "    RUNTIME_ERROR(stringFormat(vm, \"Expected a $ value, got $.\",\n"
+        "                  \"%s\", varTypeName(S(%d))));\n"
+        "  }\n", a, type, getPkVarTypeName((PkVarType)type), a);
+    } break;
+
+    default:
+      UNREACHABLE();
+  }
+
+#undef SHORT_ARG
+}
+
+static void emitFunction(EmitC* emitter, const Function* func,
+                         const FnInfo* info) {
+  const Fn* fn = func->fn;
+
+  emit(emitter,
+    "// %s() \"%s\":%u\n"
+    "static Var " IMPL_NAME "(PKVM* vm, ptrdiff_t base) {\n"
+    "  ptrdiff_t sp = vm->fiber->sp - vm->fiber->stack;\n"
+    "  Var result = VAR_NULL;\n"
+    "\n"
+    "  // The stack slots (including the arguments) of the function.\n"
+    "  vmEnsureStack(vm, (int)base + %d);\n"
+    "  Var* rbp = vm->fiber->stack + base;\n"
+    "  for (int i = %d; i < %d; i++) S(i) = VAR_NULL;\n"
+    "  vm->fiber->sp = rbp + %d;\n"
+    "\n",
+    func->name, func->owner->path->data, fn->oplines.data[0],
+    func->name, info->frame_size, func->arity, info->frame_size,
+    info->frame_size);
+
+  if (info->self_tail_call) emit(emitter, "L_begin:;\n");
+
+  uint32_t last_line = 0;
+  for (uint32_t ip = 0; ip < fn->opcodes.count; ip++) {
+    if (info->depths[ip] == -1) continue;
+
+    if (info->targets[ip]) emit(emitter, "L_%u:;\n", ip);
+    if (fn->oplines.data[ip] != last_line) {
+      last_line = fn->oplines.data[ip];
+      emit(emitter, "  // line %u\n", last_line);
+    }
+
+    emitInstruction(emitter, func, info, (int)ip);
+    ip += op_params[fn->opcodes.data[ip]];
+  }
+
+  emit(emitter,
+    "\n"
+    "L_return:\n"
+    "  vm->fiber->sp = vm->fiber->stack + sp;\n"
+    "  return result;\n"
+    "}\n"
+    "\n"
+    "static void " IMPL_NAME "_native(PKVM* vm) {\n"
+    "  ptrdiff_t base = (vm->fiber->ret + 1) - vm->fiber->stack;\n"
+    "  Var result = " IMPL_NAME "(vm, base);\n"
+    "  if (!VM_HAS_ERROR(vm)) *vm->fiber->ret = result;\n"
+    "}\n"
+    "\n", func->name, func->name);
+}
+
+static void emitRegister(EmitC* emitter, const char* module) {
+  Script* script = emitter->script;
+
+  emit(emitter,
+    "void registerModule_%s(PKVM* vm) {\n"
+    "  PkHandle* handle = pkNewModule(vm, \"%s\");\n",
+    module, module);
+
+  // The strings are kept alive by the module's literals.
+  if (emitter->strings.count > 0) {
+    emit(emitter, "  Script* module = (Script*)AS_OBJ(handle->value);\n"
+                  "  static const struct {\n"
+                  "    const char* data;\n"
+                  "    uint32_t length;\n"
+                  "  } strings[] = {\n");
+    for (uint32_t i = 0; i < emitter->strings.count; i++) {
+      String* str = emitter->strings.data[i];
+      emit(emitter, "    { ");
+      emitStringLiteral(emitter, str->data, str->length);
+      emit(emitter, ", %u },\n", str->length);
+    }
+    emit(emitter, "  };\n"
+      "  for (int i = 0; i < %u; i++) {\n"
+      "    _pk_strings[i] = newStringLength(vm, strings[i].data,\n"
+      "                                     strings[i].length);\n"
+      "    vmPushTempRef(vm, &_pk_strings[i]->_super);\n"
+      "    pkVarBufferWrite(&module->literals, vm, VAR_OBJ(_pk_strings[i]));\n"
+      "    vmPopTempRef(vm);\n"
+      "  }\n", emitter->strings.count);
+  }
+
+  for (uint32_t i = 0; i < emitter->builtins.count; i++) {
+    const char* name = getBuiltinFunctionName(emitter->vm,
+                                              emitter->builtins.data[i]);
+    emit(emitter, "  _pk_builtins[%u] = getBuiltinFunction(vm,\n"
+                  "    findBuiltinFunction(vm, \"%s\", %u));\n",
+         i, name, (uint32_t)strlen(name));
+  }
+
+  emit(emitter, "\n");
+  for (uint32_t i = 0; i < script->functions.count; i++) {
+    if (!emitter->infos[i].supported) continue;
+    const Function* fn = script->functions.data[i];
+    emit(emitter, "  pkModuleAddFunction(vm, handle, \"%s\", "
+                  IMPL_NAME "_native, %d);\n", fn->name, fn->name, fn->arity);
+  }
+
+  emit(emitter, "\n"
+                "  pkReleaseHandle(vm, handle);\n"
+                "}\n");
+}
+
+/*****************************************************************************/
+/* PUBLIC API                                                                */
+/*****************************************************************************/
+
+// Write the C translation of the [script] as the native [module].
+static void emitScript(PKVM* vm, Script* script, const char* module) {
+  EmitC emitter;
+  emitter.vm = vm;
+  emitter.script = script;
+  pkByteBufferInit(&emitter.out);
+  pkStringBufferInit(&emitter.strings);
+  pkUintBufferInit(&emitter.builtins);
+
+  uint32_t count = script->functions.count;
+  emitter.infos = ALLOCATE_ARRAY(vm, FnInfo, count);
+  for (uint32_t i = 0; i < count; i++) {
+    FnInfo* info = &emitter.infos[i];
+    info->self_tail_call = false;
+    info->supported = analyzeFunction(&emitter, script->functions.data[i],
+                                      info);
+  }
+  analyzeCalls(&emitter);
+
+  // The functions are generated first to collect the strings and builtins
+  // the preamble needs to declare, and then joined together.
+  for (uint32_t i = 0; i < count; i++) {
+    if (!emitter.infos[i].supported) continue;
+    emitFunction(&emitter, script->functions.data[i], &emitter.infos[i]);
+  }
+  emitRegister(&emitter, module);
+
+  pkByteBuffer functions = emitter.out;
+  pkByteBufferInit(&emitter.out);
+  emitPreamble(&emitter, module);
+  pkByteBufferConcat(&emitter.out, vm, &functions);
+  pkByteBufferWrite(&emitter.out, vm, '\0');
+  pkByteBufferClear(&functions, vm);
+
+  if (vm->config.write_fn != NULL) {
+    vm->config.write_fn(vm, (const char*)emitter.out.data);
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    DEALLOCATE(vm, emitter.infos[i].depths);
+    DEALLOCATE(vm, emitter.infos[i].tags);
+    DEALLOCATE(vm, emitter.infos[i].targets);
+  }
+  DEALLOCATE(vm, emitter.infos);
+  pkByteBufferClear(&emitter.out, vm);
+  pkStringBufferClear(&emitter.strings, vm);
+  pkUintBufferClear(&emitter.builtins, vm);
+}
+
+PkResult pkEmitC(PKVM* vm, PkStringPtr source, PkStringPtr path,
+                 const char* module) {
+  __ASSERT(module != NULL, "Argument module was NULL.");
+  for (const char* c = module; *c != '\0'; c++) {
+    __ASSERT(utilIsName(*c) || utilIsDigit(*c),
+             "Module name should be a valid identifier.");
+  }
+
+  String* path_name = newString(vm, path.string);
+  if (path.on_done) path.on_done(vm, path);
+  vmPushTempRef(vm, &path_name->_super); // path_name.
+
+  // The script isn't added to the VM's script cache since we're not going to
+  // run it.
+  Script* scr = newScript(vm, path_name, false);
+  vmPushTempRef(vm, &scr->_super); // scr.
+
+  // Compile without the debug option to enable the tail calls.
+  PkCompileOptions options = pkNewCompilerOptions();
+  PkResult result = compile(vm, scr, source.string, &options);
+  if (source.on_done) source.on_done(vm, source);
+
+  if (result == PK_RESULT_SUCCESS) emitScript(vm, scr, module);
+
+  vmPopTempRef(vm); // scr.
+  vmPopTempRef(vm); // path_name.
+  return result;
+}
@@ -0,0 +1,502 @@
+/*
+ *  Copyright (c) 2020-2021 Thakee Nathees
+ *  Distributed Under The MIT License
+ */
+
+#include "pk_hash.h"
+
+// The CPU specific implementations are compiled with the target attribute
+// (so the rest of the sources don't require -msse4.2 or -msha) and used only
+// if the CPU supports them, which is checked at runtime with cpuid.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define HASH_X86 1
+  #include <cpuid.h>
+  #include <immintrin.h>
+#else
+  #define HASH_X86 0
+#endif
+
+/*****************************************************************************/
+/* CPU FEATURES                                                              */
+/*****************************************************************************/
+
+#if HASH_X86
+
+// The features are checked once at the first use. Note that it's okey if
+// multiple threads do it at the same time since they'll write the same value.
+static int _cpu_checked = 0;
+static int _cpu_has_sse42 = 0;
+static int _cpu_has_sha = 0;
+
+static void _hashCheckCpu(void) {
+  unsigned int eax, ebx, ecx, edx;
+  bool sse41 = false, ssse3 = false;
+
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    _cpu_has_sse42 = (ecx & (1u << 20)) != 0;
+    sse41 = (ecx & (1u << 19)) != 0;
+    ssse3 = (ecx & (1u << 9)) != 0;
+  }
+
+  if (__get_cpuid_max(0, NULL) >= 7) {
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    _cpu_has_sha = ((ebx & (1u << 29)) != 0) && sse41 && ssse3;
+  }
+
+  _cpu_checked = 1;
+}
+
+#endif // HASH_X86
+
+/*****************************************************************************/
+/* CRC-32C                                                                   */
+/*****************************************************************************/
+
+// Table of the CRC-32C of all the bytes with the reflected polynomial
+// 0x82f63b78 (Castagnoli).
+static const uint32_t _crc32c_table[256] = {
+  0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4, 0xc79a971f, 0x35f1141c,
+  0x26a1e7e8, 0xd4ca64eb, 0x8ad958cf, 0x78b2dbcc, 0x6be22838, 0x9989ab3b,
+  0x4d43cfd0, 0xbf284cd3, 0xac78bf27, 0x5e133c24, 0x105ec76f, 0xe235446c,
+  0xf165b798, 0x030e349b, 0xd7c45070, 0x25afd373, 0x36ff2087, 0xc494a384,
+  0x9a879fa0, 0x68ec1ca3, 0x7bbcef57, 0x89d76c54, 0x5d1d08bf, 0xaf768bbc,
+  0xbc267848, 0x4e4dfb4b, 0x20bd8ede, 0xd2d60ddd, 0xc186fe29, 0x33ed7d2a,
+  0xe72719c1, 0x154c9ac2, 0x061c6936, 0xf477ea35, 0xaa64d611, 0x580f5512,
+  0x4b5fa6e6, 0xb93425e5, 0x6dfe410e, 0x9f95c20d, 0x8cc531f9, 0x7eaeb2fa,
+  0x30e349b1, 0xc288cab2, 0xd1d83946, 0x23b3ba45, 0xf779deae, 0x05125dad,
+  0x1642ae59, 0xe4292d5a, 0xba3a117e, 0x4851927d, 0x5b016189, 0xa96ae28a,
+  0x7da08661, 0x8fcb0562, 0x9c9bf696, 0x6ef07595, 0x417b1dbc, 0xb3109ebf,
+  0xa0406d4b, 0x522bee48, 0x86e18aa3, 0x748a09a0, 0x67dafa54, 0x95b17957,
+  0xcba24573, 0x39c9c670, 0x2a993584, 0xd8f2b687, 0x0c38d26c, 0xfe53516f,
+  0xed03a29b, 0x1f682198, 0x5125dad3, 0xa34e59d0, 0xb01eaa24, 0x42752927,
+  0x96bf4dcc, 0x64d4cecf, 0x77843d3b, 0x85efbe38, 0xdbfc821c, 0x2997011f,
+  0x3ac7f2eb, 0xc8ac71e8, 0x1c661503, 0xee0d9600, 0xfd5d65f4, 0x0f36e6f7,
+  0x61c69362, 0x93ad1061, 0x80fde395, 0x72966096, 0xa65c047d, 0x5437877e,
+  0x4767748a, 0xb50cf789, 0xeb1fcbad, 0x197448ae, 0x0a24bb5a, 0xf84f3859,
+  0x2c855cb2, 0xdeeedfb1, 0xcdbe2c45, 0x3fd5af46, 0x7198540d, 0x83f3d70e,
+  0x90a324fa, 0x62c8a7f9, 0xb602c312, 0x44694011, 0x5739b3e5, 0xa55230e6,
+  0xfb410cc2, 0x092a8fc1, 0x1a7a7c35, 0xe811ff36, 0x3cdb9bdd, 0xceb018de,
+  0xdde0eb2a, 0x2f8b6829, 0x82f63b78, 0x709db87b, 0x63cd4b8f, 0x91a6c88c,
+  0x456cac67, 0xb7072f64, 0xa457dc90, 0x563c5f93, 0x082f63b7, 0xfa44e0b4,
+  0xe9141340, 0x1b7f9043, 0xcfb5f4a8, 0x3dde77ab, 0x2e8e845f, 0xdce5075c,
+  0x92a8fc17, 0x60c37f14, 0x73938ce0, 0x81f80fe3, 0x55326b08, 0xa759e80b,
+  0xb4091bff, 0x466298fc, 0x1871a4d8, 0xea1a27db, 0xf94ad42f, 0x0b21572c,
+  0xdfeb33c7, 0x2d80b0c4, 0x3ed04330, 0xccbbc033, 0xa24bb5a6, 0x502036a5,
+  0x4370c551, 0xb11b4652, 0x65d122b9, 0x97baa1ba, 0x84ea524e, 0x7681d14d,
+  0x2892ed69, 0xdaf96e6a, 0xc9a99d9e, 0x3bc21e9d, 0xef087a76, 0x1d63f975,
+  0x0e330a81, 0xfc588982, 0xb21572c9, 0x407ef1ca, 0x532e023e, 0xa145813d,
+  0x758fe5d6, 0x87e466d5, 0x94b49521, 0x66df1622, 0x38cc2a06, 0xcaa7a905,
+  0xd9f75af1, 0x2b9cd9f2, 0xff56bd19, 0x0d3d3e1a, 0x1e6dcdee, 0xec064eed,
+  0xc38d26c4, 0x31e6a5c7, 0x22b65633, 0xd0ddd530, 0x0417b1db, 0xf67c32d8,
+  0xe52cc12c, 0x1747422f, 0x49547e0b, 0xbb3ffd08, 0xa86f0efc, 0x5a048dff,
+  0x8ecee914, 0x7ca56a17, 0x6ff599e3, 0x9d9e1ae0, 0xd3d3e1ab, 0x21b862a8,
+  0x32e8915c, 0xc083125f, 0x144976b4, 0xe622f5b7, 0xf5720643, 0x07198540,
+  0x590ab964, 0xab613a67, 0xb831c993, 0x4a5a4a90, 0x9e902e7b, 0x6cfbad78,
+  0x7fab5e8c, 0x8dc0dd8f, 0xe330a81a, 0x115b2b19, 0x020bd8ed, 0xf0605bee,
+  0x24aa3f05, 0xd6c1bc06, 0xc5914ff2, 0x37faccf1, 0x69e9f0d5, 0x9b8273d6,
+  0x88d28022, 0x7ab90321, 0xae7367ca, 0x5c18e4c9, 0x4f48173d, 0xbd23943e,
+  0xf36e6f75, 0x0105ec76, 0x12551f82, 0xe03e9c81, 0x34f4f86a, 0xc69f7b69,
+  0xd5cf889d, 0x27a40b9e, 0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e,
+  0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351,
+};
+
+static uint32_t _crc32cTable(uint32_t crc, const uint8_t* data,
+                             size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    crc = _crc32c_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#if HASH_X86
+__attribute__((target("sse4.2")))
+static uint32_t _crc32cSse42(uint32_t crc, const uint8_t* data,
+                             size_t length) {
+#if defined(__x86_64__)
+  uint64_t crc64 = crc;
+  for (; length >= 8; length -= 8, data += 8) {
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    crc64 = _mm_crc32_u64(crc64, value);
+  }
+  crc = (uint32_t)crc64;
+#endif
+  for (; length >= 4; length -= 4, data += 4) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    crc = _mm_crc32_u32(crc, value);
+  }
+  for (; length > 0; length--, data++) {
+    crc = _mm_crc32_u8(crc, *data);
+  }
+  return crc;
+}
+#endif // HASH_X86
+
+uint32_t hashCrc32c(uint32_t crc, const uint8_t* data, size_t length) {
+  crc = ~crc;
+
+#if HASH_X86
+  if (!_cpu_checked) _hashCheckCpu();
+  if (_cpu_has_sse42) return ~_crc32cSse42(crc, data, length);
+#endif
+
+  return ~_crc32cTable(crc, data, length);
+}
+
+/*****************************************************************************/
+/* WYHASH                                                                    */
+/*****************************************************************************/
+
+// The wyhash (final version 4) by Wang Yi, which is public domain.
+// Reference: https://github.com/wangyi-fudan/wyhash
+
+static const uint64_t _wyp[4] = {
+  0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+  0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull,
+};
+
+// Multiply [a] and [b] and set them to the low and high 64 bits of the
+// 128 bit result.
+static inline void _wymum(uint64_t* a, uint64_t* b) {
+#if defined(__SIZEOF_INT128__)
+  __uint128_t r = (__uint128_t)*a * *b;
+  *a = (uint64_t)r;
+  *b = (uint64_t)(r >> 64);
+#else
+  uint64_t ha = *a >> 32, hb = *b >> 32;
+  uint64_t la = (uint32_t)*a, lb = (uint32_t)*b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32), c = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  c += lo < t;
+  *a = lo;
+  *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t _wymix(uint64_t a, uint64_t b) {
+  _wymum(&a, &b);
+  return a ^ b;
+}
+
+// Read little endian integers of 8, 4 and 1 to 3 bytes.
+static inline uint64_t _wyr8(const uint8_t* p) {
+  return (uint64_t)p[0]         | ((uint64_t)p[1] << 8)  |
+         ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+         ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) |
+         ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+static inline uint64_t _wyr4(const uint8_t* p) {
+  return (uint64_t)p[0]         | ((uint64_t)p[1] << 8) |
+         ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24);
+}
+
+static inline uint64_t _wyr3(const uint8_t* p, size_t k) {
+  return ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) | p[k - 1];
+}
+
+// Hash a block of 48 bytes with the 3 lanes of the long input loop.
+static inline void _wyblock(uint64_t* seed, uint64_t* see1, uint64_t* see2,
+                            const uint8_t* p) {
+  *seed = _wymix(_wyr8(p) ^ _wyp[1], _wyr8(p + 8) ^ *seed);
+  *see1 = _wymix(_wyr8(p + 16) ^ _wyp[2], _wyr8(p + 24) ^ *see1);
+  *see2 = _wymix(_wyr8(p + 32) ^ _wyp[3], _wyr8(p + 40) ^ *see2);
+}
+
+// Hash the last [i] bytes at [p] of a data of [length] bytes and return the
+// final hash. If the [length] is greater than 16, the 16 bytes before [p]
+// should be readable since the last 16 bytes of the data are read.
+static uint64_t _wytail(uint64_t seed, const uint8_t* p, size_t i,
+                        size_t length) {
+  uint64_t a, b;
+  if (length <= 16) {
+    if (length >= 4) {
+      a = (_wyr4(p) << 32) | _wyr4(p + ((length >> 3) << 2));
+      b = (_wyr4(p + length - 4) << 32) |
+          _wyr4(p + length - 4 - ((length >> 3) << 2));
+    } else if (length > 0) {
+      a = _wyr3(p, length);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+
+  } else {
+    while (i > 16) {
+      seed = _wymix(_wyr8(p) ^ _wyp[1], _wyr8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = _wyr8(p + i - 16);
+    b = _wyr8(p + i - 8);
+  }
+
+  a ^= _wyp[1];
+  b ^= seed;
+  _wymum(&a, &b);
+  return _wymix(a ^ _wyp[0] ^ length, b ^ _wyp[1]);
+}
+
+uint64_t hashWyhash(const uint8_t* data, size_t length, uint64_t seed) {
+  const uint8_t* p = data;
+  size_t i = length;
+
+  seed ^= _wymix(seed ^ _wyp[0], _wyp[1]);
+
+  if (i > 48) {
+    uint64_t see1 = seed, see2 = seed;
+    do {
+      _wyblock(&seed, &see1, &see2, p);
+      p += 48;
+      i -= 48;
+    } while (i > 48);
+    seed ^= see1 ^ see2;
+  }
+
+  return _wytail(seed, p, i, length);
+}
+
+void wyhashInit(Wyhash* self, uint64_t seed) {
+  self->seed = seed ^ _wymix(seed ^ _wyp[0], _wyp[1]);
+  self->see1 = self->seed;
+  self->see2 = self->seed;
+  self->length = 0;
+  self->buffer_count = 0;
+}
+
+void wyhashUpdate(Wyhash* self, const uint8_t* data, size_t length) {
+  self->length += length;
+
+  // A block is only hashed if there are more bytes after it, since the last
+  // (up to 48) bytes are hashed by the tail. [buffer] has the 16 bytes before
+  // the pending bytes followed by the pending bytes.
+  uint8_t* pending = self->buffer + 16;
+  if (self->buffer_count + length <= 48) {
+    memcpy(pending + self->buffer_count, data, length);
+    self->buffer_count += (uint32_t)length;
+    return;
+  }
+
+  if (self->buffer_count > 0) {
+    size_t size = 48 - self->buffer_count;
+    memcpy(pending + self->buffer_count, data, size);
+    data += size;
+    length -= size;
+    _wyblock(&self->seed, &self->see1, &self->see2, pending);
+    memcpy(self->buffer, pending + 32, 16);
+    self->buffer_count = 0;
+  }
+
+  while (length > 48) {
+    _wyblock(&self->seed, &self->see1, &self->see2, data);
+    memcpy(self->buffer, data + 32, 16);
+    data += 48;
+    length -= 48;
+  }
+
+  memcpy(pending, data, length);
+  self->buffer_count = (uint32_t)length;
+}
+
+uint64_t wyhashFinal(const Wyhash* self) {
+  uint64_t seed = self->seed;
+  if (self->length > 48) seed ^= self->see1 ^ self->see2;
+  return _wytail(seed, self->buffer + 16, self->buffer_count, self->length);
+}
+
+/*****************************************************************************/
+/* SHA-256                                                                   */
+/*****************************************************************************/
+
+// The first 32 bits of the fractional parts of the cube roots of the first
+// 64 primes.
+static const uint32_t _sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+  0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+  0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+  0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+  0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+  0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define SHA256_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+// Process the [count] blocks of 64 bytes at the [data].
+static void _sha256Blocks(uint32_t state[8], const uint8_t* data,
+                          size_t count) {
+  for (; count > 0; count--, data += 64) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+      const uint8_t* p = data + 4 * i;
+      w[i] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+             ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+    }
+    for (int i = 16; i < 64; i++) {
+      uint32_t s0 = SHA256_ROTR(w[i - 15], 7) ^ SHA256_ROTR(w[i - 15], 18) ^
+                    (w[i - 15] >> 3);
+      uint32_t s1 = SHA256_ROTR(w[i - 2], 17) ^ SHA256_ROTR(w[i - 2], 19) ^
+                    (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int i = 0; i < 64; i++) {
+      uint32_t s1 = SHA256_ROTR(e, 6) ^ SHA256_ROTR(e, 11) ^
+                    SHA256_ROTR(e, 25);
+      uint32_t ch = (e & f) ^ (~e & g);
+      uint32_t t1 = h + s1 + ch + _sha256_k[i] + w[i];
+      uint32_t s0 = SHA256_ROTR(a, 2) ^ SHA256_ROTR(a, 13) ^
+                    SHA256_ROTR(a, 22);
+      uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+      uint32_t t2 = s0 + maj;
+
+      h = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+  }
+}
+
+#if HASH_X86
+
+// SHA-256 with the SHA-NI instructions. The state is kept in 2 registers as
+// ABEF and CDGH (the layout sha256rnds2 expects) and each iteration of the
+// loop does 4 rounds, while scheduling the message words of the later
+// rounds with sha256msg1 and sha256msg2.
+__attribute__((target("sha,sse4.1,ssse3")))
+static void _sha256BlocksShaNi(uint32_t state[8], const uint8_t* data,
+                               size_t count) {
+  const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bull,
+                                      0x0405060700010203ull);
+
+  __m128i tmp = _mm_loadu_si128((const __m128i*)&state[0]);
+  __m128i state1 = _mm_loadu_si128((const __m128i*)&state[4]);
+  tmp = _mm_shuffle_epi32(tmp, 0xb1);                 // CDAB
+  state1 = _mm_shuffle_epi32(state1, 0x1b);           // EFGH
+  __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);   // ABEF
+  state1 = _mm_blend_epi16(state1, tmp, 0xf0);        // CDGH
+
+  for (; count > 0; count--, data += 64) {
+    __m128i abef = state0, cdgh = state1;
+    __m128i w[4];
+
+    for (int i = 0; i < 16; i++) {
+      if (i < 4) {
+        w[i] = _mm_loadu_si128((const __m128i*)(data + 16 * i));
+        w[i] = _mm_shuffle_epi8(w[i], mask);
+      }
+
+      __m128i msg = _mm_add_epi32(w[i & 3],
+        _mm_loadu_si128((const __m128i*)&_sha256_k[4 * i]));
+      state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+
+      if (3 <= i && i <= 14) {
+        tmp = _mm_alignr_epi8(w[i & 3], w[(i - 1) & 3], 4);
+        w[(i + 1) & 3] = _mm_add_epi32(w[(i + 1) & 3], tmp);
+        w[(i + 1) & 3] = _mm_sha256msg2_epu32(w[(i + 1) & 3], w[i & 3]);
+      }
+
+      msg = _mm_shuffle_epi32(msg, 0x0e);
+      state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+      if (1 <= i && i <= 12) {
+        w[(i - 1) & 3] = _mm_sha256msg1_epu32(w[(i - 1) & 3], w[i & 3]);
+      }
+    }
+
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+  }
+
+  tmp = _mm_shuffle_epi32(state0, 0x1b);              // FEBA
+  state1 = _mm_shuffle_epi32(state1, 0xb1);           // DCHG
+  state0 = _mm_blend_epi16(tmp, state1, 0xf0);        // DCBA
+  state1 = _mm_alignr_epi8(state1, tmp, 8);           // ABEF
+  _mm_storeu_si128((__m128i*)&state[0], state0);
+  _mm_storeu_si128((__m128i*)&state[4], state1);
+}
+
+#endif // HASH_X86
+
+static void _sha256Process(uint32_t state[8], const uint8_t* data,
+                           size_t count) {
+#if HASH_X86
+  if (!_cpu_checked) _hashCheckCpu();
+  if (_cpu_has_sha) {
+    _sha256BlocksShaNi(state, data, count);
+    return;
+  }
+#endif
+  _sha256Blocks(state, data, count);
+}
+
+void sha256Init(Sha256* self) {
+  static const uint32_t initial[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+  };
+  memcpy(self->state, initial, sizeof(initial));
+  self->length = 0;
+  self->buffer_count = 0;
+}
+
+void sha256Update(Sha256* self, const uint8_t* data, size_t length) {
+  self->length += length;
+
+  // Complete the pending block first.
+  if (self->buffer_count > 0) {
+    size_t size = 64 - self->buffer_count;
+    if (size > length) size = length;
+    memcpy(self->buffer + self->buffer_count, data, size);
+    self->buffer_count += (uint32_t)size;
+    data += size;
+    length -= size;
+
+    if (self->buffer_count < 64) return;
+    _sha256Process(self->state, self->buffer, 1);
+    self->buffer_count = 0;
+  }
+
+  if (length >= 64) {
+    _sha256Process(self->state, data, length / 64);
+    data += length & ~(size_t)63;
+    length &= 63;
+  }
+
+  memcpy(self->buffer, data, length);
+  self->buffer_count = (uint32_t)length;
+}
+
+void sha256Final(Sha256* self, uint8_t digest[SHA256_DIGEST_SIZE]) {
+  uint64_t bits = self->length * 8;
+
+  // Padding: 0x80, zeros and the length in bits as a big endian 64 bit
+  // integer at the end of the last block.
+  uint8_t padding[72];
+  size_t size = ((self->buffer_count < 56) ? 56 : 120) - self->buffer_count;
+  memset(padding, 0, sizeof(padding));
+  padding[0] = 0x80;
+  for (int i = 0; i < 8; i++) {
+    padding[size + i] = (uint8_t)(bits >> (56 - 8 * i));
+  }
+  sha256Update(self, padding, size + 8);
+  ASSERT(self->buffer_count == 0, OOPS);
+
+  for (int i = 0; i < 8; i++) {
+    digest[4 * i]     = (uint8_t)(self->state[i] >> 24);
+    digest[4 * i + 1] = (uint8_t)(self->state[i] >> 16);
+    digest[4 * i + 2] = (uint8_t)(self->state[i] >> 8);
+    digest[4 * i + 3] = (uint8_t)(self->state[i]);
+  }
+}
@@ -0,0 +1,64 @@
+/*
+ *  Copyright (c) 2020-2021 Thakee Nathees
+ *  Distributed Under The MIT License
+ */
+
+#ifndef HASH_H
+#define HASH_H
+
+#include "pk_internal.h"
+
+// Checksum and hash functions of the hash module. The CRC-32C and SHA-256
+// use the CPU instructions (SSE4.2 crc32 and SHA-NI) if they're available at
+// runtime, otherwise the portable implementations.
+
+// Size of a SHA-256 digest in bytes.
+#define SHA256_DIGEST_SIZE 32
+
+// The state of an incremental SHA-256 computation.
+typedef struct {
+  uint32_t state[8];
+  uint64_t length;       //< Number of bytes hashed so far.
+  uint8_t buffer[64];    //< Pending bytes of an incomplete block.
+  uint32_t buffer_count; //< Number of bytes in the [buffer].
+} Sha256;
+
+// The state of an incremental wyhash computation.
+typedef struct {
+  uint64_t seed, see1, see2;  //< The lanes of the hashed blocks.
+  uint64_t length;            //< Number of bytes hashed so far.
+  uint8_t buffer[64];         //< Last 16 hashed bytes and the pending bytes.
+  uint32_t buffer_count;      //< Number of the pending bytes.
+} Wyhash;
+
+// Update the CRC-32C (Castagnoli) checksum [crc] with the [data]. The [crc]
+// of an empty data is 0 and the checksum of a data could be continued by
+// passing it as the [crc] with the following data.
+uint32_t hashCrc32c(uint32_t crc, const uint8_t* data, size_t length);
+
+// Returns the 64 bit wyhash of the [data] with the [seed]. It's a fast non
+// cryptographic hash (not suitable for security purposes).
+uint64_t hashWyhash(const uint8_t* data, size_t length, uint64_t seed);
+
+// Initialize the wyhash state to start a new hash with the [seed].
+void wyhashInit(Wyhash* self, uint64_t seed);
+
+// Hash the [data] of [length] bytes, it could be called multiple times with
+// the consecutive parts of the data.
+void wyhashUpdate(Wyhash* self, const uint8_t* data, size_t length);
+
+// Returns the hash of the data so far, which is the same as the hashWyhash()
+// of the joined parts. The state isn't modified so it could be continued.
+uint64_t wyhashFinal(const Wyhash* self);
+
+// Initialize the SHA-256 state to start a new digest.
+void sha256Init(Sha256* self);
+
+// Hash the [data] of [length] bytes, it could be called multiple times with
+// the consecutive parts of the data.
+void sha256Update(Sha256* self, const uint8_t* data, size_t length);
+
+// Finish the computation and write the digest to [digest].
+void sha256Final(Sha256* self, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+#endif // HASH_H
@@ -54,6 +54,11 @@
 // The initial minimum capacity of a buffer to allocate.
 #define MIN_CAPACITY 8
 
+// Buffers of at least this many bytes are allocated in their own memory
+// mapped region (where it's supported) so that growing them won't copy the
+// elements. See vmReallocBuffer().
+#define LARGE_BUFFER_SIZE (1024 * 1024)
+
 // The size of the error message buffer, used ar vsnprintf (since c99) buffer.
 #define ERROR_MESSAGE_SIZE 512
 
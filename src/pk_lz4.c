@@ -0,0 +1,607 @@
+/*
+ *  Copyright (c) 2020-2021 Thakee Nathees
+ *  Distributed Under The MIT License
+ */
+
+#include "pk_lz4.h"
+
+#include "pk_vm.h"
+
+// A block is a sequence of (literals, match) pairs, each sequence starts with
+// a token byte of 4 bits literal length and 4 bits match length (- MINMATCH),
+// a length of 15 continues with the following bytes (added until a byte is
+// not 255). The offset of a match is 2 bytes (little endian) so the matches
+// could only refer to the previous 64KB. The last sequence has only the
+// literals and the last match should end before the last 5 bytes and start
+// 12 bytes before the end of the block.
+#define MINMATCH      4
+#define LASTLITERALS  5
+#define MFLIMIT       12
+#define MAX_OFFSET    65535
+#define RUN_MASK      15
+
+// The maximum hash log (size of the hash table) of the compressor.
+#define HASH_LOG_MIN  10
+#define HASH_LOG_MAX  16
+
+// The frame format constants.
+#define FRAME_MAGIC           0x184D2204
+#define FRAME_SKIPPABLE_MAGIC 0x184D2A50
+#define FRAME_SKIPPABLE_MASK  0xFFFFFFF0
+#define FRAME_BLOCK_MAX_ID    7  //< Block maximum size of 4MB.
+#define FRAME_UNCOMPRESSED    0x80000000
+
+// The frame descriptor flags (FLG byte).
+#define FLG_VERSION           0x40
+#define FLG_VERSION_MASK      0xC0
+#define FLG_BLOCK_INDEP       0x20
+#define FLG_BLOCK_CHECKSUM    0x10
+#define FLG_CONTENT_SIZE      0x08
+#define FLG_CONTENT_CHECKSUM  0x04
+#define FLG_RESERVED          0x02
+#define FLG_DICT_ID           0x01
+
+// The xxHash32 primes.
+#define PRIME32_1 0x9E3779B1u
+#define PRIME32_2 0x85EBCA77u
+#define PRIME32_3 0xC2B2AE3Du
+#define PRIME32_4 0x27D4EB2Fu
+#define PRIME32_5 0x165667B1u
+
+/*****************************************************************************/
+/* XXHASH32                                                                  */
+/*****************************************************************************/
+
+static inline uint32_t _lz4Read32LE(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+         ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void _lz4Write32LE(uint8_t* p, uint32_t value) {
+  p[0] = (uint8_t)value;
+  p[1] = (uint8_t)(value >> 8);
+  p[2] = (uint8_t)(value >> 16);
+  p[3] = (uint8_t)(value >> 24);
+}
+
+static inline uint32_t _lz4Rotl(uint32_t x, int r) {
+  return (x << r) | (x >> (32 - r));
+}
+
+static inline uint32_t _xxhRound(uint32_t acc, uint32_t input) {
+  acc += input * PRIME32_2;
+  return _lz4Rotl(acc, 13) * PRIME32_1;
+}
+
+uint32_t lz4Xxh32(const uint8_t* data, size_t length, uint32_t seed) {
+  const uint8_t* p = data;
+  const uint8_t* end = data + length;
+  uint32_t h;
+
+  if (length >= 16) {
+    uint32_t v1 = seed + PRIME32_1 + PRIME32_2;
+    uint32_t v2 = seed + PRIME32_2;
+    uint32_t v3 = seed;
+    uint32_t v4 = seed - PRIME32_1;
+
+    do {
+      v1 = _xxhRound(v1, _lz4Read32LE(p));
+      v2 = _xxhRound(v2, _lz4Read32LE(p + 4));
+      v3 = _xxhRound(v3, _lz4Read32LE(p + 8));
+      v4 = _xxhRound(v4, _lz4Read32LE(p + 12));
+      p += 16;
+    } while (end - p >= 16);
+
+    h = _lz4Rotl(v1, 1) + _lz4Rotl(v2, 7) + _lz4Rotl(v3, 12) +
+        _lz4Rotl(v4, 18);
+  } else {
+    h = seed + PRIME32_5;
+  }
+
+  h += (uint32_t)length;
+
+  while (end - p >= 4) {
+    h += _lz4Read32LE(p) * PRIME32_3;
+    h = _lz4Rotl(h, 17) * PRIME32_4;
+    p += 4;
+  }
+
+  while (p < end) {
+    h += (*p++) * PRIME32_5;
+    h = _lz4Rotl(h, 11) * PRIME32_1;
+  }
+
+  h ^= h >> 15;
+  h *= PRIME32_2;
+  h ^= h >> 13;
+  h *= PRIME32_3;
+  h ^= h >> 16;
+  return h;
+}
+
+/*****************************************************************************/
+/* BLOCK COMPRESSION                                                         */
+/*****************************************************************************/
+
+// The state of the match finder. The hash table maps the hash of 4 bytes to
+// the last position (+ 1, 0 means empty) with that hash. For the higher
+// levels the chain table links each position to the previous position with
+// the same hash (as a distance, 0 means no more), which is searched for the
+// longest match up to [attempts] times.
+typedef struct {
+  const uint8_t* src;
+  uint32_t length;
+
+  uint32_t* table;
+  int hash_log;
+
+  uint16_t* chain;     //< NULL for the fast level.
+  int attempts;
+  uint32_t next;       //< Next position to insert into the chain.
+} Lz4Matcher;
+
+// Native endian read, only used to compare the bytes.
+static inline uint32_t _lz4Read32(const uint8_t* p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static inline uint32_t _lz4Hash(const Lz4Matcher* m, uint32_t pos) {
+  return (_lz4Read32(m->src + pos) * 2654435761u) >> (32 - m->hash_log);
+}
+
+// Returns the number of the matching bytes at [a] and [b] (a < b) without
+// exceeding the [limit] for the [b].
+static inline uint32_t _lz4MatchLength(const uint8_t* src, uint32_t a,
+                                       uint32_t b, uint32_t limit) {
+  uint32_t start = b;
+  while (b < limit && src[a] == src[b]) {
+    a++; b++;
+  }
+  return b - start;
+}
+
+// Insert the positions before [pos] into the hash chains.
+static void _lz4Insert(Lz4Matcher* m, uint32_t pos) {
+  while (m->next < pos) {
+    uint32_t h = _lz4Hash(m, m->next);
+    uint32_t delta = m->next + 1 - m->table[h];
+    if (m->table[h] == 0 || delta > MAX_OFFSET) delta = 0;
+    m->chain[m->next & MAX_OFFSET] = (uint16_t)delta;
+    m->table[h] = ++m->next;
+  }
+}
+
+// Find the longest match of the position [pos] (from the previous positions)
+// which doesn't exceed the [limit], set [match] to its position and returns
+// its length, or 0 if there isn't any.
+static uint32_t _lz4FindMatch(Lz4Matcher* m, uint32_t pos, uint32_t limit,
+                              uint32_t* match) {
+  const uint8_t* src = m->src;
+  uint32_t h = _lz4Hash(m, pos);
+  uint32_t best = 0;
+
+  if (m->chain == NULL) {
+    uint32_t candidate = m->table[h];
+    m->table[h] = pos + 1;
+    if (candidate == 0 || pos + 1 - candidate > MAX_OFFSET) return 0;
+    candidate--;
+    if (_lz4Read32(src + candidate) != _lz4Read32(src + pos)) return 0;
+    *match = candidate;
+    return MINMATCH + _lz4MatchLength(src, candidate + MINMATCH,
+                                      pos + MINMATCH, limit);
+  }
+
+  _lz4Insert(m, pos);
+
+  uint32_t candidate = m->table[h];
+  int attempts = m->attempts;
+  if (candidate == 0) return 0;
+  candidate--;
+
+  while (attempts-- > 0 && pos - candidate <= MAX_OFFSET) {
+    // Check the byte after the best length first to skip the shorter ones.
+    if (src[candidate + best] == src[pos + best] &&
+        _lz4Read32(src + candidate) == _lz4Read32(src + pos)) {
+      uint32_t length = MINMATCH + _lz4MatchLength(src, candidate + MINMATCH,
+                                                   pos + MINMATCH, limit);
+      if (length > best) {
+        best = length;
+        *match = candidate;
+        if (pos + best >= limit) break;
+      }
+    }
+
+    uint16_t delta = m->chain[candidate & MAX_OFFSET];
+    if (delta == 0 || delta > candidate) break;
+    candidate -= delta;
+  }
+
+  return best;
+}
+
+// Write the length remaining after the 4 bits of the token.
+static inline uint8_t* _lz4WriteLength(uint8_t* op, size_t length) {
+  while (length >= 255) {
+    *op++ = 255;
+    length -= 255;
+  }
+  *op++ = (uint8_t)length;
+  return op;
+}
+
+// Write a sequence of the [literals] followed by a match of [match_length]
+// at the [offset]. If the [match_length] is 0 it'll be the last sequence.
+static uint8_t* _lz4WriteSequence(uint8_t* op, const uint8_t* literals,
+                                  size_t literal_length, uint32_t offset,
+                                  uint32_t match_length) {
+  uint8_t* token = op++;
+
+  if (literal_length >= RUN_MASK) {
+    *token = RUN_MASK << 4;
+    op = _lz4WriteLength(op, literal_length - RUN_MASK);
+  } else {
+    *token = (uint8_t)(literal_length << 4);
+  }
+
+  memcpy(op, literals, literal_length);
+  op += literal_length;
+
+  if (match_length == 0) return op;
+
+  *op++ = (uint8_t)offset;
+  *op++ = (uint8_t)(offset >> 8);
+
+  uint32_t length = match_length - MINMATCH;
+  if (length >= RUN_MASK) {
+    *token |= RUN_MASK;
+    op = _lz4WriteLength(op, length - RUN_MASK);
+  } else {
+    *token |= (uint8_t)length;
+  }
+
+  return op;
+}
+
+size_t lz4CompressBlock(PKVM* vm, const uint8_t* src, size_t length,
+                        uint8_t* dst, int level) {
+  uint8_t* op = dst;
+
+  // Too short to have a match.
+  if (length < MFLIMIT + 1) {
+    op = _lz4WriteSequence(op, src, length, 0, 0);
+    return (size_t)(op - dst);
+  }
+
+  if (level < LZ4_LEVEL_FAST) level = LZ4_LEVEL_FAST;
+  if (level > LZ4_LEVEL_MAX) level = LZ4_LEVEL_MAX;
+
+  Lz4Matcher m;
+  m.src = src;
+  m.length = (uint32_t)length;
+  m.hash_log = HASH_LOG_MIN;
+  while (m.hash_log < HASH_LOG_MAX && ((size_t)1 << m.hash_log) < length) {
+    m.hash_log++;
+  }
+
+  size_t table_size = (size_t)1 << m.hash_log;
+  m.table = ALLOCATE_ARRAY(vm, uint32_t, table_size);
+  memset(m.table, 0, table_size * sizeof(uint32_t));
+
+  m.chain = NULL;
+  m.attempts = 0;
+  m.next = 0;
+  if (level > LZ4_LEVEL_FAST) {
+    m.chain = ALLOCATE_ARRAY(vm, uint16_t, MAX_OFFSET + 1);
+    m.attempts = 1 << (level - 1);
+  }
+
+  const uint32_t match_limit = m.length - LASTLITERALS;
+  const uint32_t last_start = m.length - MFLIMIT;
+
+  uint32_t anchor = 0, pos = 0;
+  while (pos <= last_start) {
+    uint32_t match = 0;
+    uint32_t match_length = _lz4FindMatch(&m, pos, match_limit, &match);
+
+    if (match_length == 0) {
+      // The fast level skips faster on the data which doesn't compress.
+      pos += (m.chain == NULL) ? 1 + ((pos - anchor) >> 6) : 1;
+      continue;
+    }
+
+    // Lazy matching: prefer a longer match at the next position.
+    if (m.chain != NULL && pos + 1 <= last_start) {
+      uint32_t next_match = 0;
+      uint32_t next_length = _lz4FindMatch(&m, pos + 1, match_limit,
+                                           &next_match);
+      if (next_length > match_length) {
+        pos++;
+        match = next_match;
+        match_length = next_length;
+      }
+    }
+
+    // Extend the match backward into the pending literals.
+    while (pos > anchor && match > 0 && src[pos - 1] == src[match - 1]) {
+      pos--; match--; match_length++;
+    }
+
+    op = _lz4WriteSequence(op, src + anchor, pos - anchor, pos - match,
+                           match_length);
+    pos += match_length;
+    anchor = pos;
+
+    // Insert a position inside the match for the fast level to find the
+    // repetitions at the next positions.
+    if (m.chain == NULL && pos - 2 <= last_start) {
+      m.table[_lz4Hash(&m, pos - 2)] = pos - 2 + 1;
+    }
+  }
+
+  op = _lz4WriteSequence(op, src + anchor, length - anchor, 0, 0);
+
+  DEALLOCATE(vm, m.table);
+  if (m.chain != NULL) DEALLOCATE(vm, m.chain);
+
+  return (size_t)(op - dst);
+}
+
+/*****************************************************************************/
+/* BLOCK DECOMPRESSION                                                       */
+/*****************************************************************************/
+
+// Read the length remaining after the 4 bits of the token and add it to the
+// [length]. Returns false if the input ends.
+static inline bool _lz4ReadLength(const uint8_t** ip, const uint8_t* end,
+                                  size_t* length) {
+  uint8_t byte;
+  do {
+    if (*ip >= end) return false;
+    byte = *(*ip)++;
+    *length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+int64_t lz4DecompressBlock(const uint8_t* src, size_t length, uint8_t* dst,
+                           size_t pos, size_t capacity) {
+  const uint8_t* ip = src;
+  const uint8_t* end = src + length;
+  size_t op = pos;
+
+  while (true) {
+    if (ip >= end) return -1;
+    uint8_t token = *ip++;
+
+    size_t literal_length = token >> 4;
+    if (literal_length == RUN_MASK &&
+        !_lz4ReadLength(&ip, end, &literal_length)) {
+      return -1;
+    }
+
+    if (literal_length > (size_t)(end - ip) ||
+        literal_length > capacity - op) {
+      return -1;
+    }
+    memcpy(dst + op, ip, literal_length);
+    ip += literal_length;
+    op += literal_length;
+
+    // The last sequence doesn't have a match.
+    if (ip == end) break;
+
+    if (end - ip < 2) return -1;
+    size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > op) return -1;
+
+    size_t match_length = token & RUN_MASK;
+    if (match_length == RUN_MASK &&
+        !_lz4ReadLength(&ip, end, &match_length)) {
+      return -1;
+    }
+    match_length += MINMATCH;
+    if (match_length > capacity - op) return -1;
+
+    // The match could overlap with the bytes being written (for repeating
+    // patterns), which should be copied byte by byte.
+    if (offset >= match_length) {
+      memcpy(dst + op, dst + op - offset, match_length);
+    } else {
+      for (size_t i = 0; i < match_length; i++) {
+        dst[op + i] = dst[op + i - offset];
+      }
+    }
+    op += match_length;
+  }
+
+  return (int64_t)(op - pos);
+}
+
+/*****************************************************************************/
+/* FRAME FORMAT                                                              */
+/*****************************************************************************/
+
+// Returns the block maximum size of the block maximum size id of the frame
+// descriptor (4 to 7).
+static inline size_t _lz4BlockMaxSize(int id) {
+  return (size_t)1 << (8 + 2 * id);
+}
+
+void lz4CompressFrame(PKVM* vm, const uint8_t* src, size_t length, int level,
+                      pkByteBuffer* out) {
+  const size_t block_max = _lz4BlockMaxSize(FRAME_BLOCK_MAX_ID);
+
+  // Magic number, frame descriptor and the header checksum.
+  uint8_t header[4 + 2 + 8 + 1];
+  _lz4Write32LE(header, FRAME_MAGIC);
+  header[4] = FLG_VERSION | FLG_BLOCK_INDEP | FLG_CONTENT_SIZE |
+              FLG_CONTENT_CHECKSUM;
+  header[5] = FRAME_BLOCK_MAX_ID << 4;
+  _lz4Write32LE(header + 6, (uint32_t)length);
+  _lz4Write32LE(header + 10, (uint32_t)((uint64_t)length >> 32));
+  header[14] = (uint8_t)(lz4Xxh32(header + 4, 10, 0) >> 8);
+
+  pkByteBufferReserve(out, vm, out->count + sizeof(header));
+  memcpy(out->data + out->count, header, sizeof(header));
+  out->count += sizeof(header);
+
+  for (size_t start = 0; start < length; start += block_max) {
+    size_t size = length - start;
+    if (size > block_max) size = block_max;
+
+    pkByteBufferReserve(out, vm, out->count + 4 + LZ4_COMPRESS_BOUND(size));
+    uint8_t* block = out->data + out->count;
+    size_t compressed = lz4CompressBlock(vm, src + start, size, block + 4,
+                                         level);
+
+    // Store the block uncompressed if it doesn't get any smaller.
+    if (compressed >= size) {
+      _lz4Write32LE(block, (uint32_t)size | FRAME_UNCOMPRESSED);
+      memcpy(block + 4, src + start, size);
+      compressed = size;
+    } else {
+      _lz4Write32LE(block, (uint32_t)compressed);
+    }
+    out->count += (uint32_t)(4 + compressed);
+  }
+
+  // End mark and the content checksum.
+  uint8_t footer[8];
+  _lz4Write32LE(footer, 0);
+  _lz4Write32LE(footer + 4, lz4Xxh32(src, length, 0));
+  pkByteBufferReserve(out, vm, out->count + sizeof(footer));
+  memcpy(out->data + out->count, footer, sizeof(footer));
+  out->count += sizeof(footer);
+}
+
+// Decompress a single frame (after the magic number) at [*ip] and advance it
+// to the end of the frame.
+static const char* _lz4DecompressFrame(PKVM* vm, const uint8_t** ip,
+                                       const uint8_t* end,
+                                       pkByteBuffer* out) {
+  const uint8_t* p = *ip;
+
+  if (end - p < 3) return "Unexpected end of the frame.";
+  const uint8_t* descriptor = p;
+  uint8_t flags = p[0], bd = p[1];
+  p += 2;
+
+  if ((flags & FLG_VERSION_MASK) != FLG_VERSION) {
+    return "Unsupported frame version.";
+  }
+  if ((flags & FLG_RESERVED) != 0 || (bd & 0x8F) != 0) {
+    return "Invalid frame descriptor.";
+  }
+  if ((flags & FLG_DICT_ID) != 0) {
+    return "Frames with a dictionary are not supported.";
+  }
+
+  int block_id = (bd >> 4) & 0x7;
+  if (block_id < 4) return "Invalid block maximum size.";
+  const size_t block_max = _lz4BlockMaxSize(block_id);
+
+  uint64_t content_size = 0;
+  if (flags & FLG_CONTENT_SIZE) {
+    if (end - p < 9) return "Unexpected end of the frame.";
+    content_size = (uint64_t)_lz4Read32LE(p) |
+                   ((uint64_t)_lz4Read32LE(p + 4) << 32);
+    p += 8;
+  }
+
+  uint8_t checksum = (uint8_t)(lz4Xxh32(descriptor, p - descriptor, 0) >> 8);
+  if (*p++ != checksum) return "Invalid frame header checksum.";
+
+  const uint32_t content_start = out->count;
+
+  while (true) {
+    if (end - p < 4) return "Unexpected end of the frame.";
+    uint32_t size = _lz4Read32LE(p);
+    p += 4;
+    if (size == 0) break; // End mark.
+
+    bool uncompressed = (size & FRAME_UNCOMPRESSED) != 0;
+    size &= ~FRAME_UNCOMPRESSED;
+    if (size > block_max) return "Invalid block size.";
+    if ((size_t)(end - p) < size) return "Unexpected end of the frame.";
+
+    if (flags & FLG_BLOCK_CHECKSUM) {
+      if ((size_t)(end - p) < (size_t)size + 4) {
+        return "Unexpected end of the frame.";
+      }
+      if (_lz4Read32LE(p + size) != lz4Xxh32(p, size, 0)) {
+        return "Invalid block checksum.";
+      }
+    }
+
+    pkByteBufferReserve(out, vm, out->count + block_max);
+    if (uncompressed) {
+      memcpy(out->data + out->count, p, size);
+      out->count += size;
+
+    } else {
+      // The matches of the linked blocks could refer to the previous blocks
+      // of the frame.
+      uint32_t base = (flags & FLG_BLOCK_INDEP) ? out->count : content_start;
+      size_t pos = out->count - base;
+      int64_t written = lz4DecompressBlock(p, size, out->data + base, pos,
+                                           pos + block_max);
+      if (written < 0) return "Invalid compressed block.";
+      out->count += (uint32_t)written;
+    }
+
+    p += size;
+    if (flags & FLG_BLOCK_CHECKSUM) p += 4;
+  }
+
+  const uint8_t* content = out->data + content_start;
+  uint32_t content_length = out->count - content_start;
+
+  if ((flags & FLG_CONTENT_SIZE) && content_size != content_length) {
+    return "Content size mismatch.";
+  }
+
+  if (flags & FLG_CONTENT_CHECKSUM) {
+    if (end - p < 4) return "Unexpected end of the frame.";
+    if (_lz4Read32LE(p) != lz4Xxh32(content, content_length, 0)) {
+      return "Invalid content checksum.";
+    }
+    p += 4;
+  }
+
+  *ip = p;
+  return NULL;
+}
+
+const char* lz4DecompressFrame(PKVM* vm, const uint8_t* src, size_t length,
+                               pkByteBuffer* out) {
+  const uint8_t* ip = src;
+  const uint8_t* end = src + length;
+
+  if (length == 0) return "Unexpected end of the frame.";
+
+  // The frames could be concatenated, skippable frames are ignored.
+  while (ip < end) {
+    if (end - ip < 4) return "Unexpected end of the frame.";
+    uint32_t magic = _lz4Read32LE(ip);
+    ip += 4;
+
+    if ((magic & FRAME_SKIPPABLE_MASK) == FRAME_SKIPPABLE_MAGIC) {
+      if (end - ip < 4) return "Unexpected end of the frame.";
+      uint32_t size = _lz4Read32LE(ip);
+      ip += 4;
+      if ((size_t)(end - ip) < size) return "Unexpected end of the frame.";
+      ip += size;
+      continue;
+    }
+
+    if (magic != FRAME_MAGIC) return "Invalid frame magic number.";
+
+    const char* error = _lz4DecompressFrame(vm, &ip, end, out);
+    if (error != NULL) return error;
+  }
+
+  return NULL;
+}
@@ -0,0 +1,54 @@
+/*
+ *  Copyright (c) 2020-2021 Thakee Nathees
+ *  Distributed Under The MIT License
+ */
+
+#ifndef LZ4_H
+#define LZ4_H
+
+#include "pk_internal.h"
+#include "pk_var.h"
+
+// A self contained implementation of the LZ4 block and frame formats, which
+// is compatible with the reference implementation (the lz4 command line tool
+// could decompress the frames and vice versa). Reference:
+//   https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+//   https://github.com/lz4/lz4/blob/dev/doc/lz4_Frame_format.md
+
+// The compression levels, level 1 is the fast greedy compressor and the
+// higher levels search more previous matches (up to 2^(level-1) with hash
+// chains) for a better compression ratio.
+#define LZ4_LEVEL_FAST 1
+#define LZ4_LEVEL_MAX  12
+
+// Returns the maximum size of a compressed block of [length] bytes.
+#define LZ4_COMPRESS_BOUND(length) ((length) + (length) / 255 + 16)
+
+// Compress the [length] bytes at [src] into a block at [dst] which should be
+// at least LZ4_COMPRESS_BOUND(length) bytes and return the size of the
+// compressed block.
+size_t lz4CompressBlock(PKVM* vm, const uint8_t* src, size_t length,
+                        uint8_t* dst, int level);
+
+// Decompress the block at [src] to [dst] starting at the offset [pos], the
+// matches of the block could refer to the data before [pos] (for linked
+// blocks). Returns the number of bytes written or -1 if the block is invalid
+// or the result doesn't fit in the [capacity] of the [dst].
+int64_t lz4DecompressBlock(const uint8_t* src, size_t length, uint8_t* dst,
+                           size_t pos, size_t capacity);
+
+// Compress the [length] bytes at [src] into an LZ4 frame (with the content
+// size and the content checksum) and append it to the buffer [out].
+void lz4CompressFrame(PKVM* vm, const uint8_t* src, size_t length, int level,
+                      pkByteBuffer* out);
+
+// Decompress all the frames at [src] and append the content to the buffer
+// [out]. Returns NULL on success otherwise a static error message.
+const char* lz4DecompressFrame(PKVM* vm, const uint8_t* src, size_t length,
+                               pkByteBuffer* out);
+
+// Returns the 32 bit xxHash of the [data] with the [seed], used for the
+// checksums of the frame format.
+uint32_t lz4Xxh32(const uint8_t* data, size_t length, uint32_t seed);
+
+#endif // LZ4_H
@@ -37,7 +37,14 @@ OPCODE(SWAP, 0, 0)
 OPCODE(PUSH_LIST, 2, 1)
 
 // Push a new map to construct from literal.
-OPCODE(PUSH_MAP, 0, 1)
+// param: 2 bytes map size (defalt is 0).
+OPCODE(PUSH_MAP, 2, 1)
+
+// Push a copy of the list or map at index [arg] of the script's literals.
+// Used for the literals which contain only constants, instead of building
+// them element by element.
+// params: 2 byte (uint16_t) index value.
+OPCODE(CLONE_CONSTANT, 2, 1)
 
 // Push a new instance to the stack.
 // param: 1 byte index.
@@ -139,9 +146,8 @@ OPCODE(ITER_TEST, 0, 0)
 // The stack top will be iteration value, next one is iterator (integer) and
 // next would be the container. It'll update those values but not push or pop
 // any values. We need to ensure that stack state at the point.
-// param: 1 byte iterate type (will be set by ITER_TEST at runtime).
 // param: 2 bytes jump offset if the iteration should stop.
-OPCODE(ITER, 3, 0)
+OPCODE(ITER, 2, 0)
 
 // The address offset to jump to. It'll add the offset to ip.
 // param: 2 bytes jump address offset.
@@ -159,6 +165,28 @@ OPCODE(JUMP_IF, 2, -1)
 // param: 2 bytes jump address.
 OPCODE(JUMP_IF_NOT, 2, -1)
 
+// Pop the stack top value and jump to the case it matches in a dense integer
+// jump table. The table is a list literal where the first element is the
+// smallest case value and the rest are the jump offsets of the consecutive
+// case values (missing cases have the default offset).
+// param: 2 bytes (uint16_t) index of the table in the script's literals.
+// param: 2 bytes default jump offset if no case matches.
+OPCODE(TABLE_JUMP, 4, -1)
+
+// Pop the stack top value and jump to the offset it maps to in a map literal
+// of case values to jump offsets. Used for strings and sparse cases.
+// param: 2 bytes (uint16_t) index of the map in the script's literals.
+// param: 2 bytes default jump offset if no case matches.
+OPCODE(MAP_JUMP, 4, -1)
+
+// Does nothing. Used to pad the bytes of rewritten instructions.
+OPCODE(NOP, 0, 0)
+
+// Mark the line of the instruction as executed and rewrite itself into OP_NOP
+// since it's only needed once. Emitted at the start of the statements when
+// compiling with the coverage option.
+OPCODE(COVER, 0, 0)
+
 // Pop the stack top value and store it to the current stack frame's 0 index.
 // Then it'll pop the current stack frame.
 OPCODE(RETURN, 0, -1)
@@ -179,12 +207,20 @@ OPCODE(SET_ATTRIB, 2, -1)
 OPCODE(GET_SUBSCRIPT, 0, -1)
 
 // Get subscript to perform assignment operation before store it, so it won't
-// pop the var and the key. (ex: map[key] += value).
+// pop the var and the key. (ex: map[key] += value). The element's slot is
+// recorded in the vm for the SUBSCRIPT_UPDATE.
 OPCODE(GET_SUBSCRIPT_KEEP, 0, 1)
 
 // Pop var, key, value set and push value back.
 OPCODE(SET_SUBSCRIPT, 0, -2)
 
+// Pop var, key, the subscript value (pushed by GET_SUBSCRIPT_KEEP) and the
+// value, apply the operator to the subscript value and the value, store it
+// through the slot of the GET_SUBSCRIPT_KEEP (if it's still valid) and push
+// the result back (ex: map[key] += value).
+// param: 1 byte opcode of the binary operator.
+OPCODE(SUBSCRIPT_UPDATE, 1, -3)
+
 // Pop unary operand and push value.
 OPCODE(NEGATIVE, 0, 0) //< Negative number value.
 OPCODE(NOT, 0, 0)      //< boolean not.
@@ -213,10 +249,37 @@ OPCODE(GTEQ, 0, -1)
 OPCODE(RANGE, 0, -1) //< Pop 2 integer make range push.
 OPCODE(IN, 0, -1)
 
+// Pop binary number operands and push value. These are emitted instead of the
+// above generic instructions when both the operands are known to be numbers at
+// compile time (see type annotations) so the operands won't be type checked.
+OPCODE(ADD_NUM, 0, -1)
+OPCODE(SUBTRACT_NUM, 0, -1)
+OPCODE(MULTIPLY_NUM, 0, -1)
+OPCODE(DIVIDE_NUM, 0, -1)
+
+OPCODE(LT_NUM, 0, -1)
+OPCODE(LTEQ_NUM, 0, -1)
+OPCODE(GT_NUM, 0, -1)
+OPCODE(GTEQ_NUM, 0, -1)
+
+// Pop a string and push it's length. The operand won't be type checked since
+// it's known to be a string at compile time.
+OPCODE(STR_LENGTH, 0, 0)
+
+// Check if the stack top value is of the annotated type, if not it'll set a
+// runtime error. This will not pop the value.
+// param: 1 byte PkVarType of the value.
+OPCODE(CHECK_TYPE, 1, 0)
+
 // Print the repr string of the value at the stack top, used in REPL mode.
 // This will not pop the value.
 OPCODE(REPL_PRINT, 0, 0)
 
+// Written by the debugger over the first byte of an instruction to pause the
+// execution there. The original opcode is kept in the debugger's side table
+// and executed once it's resumed. The compiler never emits this.
+OPCODE(BREAKPOINT, 0, 0)
+
 // A sudo instruction which will never be called. A function's last opcode
 // used for debugging.
 OPCODE(END, 0, 0)
@@ -0,0 +1,1056 @@
+/*
+ *  Copyright (c) 2020-2021 Thakee Nathees
+ *  Distributed Under The MIT License
+ */
+
+// A regular expression engine which guarantees linear time matching (like
+// RE2). The pattern is parsed into a tree, which is compiled into a program
+// of the following instructions, and the program is simulated with all the
+// threads in lock step (Pike VM) so a pattern never backtracks.
+//
+//   CHAR  c     - Consume the byte [c].
+//   ANY         - Consume any byte except '\n'.
+//   CLASS i     - Consume a byte of the byte set at [i].
+//   SPLIT x, y  - Continue at both [x] and [y], [x] has the higher priority.
+//   JUMP  x     - Continue at [x].
+//   SAVE  n     - Save the current position to the capture slot [n].
+//   BOL, EOL, WORDB, NWORDB - Assertions ('^', '$', '\b', '\B').
+//   MATCH       - Found a match.
+//
+// Example: 'a(b|c)*' compiles into
+//
+//   0: SAVE 0      3: SAVE 2       6: JUMP 8      9: JUMP 2
+//   1: CHAR 'a'    4: SPLIT 5, 7   7: CHAR 'c'   10: SAVE 1
+//   2: SPLIT 3,10  5: CHAR 'b'     8: SAVE 3     11: MATCH
+
+#include "pk_re.h"
+
+#include "pk_utils.h"
+#include "pk_vm.h"
+
+// The maximum number of instructions of a compiled pattern, this will limit
+// the time (and memory) of a match to O(n * MAX_PROGRAM_SIZE).
+#define MAX_PROGRAM_SIZE 8192
+
+// The maximum count of a counted repetition ex: 'a{1000}'.
+#define MAX_REPEAT 1000
+
+// The maximum nesting of the groups, the parser and the compiler are
+// recursive on the nested groups.
+#define MAX_DEPTH 128
+
+typedef enum {
+  RE_CHAR,
+  RE_ANY,
+  RE_CLASS,
+  RE_SPLIT,
+  RE_JUMP,
+  RE_SAVE,
+  RE_BOL,
+  RE_EOL,
+  RE_WORDB,
+  RE_NWORDB,
+  RE_MATCH,
+} ReOp;
+
+typedef struct {
+  ReOp op;
+  int arg;   //< The byte, class index or the capture slot.
+  int x, y;  //< The jump targets of SPLIT and JUMP.
+} ReInst;
+
+// A set of bytes, with a bit for each of the 256 values.
+typedef struct {
+  uint32_t bits[8];
+} ByteSet;
+
+// The list of threads at a position of the subject, a thread is the program
+// counter and it's captures. [marks] is used to add each instruction only
+// once per position, an instruction is in the list if it's mark is equal to
+// the list's [generation].
+typedef struct {
+  int count;
+  int* pcs;
+  int* caps;
+  uint32_t* marks;
+  uint32_t generation;
+} ThreadList;
+
+// An entry of the stack used to follow the SPLIT and SAVE instructions when
+// adding a thread. If the [slot] is not -1 it's an entry to restore the
+// capture [slot] to [value] after the threads of the SAVE were added.
+typedef struct {
+  int pc;
+  int slot;
+  int value;
+} StackEntry;
+
+struct Regex {
+  char* pattern;       //< Source of the pattern, to lookup the cache.
+  uint32_t length;     //< Length of the [pattern].
+
+  ReInst* program;
+  int program_size;
+
+  ByteSet* classes;
+  int class_count;
+
+  int group_count;
+
+  // The literal which every match should start with (could be empty), used
+  // to skip to the possible match positions quickly with memchr().
+  char* prefix;
+  uint32_t prefix_length;
+
+  // Index of the class which the first byte of every match should be in, if
+  // there is no [prefix], otherwise -1.
+  int first_class;
+
+  // True if every match should start at the beginning of the subject.
+  bool bol;
+
+  // Memory used while matching, allocated once with the regex.
+  ThreadList lists[2];
+  StackEntry* stack;
+  int* caps;
+};
+
+static inline void setAdd(ByteSet* set, int c) {
+  set->bits[c >> 5] |= (uint32_t)1 << (c & 31);
+}
+
+static inline bool setHas(const ByteSet* set, int c) {
+  return (set->bits[c >> 5] & ((uint32_t)1 << (c & 31))) != 0;
+}
+
+// Returns true if [c] is [A-Za-z0-9_].
+static inline bool isWordByte(int c) {
+  return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') ||
+         ('0' <= c && c <= '9') || c == '_';
+}
+
+// Returns true if [c] is in the class of the escape [kind] (d, w, s or their
+// upper case negations).
+static bool isClassByte(char kind, int c) {
+  bool result = false;
+  switch (kind) {
+    case 'd': case 'D': result = ('0' <= c && c <= '9'); break;
+    case 'w': case 'W': result = isWordByte(c); break;
+    case 's': case 'S':
+      result = (c == ' ' || c == '\t' || c == '\n' || c == '\r' ||
+                c == '\f' || c == '\v');
+      break;
+    default:
+      UNREACHABLE();
+  }
+  return ('A' <= kind && kind <= 'Z') ? !result : result;
+}
+
+static void setAddClass(ByteSet* set, char kind) {
+  for (int c = 0; c < 256; c++) {
+    if (isClassByte(kind, c)) setAdd(set, c);
+  }
+}
+
+/*****************************************************************************/
+/* PARSER                                                                    */
+/*****************************************************************************/
+
+typedef enum {
+  NODE_EMPTY,   //< Matches an empty string.
+  NODE_CHAR,    //< The byte [value].
+  NODE_ANY,     //< Any byte except '\n'.
+  NODE_CLASS,   //< A byte in the class at index [value].
+  NODE_BOL,     //< '^'
+  NODE_EOL,     //< '$'
+  NODE_WORDB,   //< '\b'
+  NODE_NWORDB,  //< '\B'
+  NODE_CAT,     //< [left] followed by [right].
+  NODE_ALT,     //< [left] or [right].
+  NODE_GROUP,   //< Group of [left], [value] is the group index or -1.
+  NODE_REPEAT,  //< [left] repeated [min] to [max] (-1 = no limit) times.
+} NodeType;
+
+typedef struct {
+  NodeType type;
+  int value;
+  int left, right;
+  int min, max;
+  bool greedy;
+} Node;
+
+// The concatenations and alternations are right leaning chains of CAT and
+// ALT nodes, so they're compiled with a loop instead of recursion.
+typedef struct {
+  const char* pattern;
+  uint32_t length;
+  uint32_t pos;
+
+  Node* nodes;
+  int node_count;
+  int node_capacity;
+
+  ByteSet* classes;
+  int class_count;
+
+  int group_count;
+  int depth;
+
+  const char* error; //< The error message, NULL if there is no errors.
+} Parser;
+
+static int parseAlternation(Parser* parser);
+
+// Set the [error] if there isn't one already and return -1.
+static int patternError(Parser* parser, const char* error) {
+  if (parser->error == NULL) parser->error = error;
+  return -1;
+}
+
+static int newNode(Parser* parser, NodeType type) {
+  ASSERT(parser->node_count < parser->node_capacity, OOPS);
+  Node* node = &parser->nodes[parser->node_count];
+  node->type = type;
+  node->value = 0;
+  node->left = -1;
+  node->right = -1;
+  node->min = 0;
+  node->max = 0;
+  node->greedy = true;
+  return parser->node_count++;
+}
+
+static int newClassNode(Parser* parser, ByteSet** set) {
+  ASSERT(parser->class_count <= (int)parser->length, OOPS);
+  *set = &parser->classes[parser->class_count];
+  memset(*set, 0, sizeof(ByteSet));
+
+  int node = newNode(parser, NODE_CLASS);
+  parser->nodes[node].value = parser->class_count++;
+  return node;
+}
+
+static inline bool patternHasNext(const Parser* parser) {
+  return parser->pos < parser->length;
+}
+
+static inline char patternPeek(const Parser* parser) {
+  return parser->pattern[parser->pos];
+}
+
+// Returns the value of the hex digit [c] or -1 if it's not a hex digit.
+static int hexValue(char c) {
+  if ('0' <= c && c <= '9') return c - '0';
+  if ('a' <= c && c <= 'f') return c - 'a' + 10;
+  if ('A' <= c && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Parse the escape sequence after a '\'. If it's a class escape (ex: '\d')
+// the [kind] will be set to the letter, otherwise [c] will be the byte.
+// Returns false on failure.
+static bool parseEscape(Parser* parser, int* c, char* kind) {
+  if (!patternHasNext(parser)) {
+    patternError(parser, "Trailing '\\' in the pattern.");
+    return false;
+  }
+
+  char escape = parser->pattern[parser->pos++];
+  *kind = '\0';
+
+  switch (escape) {
+    case 'd': case 'D':
+    case 'w': case 'W':
+    case 's': case 'S':
+      *kind = escape;
+      return true;
+
+    case 'n': *c = '\n'; return true;
+    case 'r': *c = '\r'; return true;
+    case 't': *c = '\t'; return true;
+    case 'f': *c = '\f'; return true;
+    case 'v': *c = '\v'; return true;
+    case '0': *c = '\0'; return true;
+
+    case 'x':
+    {
+      int hi = (parser->pos + 1 < parser->length)
+             ? hexValue(parser->pattern[parser->pos]) : -1;
+      int lo = (hi >= 0) ? hexValue(parser->pattern[parser->pos + 1]) : -1;
+      if (lo < 0) {
+        patternError(parser, "Expected 2 hex digits after '\\x'.");
+        return false;
+      }
+      parser->pos += 2;
+      *c = (hi << 4) | lo;
+      return true;
+    }
+
+    default:
+      // Escaping a letter or a digit which isn't an escape sequence is an
+      // error, so they could be used for escape sequences later.
+      if (isWordByte((uint8_t)escape)) {
+        patternError(parser, "Unknown escape sequence.");
+        return false;
+      }
+      *c = (uint8_t)escape;
+      return true;
+  }
+}
+
+// Parse a byte class, the '[' is already consumed.
+static int parseClass(Parser* parser) {
+  ByteSet* set;
+  int node = newClassNode(parser, &set);
+
+  bool negate = false;
+  if (patternHasNext(parser) && patternPeek(parser) == '^') {
+    negate = true;
+    parser->pos++;
+  }
+
+  // A ']' right after the '[' (or '[^') is a literal.
+  bool first = true;
+  while (true) {
+    if (!patternHasNext(parser)) return patternError(parser, "Missing ']'.");
+
+    char c = parser->pattern[parser->pos++];
+    if (c == ']' && !first) break;
+    first = false;
+
+    int from;
+    char kind = '\0';
+    if (c == '\\') {
+      if (!parseEscape(parser, &from, &kind)) return -1;
+      if (kind != '\0') {
+        setAddClass(set, kind);
+        continue;
+      }
+    } else {
+      from = (uint8_t)c;
+    }
+
+    // A range (a '-' at the end is a literal).
+    if (parser->pos + 1 < parser->length && patternPeek(parser) == '-' &&
+        parser->pattern[parser->pos + 1] != ']') {
+      parser->pos++;
+
+      int to;
+      c = parser->pattern[parser->pos++];
+      if (c == '\\') {
+        if (!parseEscape(parser, &to, &kind)) return -1;
+        if (kind != '\0') return patternError(parser, "Invalid class range.");
+      } else {
+        to = (uint8_t)c;
+      }
+
+      if (to < from) return patternError(parser, "Invalid class range.");
+      for (int i = from; i <= to; i++) setAdd(set, i);
+
+    } else {
+      setAdd(set, from);
+    }
+  }
+
+  if (negate) {
+    for (int i = 0; i < 8; i++) set->bits[i] = ~set->bits[i];
+  }
+
+  return node;
+}
+
+static int parseAtom(Parser* parser) {
+  char c = parser->pattern[parser->pos++];
+
+  switch (c) {
+    case '(':
+    {
+      if (++parser->depth > MAX_DEPTH) {
+        return patternError(parser, "Groups are nested too deeply.");
+      }
+
+      int index = -1;
+      if (patternHasNext(parser) && patternPeek(parser) == '?') {
+        if (parser->pos + 1 >= parser->length ||
+            parser->pattern[parser->pos + 1] != ':') {
+          return patternError(parser, "Unknown group extension.");
+        }
+        parser->pos += 2;
+      } else {
+        if (parser->group_count >= REGEX_MAX_GROUPS) {
+          return patternError(parser, "Too many groups.");
+        }
+        index = ++parser->group_count;
+      }
+
+      int child = parseAlternation(parser);
+      if (child < 0) return -1;
+
+      if (!patternHasNext(parser) || patternPeek(parser) != ')') {
+        return patternError(parser, "Missing ')'.");
+      }
+      parser->pos++;
+      parser->depth--;
+
+      int node = newNode(parser, NODE_GROUP);
+      parser->nodes[node].value = index;
+      parser->nodes[node].left = child;
+      return node;
+    }
+
+    case '[':
+      return parseClass(parser);
+
+    case '.': return newNode(parser, NODE_ANY);
+    case '^': return newNode(parser, NODE_BOL);
+    case '$': return newNode(parser, NODE_EOL);
+
+    case '*': case '+': case '?':
+      return patternError(parser, "Nothing to repeat.");
+
+    case '\\':
+    {
+      if (patternHasNext(parser) && patternPeek(parser) == 'b') {
+        parser->pos++;
+        return newNode(parser, NODE_WORDB);
+      }
+      if (patternHasNext(parser) && patternPeek(parser) == 'B') {
+        parser->pos++;
+        return newNode(parser, NODE_NWORDB);
+      }
+
+      int byte;
+      char kind;
+      if (!parseEscape(parser, &byte, &kind)) return -1;
+
+      if (kind != '\0') {
+        ByteSet* set;
+        int node = newClassNode(parser, &set);
+        setAddClass(set, kind);
+        return node;
+      }
+
+      int node = newNode(parser, NODE_CHAR);
+      parser->nodes[node].value = byte;
+      return node;
+    }
+
+    default:
+    {
+      int node = newNode(parser, NODE_CHAR);
+      parser->nodes[node].value = (uint8_t)c;
+      return node;
+    }
+  }
+}
+
+// Parse a decimal number of at most 4 digits, returns -1 if there isn't one.
+static int parseCount(Parser* parser) {
+  int value = -1;
+  int digits = 0;
+  while (patternHasNext(parser) && utilIsDigit(patternPeek(parser)) &&
+         digits < 4) {
+    value = ((value < 0) ? 0 : value * 10) + (patternPeek(parser) - '0');
+    parser->pos++;
+    digits++;
+  }
+  return value;
+}
+
+// Parse a counted repetition '{n}', '{n,}' or '{n,m}' if there is one at the
+// current position. If it's not a valid repetition syntax, returns false and
+// the '{' will be a literal.
+static bool parseRepeatCount(Parser* parser, int* min, int* max) {
+  uint32_t start = parser->pos;
+  parser->pos++; // '{'
+
+  *min = parseCount(parser);
+  *max = *min;
+  if (*min >= 0 && patternHasNext(parser) && patternPeek(parser) == ',') {
+    parser->pos++;
+    *max = parseCount(parser);
+  }
+
+  if (*min < 0 || !patternHasNext(parser) || patternPeek(parser) != '}') {
+    parser->pos = start;
+    return false;
+  }
+  parser->pos++; // '}'
+  return true;
+}
+
+static int parseRepeat(Parser* parser) {
+  int atom = parseAtom(parser);
+  if (atom < 0 || !patternHasNext(parser)) return atom;
+
+  int min, max;
+  switch (patternPeek(parser)) {
+    case '*': min = 0; max = -1; parser->pos++; break;
+    case '+': min = 1; max = -1; parser->pos++; break;
+    case '?': min = 0; max = 1;  parser->pos++; break;
+
+    case '{':
+      if (!parseRepeatCount(parser, &min, &max)) return atom;
+      if (min > MAX_REPEAT || max > MAX_REPEAT) {
+        return patternError(parser, "Repetition count is too large.");
+      }
+      if (max >= 0 && max < min) {
+        return patternError(parser, "Invalid repetition count.");
+      }
+      break;
+
+    default:
+      return atom;
+  }
+
+  bool greedy = true;
+  if (patternHasNext(parser) && patternPeek(parser) == '?') {
+    greedy = false;
+    parser->pos++;
+  }
+
+  if (patternHasNext(parser)) {
+    char c = patternPeek(parser);
+    int count;
+    if (c == '*' || c == '+' || c == '?' ||
+        (c == '{' && parseRepeatCount(parser, &count, &count))) {
+      return patternError(parser, "Multiple repeat.");
+    }
+  }
+
+  int node = newNode(parser, NODE_REPEAT);
+  parser->nodes[node].left = atom;
+  parser->nodes[node].min = min;
+  parser->nodes[node].max = max;
+  parser->nodes[node].greedy = greedy;
+  return node;
+}
+
+// Append the [node] to the chain of [type] (CAT or ALT) with the [head] and
+// [tail] and returns the new head.
+static int chainAppend(Parser* parser, NodeType type, int head, int* tail,
+                       int node) {
+  if (head < 0) return node;
+
+  int link = newNode(parser, type);
+  parser->nodes[link].right = node;
+  if (*tail < 0) {
+    parser->nodes[link].left = head;
+    head = link;
+  } else {
+    parser->nodes[link].left = parser->nodes[*tail].right;
+    parser->nodes[*tail].right = link;
+  }
+  *tail = link;
+  return head;
+}
+
+static int parseConcat(Parser* parser) {
+  int head = -1, tail = -1;
+
+  while (patternHasNext(parser)) {
+    char c = patternPeek(parser);
+    if (c == '|' || c == ')') break;
+
+    int node = parseRepeat(parser);
+    if (node < 0) return -1;
+    head = chainAppend(parser, NODE_CAT, head, &tail, node);
+  }
+
+  if (head < 0) return newNode(parser, NODE_EMPTY);
+  return head;
+}
+
+static int parseAlternation(Parser* parser) {
+  int head = parseConcat(parser), tail = -1;
+  if (head < 0) return -1;
+
+  while (patternHasNext(parser) && patternPeek(parser) == '|') {
+    parser->pos++;
+    int node = parseConcat(parser);
+    if (node < 0) return -1;
+    head = chainAppend(parser, NODE_ALT, head, &tail, node);
+  }
+
+  return head;
+}
+
+/*****************************************************************************/
+/* COMPILER                                                                  */
+/*****************************************************************************/
+
+// Returns the number of instructions to compile the [node]. If it's more
+// than the MAX_PROGRAM_SIZE the result will be MAX_PROGRAM_SIZE + 1.
+static int programSize(const Parser* parser, int node) {
+  int64_t size = 0;
+
+  // The chains of CAT and ALT nodes.
+  while (parser->nodes[node].type == NODE_CAT ||
+         parser->nodes[node].type == NODE_ALT) {
+    const Node* link = &parser->nodes[node];
+    size += programSize(parser, link->left);
+    if (link->type == NODE_ALT) size += 2; // SPLIT, JUMP.
+    if (size > MAX_PROGRAM_SIZE) return MAX_PROGRAM_SIZE + 1;
+    node = link->right;
+  }
+
+  const Node* n = &parser->nodes[node];
+  switch (n->type) {
+    case NODE_EMPTY:
+      break;
+
+    case NODE_GROUP:
+      size += programSize(parser, n->left) + ((n->value >= 0) ? 2 : 0);
+      break;
+
+    case NODE_REPEAT:
+    {
+      int64_t child = programSize(parser, n->left);
+      size += child * n->min;
+      if (n->max < 0) size += child + 2; // SPLIT, JUMP.
+      else size += (child + 1) * (n->max - n->min); // SPLIT.
+    } break;
+
+    default: // Single instruction nodes.
+      size += 1;
+      break;
+  }
+
+  return (size > MAX_PROGRAM_SIZE) ? MAX_PROGRAM_SIZE + 1 : (int)size;
+}
+
+static int emitInst(Regex* re, ReOp op, int arg) {
+  ASSERT(re->program_size < MAX_PROGRAM_SIZE + 3, OOPS);
+  ReInst* inst = &re->program[re->program_size];
+  inst->op = op;
+  inst->arg = arg;
+  inst->x = -1;
+  inst->y = -1;
+  return re->program_size++;
+}
+
+// Set the targets of the SPLIT at [split], to [enter] the repeated node or
+// to [skip] it with the priority depends on [greedy].
+static void patchSplit(Regex* re, int split, int enter, int skip,
+                       bool greedy) {
+  re->program[split].x = (greedy) ? enter : skip;
+  re->program[split].y = (greedy) ? skip : enter;
+}
+
+static void emitNode(Regex* re, const Parser* parser, int node) {
+
+  // Concatenation: emit one after another.
+  while (parser->nodes[node].type == NODE_CAT) {
+    emitNode(re, parser, parser->nodes[node].left);
+    node = parser->nodes[node].right;
+  }
+
+  // Alternation: the JUMP instructions at the end of each alternatives are
+  // linked through their [x] till they're patched to the end.
+  if (parser->nodes[node].type == NODE_ALT) {
+    int jumps = -1;
+    while (parser->nodes[node].type == NODE_ALT) {
+      int split = emitInst(re, RE_SPLIT, 0);
+      emitNode(re, parser, parser->nodes[node].left);
+      int jump = emitInst(re, RE_JUMP, 0);
+      re->program[jump].x = jumps;
+      jumps = jump;
+      patchSplit(re, split, split + 1, re->program_size, true);
+      node = parser->nodes[node].right;
+    }
+    emitNode(re, parser, node);
+
+    while (jumps >= 0) {
+      int next = re->program[jumps].x;
+      re->program[jumps].x = re->program_size;
+      jumps = next;
+    }
+    return;
+  }
+
+  const Node* n = &parser->nodes[node];
+  switch (n->type) {
+    case NODE_EMPTY: break;
+    case NODE_CHAR:   emitInst(re, RE_CHAR, n->value);  break;
+    case NODE_ANY:    emitInst(re, RE_ANY, 0);          break;
+    case NODE_CLASS:  emitInst(re, RE_CLASS, n->value); break;
+    case NODE_BOL:    emitInst(re, RE_BOL, 0);          break;
+    case NODE_EOL:    emitInst(re, RE_EOL, 0);          break;
+    case NODE_WORDB:  emitInst(re, RE_WORDB, 0);        break;
+    case NODE_NWORDB: emitInst(re, RE_NWORDB, 0);       break;
+
+    case NODE_GROUP:
+      if (n->value >= 0) emitInst(re, RE_SAVE, 2 * n->value);
+      emitNode(re, parser, n->left);
+      if (n->value >= 0) emitInst(re, RE_SAVE, 2 * n->value + 1);
+      break;
+
+    case NODE_REPEAT:
+    {
+      for (int i = 0; i < n->min; i++) emitNode(re, parser, n->left);
+
+      if (n->max < 0) {
+        int split = emitInst(re, RE_SPLIT, 0);
+        emitNode(re, parser, n->left);
+        int jump = emitInst(re, RE_JUMP, 0);
+        re->program[jump].x = split;
+        patchSplit(re, split, split + 1, re->program_size, n->greedy);
+
+      } else {
+        // x{0,2} is compiled as (x(x)?)? the optional SPLITs are linked
+        // through their [arg] till they're patched to skip to the end.
+        int splits = -1;
+        for (int i = n->min; i < n->max; i++) {
+          int split = emitInst(re, RE_SPLIT, splits);
+          splits = split;
+          emitNode(re, parser, n->left);
+        }
+        while (splits >= 0) {
+          int next = re->program[splits].arg;
+          patchSplit(re, splits, splits + 1, re->program_size, n->greedy);
+          splits = next;
+        }
+      }
+    } break;
+
+    default:
+      UNREACHABLE();
+  }
+}
+
+// Find the literal prefix and the other hints to skip to the possible match
+// positions quickly.
+static void compilePrefilter(PKVM* vm, Regex* re) {
+  int pc = 0;
+  while (re->program[pc].op == RE_SAVE) pc++;
+
+  re->bol = (re->program[pc].op == RE_BOL);
+
+  int start = pc, length = 0;
+  for (; re->program[pc].op == RE_CHAR; pc++) {
+    length++;
+  }
+
+  re->prefix_length = (uint32_t)length;
+  re->prefix = ALLOCATE_ARRAY(vm, char, length + 1);
+  for (int i = 0; i < length; i++) {
+    re->prefix[i] = (char)re->program[start + i].arg;
+  }
+
+  re->first_class = -1;
+  if (length == 0 && re->program[pc].op == RE_CLASS) {
+    re->first_class = re->program[pc].arg;
+  }
+}
+
+static void initThreadList(PKVM* vm, ThreadList* list, int size, int ncap) {
+  list->count = 0;
+  list->pcs = ALLOCATE_ARRAY(vm, int, size);
+  list->caps = ALLOCATE_ARRAY(vm, int, size * ncap);
+  list->marks = ALLOCATE_ARRAY(vm, uint32_t, size);
+  memset(list->marks, 0, sizeof(uint32_t) * size);
+  list->generation = 0;
+}
+
+static void freeThreadList(PKVM* vm, ThreadList* list) {
+  DEALLOCATE(vm, list->pcs);
+  DEALLOCATE(vm, list->caps);
+  DEALLOCATE(vm, list->marks);
+}
+
+Regex* regexCompile(PKVM* vm, const char* pattern, uint32_t length,
+                    const char** error, uint32_t* error_pos) {
+  Parser parser;
+  memset(&parser, 0, sizeof(Parser));
+  parser.pattern = pattern;
+  parser.length = length;
+
+  // Every byte of the pattern creates at most 3 nodes (an atom, a CAT and an
+  // EMPTY after a '|' or '('), and at most a class.
+  parser.node_capacity = 3 * (int)length + 2;
+  parser.nodes = ALLOCATE_ARRAY(vm, Node, parser.node_capacity);
+  parser.classes = ALLOCATE_ARRAY(vm, ByteSet, length + 1);
+
+  int root = parseAlternation(&parser);
+  if (root >= 0 && patternHasNext(&parser)) {
+    patternError(&parser, "Unmatched ')'.");
+  }
+
+  // SAVE 0, <program>, SAVE 1, MATCH.
+  int size = 0;
+  if (parser.error == NULL) {
+    size = programSize(&parser, root) + 3;
+    if (size > MAX_PROGRAM_SIZE) {
+      patternError(&parser, "Pattern is too large.");
+    }
+  }
+
+  if (parser.error != NULL) {
+    *error = parser.error;
+    *error_pos = parser.pos;
+    DEALLOCATE(vm, parser.nodes);
+    DEALLOCATE(vm, parser.classes);
+    return NULL;
+  }
+
+  Regex* re = ALLOCATE(vm, Regex);
+  memset(re, 0, sizeof(Regex));
+
+  re->pattern = ALLOCATE_ARRAY(vm, char, length + 1);
+  memcpy(re->pattern, pattern, length);
+  re->pattern[length] = '\0';
+  re->length = length;
+
+  re->program = ALLOCATE_ARRAY(vm, ReInst, size);
+  emitInst(re, RE_SAVE, 0);
+  emitNode(re, &parser, root);
+  emitInst(re, RE_SAVE, 1);
+  emitInst(re, RE_MATCH, 0);
+  ASSERT(re->program_size == size, OOPS);
+
+  re->class_count = parser.class_count;
+  re->classes = ALLOCATE_ARRAY(vm, ByteSet, parser.class_count + 1);
+  memcpy(re->classes, parser.classes, sizeof(ByteSet) * parser.class_count);
+  re->group_count = parser.group_count;
+
+  DEALLOCATE(vm, parser.nodes);
+  DEALLOCATE(vm, parser.classes);
+
+  compilePrefilter(vm, re);
+
+  int ncap = 2 * (re->group_count + 1);
+  initThreadList(vm, &re->lists[0], size, ncap);
+  initThreadList(vm, &re->lists[1], size, ncap);
+  re->stack = ALLOCATE_ARRAY(vm, StackEntry, size + 1);
+  re->caps = ALLOCATE_ARRAY(vm, int, ncap);
+
+  return re;
+}
+
+void regexFree(PKVM* vm, Regex* self) {
+  DEALLOCATE(vm, self->pattern);
+  DEALLOCATE(vm, self->program);
+  DEALLOCATE(vm, self->classes);
+  DEALLOCATE(vm, self->prefix);
+  freeThreadList(vm, &self->lists[0]);
+  freeThreadList(vm, &self->lists[1]);
+  DEALLOCATE(vm, self->stack);
+  DEALLOCATE(vm, self->caps);
+  DEALLOCATE(vm, self);
+}
+
+size_t regexSize(const Regex* self) {
+  size_t size = (size_t)self->program_size;
+  size_t ncap = 2 * ((size_t)self->group_count + 1);
+  return sizeof(Regex) + (self->length + 1) + (self->prefix_length + 1) +
+         sizeof(ReInst) * size +
+         sizeof(ByteSet) * ((size_t)self->class_count + 1) +
+         2 * (sizeof(int) * (1 + ncap) + sizeof(uint32_t)) * size +
+         sizeof(StackEntry) * (size + 1) + sizeof(int) * ncap;
+}
+
+bool regexIsPattern(const Regex* self, const char* pattern, uint32_t length) {
+  return self->length == length && memcmp(self->pattern, pattern, length) == 0;
+}
+
+int regexGroupCount(const Regex* self) {
+  return self->group_count;
+}
+
+/*****************************************************************************/
+/* MATCHER                                                                   */
+/*****************************************************************************/
+
+typedef struct {
+  Regex* re;
+  const char* subject;
+  uint32_t length;
+  int ncap;
+} Matcher;
+
+static void clearThreadList(ThreadList* list, int size) {
+  list->count = 0;
+  if (++list->generation == 0) {
+    memset(list->marks, 0, sizeof(uint32_t) * size);
+    list->generation = 1;
+  }
+}
+
+static inline bool isWordAt(const Matcher* m, int64_t pos) {
+  if (pos < 0 || pos >= (int64_t)m->length) return false;
+  return isWordByte((uint8_t)m->subject[pos]);
+}
+
+// Add the thread at [pc] with the captures [caps] to the [list], following
+// the non consuming instructions with their priority. The [caps] will be
+// modified by the SAVE instructions but restored before returning.
+static void addThread(const Matcher* m, ThreadList* list, int pc, int* caps,
+                      uint32_t pos) {
+  Regex* re = m->re;
+  StackEntry* stack = re->stack;
+  int sp = 0;
+
+  stack[sp].pc = pc;
+  stack[sp++].slot = -1;
+
+  while (sp > 0) {
+    StackEntry entry = stack[--sp];
+    if (entry.slot >= 0) {
+      caps[entry.slot] = entry.value;
+      continue;
+    }
+
+    pc = entry.pc;
+    while (list->marks[pc] != list->generation) {
+      list->marks[pc] = list->generation;
+
+      const ReInst* inst = &re->program[pc];
+      switch (inst->op) {
+        case RE_JUMP:
+          pc = inst->x;
+          continue;
+
+        case RE_SPLIT:
+          stack[sp].pc = inst->y;
+          stack[sp++].slot = -1;
+          pc = inst->x;
+          continue;
+
+        case RE_SAVE:
+          stack[sp].slot = inst->arg;
+          stack[sp++].value = caps[inst->arg];
+          caps[inst->arg] = (int)pos;
+          pc++;
+          continue;
+
+        case RE_BOL:
+          if (pos != 0) break;
+          pc++;
+          continue;
+
+        case RE_EOL:
+          if (pos != m->length) break;
+          pc++;
+          continue;
+
+        case RE_WORDB:
+        case RE_NWORDB:
+        {
+          bool boundary = isWordAt(m, (int64_t)pos - 1) != isWordAt(m, pos);
+          if (boundary != (inst->op == RE_WORDB)) break;
+          pc++;
+          continue;
+        }
+
+        default:
+          list->pcs[list->count] = pc;
+          memcpy(list->caps + list->count * m->ncap, caps,
+                 sizeof(int) * m->ncap);
+          list->count++;
+          break;
+      }
+      break;
+    }
+  }
+}
+
+// Returns the position of the next occurrence of the prefix in the subject
+// from [pos], or the subject's length if there isn't one.
+static uint32_t findPrefix(const Matcher* m, uint32_t pos) {
+  const Regex* re = m->re;
+
+  if (re->prefix_length > 0) {
+    while (pos + re->prefix_length <= m->length) {
+      const char* found = memchr(m->subject + pos, re->prefix[0],
+                                 m->length - re->prefix_length - pos + 1);
+      if (found == NULL) break;
+
+      pos = (uint32_t)(found - m->subject);
+      if (memcmp(found, re->prefix, re->prefix_length) == 0) return pos;
+      pos++;
+    }
+    return m->length;
+  }
+
+  const ByteSet* set = &re->classes[re->first_class];
+  while (pos < m->length && !setHas(set, (uint8_t)m->subject[pos])) pos++;
+  return pos;
+}
+
+bool regexSearch(Regex* self, const char* subject, uint32_t length,
+                 uint32_t start, bool anchored, int* captures) {
+  if (start > length) return false;
+  if (self->bol && start != 0) return false;
+
+  Matcher m;
+  m.re = self;
+  m.subject = subject;
+  m.length = length;
+  m.ncap = 2 * (self->group_count + 1);
+
+  bool prefilter = !anchored &&
+                   (self->prefix_length > 0 || self->first_class >= 0);
+
+  ThreadList* clist = &self->lists[0];
+  ThreadList* nlist = &self->lists[1];
+  clearThreadList(clist, self->program_size);
+
+  bool matched = false;
+  for (uint32_t pos = start; ; pos++) {
+
+    // Start a new thread at this position with the lowest priority, unless
+    // we've already found a match (which starts before this position).
+    if (!matched && (pos == start || (!anchored && !self->bol))) {
+      if (clist->count == 0 && prefilter) {
+        pos = findPrefix(&m, pos);
+        if (pos == length) break;
+      }
+      for (int i = 0; i < m.ncap; i++) self->caps[i] = -1;
+      addThread(&m, clist, 0, self->caps, pos);
+    }
+
+    // If there isn't any threads, and no more threads will be started
+    // we're done, otherwise try at the next position.
+    if (clist->count == 0) {
+      if (matched || anchored || self->bol || pos >= length) break;
+      clearThreadList(clist, self->program_size);
+      continue;
+    }
+
+    clearThreadList(nlist, self->program_size);
+    for (int i = 0; i < clist->count; i++) {
+      int pc = clist->pcs[i];
+      int* caps = clist->caps + i * m.ncap;
+      const ReInst* inst = &self->program[pc];
+
+      int c = (pos < length) ? (uint8_t)subject[pos] : -1;
+      bool step = false;
+      switch (inst->op) {
+        case RE_CHAR:  step = (c == inst->arg); break;
+        case RE_ANY:   step = (c >= 0 && c != '\n'); break;
+        case RE_CLASS: step = (c >= 0 && setHas(&self->classes[inst->arg], c));
+          break;
+
+        case RE_MATCH:
+          // The threads after this have lower priority, cut them off.
+          matched = true;
+          memcpy(captures, caps, sizeof(int) * m.ncap);
+          i = clist->count;
+          break;
+
+        default:
+          UNREACHABLE();
+      }
+
+      if (step) addThread(&m, nlist, pc + 1, caps, pos + 1);
+    }
+
+    ThreadList* tmp = clist;
+    clist = nlist;
+    nlist = tmp;
+
+    if (pos >= length) break;
+  }
+
+  return matched;
+}
@@ -0,0 +1,56 @@
+/*
+ *  Copyright (c) 2020-2021 Thakee Nathees
+ *  Distributed Under The MIT License
+ */
+
+#ifndef RE_H
+#define RE_H
+
+#include "pk_internal.h"
+
+// A compiled regular expression. The pattern is compiled into a program of an
+// NFA which is simulated in a single pass over the subject (Pike VM), all the
+// possible threads are advanced in lock step and there is no backtracking.
+// So the time to match is O(n * m) where n is the length of the subject and
+// m is the size of the program, for any pattern and input.
+//
+// Supported syntax (byte oriented, no unicode classes):
+//   .  [abc]  [^a-z]  \d \w \s \D \W \S  ^  $  \b \B  (...)  (?:...)  a|b
+//   *  +  ?  {n}  {n,}  {n,m}  and the lazy versions *?  +?  ??  {n,m}?
+typedef struct Regex Regex;
+
+// The maximum number of compiled patterns cached in the VM.
+#define REGEX_CACHE_SIZE 16
+
+// The maximum number of capture groups in a pattern.
+#define REGEX_MAX_GROUPS 64
+
+// Compile the [pattern] and return the regex. On failure it'll return NULL
+// and set [error] to a static error message and [error_pos] to the offset
+// of the pattern where the error is.
+Regex* regexCompile(PKVM* vm, const char* pattern, uint32_t length,
+                    const char** error, uint32_t* error_pos);
+
+// Free the regex allocated by regexCompile().
+void regexFree(PKVM* vm, Regex* self);
+
+// Returns the number of bytes allocated for the [self], used by the garbage
+// collector to count the memory of the pattern objects.
+size_t regexSize(const Regex* self);
+
+// Returns true if the [self] is compiled from the [pattern].
+bool regexIsPattern(const Regex* self, const char* pattern, uint32_t length);
+
+// Returns the number of capture groups of the pattern (not including the
+// entire match).
+int regexGroupCount(const Regex* self);
+
+// Search the [subject] from the offset [start] for the left most match. If
+// [anchored] is true, only a match at [start] will be considered. On success
+// the [captures] will be filled with the start and end offsets of the match
+// followed by the ones of each groups (-1 if not participated), it should be
+// an array of 2 * (regexGroupCount() + 1) integers.
+bool regexSearch(Regex* self, const char* subject, uint32_t length,
+                 uint32_t start, bool anchored, int* captures);
+
+#endif // RE_H
@@ -0,0 +1,213 @@
+/*
+ *  Copyright (c) 2020-2021 Thakee Nathees
+ *  Distributed Under The MIT License
+ */
+
+// A prefork server: the host loads and runs the scripts once, the heap is
+// frozen and the worker processes forked from it share the warmed up heap
+// (copy-on-write) so a worker is ready as soon as it's forked. The workers
+// accept the connections of a shared listening Unix domain socket.
+
+#include "pk_vm.h"
+
+#include <errno.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+  #define SERVE_SUPPORTED 1
+#else
+  #define SERVE_SUPPORTED 0
+#endif
+
+#if SERVE_SUPPORTED
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// The size of the buffer to read the requests of a connection.
+#define READ_BUFFER_SIZE 4096
+
+// The backlog of the listening socket.
+#define LISTEN_BACKLOG 128
+
+// Write all the [length] bytes of the [data] to the connection [conn].
+static bool writeAll(int conn, const char* data, size_t length) {
+  while (length > 0) {
+    ssize_t written = write(conn, data, length);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += written;
+    length -= (size_t)written;
+  }
+  return true;
+}
+
+// Call the function [fn] with the request [line] and write it's response to
+// the connection [conn].
+static bool handleRequest(PKVM* vm, Function* fn, const char* line,
+                          uint32_t length, int conn) {
+  String* request = newStringLength(vm, line, length);
+  vmPushTempRef(vm, &request->_super); // request.
+  Fiber* fiber = newFiber(vm, fn);
+  vmPushTempRef(vm, &fiber->_super); // fiber.
+
+  PkHandle* fb = vmNewHandle(vm, VAR_OBJ(fiber));
+  PkHandle* arg = vmNewHandle(vm, VAR_OBJ(request));
+  vmPopTempRef(vm); // fiber.
+  vmPopTempRef(vm); // request.
+
+  PkResult result = pkRunFiber(vm, fb, 1, &arg);
+  pkReleaseHandle(vm, arg);
+
+  bool done = true;
+  if (result == PK_RESULT_SUCCESS) {
+    String* response = toString(vm, *fiber->ret);
+    vmPushTempRef(vm, &response->_super); // response.
+    done = writeAll(conn, response->data, response->length);
+    vmPopTempRef(vm); // response.
+  }
+  pkReleaseHandle(vm, fb);
+
+  return done && writeAll(conn, "\n", 1);
+}
+
+// Read the requests of the connection [conn] line by line till it's closed.
+static void serveConnection(PKVM* vm, Function* fn, int conn) {
+  pkByteBuffer line;
+  pkByteBufferInit(&line);
+
+  char buff[READ_BUFFER_SIZE];
+  bool alive = true;
+  while (alive) {
+    ssize_t count = read(conn, buff, sizeof(buff));
+    if (count < 0 && errno == EINTR) continue;
+    if (count <= 0) break;
+
+    for (ssize_t i = 0; i < count && alive; i++) {
+      if (buff[i] != '\n') {
+        pkByteBufferWrite(&line, vm, (uint8_t)buff[i]);
+        continue;
+      }
+      alive = handleRequest(vm, fn, (const char*)line.data, line.count, conn);
+      line.count = 0;
+    }
+  }
+
+  // The last line of the connection without a newline.
+  if (alive && line.count > 0) {
+    handleRequest(vm, fn, (const char*)line.data, line.count, conn);
+  }
+
+  pkByteBufferClear(&line, vm);
+}
+
+// The loop of a worker process which never returns.
+static void runWorker(PKVM* vm, Function* fn, int server) {
+
+  // Writing to a connection closed by the client shouldn't kill the worker.
+  signal(SIGPIPE, SIG_IGN);
+
+  while (true) {
+    int conn = accept(server, NULL, NULL);
+    if (conn < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      break;
+    }
+    serveConnection(vm, fn, conn);
+    close(conn);
+  }
+
+  fflush(NULL);
+  _exit(0);
+}
+
+bool pkServe(PKVM* vm, PkHandle* fn, const char* path, int workers) {
+  __ASSERT(fn != NULL && IS_OBJ_TYPE(fn->value, OBJ_FUNC),
+           "Given handle is not a function.");
+  __ASSERT(path != NULL, "Argument path was NULL.");
+  __ASSERT(workers > 0, "Number of workers should be greater than 0.");
+
+  Function* function = (Function*)AS_OBJ(fn->value);
+  if (function->arity != 1) {
+    errno = EINVAL;
+    return false;
+  }
+
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+  strcpy(address.sun_path, path);
+
+  // Remove the socket file of a previous run (if any), but never a file
+  // which isn't a socket.
+  struct stat info;
+  if (lstat(path, &info) == 0) {
+    if (!S_ISSOCK(info.st_mode)) {
+      errno = EEXIST;
+      return false;
+    }
+    if (unlink(path) != 0) return false;
+  }
+
+  int server = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server < 0) return false;
+
+  if (bind(server, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+      listen(server, LISTEN_BACKLOG) != 0) {
+    int error = errno;
+    close(server);
+    errno = error;
+    return false;
+  }
+
+  pkFreezeHeap(vm);
+
+  // The buffered outputs would be written by every worker otherwise.
+  fflush(NULL);
+
+  pid_t* pids = ALLOCATE_ARRAY(vm, pid_t, workers);
+
+  int forked = 0;
+  for (; forked < workers; forked++) {
+    pid_t pid = fork();
+    if (pid == 0) runWorker(vm, function, server);
+    if (pid < 0) break;
+    pids[forked] = pid;
+  }
+
+  // If a fork failed, stop the workers already forked.
+  bool success = (forked == workers);
+  int error = errno;
+  if (!success) {
+    for (int i = 0; i < forked; i++) kill(pids[i], SIGTERM);
+  }
+
+  while (forked > 0) {
+    if (wait(NULL) > 0) forked--;
+    else if (errno != EINTR) break;
+  }
+
+  DEALLOCATE(vm, pids);
+  close(server);
+  unlink(path);
+  errno = error;
+  return success;
+}
+
+#else // SERVE_SUPPORTED
+
+bool pkServe(PKVM* vm, PkHandle* fn, const char* path, int workers) {
+  errno = ENOSYS;
+  return false;
+}
+
+#endif // SERVE_SUPPORTED
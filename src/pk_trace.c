@@ -0,0 +1,252 @@
+/*
+ *  Copyright (c) 2020-2021 Thakee Nathees
+ *  Distributed Under The MIT License
+ */
+
+// clock_gettime() is a POSIX function which isn't declared with a strict C
+// standard (ex: -std=c99) unless _POSIX_C_SOURCE is defined.
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+  #define _POSIX_C_SOURCE 199309L
+#endif
+
+#include "pk_trace.h"
+
+#include <time.h>
+
+#include "pk_vm.h"
+
+// The names and the categories of the events written to the JSON, indexed
+// with TraceEventType.
+static const char* trace_names[] = {
+  "compile", "gc", "mark", "sweep", "run", "resume", "yield", "native",
+};
+static const char* trace_categories[] = {
+  "compiler", "gc", "gc", "gc", "fiber", "fiber", "fiber", "native",
+};
+
+void tracerInit(PKVM* vm) {
+  Tracer* tracer = &vm->tracer;
+  tracer->enabled = false;
+  tracer->events = NULL;
+  tracer->capacity = 0;
+  tracer->head = 0;
+  tracer->count = 0;
+  tracer->dropped = 0;
+  tracer->epoch = 0;
+  tracer->threshold = 0;
+}
+
+void tracerFree(PKVM* vm) {
+  Tracer* tracer = &vm->tracer;
+  if (tracer->events != NULL) DEALLOCATE(vm, tracer->events);
+  tracerInit(vm);
+}
+
+double traceNow(void) {
+  struct timespec ts;
+#if defined(_WIN32)
+  timespec_get(&ts, TIME_UTC);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+  return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+// Returns the next event of the ring buffer to be written (overwriting the
+// oldest one if it's full) with the [type] and the [name].
+static TraceEvent* addEvent(Tracer* tracer, TraceEventType type,
+                            const char* name) {
+  TraceEvent* event = &tracer->events[tracer->head];
+  tracer->head = (tracer->head + 1) % tracer->capacity;
+  if (tracer->count < tracer->capacity) tracer->count++;
+  else tracer->dropped++;
+
+  event->type = type;
+  event->before = event->after = 0;
+
+  // A long name is cut from the front (to keep the end of a path), on a
+  // character boundary so an UTF-8 sequence won't be split.
+  size_t length = strlen(name);
+  if (length >= TRACE_NAME_SIZE) {
+    name += length - (TRACE_NAME_SIZE - 1);
+    length = TRACE_NAME_SIZE - 1;
+    while (((uint8_t)*name & 0xc0) == 0x80) {
+      name++;
+      length--;
+    }
+  }
+  memcpy(event->name, name, length);
+  event->name[length] = '\0';
+
+  return event;
+}
+
+// The functions below could be called after the tracing is stopped (ex: by a
+// native function), so they've to check if it's still enabled.
+
+void traceCompile(PKVM* vm, const char* path, double start) {
+  if (!vm->tracer.enabled) return;
+  double end = traceNow();
+  TraceEvent* event = addEvent(&vm->tracer, TRACE_COMPILE, path);
+  event->start = start;
+  event->duration = end - start;
+}
+
+void traceGC(PKVM* vm, double start, double sweep, size_t before,
+             size_t after) {
+  if (!vm->tracer.enabled) return;
+  double end = traceNow();
+
+  TraceEvent* event = addEvent(&vm->tracer, TRACE_GC, "");
+  event->start = start;
+  event->duration = end - start;
+  event->before = before;
+  event->after = after;
+
+  event = addEvent(&vm->tracer, TRACE_GC_MARK, "");
+  event->start = start;
+  event->duration = sweep - start;
+
+  event = addEvent(&vm->tracer, TRACE_GC_SWEEP, "");
+  event->start = sweep;
+  event->duration = end - sweep;
+}
+
+void traceFiber(PKVM* vm, TraceEventType type, const char* fn) {
+  if (!vm->tracer.enabled) return;
+  TraceEvent* event = addEvent(&vm->tracer, type, fn);
+  event->start = traceNow();
+  event->duration = 0;
+}
+
+void traceNative(PKVM* vm, const char* fn, double start) {
+  if (!vm->tracer.enabled) return;
+  double end = traceNow();
+  if (end - start < vm->tracer.threshold) return;
+
+  TraceEvent* event = addEvent(&vm->tracer, TRACE_NATIVE, fn);
+  event->start = start;
+  event->duration = end - start;
+}
+
+// Write the [str] as a JSON string (with the quotes) to the [buff].
+static void writeString(PKVM* vm, const char* str, pkByteBuffer* buff) {
+  pkByteBufferWrite(buff, vm, '"');
+  for (const char* c = str; *c != '\0'; c++) {
+    if ((uint8_t)*c < 0x20) {
+      char escape[8];
+      int length = sprintf(escape, "\\u%04x", (unsigned)(uint8_t)*c);
+      pkByteBufferAddString(buff, vm, escape, (uint32_t)length);
+      continue;
+    }
+    if (*c == '"' || *c == '\\') pkByteBufferWrite(buff, vm, '\\');
+    pkByteBufferWrite(buff, vm, (uint8_t)*c);
+  }
+  pkByteBufferWrite(buff, vm, '"');
+}
+
+// Write the [event] as a JSON object to the [buff], the timestamps are
+// relative to the [epoch].
+static void writeEvent(PKVM* vm, const TraceEvent* event, double epoch,
+                       pkByteBuffer* buff) {
+  // The native calls are named after the function to be distinguished in
+  // the timeline.
+  const char* name = trace_names[event->type];
+  if (event->type == TRACE_NATIVE) name = event->name;
+  char num[128];
+
+  pkByteBufferAddString(buff, vm, "{\"name\": ", 9);
+  writeString(vm, name, buff);
+  int length = sprintf(num, ", \"cat\": \"%s\", ",
+                       trace_categories[event->type]);
+  pkByteBufferAddString(buff, vm, num, (uint32_t)length);
+
+  bool instant = (event->type == TRACE_FIBER_RUN ||
+                  event->type == TRACE_FIBER_RESUME ||
+                  event->type == TRACE_FIBER_YIELD);
+  if (instant) {
+    length = sprintf(num, "\"ph\": \"i\", \"s\": \"t\", \"ts\": %.3f, ",
+                     event->start - epoch);
+  } else {
+    length = sprintf(num, "\"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, ",
+                     event->start - epoch, event->duration);
+  }
+  pkByteBufferAddString(buff, vm, num, (uint32_t)length);
+  pkByteBufferAddString(buff, vm, "\"pid\": 1, \"tid\": 1", 18);
+
+  if (event->type == TRACE_GC) {
+    length = sprintf(num, ", \"args\": {\"before\": %llu, \"after\": %llu}",
+                     (unsigned long long)event->before,
+                     (unsigned long long)event->after);
+    pkByteBufferAddString(buff, vm, num, (uint32_t)length);
+
+  } else if (event->name[0] != '\0') {
+    const char* key = (event->type == TRACE_COMPILE) ? "path" : "fn";
+    length = sprintf(num, ", \"args\": {\"%s\": ", key);
+    pkByteBufferAddString(buff, vm, num, (uint32_t)length);
+    writeString(vm, event->name, buff);
+    pkByteBufferWrite(buff, vm, '}');
+  }
+
+  pkByteBufferWrite(buff, vm, '}');
+}
+
+// pkTraceStart implementation (see pocketlang.h for description).
+void pkTraceStart(PKVM* vm, uint32_t capacity, double threshold) {
+  __ASSERT(capacity > 0, "Trace capacity should be greater than 0.");
+
+  tracerFree(vm);
+  Tracer* tracer = &vm->tracer;
+  tracer->events = ALLOCATE_ARRAY(vm, TraceEvent, capacity);
+  tracer->capacity = capacity;
+  tracer->threshold = threshold;
+  tracer->epoch = traceNow();
+  tracer->enabled = true;
+}
+
+// pkTraceStop implementation (see pocketlang.h for description).
+void pkTraceStop(PKVM* vm) {
+  tracerFree(vm);
+}
+
+// pkTraceFlush implementation (see pocketlang.h for description).
+PkHandle* pkTraceFlush(PKVM* vm) {
+  Tracer* tracer = &vm->tracer;
+
+  // Writing the buffer might trigger a garbage collection which shouldn't be
+  // recorded while the events are being read.
+  bool enabled = tracer->enabled;
+  tracer->enabled = false;
+
+  pkByteBuffer buff;
+  pkByteBufferInit(&buff);
+
+  pkByteBufferAddString(&buff, vm, "{\"traceEvents\": [\n", 18);
+  pkByteBufferAddString(&buff, vm, "{\"name\": \"process_name\", "
+    "\"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"pocketlang\"}}", 77);
+
+  // The oldest event is at [head] if the buffer is full, at 0 otherwise.
+  uint32_t first = (tracer->count < tracer->capacity) ? 0 : tracer->head;
+  for (uint32_t i = 0; i < tracer->count; i++) {
+    pkByteBufferAddString(&buff, vm, ",\n", 2);
+    writeEvent(vm, &tracer->events[(first + i) % tracer->capacity],
+               tracer->epoch, &buff);
+  }
+
+  char num[64];
+  int length = sprintf(num, "\n],\n\"otherData\": {\"dropped\": %u}}\n",
+                       tracer->dropped);
+  pkByteBufferAddString(&buff, vm, num, (uint32_t)length);
+
+  tracer->head = tracer->count = tracer->dropped = 0;
+
+  String* trace = newStringLength(vm, (const char*)buff.data, buff.count);
+  pkByteBufferClear(&buff, vm);
+
+  vmPushTempRef(vm, &trace->_super); // trace.
+  PkHandle* handle = vmNewHandle(vm, VAR_OBJ(trace));
+  vmPopTempRef(vm); // trace.
+
+  tracer->enabled = enabled;
+  return handle;
+}
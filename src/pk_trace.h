@@ -0,0 +1,94 @@
+/*
+ *  Copyright (c) 2020-2021 Thakee Nathees
+ *  Distributed Under The MIT License
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "pk_internal.h"
+#include "pk_var.h"
+
+// The tracer records a timeline of what the VM did (the compilations, the
+// garbage collections, the fiber switches and the slow native calls) to a
+// fixed size ring buffer which is written as Chrome trace event JSON on
+// demand. Once the buffer is full the oldest events are overwritten, so a
+// long running host could keep it enabled and flush it only when needed.
+// The output could be opened with chrome://tracing or Perfetto.
+
+// The maximum length of the name of an event (a longer one is truncated from
+// the start, since the end of a path is more useful).
+#define TRACE_NAME_SIZE 48
+
+// Evaluated to the current time in microseconds if the [vm] is tracing and 0
+// otherwise, so the timing of an event is only done when it's recorded.
+#define TRACE_NOW(vm) ((vm)->tracer.enabled ? traceNow() : 0.0)
+
+typedef enum {
+  TRACE_COMPILE,
+  TRACE_GC,
+  TRACE_GC_MARK,
+  TRACE_GC_SWEEP,
+  TRACE_FIBER_RUN,
+  TRACE_FIBER_RESUME,
+  TRACE_FIBER_YIELD,
+  TRACE_NATIVE,
+} TraceEventType;
+
+// A recorded event, the fiber switches are instant events (without a
+// duration).
+typedef struct {
+  TraceEventType type;
+  double start;    //< Start time in microseconds.
+  double duration; //< Duration in microseconds.
+  size_t before;   //< Allocated bytes before a garbage collection.
+  size_t after;    //< Allocated bytes after a garbage collection.
+  char name[TRACE_NAME_SIZE];
+} TraceEvent;
+
+// The state of the tracer, a member of the PKVM.
+typedef struct {
+  bool enabled;
+
+  // The ring buffer of the events, [head] is the index of the next event to
+  // be written and [count] is the number of events in the buffer.
+  TraceEvent* events;
+  uint32_t capacity;
+  uint32_t head;
+  uint32_t count;
+
+  // Number of events overwritten since the last flush.
+  uint32_t dropped;
+
+  // The time the tracing was started (the timestamps are relative to it) and
+  // the minimum duration of a native call to be recorded.
+  double epoch;
+  double threshold;
+} Tracer;
+
+// Initialize the tracer of the [vm] (disabled).
+void tracerInit(PKVM* vm);
+
+// Free the event buffer of the [vm]'s tracer.
+void tracerFree(PKVM* vm);
+
+// Returns the current time of a monotonic clock in microseconds.
+double traceNow(void);
+
+// Record the compilation of the script at [path] started at [start].
+void traceCompile(PKVM* vm, const char* path, double start);
+
+// Record a garbage collection which started at [start] and it's sweep phase
+// at [sweep], [before] and [after] are the allocated bytes.
+void traceGC(PKVM* vm, double start, double sweep, size_t before,
+             size_t after);
+
+// Record an instant event of a fiber switch of the [type] where [fn] is the
+// name of the fiber's function.
+void traceFiber(PKVM* vm, TraceEventType type, const char* fn);
+
+// Record the call of the native function [fn] started at [start] if it took
+// longer than the threshold.
+void traceNative(PKVM* vm, const char* fn, double start);
+
+#endif // TRACE_H
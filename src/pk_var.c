@@ -8,6 +8,8 @@
 #include <math.h>
 #include <ctype.h>
 
+#include "pk_bigint.h"
+#include "pk_debug.h"
 #include "pk_utils.h"
 #include "pk_vm.h"
 
@@ -36,6 +38,10 @@ PkVarType pkGetValueType(const PkVar value) {
     case OBJ_FIBER:  return PK_FIBER;
     case OBJ_CLASS:  return PK_CLASS;
     case OBJ_INST:   return PK_INST;
+    case OBJ_AUTOMATON: return PK_AUTOMATON;
+    case OBJ_BIGINT: return PK_BIGINT;
+    case OBJ_PATTERN: return PK_PATTERN;
+    case OBJ_HASHER: return PK_HASHER;
   }
 
   UNREACHABLE();
@@ -73,6 +79,23 @@ PkHandle* pkNewMap(PKVM* vm) {
   return handle;
 }
 
+PkHandle* pkNewListCapacity(PKVM* vm, uint32_t capacity) {
+  List* list = newList(vm, capacity);
+  vmPushTempRef(vm, &list->_super); // list
+  PkHandle* handle = vmNewHandle(vm, VAR_OBJ(list));
+  vmPopTempRef(vm); // list
+  return handle;
+}
+
+PkHandle* pkNewMapCapacity(PKVM* vm, uint32_t capacity) {
+  Map* map = newMap(vm);
+  vmPushTempRef(vm, &map->_super); // map
+  if (capacity > 0) mapReserve(vm, map, capacity);
+  PkHandle* handle = vmNewHandle(vm, VAR_OBJ(map));
+  vmPopTempRef(vm); // map
+  return handle;
+}
+
 PkHandle* pkNewFiber(PKVM* vm, PkHandle* fn) {
   __ASSERT(IS_OBJ_TYPE(fn->value, OBJ_FUNC), "Fn should be of type function.");
 
@@ -100,6 +123,9 @@ PkHandle* pkNewInstNative(PKVM* vm, void* data, uint32_t id) {
 // but take more memory.
 #define MAP_LOAD_PERCENT 75
 
+// The maximum capacity of a map, the largest power of 2 of an uint32_t.
+#define MAX_MAP_CAPACITY (1u << 31)
+
 // The factor a collection would grow by when it's exceeds the current
 // capacity. The new capacity will be calculated by multiplying it's old
 // capacity by the GROW_FACTOR.
@@ -124,13 +150,28 @@ void pkByteBufferAddString(pkByteBuffer* self, PKVM* vm, const char* str,
 void varInitObject(Object* self, PKVM* vm, ObjectType type) {
   self->type = type;
   self->is_marked = false;
+  self->is_old = false;
+  self->is_frozen = false;
   self->next = vm->first;
   vm->first = self;
 }
 
 void markObject(PKVM* vm, Object* self) {
-  if (self == NULL || self->is_marked) return;
-  self->is_marked = true;
+  if (self == NULL) return;
+
+  // The pages of the frozen objects are shared with the forked processes,
+  // writing the mark to their header would copy them. So they're marked in
+  // the vm's bitmap instead.
+  if (self->is_frozen) {
+    uint8_t* byte = &vm->frozen_marks[self->frozen_id / 8];
+    uint8_t bit = (uint8_t)(1 << (self->frozen_id % 8));
+    if (*byte & bit) return;
+    *byte |= bit;
+
+  } else {
+    if (self->is_marked) return;
+    self->is_marked = true;
+  }
 
   // Add the object to the VM's working_set so that we can recursively mark
   // its referenced objects later.
@@ -213,8 +254,12 @@ static void popMarkedObjectsInternal(Object* obj, PKVM* vm) {
       markVarBuffer(vm, &scr->globals);
       vm->bytes_allocated += sizeof(Var) * scr->globals.capacity;
 
+      markVarBuffer(vm, &scr->prepared);
+      vm->bytes_allocated += sizeof(Var) * scr->prepared.capacity;
+
       // Integer buffer has no gray call.
       vm->bytes_allocated += sizeof(uint32_t) * scr->global_names.capacity;
+      vm->bytes_allocated += sizeof(uint32_t) * scr->constants.capacity;
 
       markVarBuffer(vm, &scr->literals);
       vm->bytes_allocated += sizeof(Var) * scr->literals.capacity;
@@ -244,6 +289,8 @@ static void popMarkedObjectsInternal(Object* obj, PKVM* vm) {
 
         vm->bytes_allocated += sizeof(uint8_t)* fn->opcodes.capacity;
         vm->bytes_allocated += sizeof(uint32_t) * fn->oplines.capacity;
+        vm->bytes_allocated += sizeof(uint32_t) * fn->cover_lines.capacity;
+        vm->bytes_allocated += sizeof(uint8_t) * fn->cover_bits.capacity;
       }
     } break;
 
@@ -290,6 +337,36 @@ static void popMarkedObjectsInternal(Object* obj, PKVM* vm) {
         vm->bytes_allocated += sizeof(Var*) * ins->fields.capacity;
       }
     } break;
+
+    case OBJ_AUTOMATON:
+    {
+      Automaton* automaton = (Automaton*)obj;
+      vm->bytes_allocated += sizeof(Automaton);
+      vm->bytes_allocated += (sizeof(uint32_t) + sizeof(int32_t)) *
+                             automaton->pattern_count;
+      vm->bytes_allocated += (sizeof(uint32_t) * 4 + sizeof(uint8_t) +
+                              sizeof(int32_t)) * automaton->state_count;
+    } break;
+
+    case OBJ_BIGINT:
+    {
+      BigInt* bigint = (BigInt*)obj;
+      vm->bytes_allocated += sizeof(BigInt);
+      vm->bytes_allocated += sizeof(uint32_t) * bigint->capacity;
+    } break;
+
+    case OBJ_PATTERN:
+    {
+      Pattern* pattern = (Pattern*)obj;
+      vm->bytes_allocated += sizeof(Pattern);
+      vm->bytes_allocated += regexSize(pattern->regex);
+
+      markObject(vm, &pattern->source->_super);
+    } break;
+
+    case OBJ_HASHER:
+      vm->bytes_allocated += sizeof(Hasher);
+      break;
   }
 }
 
@@ -300,28 +377,12 @@ void popMarkedObjects(PKVM* vm) {
   }
 }
 
-Var doubleToVar(double value) {
-#if VAR_NAN_TAGGING
-  return utilDoubleToBits(value);
-#else
-#error TODO:
-#endif // VAR_NAN_TAGGING
-}
-
-double varToDouble(Var value) {
-#if VAR_NAN_TAGGING
-  return utilDoubleFromBits(value);
-#else
-  #error TODO:
-#endif // VAR_NAN_TAGGING
-}
-
-static String* _allocateString(PKVM* vm, size_t length) {
-  String* string = ALLOCATE_DYNAMIC(vm, String, length + 1, char);
+static String* _allocateString(PKVM* vm, uint32_t length) {
+  String* string = ALLOCATE_DYNAMIC(vm, String, (size_t)length + 1, char);
   varInitObject(&string->_super, vm, OBJ_STRING);
-  string->length = (uint32_t)length;
+  string->length = length;
   string->data[length] = '\0';
-  string->capacity = (uint32_t)(length + 1);
+  string->capacity = length + 1;
   return string;
 }
 
@@ -342,6 +403,7 @@ List* newList(PKVM* vm, uint32_t size) {
   vmPushTempRef(vm, &list->_super);
   varInitObject(&list->_super, vm, OBJ_LIST);
   pkVarBufferInit(&list->elements);
+  list->reserved = 0;
   if (size > 0) {
     pkVarBufferFill(&list->elements, vm, VAR_NULL, size);
     list->elements.count = 0;
@@ -383,6 +445,8 @@ Script* newScript(PKVM* vm, String* name, bool is_core) {
 
   pkVarBufferInit(&script->globals);
   pkUintBufferInit(&script->global_names);
+  pkUintBufferInit(&script->constants);
+  pkVarBufferInit(&script->prepared);
   pkVarBufferInit(&script->literals);
   pkFunctionBufferInit(&script->functions);
   pkClassBufferInit(&script->classes);
@@ -440,6 +504,8 @@ Function* newFunction(PKVM* vm, const char* name, int length, Script* owner,
     pkByteBufferInit(&fn->opcodes);
     pkUintBufferInit(&fn->oplines);
     fn->stack_size = 0;
+    pkUintBufferInit(&fn->cover_lines);
+    pkByteBufferInit(&fn->cover_bits);
     func->fn = fn;
   }
 
@@ -458,6 +524,8 @@ Fiber* newFiber(PKVM* vm, Function* fn) {
   fiber->state = FIBER_NEW;
   fiber->func = fn;
 
+  vmPushTempRef(vm, &fiber->_super); // fiber.
+
   if (fn->is_native) {
     // For native functions, we're only using stack for parameters,
     // there won't be any locals or temps (which are belongs to the
@@ -469,6 +537,11 @@ Fiber* newFiber(PKVM* vm, Function* fn) {
     fiber->sp = fiber->stack + 1;
 
   } else {
+    // Allocate call frames (before the stack, so a garbage collection
+    // triggered by the allocation won't see it's uninitialized slots).
+    fiber->frame_capacity = INITIAL_CALL_FRAMES;
+    fiber->frames = ALLOCATE_ARRAY(vm, CallFrame, fiber->frame_capacity);
+
     // Allocate stack.
     int stack_size = utilPowerOf2Ceil(fn->fn->stack_size + 1);
     if (stack_size < MIN_STACK_SIZE) stack_size = MIN_STACK_SIZE;
@@ -476,10 +549,6 @@ Fiber* newFiber(PKVM* vm, Function* fn) {
     fiber->stack_size = stack_size;
     fiber->ret = fiber->stack;
     fiber->sp = fiber->stack + 1;
-
-    // Allocate call frames.
-    fiber->frame_capacity = INITIAL_CALL_FRAMES;
-    fiber->frames = ALLOCATE_ARRAY(vm, CallFrame, fiber->frame_capacity);
     fiber->frame_count = 1;
 
     // Initialize the first frame.
@@ -492,6 +561,7 @@ Fiber* newFiber(PKVM* vm, Function* fn) {
   // but if we're trying to debut it may crash when dumping the return value).
   *fiber->ret = VAR_NULL;
 
+  vmPopTempRef(vm); // fiber.
   return fiber;
 }
 
@@ -548,6 +618,25 @@ Instance* newInstance(PKVM* vm, Class* ty, bool initialize) {
   return inst;
 }
 
+// Returns the next state of the automaton from the [state] with the byte [c].
+static inline uint32_t _automatonNext(const Automaton* self, uint32_t state,
+                                      uint8_t c) {
+  while (state != 0) {
+    uint32_t low = self->edge_start[state];
+    uint32_t high = self->edge_start[state + 1];
+    while (low < high) {
+      uint32_t mid = low + (high - low) / 2;
+      if (self->edge_bytes[mid] < c) low = mid + 1;
+      else high = mid;
+    }
+    if (low < self->edge_start[state + 1] && self->edge_bytes[low] == c) {
+      return self->edge_targets[low];
+    }
+    state = self->fail[state];
+  }
+  return self->root[c];
+}
+
 Instance* newInstanceNative(PKVM* vm, void* data, uint32_t id) {
   Instance* inst = ALLOCATE(vm, Instance);
   varInitObject(&inst->_super, vm, OBJ_INST);
@@ -564,6 +653,173 @@ Instance* newInstanceNative(PKVM* vm, void* data, uint32_t id) {
   return inst;
 }
 
+Automaton* newAutomaton(PKVM* vm, List* patterns) {
+  Automaton* self = ALLOCATE(vm, Automaton);
+  varInitObject(&self->_super, vm, OBJ_AUTOMATON);
+  self->pattern_count = 0;
+  self->pattern_lengths = NULL;
+  self->pattern_next = NULL;
+  self->state_count = 0;
+  self->edge_start = NULL;
+  self->edge_bytes = NULL;
+  self->edge_targets = NULL;
+  self->fail = NULL;
+  self->output = NULL;
+  self->match = NULL;
+
+  vmPushTempRef(vm, &self->_super); // self.
+
+  uint32_t count = patterns->elements.count;
+  uint32_t max_states = 1;
+  for (uint32_t i = 0; i < count; i++) {
+    Var pattern = patterns->elements.data[i];
+    ASSERT(IS_OBJ_TYPE(pattern, OBJ_STRING), OOPS);
+    ASSERT(((String*)AS_OBJ(pattern))->length > 0, OOPS);
+    max_states += ((String*)AS_OBJ(pattern))->length;
+  }
+
+  self->pattern_lengths = ALLOCATE_ARRAY(vm, uint32_t, count);
+  self->pattern_next = ALLOCATE_ARRAY(vm, int32_t, count);
+  self->pattern_count = count;
+
+  // The trie is first built with linked lists of the children (sorted by
+  // their byte) and then it'll be flattened into the edge arrays. The root
+  // is never a child so 0 is used as the end of the lists.
+  uint32_t* child = ALLOCATE_ARRAY(vm, uint32_t, max_states);
+  uint32_t* sibling = ALLOCATE_ARRAY(vm, uint32_t, max_states);
+  uint8_t* bytes = ALLOCATE_ARRAY(vm, uint8_t, max_states);
+  int32_t* match = ALLOCATE_ARRAY(vm, int32_t, max_states);
+
+  uint32_t state_count = 1;
+  child[0] = 0;
+  sibling[0] = 0;
+  match[0] = -1;
+
+  for (uint32_t i = 0; i < count; i++) {
+    String* pattern = (String*)AS_OBJ(patterns->elements.data[i]);
+    self->pattern_lengths[i] = pattern->length;
+    self->pattern_next[i] = -1;
+
+    uint32_t state = 0;
+    for (uint32_t j = 0; j < pattern->length; j++) {
+      uint8_t c = (uint8_t)pattern->data[j];
+
+      uint32_t* link = &child[state];
+      while (*link != 0 && bytes[*link] < c) link = &sibling[*link];
+
+      if (*link == 0 || bytes[*link] != c) {
+        uint32_t new_state = state_count++;
+        bytes[new_state] = c;
+        child[new_state] = 0;
+        sibling[new_state] = *link;
+        match[new_state] = -1;
+        *link = new_state;
+      }
+      state = *link;
+    }
+
+    // Patterns of the same string are chained in their order.
+    if (match[state] < 0) {
+      match[state] = (int32_t)i;
+    } else {
+      int32_t last = match[state];
+      while (self->pattern_next[last] >= 0) last = self->pattern_next[last];
+      self->pattern_next[last] = (int32_t)i;
+    }
+  }
+
+  // Every state except the root is the target of a single edge.
+  self->edge_start = ALLOCATE_ARRAY(vm, uint32_t, state_count + 1);
+  self->edge_bytes = ALLOCATE_ARRAY(vm, uint8_t, state_count - 1);
+  self->edge_targets = ALLOCATE_ARRAY(vm, uint32_t, state_count - 1);
+  self->fail = ALLOCATE_ARRAY(vm, uint32_t, state_count);
+  self->output = ALLOCATE_ARRAY(vm, uint32_t, state_count);
+  self->match = ALLOCATE_ARRAY(vm, int32_t, state_count);
+  self->state_count = state_count;
+
+  uint32_t edge = 0;
+  for (uint32_t state = 0; state < state_count; state++) {
+    self->edge_start[state] = edge;
+    for (uint32_t c = child[state]; c != 0; c = sibling[c]) {
+      self->edge_bytes[edge] = bytes[c];
+      self->edge_targets[edge] = c;
+      edge++;
+    }
+  }
+  self->edge_start[state_count] = edge;
+  memcpy(self->match, match, sizeof(int32_t) * state_count);
+
+  for (int i = 0; i < 256; i++) self->root[i] = 0;
+  for (uint32_t c = child[0]; c != 0; c = sibling[c]) {
+    self->root[bytes[c]] = c;
+  }
+
+  DEALLOCATE(vm, child);
+  DEALLOCATE(vm, sibling);
+  DEALLOCATE(vm, bytes);
+  DEALLOCATE(vm, match);
+
+  // Set the fail links in the breadth first order, so the fail links of
+  // the shorter states (which are used to find the link) are already set.
+  uint32_t* queue = ALLOCATE_ARRAY(vm, uint32_t, state_count);
+  uint32_t head = 0, tail = 0;
+  queue[tail++] = 0;
+  self->fail[0] = 0;
+  self->output[0] = 0;
+
+  while (head < tail) {
+    uint32_t state = queue[head++];
+    for (uint32_t e = self->edge_start[state];
+         e < self->edge_start[state + 1]; e++) {
+      uint32_t target = self->edge_targets[e];
+
+      uint32_t fail = 0;
+      if (state != 0) {
+        fail = _automatonNext(self, self->fail[state], self->edge_bytes[e]);
+      }
+      self->fail[target] = fail;
+      self->output[target] = (self->match[fail] >= 0)
+                           ? fail : self->output[fail];
+      queue[tail++] = target;
+    }
+  }
+
+  DEALLOCATE(vm, queue);
+
+  vmPopTempRef(vm); // self.
+  return self;
+}
+
+BigInt* newBigInt(PKVM* vm, uint32_t count) {
+  BigInt* self = ALLOCATE_DYNAMIC(vm, BigInt, count, uint32_t);
+  varInitObject(&self->_super, vm, OBJ_BIGINT);
+  self->negative = false;
+  self->count = count;
+  self->capacity = count;
+  return self;
+}
+
+Pattern* newPattern(PKVM* vm, String* source, Regex* regex) {
+  Pattern* self = ALLOCATE(vm, Pattern);
+  varInitObject(&self->_super, vm, OBJ_PATTERN);
+  self->source = source;
+  self->regex = regex;
+  return self;
+}
+
+Hasher* newHasher(PKVM* vm, HashAlgorithm algorithm, uint64_t seed) {
+  Hasher* self = ALLOCATE(vm, Hasher);
+  varInitObject(&self->_super, vm, OBJ_HASHER);
+  self->algorithm = algorithm;
+  self->length = 0;
+  switch (algorithm) {
+    case HASH_CRC32C: self->crc = (uint32_t)seed; break;
+    case HASH_WYHASH: wyhashInit(&self->wyhash, seed); break;
+    case HASH_SHA256: sha256Init(&self->sha256); break;
+  }
+  return self;
+}
+
 List* rangeAsList(PKVM* vm, Range* self) {
   List* list;
   if (self->from < self->to) {
@@ -728,6 +984,54 @@ String* stringJoin(PKVM* vm, String* str1, String* str2) {
   return string;
 }
 
+String* stringJoinList(PKVM* vm, List* parts, String* sep) {
+  uint32_t count = parts->elements.count;
+  uint32_t sep_length = (sep != NULL) ? sep->length : 0;
+
+  uint64_t length = (count > 0) ? (uint64_t)sep_length * (count - 1) : 0;
+  for (uint32_t i = 0; i < count; i++) {
+    ASSERT(IS_OBJ_TYPE(parts->elements.data[i], OBJ_STRING), OOPS);
+    length += ((String*)AS_OBJ(parts->elements.data[i]))->length;
+  }
+
+  // The length of a string is an uint32_t.
+  if (length > UINT32_MAX) return NULL;
+  String* string = _allocateString(vm, (uint32_t)length);
+
+  char* ptr = string->data;
+  for (uint32_t i = 0; i < count; i++) {
+    if (i > 0 && sep_length > 0) {
+      memcpy(ptr, sep->data, sep_length);
+      ptr += sep_length;
+    }
+    String* part = (String*)AS_OBJ(parts->elements.data[i]);
+    memcpy(ptr, part->data, part->length);
+    ptr += part->length;
+  }
+  // Null byte already existed. From _allocateString.
+
+  string->hash = utilHashString(string->data);
+  return string;
+}
+
+int64_t stringFind(String* self, String* sub, uint32_t start) {
+  if (start > self->length || sub->length > self->length - start) return -1;
+  if (sub->length == 0) return start;
+
+  // Find the first byte with memchr() and compare the rest.
+  const char* end = self->data + self->length - sub->length + 1;
+  const char* ptr = self->data + start;
+  while (ptr < end) {
+    ptr = memchr(ptr, sub->data[0], (size_t)(end - ptr));
+    if (ptr == NULL) return -1;
+    if (memcmp(ptr, sub->data, sub->length) == 0) {
+      return (int64_t)(ptr - self->data);
+    }
+    ptr++;
+  }
+  return -1;
+}
+
 void listInsert(PKVM* vm, List* self, uint32_t index, Var value) {
 
   // Add an empty slot at the end of the buffer.
@@ -755,7 +1059,7 @@ Var listRemoveAt(PKVM* vm, List* self, uint32_t index) {
 
   // Shrink the size if it's too much excess.
   if (self->elements.capacity / GROW_FACTOR >= self->elements.count) {
-    self->elements.data = (Var*)vmRealloc(vm, self->elements.data,
+    self->elements.data = (Var*)vmReallocBuffer(vm, self->elements.data,
       sizeof(Var) * self->elements.capacity,
       sizeof(Var) * self->elements.capacity / GROW_FACTOR);
     self->elements.capacity /= GROW_FACTOR;
@@ -784,6 +1088,14 @@ List* listJoin(PKVM* vm, List* l1, List* l2) {
   return list;
 }
 
+List* listCopy(PKVM* vm, List* self) {
+  List* list = newList(vm, self->elements.count);
+  memcpy(list->elements.data, self->elements.data,
+         sizeof(Var) * self->elements.count);
+  list->elements.count = self->elements.count;
+  return list;
+}
+
 // Return a hash value for the object.
 static uint32_t _hashObject(Object* obj) {
 
@@ -805,11 +1117,19 @@ static uint32_t _hashObject(Object* obj) {
       return utilHashNumber(range->from) ^ utilHashNumber(range->to);
     }
 
+    case OBJ_BIGINT:
+      return bigIntHash((BigInt*)obj);
+
+    case OBJ_PATTERN:
+      return ((Pattern*)obj)->source->hash;
+
     case OBJ_SCRIPT:
     case OBJ_FUNC:
     case OBJ_FIBER:
     case OBJ_CLASS:
     case OBJ_INST:
+    case OBJ_AUTOMATON:
+    case OBJ_HASHER:
       TODO;
       UNREACHABLE();
 
@@ -930,26 +1250,64 @@ static void _mapResize(PKVM* vm, Map* self, uint32_t capacity) {
   DEALLOCATE(vm, old_entries);
 }
 
+// Returns the capacity required for a map with [count] entries without
+// exceeding the MAP_LOAD_PERCENT.
+static uint32_t _mapCapacityFor(uint32_t count) {
+
+  // It's computed in 64 bits since the [count] * 100 could overflow, and
+  // capped to the largest power of 2 capacity of an uint32_t.
+  uint64_t required = (uint64_t)count * 100 / MAP_LOAD_PERCENT + 1;
+  if (required > MAX_MAP_CAPACITY / 2) return MAX_MAP_CAPACITY;
+
+  int capacity = utilPowerOf2Ceil((int)required);
+  if (capacity < MIN_CAPACITY) capacity = MIN_CAPACITY;
+  return (uint32_t)capacity;
+}
+
 Var mapGet(Map* self, Var key) {
   MapEntry* entry;
   if (_mapFindEntry(self, key, &entry)) return entry->value;
   return VAR_UNDEFINED;
 }
 
-void mapSet(PKVM* vm, Map* self, Var key, Var value) {
+MapEntry* mapGetEntry(Map* self, Var key) {
+  MapEntry* entry;
+  if (_mapFindEntry(self, key, &entry)) return entry;
+  return NULL;
+}
 
-  // If map is about to fill, resize it first.
-  if (self->count + 1 > self->capacity * MAP_LOAD_PERCENT / 100) {
+// Resize the map if it's about to fill, to insert a new entry.
+static void _mapEnsureSlot(PKVM* vm, Map* self) {
+  uint64_t limit = (uint64_t)self->capacity * MAP_LOAD_PERCENT / 100;
+  if (self->count + 1 > limit && self->capacity < MAX_MAP_CAPACITY) {
     uint32_t capacity = self->capacity * GROW_FACTOR;
     if (capacity < MIN_CAPACITY) capacity = MIN_CAPACITY;
     _mapResize(vm, self, capacity);
   }
+}
+
+void mapSet(PKVM* vm, Map* self, Var key, Var value) {
+
+  // If map is about to fill, resize it first.
+  _mapEnsureSlot(vm, self);
 
   if (_mapInsertEntry(self, key, value)) {
     self->count++; //< A new key added.
   }
 }
 
+Var mapSetDefault(PKVM* vm, Map* self, Var key, Var value) {
+  _mapEnsureSlot(vm, self);
+
+  MapEntry* entry;
+  if (_mapFindEntry(self, key, &entry)) return entry->value;
+
+  entry->key = key;
+  entry->value = value;
+  self->count++;
+  return value;
+}
+
 void mapClear(PKVM* vm, Map* self) {
   DEALLOCATE(vm, self->entries);
   self->entries = NULL;
@@ -957,6 +1315,25 @@ void mapClear(PKVM* vm, Map* self) {
   self->count = 0;
 }
 
+void mapReserve(PKVM* vm, Map* self, uint32_t count) {
+  uint32_t capacity = _mapCapacityFor(count);
+  if (capacity > self->capacity) _mapResize(vm, self, capacity);
+}
+
+Map* mapCopy(PKVM* vm, Map* self) {
+  Map* map = newMap(vm);
+  if (self->capacity == 0) return map;
+
+  vmPushTempRef(vm, &map->_super);
+  map->entries = ALLOCATE_ARRAY(vm, MapEntry, self->capacity);
+  memcpy(map->entries, self->entries, sizeof(MapEntry) * self->capacity);
+  map->capacity = self->capacity;
+  map->count = self->count;
+  vmPopTempRef(vm);
+
+  return map;
+}
+
 Var mapRemoveKey(PKVM* vm, Map* self, Var key) {
   MapEntry* entry;
   if (!_mapFindEntry(self, key, &entry)) return VAR_NULL;
@@ -1000,6 +1377,40 @@ bool fiberHasError(Fiber* fiber) {
   return fiber->error != NULL;
 }
 
+bool automatonContains(const Automaton* self, const char* text,
+                       uint32_t length) {
+  uint32_t state = 0;
+  for (uint32_t i = 0; i < length; i++) {
+    state = _automatonNext(self, state, (uint8_t)text[i]);
+    if (self->match[state] >= 0 || self->output[state] != 0) return true;
+  }
+  return false;
+}
+
+void automatonFindAll(PKVM* vm, Automaton* self, String* text,
+                      List* matches) {
+  uint32_t state = 0;
+  for (uint32_t i = 0; i < text->length; i++) {
+    state = _automatonNext(self, state, (uint8_t)text->data[i]);
+
+    // The patterns ending at the state and then at it's suffixes.
+    uint32_t found = (self->match[state] >= 0) ? state : self->output[state];
+    for (; found != 0; found = self->output[found]) {
+      int32_t pattern = self->match[found];
+      for (; pattern >= 0; pattern = self->pattern_next[pattern]) {
+        uint32_t start = i + 1 - self->pattern_lengths[pattern];
+
+        List* item = newList(vm, 2);
+        vmPushTempRef(vm, &item->_super); // item.
+        listAppend(vm, item, VAR_NUM((double)start));
+        listAppend(vm, item, VAR_NUM((double)pattern));
+        listAppend(vm, matches, VAR_OBJ(item));
+        vmPopTempRef(vm); // item.
+      }
+    }
+  }
+}
+
 void freeObject(PKVM* vm, Object* self) {
   // TODO: Debug trace memory here.
 
@@ -1028,6 +1439,8 @@ void freeObject(PKVM* vm, Object* self) {
       Script* scr = (Script*)self;
       pkVarBufferClear(&scr->globals, vm);
       pkUintBufferClear(&scr->global_names, vm);
+      pkUintBufferClear(&scr->constants, vm);
+      pkVarBufferClear(&scr->prepared, vm);
       pkVarBufferClear(&scr->literals, vm);
       pkFunctionBufferClear(&scr->functions, vm);
       pkClassBufferClear(&scr->classes, vm);
@@ -1037,8 +1450,11 @@ void freeObject(PKVM* vm, Object* self) {
     case OBJ_FUNC: {
       Function* func = (Function*)self;
       if (!func->is_native) {
+        if (vm->debugger.sites.count > 0) debugForgetFunction(vm, func);
         pkByteBufferClear(&func->fn->opcodes, vm);
         pkUintBufferClear(&func->fn->oplines, vm);
+        pkUintBufferClear(&func->fn->cover_lines, vm);
+        pkByteBufferClear(&func->fn->cover_bits, vm);
         DEALLOCATE(vm, func->fn);
       }
     } break;
@@ -1072,11 +1488,65 @@ void freeObject(PKVM* vm, Object* self) {
 
       break;
     }
+
+    case OBJ_AUTOMATON: {
+      Automaton* automaton = (Automaton*)self;
+      DEALLOCATE(vm, automaton->pattern_lengths);
+      DEALLOCATE(vm, automaton->pattern_next);
+      DEALLOCATE(vm, automaton->edge_start);
+      DEALLOCATE(vm, automaton->edge_bytes);
+      DEALLOCATE(vm, automaton->edge_targets);
+      DEALLOCATE(vm, automaton->fail);
+      DEALLOCATE(vm, automaton->output);
+      DEALLOCATE(vm, automaton->match);
+    } break;
+
+    case OBJ_BIGINT:
+      break;
+
+    case OBJ_PATTERN:
+      regexFree(vm, ((Pattern*)self)->regex);
+      break;
+
+    case OBJ_HASHER:
+      break;
   }
 
   DEALLOCATE(vm, self);
 }
 
+void shrinkObject(PKVM* vm, Object* self) {
+  switch (self->type) {
+    case OBJ_LIST: {
+      pkVarBuffer* elements = &((List*)self)->elements;
+      if (elements->capacity <= MIN_CAPACITY) return;
+      if (elements->count > elements->capacity / (GROW_FACTOR * GROW_FACTOR)) {
+        return;
+      }
+
+      uint32_t capacity = (uint32_t)utilPowerOf2Ceil((int)elements->count);
+      if (capacity < MIN_CAPACITY) capacity = MIN_CAPACITY;
+
+      uint32_t reserved = ((List*)self)->reserved;
+      if (capacity < reserved) {
+        capacity = (uint32_t)utilPowerOf2Ceil((int)reserved);
+      }
+      if (capacity >= elements->capacity) return;
+
+      elements->data = (Var*)vmReallocBuffer(vm, elements->data,
+                                             sizeof(Var) * elements->capacity,
+                                             sizeof(Var) * capacity);
+      elements->capacity = capacity;
+    } break;
+
+    // Strings are immutable and allocated with their exact size, maps would
+    // be re-hashed (see the description in pk_var.h) and the buffers of the
+    // other objects won't grow at runtime.
+    default:
+      break;
+  }
+}
+
 uint32_t scriptAddName(Script* self, PKVM* vm, const char* name,
   uint32_t length) {
 
@@ -1152,6 +1622,13 @@ uint32_t scriptAddGlobal(PKVM* vm, Script* script,
   return script->globals.count - 1;
 }
 
+bool scriptIsConstant(Script* script, uint32_t index) {
+  for (uint32_t i = 0; i < script->constants.count; i++) {
+    if (script->constants.data[i] == index) return true;
+  }
+  return false;
+}
+
 void scriptAddMain(PKVM* vm, Script* script) {
   ASSERT(script->body == NULL, OOPS);
 
@@ -1302,6 +1779,10 @@ const char* getPkVarTypeName(PkVarType type) {
     case PK_FIBER:    return "Fiber";
     case PK_CLASS:    return "Class";
     case PK_INST:     return "Inst";
+    case PK_AUTOMATON: return "Automaton";
+    case PK_BIGINT:   return "BigInt";
+    case PK_PATTERN:  return "Pattern";
+    case PK_HASHER:   return "Hasher";
   }
 
   UNREACHABLE();
@@ -1318,6 +1799,10 @@ const char* getObjectTypeName(ObjectType type) {
     case OBJ_FIBER:   return "Fiber";
     case OBJ_CLASS:   return "Class";
     case OBJ_INST:    return "Inst";
+    case OBJ_AUTOMATON: return "Automaton";
+    case OBJ_BIGINT:  return "BigInt";
+    case OBJ_PATTERN: return "Pattern";
+    case OBJ_HASHER:  return "Hasher";
   }
   UNREACHABLE();
 }
@@ -1332,6 +1817,15 @@ const char* varTypeName(Var v) {
   return getObjectTypeName(obj->type);
 }
 
+const char* hashAlgorithmName(HashAlgorithm algorithm) {
+  switch (algorithm) {
+    case HASH_CRC32C: return "crc32c";
+    case HASH_WYHASH: return "wyhash";
+    case HASH_SHA256: return "sha256";
+  }
+  UNREACHABLE();
+}
+
 bool isValuesSame(Var v1, Var v2) {
 #if VAR_NAN_TAGGING
   // Bit representation of each values are unique so just compare the bits.
@@ -1344,6 +1838,13 @@ bool isValuesSame(Var v1, Var v2) {
 bool isValuesEqual(Var v1, Var v2) {
   if (isValuesSame(v1, v2)) return true;
 
+  // A BigInt could be equal to a number with the same value.
+  if (IS_OBJ_TYPE(v1, OBJ_BIGINT) && IS_NUM(v2)) {
+    double num = AS_NUM(v2);
+    return !isnan(num) && bigIntCompareNumber((BigInt*)AS_OBJ(v1), num) == 0;
+  }
+  if (IS_NUM(v1) && IS_OBJ_TYPE(v2, OBJ_BIGINT)) return isValuesEqual(v2, v1);
+
   // If we reach here only heap allocated objects could be compared.
   if (!IS_OBJ(v1) || !IS_OBJ(v2)) return false;
 
@@ -1355,6 +1856,9 @@ bool isValuesEqual(Var v1, Var v2) {
       return ((Range*)o1)->from == ((Range*)o2)->from &&
              ((Range*)o1)->to   == ((Range*)o2)->to;
 
+    case OBJ_BIGINT:
+      return bigIntCompare((BigInt*)o1, (BigInt*)o2) == 0;
+
     case OBJ_STRING: {
       String* s1 = (String*)o1, *s2 = (String*)o2;
       return s1->hash == s2->hash &&
@@ -1643,6 +2147,37 @@ static void _toStringInternal(PKVM* vm, const Var v, pkByteBuffer* buff,
         pkByteBufferWrite(buff, vm, ']');
         return;
       }
+
+      case OBJ_AUTOMATON: {
+        const Automaton* automaton = (const Automaton*)obj;
+        char buff_count[STR_INT_BUFF_SIZE];
+        const int len = snprintf(buff_count, sizeof(buff_count), "%u",
+                                 automaton->pattern_count);
+        pkByteBufferAddString(buff, vm, "[Automaton:", 11);
+        pkByteBufferAddString(buff, vm, buff_count, (uint32_t)len);
+        pkByteBufferWrite(buff, vm, ']');
+        return;
+      }
+
+      case OBJ_BIGINT:
+        bigIntWrite(vm, (const BigInt*)obj, 10, NULL, buff);
+        return;
+
+      case OBJ_PATTERN: {
+        const String* source = ((const Pattern*)obj)->source;
+        pkByteBufferAddString(buff, vm, "[Pattern:", 9);
+        pkByteBufferAddString(buff, vm, source->data, source->length);
+        pkByteBufferWrite(buff, vm, ']');
+        return;
+      }
+
+      case OBJ_HASHER: {
+        const char* name = hashAlgorithmName(((const Hasher*)obj)->algorithm);
+        pkByteBufferAddString(buff, vm, "[Hasher:", 8);
+        pkByteBufferAddString(buff, vm, name, (uint32_t)strlen(name));
+        pkByteBufferWrite(buff, vm, ']');
+        return;
+      }
     }
 
   }
@@ -1692,7 +2227,12 @@ bool toBool(Var v) {
     case OBJ_FIBER:
     case OBJ_CLASS:
     case OBJ_INST:
+    case OBJ_AUTOMATON:
       return true;
+
+    case OBJ_BIGINT: return ((BigInt*)o)->count != 0;
+    case OBJ_PATTERN: return true;
+    case OBJ_HASHER:  return true;
   }
 
   UNREACHABLE();
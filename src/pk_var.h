@@ -7,7 +7,9 @@
 #define VAR_H
 
 #include "pk_buffers.h"
+#include "pk_hash.h"
 #include "pk_internal.h"
+#include "pk_re.h"
 
 /** @file
  * A simple dynamic type system library for small dynamic typed languages using
@@ -139,7 +141,8 @@
 #define IS_OBJ(value)   ((value & _MASK_OBJECT) == _MASK_OBJECT)
 
 // Evaluate to true if the var is an object and type of [obj_type].
-#define IS_OBJ_TYPE(var, obj_type) IS_OBJ(var) && AS_OBJ(var)->type == obj_type
+#define IS_OBJ_TYPE(var, obj_type) \
+  (IS_OBJ(var) && AS_OBJ(var)->type == (obj_type))
 
 // Check if the 2 pocket strings are equal.
 #define IS_STR_EQ(s1, s2)          \
@@ -203,6 +206,10 @@ typedef struct Function Function;
 typedef struct Fiber Fiber;
 typedef struct Class Class;
 typedef struct Instance Instance;
+typedef struct Automaton Automaton;
+typedef struct BigInt BigInt;
+typedef struct Pattern Pattern;
+typedef struct Hasher Hasher;
 
 // Declaration of buffer objects of different types.
 DECLARE_BUFFER(Uint, uint32_t)
@@ -229,13 +236,22 @@ typedef enum {
   OBJ_FIBER,
   OBJ_CLASS,
   OBJ_INST,
+  OBJ_AUTOMATON,
+  OBJ_BIGINT,
+  OBJ_PATTERN,
+  OBJ_HASHER,
 } ObjectType;
 
 // Base struct for all heap allocated objects.
 struct Object {
   ObjectType type;  //< Type of the object in \ref var_Object_Type.
   bool is_marked;   //< Marked when garbage collection's marking phase.
-  Object* next;     //< Next object in the heap allocated link list.
+  bool is_old;      //< Survived at least one garbage collection.
+  bool is_frozen;   //< Frozen by pkFreezeHeap() (never written by the GC).
+  union {
+    Object* next;       //< Next object in the heap allocated link list.
+    uint32_t frozen_id; //< Index of the frozen object in the vm.
+  };
 };
 
 struct String {
@@ -251,6 +267,10 @@ struct List {
   Object _super;
 
   pkVarBuffer elements; //< Elements of the array.
+
+  // The capacity reserved with list_reserve(), the garbage collector won't
+  // shrink the elements below it.
+  uint32_t reserved;
 };
 
 typedef struct {
@@ -287,6 +307,11 @@ struct Script {
 
   pkVarBuffer globals;         //< Script level global variables.
   pkUintBuffer global_names;   //< Name map to index in globals.
+  pkUintBuffer constants;      //< Indexes of the globals which are constant.
+
+  // The initial values of the globals of a prepared script (see
+  // pkPrepareScript()), copied to the globals before every run.
+  pkVarBuffer prepared;
 
   pkFunctionBuffer functions;  //< Functions of the script.
   pkClassBuffer classes;       //< Classes of the script.
@@ -307,6 +332,11 @@ typedef struct {
   pkByteBuffer opcodes;  //< Buffer of opcodes.
   pkUintBuffer oplines;  //< Line number of opcodes for debug (1 based).
   int stack_size;        //< Maximum size of stack required.
+
+  // If compiled with the coverage option, the sorted line numbers of the
+  // OP_COVER instructions and a bitmap of the executed ones.
+  pkUintBuffer cover_lines;
+  pkByteBuffer cover_bits;
 } Fn;
 
 struct Function {
@@ -406,6 +436,79 @@ struct Instance {
   };
 };
 
+// An Aho-Corasick automaton built from a list of strings (patterns) which
+// finds all the occurrences of them in a text with a single pass, so the
+// time to search doesn't grow with the number of the patterns.
+//
+// The states are the nodes of the trie of the patterns, the edges of a state
+// [s] are at the index edge_start[s] to edge_start[s+1] of the edges arrays
+// sorted by their byte (for binary search). If a state doesn't have an edge
+// for a byte, it'll follow the [fail] link which is the state of the longest
+// proper suffix of it in the trie. The transitions of the root are stored as
+// a table since most of the bytes of a text will be looked up there.
+struct Automaton {
+  Object _super;
+
+  uint32_t pattern_count;
+  uint32_t* pattern_lengths; //< Length of the patterns.
+  int32_t* pattern_next;     //< Next pattern of the same string or -1.
+
+  uint32_t state_count;
+  uint32_t* edge_start;      //< Start index of the edges (state_count + 1).
+  uint8_t* edge_bytes;       //< Byte of the edges.
+  uint32_t* edge_targets;    //< Target state of the edges.
+
+  uint32_t* fail;            //< Failure link of the states.
+  uint32_t* output;          //< Next state in the fail chain with a match.
+  int32_t* match;            //< First pattern ending at the state or -1.
+
+  uint32_t root[256];        //< Transitions of the root state (0).
+};
+
+// An arbitrary precision integer (see pk_bigint.h), the magnitude is stored
+// as 32 bit limbs (least significant first) without the leading zero limbs,
+// so the zero has no limbs.
+struct BigInt {
+  Object _super;
+
+  bool negative;      //< True if the value is negative (never for zero).
+  uint32_t count;     //< Number of limbs in \ref limbs.
+  uint32_t capacity;  //< Size of allocated \ref limbs.
+  uint32_t limbs[DYNAMIC_TAIL_ARRAY];
+};
+
+// A compiled regular expression returned by re.compile(), it owns the regex
+// (see pk_re.h) so the program is compiled once and isn't evicted from the
+// VM's cache of the string patterns.
+struct Pattern {
+  Object _super;
+
+  String* source;  //< Source of the pattern.
+  Regex* regex;    //< The compiled program.
+};
+
+// The algorithms of the hash module.
+typedef enum {
+  HASH_CRC32C,
+  HASH_WYHASH,
+  HASH_SHA256,
+} HashAlgorithm;
+
+// An incremental hash computation of the hash module (see pk_hash.h), the
+// data is added part by part with hash.update() and the digest of the data
+// so far could be taken any time with hash.digest().
+struct Hasher {
+  Object _super;
+
+  HashAlgorithm algorithm;
+  uint64_t length;  //< Number of bytes hashed so far.
+  union {
+    uint32_t crc;   //< The checksum of HASH_CRC32C.
+    Wyhash wyhash;
+    Sha256 sha256;
+  };
+};
+
 /*****************************************************************************/
 /* "CONSTRUCTORS"                                                            */
 /*****************************************************************************/
@@ -474,6 +577,22 @@ Instance* newInstance(PKVM* vm, Class* ty, bool initialize);
 // instance using NativeTypeNameFn callback.
 Instance* newInstanceNative(PKVM* vm, void* data, uint32_t id);
 
+// Allocate new Automaton object from the [patterns] and return Automaton*.
+// The [patterns] should be a list of non empty strings.
+Automaton* newAutomaton(PKVM* vm, List* patterns);
+
+// Allocate new BigInt object with [count] limbs and return BigInt*. Note that
+// the limbs are un initialized and the value is positive.
+BigInt* newBigInt(PKVM* vm, uint32_t count);
+
+// Allocate new Pattern object which takes the ownership of the compiled
+// [regex] of the [source] and return Pattern*.
+Pattern* newPattern(PKVM* vm, String* source, Regex* regex);
+
+// Allocate new Hasher object of the [algorithm] and return Hasher*. The
+// [seed] is the seed of the wyhash or the initial checksum of the crc32c.
+Hasher* newHasher(PKVM* vm, HashAlgorithm algorithm, uint64_t seed);
+
 /*****************************************************************************/
 /* METHODS                                                                   */
 /*****************************************************************************/
@@ -530,6 +649,16 @@ String* stringFormat(PKVM* vm, const char* fmt, ...);
 // Which would be faster than using "@@" format.
 String* stringJoin(PKVM* vm, String* str1, String* str2);
 
+// Create a new string by joining all the elements of the list [parts] with
+// the [sep] between them (could be NULL). The elements should be strings.
+// The result is allocated once, instead of creating the intermediate strings.
+// Returns NULL if the length of the result exceeds UINT32_MAX.
+String* stringJoinList(PKVM* vm, List* parts, String* sep);
+
+// Returns the index of the first occurrence of [sub] in the string [self]
+// from the index [start], or -1 if it's not found.
+int64_t stringFind(String* self, String* sub, uint32_t start);
+
 // An inline function/macro implementation of listAppend(). Set below 0 to 1,
 // to make the implementation a static inline function, it's totally okey to
 // define a function inside a header as long as it's static (but not a fan).
@@ -552,16 +681,33 @@ Var listRemoveAt(PKVM* vm, List* self, uint32_t index);
 // Create a new list by joining the 2 given list and return the result.
 List* listJoin(PKVM* vm, List* l1, List* l2);
 
+// Create a shallow copy of the list [self].
+List* listCopy(PKVM* vm, List* self);
+
 // Returns the value for the [key] in the map. If key not exists return
 // VAR_UNDEFINED.
 Var mapGet(Map* self, Var key);
 
+// Returns the entry of the [key] in the map or NULL if key not exists.
+MapEntry* mapGetEntry(Map* self, Var key);
+
 // Add the [key], [value] entry to the map.
 void mapSet(PKVM* vm, Map* self, Var key, Var value);
 
+// Returns the value for the [key] in the map. If key not exists add the
+// [key], [value] entry and return the [value].
+Var mapSetDefault(PKVM* vm, Map* self, Var key, Var value);
+
 // Remove all the entries from the map.
 void mapClear(PKVM* vm, Map* self);
 
+// Ensure the map [self] can hold [count] entries without resizing.
+void mapReserve(PKVM* vm, Map* self, uint32_t count);
+
+// Create a shallow copy of the map [self] by copying it's entries as it is
+// (without re-hashing the keys).
+Map* mapCopy(PKVM* vm, Map* self);
+
 // Remove the [key] from the map. If the key exists return it's value
 // otherwise return VAR_NULL.
 Var mapRemoveKey(PKVM* vm, Map* self, Var key);
@@ -570,6 +716,16 @@ Var mapRemoveKey(PKVM* vm, Map* self, Var key);
 // resumed anymore.
 bool fiberHasError(Fiber* fiber);
 
+// Returns true if any of the patterns of the automaton occurs in the [text].
+bool automatonContains(const Automaton* self, const char* text,
+                       uint32_t length);
+
+// Find all the (could be overlapping) occurrences of the patterns in the
+// [text] and append them to the list [matches] as [start, pattern_index]
+// lists, ordered by their end position.
+void automatonFindAll(PKVM* vm, Automaton* self, String* text,
+                      List* matches);
+
 // Add the name (string literal) to the string buffer if not already exists and
 // return it's index in the buffer.
 uint32_t scriptAddName(Script* self, PKVM* vm, const char* name,
@@ -592,6 +748,10 @@ uint32_t scriptAddGlobal(PKVM* vm, Script* script,
                          const char* name, uint32_t length,
                          Var value);
 
+// Returns true if the global at the [index] of the script is a constant, which
+// value is set at the compile time and cannot be re-assigned.
+bool scriptIsConstant(Script* script, uint32_t index);
+
 // This will allocate a new implicit main function for the script and assign to
 // the script's body attribute. And the attribute initialized will be set to
 // false for the new function. Note that the body of the script should be NULL
@@ -611,15 +771,40 @@ bool instSetAttrib(PKVM* vm, Instance* inst, String* attrib, Var value);
 // Release all the object owned by the [self] including itself.
 void freeObject(PKVM* vm, Object* self);
 
+// Shrink the over allocated elements of the list [self] if they're filled a
+// quarter (1/(GROW_FACTOR*GROW_FACTOR)) or less to give the memory back to
+// the allocator, but not below the reserved capacity. Called by the garbage
+// collector on the objects which survived more than one collection. Maps
+// aren't shrunk here, since re-hashing would break an iteration in progress
+// (they shrink when the keys are removed, see mapRemoveKey()).
+void shrinkObject(PKVM* vm, Object* self);
+
 /*****************************************************************************/
 /* UTILITY FUNCTIONS                                                         */
 /*****************************************************************************/
 
-// Internal method behind VAR_NUM(value) don't use it directly.
-Var doubleToVar(double value);
+// Internal method behind VAR_NUM(value) don't use it directly. It's defined
+// here to be inlined, since it's used by every arithmetic operation.
+static inline Var doubleToVar(double value) {
+#if VAR_NAN_TAGGING
+  union { double num; Var bits; } conv;
+  conv.num = value;
+  return conv.bits;
+#else
+  #error TODO:
+#endif // VAR_NAN_TAGGING
+}
 
 // Internal method behind AS_NUM(value) don't use it directly.
-double varToDouble(Var value);
+static inline double varToDouble(Var value) {
+#if VAR_NAN_TAGGING
+  union { double num; Var bits; } conv;
+  conv.bits = value;
+  return conv.num;
+#else
+  #error TODO:
+#endif // VAR_NAN_TAGGING
+}
 
 // Returns the type name of the PkVarType enum value.
 const char* getPkVarTypeName(PkVarType type);
@@ -630,6 +815,9 @@ const char* getObjectTypeName(ObjectType type);
 // Returns the type name of the var [v].
 const char* varTypeName(Var v);
 
+// Returns the name of the hash algorithm (as given to hash.new()).
+const char* hashAlgorithmName(HashAlgorithm algorithm);
+
 // Returns true if both variables are the same (ie v1 is v2).
 bool isValuesSame(Var v1, Var v2);
 
@@ -3,13 +3,27 @@
  *  Distributed Under The MIT License
  */
 
+// mremap() is a linux extension which requires _GNU_SOURCE to be defined
+// before including any system headers.
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+  #define _GNU_SOURCE
+#endif
+
 #include "pk_vm.h"
 
 #include <math.h>
+#include "pk_bigint.h"
 #include "pk_core.h"
 #include "pk_utils.h"
 #include "pk_debug.h"
 
+#if defined(__linux__)
+  #include <sys/mman.h>
+  #define LARGE_BUFFER_MMAP 1
+#else
+  #define LARGE_BUFFER_MMAP 0
+#endif
+
 /*****************************************************************************/
 /* VM PUBLIC API                                                             */
 /*****************************************************************************/
@@ -37,6 +51,7 @@ PkConfiguration pkNewConfiguration(void) {
 
   config.load_script_fn = NULL;
   config.resolve_path_fn = NULL;
+  config.debug_fn = NULL;
   config.user_data = NULL;
 
   return config;
@@ -49,6 +64,8 @@ PkCompileOptions pkNewCompilerOptions(void) {
   //options.dump_opcodes = false;
   //options.dump_stream = stdout;
   options.repl_mode = false;
+  options.coverage = false;
+  options.stats = false;
   return options;
 }
 
@@ -73,6 +90,9 @@ PKVM* pkNewVM(PkConfiguration* config) {
   vm->scripts = newMap(vm);
   vm->core_libs = newMap(vm);
   vm->builtins_count = 0;
+  debuggerInit(vm);
+  tracerInit(vm);
+  pkCompileStatsBufferInit(&vm->compile_stats);
 
   initializeCore(vm);
   return vm;
@@ -80,6 +100,11 @@ PKVM* pkNewVM(PkConfiguration* config) {
 
 void pkFreeVM(PKVM* vm) {
 
+  // Free the debugger first so the functions freed below won't be searched
+  // in its break sites.
+  debuggerFree(vm);
+  tracerFree(vm);
+
   Object* obj = vm->first;
   while (obj != NULL) {
     Object* next = obj->next;
@@ -87,6 +112,23 @@ void pkFreeVM(PKVM* vm) {
     obj = next;
   }
 
+  for (uint32_t i = 0; i < vm->frozen_count; i++) {
+    freeObject(vm, vm->frozen[i]);
+  }
+  if (vm->frozen != NULL) {
+    DEALLOCATE(vm, vm->frozen);
+    DEALLOCATE(vm, vm->frozen_marks);
+  }
+
+  for (int i = 0; i < REGEX_CACHE_SIZE; i++) {
+    if (vm->regex_cache[i] != NULL) regexFree(vm, vm->regex_cache[i]);
+  }
+
+  for (uint32_t i = 0; i < vm->compile_stats.count; i++) {
+    DEALLOCATE(vm, (char*)vm->compile_stats.data[i].path);
+  }
+  pkCompileStatsBufferClear(&vm->compile_stats, vm);
+
   vm->working_set = (Object**)vm->config.realloc_fn(
     vm->working_set, 0, vm->config.user_data);
 
@@ -105,6 +147,37 @@ void pkSetUserData(PKVM* vm, void* user_data) {
   vm->config.user_data = user_data;
 }
 
+void pkFreezeHeap(PKVM* vm) {
+
+  // The frozen objects are never freed, collect the garbage before.
+  vmCollectGarbage(vm);
+
+  uint32_t count = 0;
+  for (Object* obj = vm->first; obj != NULL; obj = obj->next) count++;
+  if (count == 0) return;
+
+  // Grow the arrays before moving the objects, the allocation might trigger
+  // a collection which could only free some of them.
+  uint32_t old_count = vm->frozen_count;
+  uint32_t new_count = old_count + count;
+  vm->frozen = (Object**)vmRealloc(vm, vm->frozen,
+                                   sizeof(Object*) * old_count,
+                                   sizeof(Object*) * new_count);
+  vm->frozen_marks = (uint8_t*)vmRealloc(vm, vm->frozen_marks,
+                                         (old_count + 7) / 8,
+                                         (new_count + 7) / 8);
+
+  Object* obj = vm->first;
+  while (obj != NULL) {
+    Object* next = obj->next;
+    obj->is_frozen = true;
+    obj->frozen_id = vm->frozen_count;
+    vm->frozen[vm->frozen_count++] = obj;
+    obj = next;
+  }
+  vm->first = NULL;
+}
+
 PkHandle* pkNewHandle(PKVM* vm, PkVar value) {
   return vmNewHandle(vm, *((Var*)value));
 }
@@ -162,6 +235,137 @@ PkResult pkInterpretSource(PKVM* vm, PkStringPtr source, PkStringPtr path,
   return runFiber(vm, newFiber(vm, scr->body));
 }
 
+PkHandle* pkPrepareScript(PKVM* vm, PkStringPtr source, PkStringPtr path,
+                          int count, const char** globals) {
+
+  String* path_name = newString(vm, path.string);
+  if (path.on_done) path.on_done(vm, path);
+  vmPushTempRef(vm, &path_name->_super); // path_name.
+  Script* scr = newScript(vm, path_name, false);
+  vmPopTempRef(vm); // path_name.
+  vmPushTempRef(vm, &scr->_super); // scr.
+
+  // Add the globals of the host before compiling, so the script can use them.
+  for (int i = 0; i < count; i++) {
+    scriptAddGlobal(vm, scr, globals[i], (uint32_t)strlen(globals[i]),
+                    VAR_NULL);
+  }
+
+  PkResult result = compile(vm, scr, source.string, NULL);
+  if (source.on_done) source.on_done(vm, source);
+
+  PkHandle* handle = NULL;
+  if (result == PK_RESULT_SUCCESS) {
+    scr->initialized = true;
+    pkVarBufferConcat(&scr->prepared, vm, &scr->globals);
+    handle = vmNewHandle(vm, VAR_OBJ(scr));
+  }
+
+  vmPopTempRef(vm); // scr.
+  return handle;
+}
+
+PkResult pkRunPrepared(PKVM* vm, PkHandle* script, int count,
+                       const char** names, PkHandle** values) {
+  __ASSERT(script != NULL && IS_OBJ_TYPE(script->value, OBJ_SCRIPT),
+           "Given handle is not a script.");
+
+  Script* scr = (Script*)AS_OBJ(script->value);
+  __ASSERT(scr->prepared.count == scr->globals.count,
+           "Given script is not prepared.");
+
+  // Reset the globals to their values after the compilation.
+  memcpy(scr->globals.data, scr->prepared.data,
+         sizeof(Var) * scr->globals.count);
+
+  for (int i = 0; i < count; i++) {
+    int index = scriptGetGlobals(scr, names[i], (uint32_t)strlen(names[i]));
+
+    // The constants are already folded into the code.
+    if (index == -1 || scriptIsConstant(scr, (uint32_t)index)) {
+      if (vm->config.error_fn != NULL) {
+        String* message = stringFormat(vm, "Global '$' $.", names[i],
+          (index == -1) ? "not exists" : "is a constant");
+        vmPushTempRef(vm, &message->_super); // message.
+        vm->config.error_fn(vm, PK_ERROR_RUNTIME, NULL, -1, message->data);
+        vmPopTempRef(vm); // message.
+      }
+      return PK_RESULT_RUNTIME_ERROR;
+    }
+    scr->globals.data[index] = values[i]->value;
+  }
+
+  return runFiber(vm, newFiber(vm, scr->body));
+}
+
+PkHandle* pkCompileExpression(PKVM* vm, const char* source,
+                              const char** names, int count) {
+  __ASSERT(source != NULL, "Argument source was NULL.");
+  __ASSERT(count >= 0 && count <= MAX_ARGC, "Invalid variable count.");
+
+  String* path = newString(vm, "$(Expression)");
+  vmPushTempRef(vm, &path->_super); // path.
+  Script* scr = newScript(vm, path, false);
+  vmPopTempRef(vm); // path.
+  vmPushTempRef(vm, &scr->_super); // scr.
+
+  PkHandle* handle = NULL;
+  Function* fn = compileExpressionFn(vm, scr, source, count, names);
+  if (fn != NULL) {
+    scr->initialized = true;
+
+    // The fiber of the expression is kept as it's handle and reused.
+    Fiber* fiber = newFiber(vm, fn);
+    vmPushTempRef(vm, &fiber->_super); // fiber.
+    handle = vmNewHandle(vm, VAR_OBJ(fiber));
+    vmPopTempRef(vm); // fiber.
+  }
+
+  vmPopTempRef(vm); // scr.
+  return handle;
+}
+
+PkResult pkEvalExpression(PKVM* vm, PkHandle* expression,
+                          const PkVar* values, PkVar* result) {
+  __ASSERT(expression != NULL, "Argument expression was NULL.");
+  __ASSERT(IS_OBJ_TYPE(expression->value, OBJ_FIBER),
+           "Given handle is not an expression.");
+
+  Fiber* fiber = (Fiber*)AS_OBJ(expression->value);
+  const Function* fn = fiber->func;
+  __ASSERT(fiber->state != FIBER_RUNNING,
+           "The expression is already being evaluated.");
+
+  // Reset the fiber to run the expression from the start.
+  fiber->state = FIBER_NEW;
+  fiber->error = NULL;
+  fiber->ret = fiber->stack;
+  fiber->frame_count = 1;
+  fiber->frames[0].ip = fn->fn->opcodes.data;
+  fiber->frames[0].rbp = fiber->stack;
+
+  // The values are the parameters of the function.
+  fiber->stack[0] = VAR_NULL;
+  for (int i = 0; i < fn->arity; i++) {
+    fiber->stack[1 + i] = *(const Var*)values[i];
+  }
+  fiber->sp = fiber->stack + 1 + fn->arity;
+
+  // It could be evaluated from a native function, the current fiber will be
+  // resumed once it's done.
+  Fiber* current = vm->fiber;
+  if (current != NULL) vmPushTempRef(vm, &current->_super); // current.
+  fiber->caller = NULL;
+
+  PkResult status = runFiber(vm, fiber);
+
+  if (current != NULL) vmPopTempRef(vm); // current.
+  vm->fiber = current;
+
+  *result = (PkVar)fiber->ret;
+  return status;
+}
+
 PkResult pkRunFiber(PKVM* vm, PkHandle* fiber,
                     int argc, PkHandle** argv) {
   __ASSERT(fiber != NULL, "Handle fiber was NULL.");
@@ -214,6 +418,12 @@ PkHandle* vmNewHandle(PKVM* vm, Var value) {
   return handle;
 }
 
+// True if the allocated bytes reached the next GC. It's deferred while
+// compiling (the objects being compiled aren't marked) and the first
+// allocation after the compilation will trigger it.
+#define GC_NEEDED(vm) \
+  ((vm)->bytes_allocated > (vm)->next_gc && (vm)->compiler == NULL)
+
 void* vmRealloc(PKVM* vm, void* memory, size_t old_size, size_t new_size) {
 
   // TODO: Debug trace allocations here.
@@ -223,13 +433,70 @@ void* vmRealloc(PKVM* vm, void* memory, size_t old_size, size_t new_size) {
   // deallocated bytes are traced by garbage collector.
   vm->bytes_allocated += new_size - old_size;
 
-  if (new_size > 0 && vm->bytes_allocated > vm->next_gc) {
+  if (new_size > 0 && GC_NEEDED(vm)) {
     vmCollectGarbage(vm);
   }
 
   return vm->config.realloc_fn(memory, new_size, vm->config.user_data);
 }
 
+void* vmReallocBuffer(PKVM* vm, void* memory, size_t old_size,
+                      size_t new_size) {
+
+  bool was_large = old_size >= LARGE_BUFFER_SIZE;
+  bool is_large = new_size >= LARGE_BUFFER_SIZE;
+
+  // If the host has provided an allocator, all the allocations should go
+  // through it (the host might be tracking or limiting them).
+  if (!LARGE_BUFFER_MMAP || vm->config.realloc_fn != defaultRealloc ||
+      (!was_large && !is_large)) {
+    return vmRealloc(vm, memory, new_size == 0 ? 0 : old_size, new_size);
+  }
+
+#if LARGE_BUFFER_MMAP
+  // Freed bytes are not tracked here, the garbage collector will recount
+  // them (see vmRealloc()).
+  if (new_size == 0) {
+    munmap(memory, old_size);
+    return NULL;
+  }
+
+  vm->bytes_allocated += new_size - old_size;
+  if (GC_NEEDED(vm)) {
+    vmCollectGarbage(vm);
+  }
+
+  // Let the kernel remap the pages of the region to a bigger (or smaller)
+  // one without copying them.
+  if (was_large && is_large) {
+    void* region = mremap(memory, old_size, new_size, MREMAP_MAYMOVE);
+    return (region == MAP_FAILED) ? NULL : region;
+  }
+
+  // The buffer crossed the LARGE_BUFFER_SIZE, this is the only time the
+  // elements are copied.
+  if (is_large) {
+    void* region = mmap(NULL, new_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) return NULL;
+    if (memory != NULL) {
+      memcpy(region, memory, old_size);
+      defaultRealloc(memory, 0, NULL);
+    }
+    return region;
+  }
+
+  void* buffer = defaultRealloc(NULL, new_size, NULL);
+  if (buffer == NULL) return NULL;
+  memcpy(buffer, memory, new_size);
+  munmap(memory, old_size);
+  return buffer;
+#else
+  UNREACHABLE();
+  return NULL;
+#endif
+}
+
 void vmPushTempRef(PKVM* vm, Object* obj) {
   ASSERT(obj != NULL, "Cannot reference to NULL.");
   ASSERT(vm->temp_reference_count < MAX_TEMP_REFERENCE,
@@ -251,11 +518,19 @@ Script* vmGetScript(PKVM* vm, String* path) {
 }
 
 void vmCollectGarbage(PKVM* vm) {
+  ASSERT(vm->compiler == NULL, "Garbage collection while compiling.");
+
+  double start = TRACE_NOW(vm);
+  size_t before = vm->bytes_allocated;
 
   // Reset VM's bytes_allocated value and count it again so that we don't
   // required to know the size of each object that'll be freeing.
   vm->bytes_allocated = 0;
 
+  if (vm->frozen_count > 0) {
+    memset(vm->frozen_marks, 0, (vm->frozen_count + 7) / 8);
+  }
+
   // Mark the core libs and builtin functions.
   markObject(vm, &vm->core_libs->_super);
   for (uint32_t i = 0; i < vm->builtins_count; i++) {
@@ -275,11 +550,6 @@ void vmCollectGarbage(PKVM* vm) {
     markValue(vm, h->value);
   }
 
-  // Garbage collection triggered at the middle of a compilation.
-  if (vm->compiler != NULL) {
-    compilerMarkObjects(vm, vm->compiler);
-  }
-
   if (vm->fiber != NULL) {
     markObject(vm, &vm->fiber->_super);
   }
@@ -289,9 +559,16 @@ void vmCollectGarbage(PKVM* vm) {
   // working set.
   popMarkedObjects(vm);
 
+  double sweep = TRACE_NOW(vm);
+
   // Now sweep all the un-marked objects in then link list and remove them
   // from the chain.
 
+  // Shrinking the objects below might allocate (the new list buffers), which
+  // shouldn't trigger another collection in the middle of this one. The
+  // [next_gc] will be re-calculated once we're done.
+  vm->next_gc = (size_t)-1;
+
   // [ptr] is an Object* reference that should be equal to the next
   // non-garbage Object*.
   Object** ptr = &vm->first;
@@ -305,6 +582,11 @@ void vmCollectGarbage(PKVM* vm) {
       freeObject(vm, garbage);
 
     } else {
+      // Shrink the buffers of the objects survived more than one collection,
+      // if they're mostly empty. The young ones are probably still growing.
+      if ((*ptr)->is_old) shrinkObject(vm, *ptr);
+      (*ptr)->is_old = true;
+
       // Unmark the object for the next garbage collection.
       (*ptr)->is_marked = false;
       ptr = &(*ptr)->next;
@@ -316,6 +598,8 @@ void vmCollectGarbage(PKVM* vm) {
   vm->next_gc = vm->bytes_allocated + (
     (vm->bytes_allocated * vm->heap_fill_percent) / 100);
   if (vm->next_gc < vm->min_heap_size) vm->next_gc = vm->min_heap_size;
+
+  if (start != 0) traceGC(vm, start, sweep, before, vm->bytes_allocated);
 }
 
 #define _ERR_FAIL(msg)                             \
@@ -368,6 +652,10 @@ bool vmPrepareFiber(PKVM* vm, Fiber* fiber, int argc, Var** argv) {
   fiber->caller = vm->fiber;
   vm->fiber = fiber;
 
+  if (vm->tracer.enabled) {
+    traceFiber(vm, TRACE_FIBER_RUN, fiber->func->name);
+  }
+
   // On success return true.
   return true;
 }
@@ -402,6 +690,10 @@ bool vmSwitchFiber(PKVM* vm, Fiber* fiber, Var* value) {
   fiber->caller = vm->fiber;
   vm->fiber = fiber;
 
+  if (vm->tracer.enabled) {
+    traceFiber(vm, TRACE_FIBER_RESUME, fiber->func->name);
+  }
+
   // On success return true.
   return true;
 }
@@ -410,6 +702,10 @@ bool vmSwitchFiber(PKVM* vm, Fiber* fiber, Var* value) {
 
 void vmYieldFiber(PKVM* vm, Var* value) {
 
+  if (vm->tracer.enabled) {
+    traceFiber(vm, TRACE_FIBER_YIELD, vm->fiber->func->name);
+  }
+
   Fiber* caller = vm->fiber->caller;
 
   // Return the yield value to the caller fiber.
@@ -582,7 +878,11 @@ static inline void reuseCallFrame(PKVM* vm, const Function* fn) {
   if (vm->fiber->stack_size <= needed) growStack(vm, needed);
 }
 
-static void reportError(PKVM* vm) {
+void vmEnsureStack(PKVM* vm, int size) {
+  if (vm->fiber->stack_size <= size) growStack(vm, size);
+}
+
+static void reportRuntimeError(PKVM* vm) {
   ASSERT(VM_HAS_ERROR(vm), "runtimeError() should be called after an error.");
   // TODO: pass the error to the caller of the fiber.
 
@@ -653,7 +953,7 @@ static PkResult runFiber(PKVM* vm, Fiber* fiber) {
   do {                                \
     if (VM_HAS_ERROR(vm)) {           \
       UPDATE_FRAME();                 \
-      reportError(vm);                \
+      reportRuntimeError(vm);         \
       FIBER_SWITCH_BACK();            \
       return PK_RESULT_RUNTIME_ERROR; \
     }                                 \
@@ -664,7 +964,7 @@ static PkResult runFiber(PKVM* vm, Fiber* fiber) {
   do {                               \
     VM_SET_ERROR(vm, err_msg);       \
     UPDATE_FRAME();                  \
-    reportError(vm);                 \
+    reportRuntimeError(vm);          \
     FIBER_SWITCH_BACK();             \
     return PK_RESULT_RUNTIME_ERROR;  \
   } while (false)
@@ -697,10 +997,21 @@ static PkResult runFiber(PKVM* vm, Fiber* fiber) {
   #define DEBUG_CALL_STACK() NO_OP
 #endif
 
-#define SWITCH() Opcode instruction; switch (instruction = (Opcode)READ_BYTE())
+#define SWITCH() switch (instruction)
 #define OPCODE(code) case OP_##code
 #define DISPATCH()   goto L_vm_main_loop
 
+// The arithmetic operators of two numbers are computed inline, without
+// calling the operator function which checks for the other types.
+#define NUM_BINARY_OP(l, r, op)                     \
+  do {                                              \
+    if (IS_NUM(l) && IS_NUM(r)) {                   \
+      DROP();                                       \
+      PEEK(-1) = VAR_NUM(AS_NUM(l) op AS_NUM(r));   \
+      DISPATCH();                                   \
+    }                                               \
+  } while (false)
+
   // Trigger a break point here, if we're trying to debug the call stack.
 #if DEBUG_DUMP_CALL_STACK
   DEBUG_BREAK();
@@ -709,8 +1020,15 @@ static PkResult runFiber(PKVM* vm, Fiber* fiber) {
   // Load the fiber's top call frame to the vm's execution variables.
   LOAD_FRAME();
 
+  // The opcode of the current instruction.
+  Opcode instruction;
+
   L_vm_main_loop:
   DEBUG_CALL_STACK();
+  instruction = (Opcode)READ_BYTE();
+
+  // The original instruction of a breakpoint will be executed from here.
+  L_vm_execute:
   SWITCH() {
 
     OPCODE(PUSH_CONSTANT):
@@ -754,8 +1072,25 @@ static PkResult runFiber(PKVM* vm, Fiber* fiber) {
 
     OPCODE(PUSH_MAP):
     {
+      uint16_t size = READ_SHORT();
       Map* map = newMap(vm);
-      PUSH(VAR_OBJ(map));
+      PUSH(VAR_OBJ(map)); // Pushed first for gc, reserving will allocate.
+      if (size > 0) mapReserve(vm, map, size);
+      DISPATCH();
+    }
+
+    OPCODE(CLONE_CONSTANT):
+    {
+      uint16_t index = READ_SHORT();
+      ASSERT_INDEX(index, script->literals.count);
+      Var constant = script->literals.data[index];
+
+      if (IS_OBJ_TYPE(constant, OBJ_LIST)) {
+        PUSH(VAR_OBJ(listCopy(vm, (List*)AS_OBJ(constant))));
+      } else {
+        ASSERT(IS_OBJ_TYPE(constant, OBJ_MAP), OOPS);
+        PUSH(VAR_OBJ(mapCopy(vm, (Map*)AS_OBJ(constant))));
+      }
       DISPATCH();
     }
 
@@ -985,14 +1320,21 @@ static PkResult runFiber(PKVM* vm, Fiber* fiber) {
         // Update the current frame's ip.
         UPDATE_FRAME();
 
+        // The native function might grow (and move) the stack.
+        Var* stack = call_fiber->stack;
+
+        double start = TRACE_NOW(vm);
         fn->native(vm); //< Call the native function.
+        if (start != 0) traceNative(vm, fn->name, start);
 
         // Calling yield() will change vm->fiber to it's caller fiber, which
         // would be null if we're not running the function with a fiber.
         if (vm->fiber == NULL) return PK_RESULT_SUCCESS;
 
         // Load the top frame to vm's execution variables.
-        if (vm->fiber != call_fiber) LOAD_FRAME();
+        if (vm->fiber != call_fiber || call_fiber->stack != stack) {
+          LOAD_FRAME();
+        }
 
         // Pop function arguments except for the return value.
         // Don't use 'vm->fiber' because calling fiber_new() and yield()
@@ -1118,6 +1460,10 @@ static PkResult runFiber(PKVM* vm, Fiber* fiber) {
         case OBJ_FIBER:
         case OBJ_CLASS:
         case OBJ_INST:
+        case OBJ_AUTOMATON:
+        case OBJ_BIGINT:
+        case OBJ_PATTERN:
+        case OBJ_HASHER:
           TODO; break;
         default:
           UNREACHABLE();
@@ -1160,6 +1506,73 @@ static PkResult runFiber(PKVM* vm, Fiber* fiber) {
       DISPATCH();
     }
 
+    OPCODE(TABLE_JUMP):
+    {
+      uint16_t index = READ_SHORT();
+      uint16_t offset = READ_SHORT(); //< Default offset.
+      ASSERT_INDEX(index, script->literals.count);
+      ASSERT(IS_OBJ_TYPE(script->literals.data[index], OBJ_LIST), OOPS);
+
+      // The first element of the table is the smallest case value.
+      List* table = (List*)AS_OBJ(script->literals.data[index]);
+      Var value = POP();
+
+      // A BigInt is equal to the number of the same integer value.
+      if (IS_OBJ_TYPE(value, OBJ_BIGINT)) {
+        int64_t integer;
+        if (bigIntToInt64((BigInt*)AS_OBJ(value), &integer)) {
+          value = VAR_NUM((double)integer);
+        }
+      }
+
+      // -0 isn't equal to 0 (see isValuesEqual()) so it's not in the table.
+      if (IS_NUM(value) && !(AS_NUM(value) == 0 && signbit(AS_NUM(value)))) {
+        double case_index = AS_NUM(value) - AS_NUM(table->elements.data[0]);
+        if (case_index >= 0 && case_index < table->elements.count - 1 &&
+            case_index == (double)(uint32_t)case_index) {
+          Var target = table->elements.data[(uint32_t)case_index + 1];
+          offset = (uint16_t)AS_NUM(target);
+        }
+      }
+
+      ip += offset;
+      DISPATCH();
+    }
+
+    OPCODE(MAP_JUMP):
+    {
+      uint16_t index = READ_SHORT();
+      uint16_t offset = READ_SHORT(); //< Default offset.
+      ASSERT_INDEX(index, script->literals.count);
+      ASSERT(IS_OBJ_TYPE(script->literals.data[index], OBJ_MAP), OOPS);
+
+      Map* table = (Map*)AS_OBJ(script->literals.data[index]);
+      Var value = POP();
+
+      // Un-hashable values (lists and maps) can't be equal to any case value.
+      if (!IS_OBJ(value) || isObjectHashable(AS_OBJ(value)->type)) {
+        Var target = mapGet(table, value);
+        if (!IS_UNDEF(target)) offset = (uint16_t)AS_NUM(target);
+      }
+
+      ip += offset;
+      DISPATCH();
+    }
+
+    OPCODE(NOP):
+      DISPATCH();
+
+    OPCODE(COVER):
+    {
+      uint8_t* opcodes = frame->fn->fn->opcodes.data;
+      uint32_t offset = (uint32_t)(ip - 1 - opcodes);
+      coverageHit(frame->fn, offset);
+
+      // The byte would be OP_BREAKPOINT if it's patched by the debugger.
+      if (opcodes[offset] == OP_COVER) opcodes[offset] = OP_NOP;
+      DISPATCH();
+    }
+
     OPCODE(RETURN):
     {
 
@@ -1173,6 +1586,11 @@ static PkResult runFiber(PKVM* vm, Fiber* fiber) {
         // value on the stack.
         //vm->fiber->sp = vm->fiber->stack; ??
 
+        // Keep the return value in the fiber for pkFiberGetReturnValue(), the
+        // [ret] would be pointing to the return value of the last call.
+        *rbp = ret_value;
+        vm->fiber->ret = rbp;
+
         FIBER_SWITCH_BACK();
 
         if (vm->fiber == NULL) {
@@ -1246,7 +1664,7 @@ static PkResult runFiber(PKVM* vm, Fiber* fiber) {
     {
       Var key = PEEK(-1);
       Var on = PEEK(-2);
-      PUSH(varGetSubscript(vm, on, key));
+      PUSH(varGetSubscriptKeep(vm, on, key));
       CHECK_ERROR();
       DISPATCH();
     }
@@ -1266,8 +1684,34 @@ static PkResult runFiber(PKVM* vm, Fiber* fiber) {
       DISPATCH();
     }
 
+    OPCODE(SUBSCRIPT_UPDATE):
+    {
+      Opcode op = (Opcode)READ_BYTE();
+      Var value = PEEK(-1);   // Don't pop yet, we need the reference for gc.
+      Var current = PEEK(-2); // Don't pop yet, we need the reference for gc.
+      Var key = PEEK(-3);     // Don't pop yet, we need the reference for gc.
+      Var on = PEEK(-4);      // Don't pop yet, we need the reference for gc.
+      Var result = varUpdateSubscript(vm, on, key, op, current, value);
+      DROP(); // value
+      DROP(); // current
+      DROP(); // key
+      DROP(); // on
+      PUSH(result);
+
+      CHECK_ERROR();
+      DISPATCH();
+    }
+
     OPCODE(NEGATIVE):
     {
+      // The BigInt operand is kept on the stack while allocating the result.
+      if (IS_OBJ_TYPE(PEEK(-1), OBJ_BIGINT)) {
+        BigInt* value = bigIntNegate(vm, (BigInt*)AS_OBJ(PEEK(-1)));
+        DROP();
+        PUSH(VAR_OBJ(value));
+        DISPATCH();
+      }
+
       Var num = POP();
       if (!IS_NUM(num)) {
         RUNTIME_ERROR(newString(vm, "Can not negate a non numeric value."));
@@ -1303,6 +1747,7 @@ static PkResult runFiber(PKVM* vm, Fiber* fiber) {
     {
       // Don't pop yet, we need the reference for gc.
       Var r = PEEK(-1), l = PEEK(-2);
+      NUM_BINARY_OP(l, r, +);
       Var result = varAdd(vm, l, r);
       DROP(); DROP(); // r, l
       PUSH(result);
@@ -1315,6 +1760,7 @@ static PkResult runFiber(PKVM* vm, Fiber* fiber) {
     {
       // Don't pop yet, we need the reference for gc.
       Var r = PEEK(-1), l = PEEK(-2);
+      NUM_BINARY_OP(l, r, -);
       Var result = varSubtract(vm, l, r);
       DROP(); DROP(); // r, l
       PUSH(result);
@@ -1327,6 +1773,7 @@ static PkResult runFiber(PKVM* vm, Fiber* fiber) {
     {
       // Don't pop yet, we need the reference for gc.
       Var r = PEEK(-1), l = PEEK(-2);
+      NUM_BINARY_OP(l, r, *);
       Var result = varMultiply(vm, l, r);
       DROP(); DROP(); // r, l
       PUSH(result);
@@ -1339,6 +1786,7 @@ static PkResult runFiber(PKVM* vm, Fiber* fiber) {
     {
       // Don't pop yet, we need the reference for gc.
       Var r = PEEK(-1), l = PEEK(-2);
+      NUM_BINARY_OP(l, r, /);
       Var result = varDivide(vm, l, r);
       DROP(); DROP(); // r, l
       PUSH(result);
@@ -1507,6 +1955,89 @@ static PkResult runFiber(PKVM* vm, Fiber* fiber) {
       DISPATCH();
     }
 
+    OPCODE(ADD_NUM):
+    {
+      Var r = POP(), l = POP();
+      ASSERT(IS_NUM(l) && IS_NUM(r), OOPS);
+      PUSH(VAR_NUM(AS_NUM(l) + AS_NUM(r)));
+      DISPATCH();
+    }
+
+    OPCODE(SUBTRACT_NUM):
+    {
+      Var r = POP(), l = POP();
+      ASSERT(IS_NUM(l) && IS_NUM(r), OOPS);
+      PUSH(VAR_NUM(AS_NUM(l) - AS_NUM(r)));
+      DISPATCH();
+    }
+
+    OPCODE(MULTIPLY_NUM):
+    {
+      Var r = POP(), l = POP();
+      ASSERT(IS_NUM(l) && IS_NUM(r), OOPS);
+      PUSH(VAR_NUM(AS_NUM(l) * AS_NUM(r)));
+      DISPATCH();
+    }
+
+    OPCODE(DIVIDE_NUM):
+    {
+      Var r = POP(), l = POP();
+      ASSERT(IS_NUM(l) && IS_NUM(r), OOPS);
+      PUSH(VAR_NUM(AS_NUM(l) / AS_NUM(r)));
+      DISPATCH();
+    }
+
+    OPCODE(LT_NUM):
+    {
+      Var r = POP(), l = POP();
+      ASSERT(IS_NUM(l) && IS_NUM(r), OOPS);
+      PUSH(VAR_BOOL(AS_NUM(l) < AS_NUM(r)));
+      DISPATCH();
+    }
+
+    OPCODE(LTEQ_NUM):
+    {
+      Var r = POP(), l = POP();
+      ASSERT(IS_NUM(l) && IS_NUM(r), OOPS);
+      PUSH(VAR_BOOL(AS_NUM(l) <= AS_NUM(r)));
+      DISPATCH();
+    }
+
+    OPCODE(GT_NUM):
+    {
+      Var r = POP(), l = POP();
+      ASSERT(IS_NUM(l) && IS_NUM(r), OOPS);
+      PUSH(VAR_BOOL(AS_NUM(l) > AS_NUM(r)));
+      DISPATCH();
+    }
+
+    OPCODE(GTEQ_NUM):
+    {
+      Var r = POP(), l = POP();
+      ASSERT(IS_NUM(l) && IS_NUM(r), OOPS);
+      PUSH(VAR_BOOL(AS_NUM(l) >= AS_NUM(r)));
+      DISPATCH();
+    }
+
+    OPCODE(STR_LENGTH):
+    {
+      Var str = POP();
+      ASSERT(IS_OBJ_TYPE(str, OBJ_STRING), OOPS);
+      PUSH(VAR_NUM((double)((String*)AS_OBJ(str))->length));
+      DISPATCH();
+    }
+
+    OPCODE(CHECK_TYPE):
+    {
+      PkVarType type = (PkVarType)READ_BYTE();
+      Var value = PEEK(-1);
+      if (pkGetValueType((PkVar)&value) != type) {
+        RUNTIME_ERROR(stringFormat(vm, "Expected a $ value, got $.",
+                      getPkVarTypeName(type), varTypeName(value)));
+      }
+      DISPATCH();
+    }
+
     OPCODE(REPL_PRINT):
     {
       if (vm->config.write_fn != NULL) {
@@ -1519,6 +2050,15 @@ static PkResult runFiber(PKVM* vm, Fiber* fiber) {
       DISPATCH();
     }
 
+    OPCODE(BREAKPOINT):
+    {
+      // Set the frame's ip for the debugger to inspect the paused frame.
+      UPDATE_FRAME();
+      uint32_t offset = (uint32_t)(ip - 1 - frame->fn->fn->opcodes.data);
+      instruction = debugBreak(vm, frame->fn, offset);
+      goto L_vm_execute;
+    }
+
     OPCODE(END):
       UNREACHABLE();
       break;
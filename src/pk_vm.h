@@ -7,7 +7,10 @@
 #define VM_H
 
 #include "pk_compiler.h"
+#include "pk_debug.h"
 #include "pk_internal.h"
+#include "pk_re.h"
+#include "pk_trace.h"
 #include "pk_var.h"
 
 // The maximum number of temporary object reference to protect them from being
@@ -54,6 +57,19 @@ typedef struct {
   Function* fn;     //< Native function pointer.
 } BuiltinFn;
 
+// The element found by the last GET_SUBSCRIPT_KEEP instruction, so the
+// SUBSCRIPT_UPDATE after it could store the result without looking the key up
+// again. It's only valid if the container's buffer ([data] and [capacity])
+// haven't changed in the meantime (see varUpdateSubscript()).
+typedef struct {
+  Object* on;        //< The list or the map, NULL if there isn't a slot.
+  Var key;           //< The subscript key.
+  Var entry_key;     //< The key of the map entry (same as [key] for lists).
+  void* data;        //< The list's elements or the map's entries.
+  uint32_t capacity; //< The capacity of the above buffer.
+  uint32_t index;    //< Index of the element or the entry in the buffer.
+} SubscriptSlot;
+
 // A doubly link list of vars that have reference in the host application.
 // Handles are wrapper around Var that lives on the host application.
 struct PkHandle {
@@ -70,6 +86,13 @@ struct PKVM {
   // The first object in the link list of all heap allocated objects.
   Object* first;
 
+  // The objects frozen by pkFreezeHeap() (they're not in the above list and
+  // never freed by the GC) and the bitmap of their marks indexed with their
+  // [frozen_id].
+  Object** frozen;
+  uint32_t frozen_count;
+  uint8_t* frozen_marks;
+
   // The number of bytes allocated by the vm and not (yet) garbage collected.
   size_t bytes_allocated;
 
@@ -87,8 +110,8 @@ struct PKVM {
   // from the list color it black and add it's referenced objects to gray_list.
 
   // Working set is the is the list of objects that were marked reachable from
-  // VM's root (ex: stack values, temp references, handles, vm's running fiber,
-  // current compiler etc). But yet tobe perform a reachability analysis of the
+  // VM's root (ex: stack values, temp references, handles, vm's running
+  // fiber etc). But yet tobe perform a reachability analysis of the
   // objects it reference to.
   Object** working_set;
   int working_set_count;
@@ -107,8 +130,9 @@ struct PKVM {
   // VM's configurations.
   PkConfiguration config;
 
-  // Current compiler reference to mark it's heap allocated objects. Note that
-  // The compiler isn't heap allocated. It'll be a link list of all the
+  // Current compiler reference, the garbage collection is deferred while
+  // it's not NULL so the objects being compiled don't need to be marked. Note
+  // that the compiler isn't heap allocated. It'll be a link list of all the
   // compiler we have so far. A new compiler will be created and appended when
   // a new scirpt is being imported and compiled at compiletime.
   Compiler* compiler;
@@ -125,6 +149,24 @@ struct PKVM {
   BuiltinFn builtins[BUILTIN_FN_CAPACITY];
   uint32_t builtins_count;
 
+  // The recently used regular expressions of the re module, so the patterns
+  // used in a loop won't be compiled every time. When it's full the entry at
+  // [regex_cache_next] will be replaced (round robin).
+  Regex* regex_cache[REGEX_CACHE_SIZE];
+  int regex_cache_next;
+
+  // The breakpoints and the patched instructions of the debugger.
+  Debugger debugger;
+
+  // The timeline of the VM recorded for the host (disabled by default).
+  Tracer tracer;
+
+  // The statistics of the compilations with the stats option.
+  pkCompileStatsBuffer compile_stats;
+
+  // The element of the current compound subscript assignment.
+  SubscriptSlot subscript_slot;
+
   // Current fiber.
   Fiber* fiber;
 };
@@ -140,6 +182,15 @@ struct PKVM {
 // going to track deallocated bytes, instead use garbage collector to do it.
 void* vmRealloc(PKVM* vm, void* memory, size_t old_size, size_t new_size);
 
+// Same as vmRealloc() but for the data of the buffers (list elements, byte
+// buffers, etc.) where the [old_size] is always the exact allocated size of
+// the [memory], even when freeing. If the buffer is larger than
+// LARGE_BUFFER_SIZE it'll be moved to its own memory mapped region which can
+// grow in place with mremap() instead of copying the whole buffer and
+// requiring both the old and the new buffer to be alive at the same time.
+void* vmReallocBuffer(PKVM* vm, void* memory, size_t old_size,
+                      size_t new_size);
+
 // Create and return a new handle for the [value].
 PkHandle* vmNewHandle(PKVM* vm, Var value);
 
@@ -156,12 +207,12 @@ PkHandle* vmNewHandle(PKVM* vm, Var value);
 //        working set                         '------------------------'
 //
 //   First we preform a tree traversal from all the vm's root objects. such as
-//   stack values, temp references, handles, vm's running fiber, current
-//   compiler (if it has any) etc. Mark them (ie. is_marked = true) and add
-//   them to the working set (the gray_list). Pop the top object from the
-//   working set add all of it's referenced objects to the working set and mark
-//   it black (try-color marking) We'll keep doing this till the working set
-//   become empty, at this point any object which isn't marked is a garbage.
+//   stack values, temp references, handles, vm's running fiber etc. Mark
+//   them (ie. is_marked = true) and add them to the working set (the
+//   gray_list). Pop the top object from the working set add all of it's
+//   referenced objects to the working set and mark it black (try-color
+//   marking) We'll keep doing this till the working set become empty, at
+//   this point any object which isn't marked is a garbage.
 //
 //   Every single heap allocated objects will be in the VM's link list. Those
 //   objects which are reachable have marked (ie. is_marked = true) once the
@@ -181,6 +232,11 @@ PkHandle* vmNewHandle(PKVM* vm, Var value);
 //
 //   Once the marking phase is done, we iterate through the objects and remove
 //   the objects which are not marked from the linked list and deallocate them.
+//   The list buffers of the objects that survived more than one collection
+//   will be shrunk if they're mostly empty (see shrinkObject()).
+//
+//   The frozen objects (see pkFreezeHeap()) are marked in a bitmap instead of
+//   their header and never swept, so a collection won't write to them.
 //
 void vmCollectGarbage(PKVM* vm);
 
@@ -195,6 +251,12 @@ void vmPopTempRef(PKVM* vm);
 // cache. If not found itll return NULL.
 Script* vmGetScript(PKVM* vm, String* path);
 
+// Ensure the current fiber's stack has at least [size] slots, grow it if
+// needed. Growing might move the stack so any pointers to the stack slots
+// should be re-loaded after calling this (used by the natives generated with
+// --emit-c which keep their locals on the fiber's stack).
+void vmEnsureStack(PKVM* vm, int size);
+
 // ((Context switching - start))
 // Prepare a new fiber for execution with the given arguments. That can be used
 // different fiber_run apis. Return true on success, otherwise it'll set the
@@ -0,0 +1,143 @@
+/*
+ *  Copyright (c) 2020-2021 Thakee Nathees
+ *  Distributed Under The MIT License
+ */
+
+// This is an example on how to compile a script once and run it many times
+// with different values of it's globals (prepared scripts).
+
+#include <pocketlang.h>
+#include <stdio.h>
+
+// The pocket script we're using to test, [price] and [quantity] are provided
+// by the application for each run.
+static const char* code =
+  "  from Host import report                      \n"
+  "  const DISCOUNT = 0.25                        \n"
+  "  runs = (runs or 0) + 1                       \n"
+  "  total = price * quantity                     \n"
+  "  if total > 100 then                          \n"
+  "    total = total * (1 - DISCOUNT)             \n"
+  "  end                                          \n"
+  "  report(total, runs)                          \n"
+  ;
+
+// The values reported by the last run.
+static double last_total = 0;
+static double last_runs = 0;
+
+/*****************************************************************************/
+/* MODULE FUNCTION                                                           */
+/*****************************************************************************/
+
+static void report(PKVM* vm) {
+  if (!pkGetArgNumber(vm, 1, &last_total)) return;
+  if (!pkGetArgNumber(vm, 2, &last_runs)) return;
+}
+
+/*****************************************************************************/
+/* POCKET VM CALLBACKS                                                       */
+/*****************************************************************************/
+
+// Error report callback.
+static void reportError(PKVM* vm, PkErrorType type,
+                        const char* file, int line,
+                        const char* message) {
+  fprintf(stderr, "Error: %s\n", message);
+}
+
+// print() callback to write stdout.
+static void stdoutWrite(PKVM* vm, const char* text) {
+  fprintf(stdout, "%s", text);
+}
+
+/*****************************************************************************/
+/* MAIN                                                                      */
+/*****************************************************************************/
+
+// Run the prepared [script] with the [price] and [quantity] and check the
+// reported total.
+static int runOrder(PKVM* vm, PkHandle* script, double price,
+                    double quantity, double expected) {
+  const char* names[] = { "price", "quantity" };
+  PkHandle* values[] = { pkNewHandle(vm, &price),
+                         pkNewHandle(vm, &quantity) };
+
+  PkResult result = pkRunPrepared(vm, script, 2, names, values);
+  pkReleaseHandle(vm, values[0]);
+  pkReleaseHandle(vm, values[1]);
+
+  printf("[C] %g x %g = %g\n", price, quantity, last_total);
+
+  // The globals are reset before every run, so [runs] is always 1.
+  if (result != PK_RESULT_SUCCESS || last_total != expected ||
+      last_runs != 1) {
+    fprintf(stderr, "[C] Unexpected result of a run.\n");
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+
+  // Pocket VM configuration.
+  PkConfiguration config = pkNewConfiguration();
+  config.error_fn  = reportError;
+  config.write_fn  = stdoutWrite;
+
+  // Create a new pocket VM.
+  PKVM* vm = pkNewVM(&config);
+
+  PkHandle* host = pkNewModule(vm, "Host");
+  pkModuleAddFunction(vm, host, "report", report, 2);
+  pkReleaseHandle(vm, host);
+
+  // The path and the source code.
+  PkStringPtr source = { code, NULL, NULL, 0, 0 };
+  PkStringPtr path = { "./order.pk", NULL, NULL, 0, 0 };
+
+  // Compile the script once with the globals provided by the application.
+  const char* globals[] = { "price", "quantity" };
+  PkHandle* script = pkPrepareScript(vm, source, path, 2, globals);
+  if (script == NULL) {
+    pkFreeVM(vm);
+    return 1;
+  }
+
+  // Run it many times with different values.
+  int failed = 0;
+  failed |= runOrder(vm, script, 10, 3, 30);
+  failed |= runOrder(vm, script, 50, 4, 150);
+  failed |= runOrder(vm, script, 10, 3, 30);
+
+  // A global which doesn't exists and a constant (which is already folded
+  // into the code) couldn't be overridden, and the run will fail.
+  double value = 1;
+  PkHandle* handle = pkNewHandle(vm, &value);
+  const char* unknown[] = { "tax" };
+  const char* constant[] = { "DISCOUNT" };
+  if (pkRunPrepared(vm, script, 1, unknown, &handle) == PK_RESULT_SUCCESS ||
+      pkRunPrepared(vm, script, 1, constant, &handle) == PK_RESULT_SUCCESS) {
+    fprintf(stderr, "[C] Expected the runs to fail.\n");
+    failed = 1;
+  }
+  pkReleaseHandle(vm, handle);
+
+  // The script could still be run after a failed run.
+  failed |= runOrder(vm, script, 20, 2, 40);
+
+  // A script which doesn't compile will return NULL.
+  PkStringPtr invalid = { "total = price *", NULL, NULL, 0, 0 };
+  PkHandle* broken = pkPrepareScript(vm, invalid, path, 2, globals);
+  if (broken != NULL) {
+    fprintf(stderr, "[C] Expected the compilation to fail.\n");
+    pkReleaseHandle(vm, broken);
+    failed = 1;
+  }
+
+  // Free the script and the VM.
+  pkReleaseHandle(vm, script);
+  pkFreeVM(vm);
+
+  return failed;
+}
@@ -0,0 +1,101 @@
+/*
+ *  Copyright (c) 2020-2021 Thakee Nathees
+ *  Distributed Under The MIT License
+ */
+
+// This is an example on how to compile an expression once and evaluate it
+// many times with different values of it's variables.
+
+#include <pocketlang.h>
+#include <stdio.h>
+#include <string.h>
+
+/*****************************************************************************/
+/* POCKET VM CALLBACKS                                                       */
+/*****************************************************************************/
+
+// Error report callback.
+static void reportError(PKVM* vm, PkErrorType type,
+                        const char* file, int line,
+                        const char* message) {
+  fprintf(stderr, "Error: %s\n", message);
+}
+
+/*****************************************************************************/
+/* MAIN                                                                      */
+/*****************************************************************************/
+
+int main(int argc, char** argv) {
+
+  // Pocket VM configuration.
+  PkConfiguration config = pkNewConfiguration();
+  config.error_fn  = reportError;
+
+  // Create a new pocket VM.
+  PKVM* vm = pkNewVM(&config);
+
+  // The names of the variables, the values are given in the same order.
+  const char* names[] = { "price", "qty", "discount" };
+
+  // Compile the expression once.
+  PkHandle* total = pkCompileExpression(vm, "price * qty * (1 - discount)",
+                                        names, 3);
+  if (total == NULL) {
+    pkFreeVM(vm);
+    return 1;
+  }
+
+  double price = 0, qty = 3, discount = 0.25;
+  PkVar values[] = { &price, &qty, &discount };
+  PkVar result;
+
+  // Evaluate it many times with different values.
+  int failed = 0;
+  for (int i = 0; i < 1000; i++) {
+    price = i;
+    if (pkEvalExpression(vm, total, values, &result) != PK_RESULT_SUCCESS ||
+        pkGetValueType(result) != PK_NUMBER ||
+        *(double*)result != i * 3 * 0.75) {
+      fprintf(stderr, "[C] Unexpected result at %d.\n", i);
+      failed = 1;
+      break;
+    }
+  }
+  printf("[C] total = %g\n", *(double*)result);
+
+  // An expression which doesn't compile will return NULL.
+  if (pkCompileExpression(vm, "price *", names, 3) != NULL ||
+      pkCompileExpression(vm, "price + tax", names, 3) != NULL) {
+    fprintf(stderr, "[C] Expected the compilation to fail.\n");
+    failed = 1;
+  }
+
+  // An error while evaluating will return the error result, and the
+  // expression could be evaluated again.
+  PkHandle* label = pkCompileExpression(vm, "str_sub(qty, 0, 1) + '!'",
+                                        names, 3);
+  if (label == NULL ||
+      pkEvalExpression(vm, label, values, &result) == PK_RESULT_SUCCESS) {
+    fprintf(stderr, "[C] Expected the evaluation to fail.\n");
+    failed = 1;
+  }
+
+  PkHandle* name = pkNewString(vm, "pocket");
+  PkVar args[] = { &price, pkGetHandleValue(name), &discount };
+  if (label == NULL ||
+      pkEvalExpression(vm, label, args, &result) != PK_RESULT_SUCCESS ||
+      strcmp(pkStringGetData(result), "p!") != 0) {
+    fprintf(stderr, "[C] Unexpected result of the label.\n");
+    failed = 1;
+  } else {
+    printf("[C] label = %s\n", pkStringGetData(result));
+  }
+  pkReleaseHandle(vm, name);
+
+  // Free the expressions and the VM.
+  if (label != NULL) pkReleaseHandle(vm, label);
+  pkReleaseHandle(vm, total);
+  pkFreeVM(vm);
+
+  return failed;
+}
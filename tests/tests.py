@@ -2,8 +2,8 @@
 ## Copyright (c) 2020-2021 Thakee Nathees
 ## Distributed Under The MIT License
 
-import os, sys, platform
-import subprocess, json, re
+import os, sys, platform, time, signal, socket
+import subprocess, json, re, tempfile
 from os.path import join, abspath, dirname, relpath
 
 ## TODO: Re-write this in doctest (https://github.com/onqtam/doctest)
@@ -22,6 +22,7 @@ TEST_SUITE = {
     "lang/fibers.pk",
     "lang/functions.pk",
     "lang/import.pk",
+    "lang/literals.pk",
   ),
 
   "Examples": (
@@ -63,6 +64,10 @@ def run_all_tests():
       path = join(THIS_PATH, test)
       run_test_file(pocket, test, path)
 
+  print_title("Tools")
+  for name, test in TOOL_TESTS:
+    run_tool_test(pocket, name, test)
+
 def run_test_file(pocket, test, path):
   FMT_PATH = "%-25s"
   INDENTATION = '  | '
@@ -79,6 +84,270 @@ def run_test_file(pocket, test, path):
   else:
     print_success('-- PASSED')
 
+## Run the [test] function of a command line tool in a temporary directory,
+## the function returns an error message if the test failed otherwise None.
+def run_tool_test(pocket, name, test):
+  FMT_PATH = "%-25s"
+  INDENTATION = '  | '
+  print(FMT_PATH % name, end='')
+
+  sys.stdout.flush()
+  with tempfile.TemporaryDirectory() as tmp:
+    error = test(pocket, tmp)
+  if error is not None:
+    print_error('-- Failed')
+    print_error(INDENTATION + error.replace('\n', '\n' + INDENTATION))
+  else:
+    print_success('-- PASSED')
+
+## Write the [source] to the file [name] in the directory [tmp] and return
+## it's path.
+def write_script(tmp, name, source):
+  path = join(tmp, name)
+  with open(path, 'w') as file:
+    file.write(source)
+  return path
+
+## ----------------------------------------------------------------------------
+
+## The script used by the tool tests.
+TOOL_SCRIPT = """\
+def add(a, b)
+  c = a + b
+  return c
+end
+x = add(1, 2)
+print(x)
+if x > 10 then
+  print('big')
+end
+"""
+
+## Run the interpreter with the [args] and return the error message if it
+## failed, otherwise None.
+def run_tool(pocket, tmp, args):
+  result = subprocess.run([pocket] + args, cwd=tmp,
+                          stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+  if result.returncode != 0:
+    return "Exited with %i:\n%s" % (result.returncode,
+                                     result.stderr.decode('utf8'))
+
+## Break at a line of a function and inspect the frame with the debugger.
+def test_debugger(pocket, tmp):
+  path = write_script(tmp, 'debug.pk', TOOL_SCRIPT)
+  commands = 'break 2\ncontinue\nlocals\nbt\ncontinue\n'
+  result = subprocess.run([pocket, '--debugger', path], cwd=tmp,
+                          input=commands.encode('utf8'),
+                          stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+  output = result.stdout.decode('utf8')
+  if result.returncode != 0:
+    return result.stderr.decode('utf8')
+  for expected in ('Breakpoint 1, add() ["%s":2]' % path,
+                   '[0] (param) = 1', '[1] (param) = 2',
+                   '#1  $(SourceBody)() ["%s":5]' % path):
+    if expected not in output:
+      return "Expected '%s' in the output:\n%s" % (expected, output)
+  if not output.rstrip().endswith('3'):
+    return "Expected the script to finish:\n%s" % output
+
+## The executed lines of the script, and the ones which aren't.
+COVERED_LINES = { 2: 1, 3: 1, 5: 1, 6: 1, 7: 1, 8: 0 }
+
+## Write the line coverage in JSON and lcov formats.
+def test_coverage(pocket, tmp):
+  path = write_script(tmp, 'coverage.pk', TOOL_SCRIPT)
+
+  json_path = join(tmp, 'coverage.json')
+  error = run_tool(pocket, tmp, ['--coverage=' + json_path, path])
+  if error is not None: return error
+  with open(json_path) as file:
+    coverage = json.load(file)
+  lines = { int(line) : hits for line, hits in coverage[path].items() }
+  if lines != COVERED_LINES:
+    return "Unexpected JSON coverage: %s" % coverage
+
+  lcov_path = join(tmp, 'coverage.info')
+  error = run_tool(pocket, tmp, ['--coverage=' + lcov_path, path])
+  if error is not None: return error
+  with open(lcov_path) as file:
+    lcov = file.read().splitlines()
+  expected = ['TN:', 'SF:' + path]
+  expected += ['DA:%i,%i' % (line, COVERED_LINES[line])
+               for line in sorted(COVERED_LINES)]
+  expected += ['LF:6', 'LH:5', 'end_of_record']
+  if lcov != expected:
+    return "Unexpected lcov coverage:\n%s" % '\n'.join(lcov)
+
+## The script used to test the trace events of the fibers and the GC.
+TRACE_SCRIPT = """\
+import Fiber, lang
+def f()
+  yield(1)
+end
+fiber = Fiber.new(f)
+Fiber.run(fiber); Fiber.resume(fiber)
+lang.gc()
+"""
+
+## Write the timeline of a script in the Chrome trace event format.
+def test_trace(pocket, tmp):
+  ## A name with a control character, which is too long and cut in the
+  ## middle of a multi byte character.
+  path = write_script(tmp, 'trace\t' + '\u00e9' * 30 + 'x.pk', TRACE_SCRIPT)
+  trace_path = join(tmp, 'trace.json')
+  error = run_tool(pocket, tmp, ['--trace=' + trace_path, path])
+  if error is not None: return error
+
+  try:
+    with open(trace_path, encoding='utf8') as file:
+      events = json.load(file)['traceEvents']
+  except (ValueError, KeyError) as err:
+    return "Invalid trace file: %s" % err
+
+  ## The native calls are only traced if they're slower than a threshold.
+  events = [event for event in events if event.get('cat') != 'native']
+  names = [event['name'] for event in events]
+  expected = ['process_name', 'compile', 'run', 'yield', 'resume',
+              'gc', 'mark', 'sweep']
+  if names != expected:
+    return "Unexpected trace events: %s" % names
+
+  ## The name is cut from the front to TRACE_NAME_SIZE - 1 bytes.
+  cut = path.encode('utf8')[-47:].decode('utf8', errors='ignore')
+  if events[1]['args']['path'] != cut:
+    return "Unexpected compile event: %s" % events[1]
+  for event in events[2:5]:
+    if event['ph'] != 'i' or event['args']['fn'] != 'f':
+      return "Unexpected fiber event: %s" % event
+  for event in events[5:]:
+    if event['ph'] != 'X' or event['dur'] < 0:
+      return "Unexpected gc event: %s" % event
+  if events[5]['args']['before'] < events[5]['args']['after']:
+    return "Unexpected gc event: %s" % events[5]
+  timestamps = [event['ts'] for event in events[1:]]
+  if timestamps != sorted(timestamps):
+    return "The events are not in order: %s" % timestamps
+
+## The columns of the compilation statistics.
+COMPILE_STATS_COLUMNS = ['bytes', 'tokens', 'funcs', 'consts', 'names',
+                         'bytecode', 'lex', 'parse', 'resolve', 'import',
+                         'total', 'path']
+
+## Print the compilation statistics of a script and the script it imports.
+def test_compile_stats(pocket, tmp):
+  module = write_script(tmp, 'module.pk', 'def g() return 1 end\n')
+  path = write_script(tmp, 'main.pk', "import 'module.pk' as m\n"
+                                      "print(m.g())\n")
+  result = subprocess.run([pocket, '--compile-stats', path], cwd=tmp,
+                          stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+  if result.returncode != 0 or result.stdout.decode('utf8').strip() != '1':
+    return "Exited with %i:\n%s" % (result.returncode,
+                                     result.stderr.decode('utf8'))
+
+  lines = result.stderr.decode('utf8').splitlines()
+  if len(lines) != 3 or lines[0].split() != COMPILE_STATS_COLUMNS:
+    return "Unexpected compilation statistics:\n%s" % '\n'.join(lines)
+
+  ## The imported script is compiled while compiling the main script.
+  rows = [dict(zip(COMPILE_STATS_COLUMNS, line.split()))
+          for line in lines[1:]]
+  for row, script, funcs in ((rows[0], path, '0'), (rows[1], module, '1')):
+    if row['path'] != script or row['funcs'] != funcs or \
+       int(row['bytes']) != os.path.getsize(script):
+      return "Unexpected statistics of '%s': %s" % (script, row)
+    if any(float(row[time]) < 0 for time in COMPILE_STATS_COLUMNS[6:11]):
+      return "Unexpected times of '%s': %s" % (script, row)
+  if float(rows[0]['import']) < float(rows[1]['total']):
+    return "The import time should include the imported script: %s" % rows
+
+## The script served by the workers, the [names] is built once by the host
+## before the workers are forked.
+SERVE_SCRIPT = """\
+names = {}
+for i in 0..10 do names[to_string(i)] = 'n' + to_string(i * i) end
+def handle(request)
+  if request in names then return names[request] end
+  return '?' + request
+end
+"""
+
+## Send the [lines] to the Unix socket at [path] with a single connection and
+## return the response lines.
+def serve_request(path, lines):
+  client = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+  client.settimeout(10)
+  try:
+    ## The socket file is created before it's listening.
+    for attempt in range(20):
+      try:
+        client.connect(path)
+        break
+      except ConnectionRefusedError:
+        if attempt == 19: raise
+        time.sleep(0.05)
+    client.sendall(('\n'.join(lines) + '\n').encode('utf8'))
+    response = b''
+    while response.count(b'\n') < len(lines):
+      data = client.recv(4096)
+      if not data: break
+      response += data
+    return response.decode('utf8').splitlines()
+  finally:
+    client.close()
+
+## Serve a script with 2 worker processes and send requests to them.
+def test_serve(pocket, tmp):
+  if not hasattr(socket, 'AF_UNIX'): return None ## Not supported.
+
+  path = write_script(tmp, 'serve.pk', SERVE_SCRIPT)
+  socket_path = join(tmp, 'serve.sock')
+
+  ## The workers are in the same session, to stop all of them at the end.
+  server = subprocess.Popen([pocket, '--serve=2', '--socket=' + socket_path,
+                             path], cwd=tmp, start_new_session=True,
+                            stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+  try:
+    for _ in range(100):
+      if os.path.exists(socket_path) or server.poll() is not None: break
+      time.sleep(0.05)
+    if not os.path.exists(socket_path):
+      return "The socket was not created:\n%s" % \
+             server.communicate()[1].decode('utf8')
+
+    for lines, expected in ((['3', '9'], ['n9', 'n81']),
+                            (['x', '0', ''], ['?x', 'n0', '?'])):
+      response = serve_request(socket_path, lines)
+      if response != expected:
+        return "Unexpected response to %s: %s" % (lines, response)
+  finally:
+    os.killpg(server.pid, signal.SIGTERM)
+    server.communicate()
+
+  ## A file which isn't a socket shouldn't be replaced.
+  file_path = write_script(tmp, 'serve.txt', 'data')
+  server = subprocess.Popen([pocket, '--serve=1', '--socket=' + file_path,
+                             path], cwd=tmp, start_new_session=True,
+                            stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+  try:
+    server.wait(timeout=10)
+  except subprocess.TimeoutExpired:
+    os.killpg(server.pid, signal.SIGTERM)
+  server.communicate()
+  with open(file_path, 'r') as file:
+    if server.returncode == 0 or file.read() != 'data':
+      return "The file at the socket path was replaced."
+
+## All the tool tests, (name, function) pairs.
+TOOL_TESTS = (
+  ("tools/debugger", test_debugger),
+  ("tools/coverage", test_coverage),
+  ("tools/trace", test_trace),
+  ("tools/compile-stats", test_compile_stats),
+  ("tools/serve", test_serve),
+)
+
+## ----------------------------------------------------------------------------
+
 ## This will return the path of the pocket binary (on different platforms).
 ## The debug version of it for enabling the assertions.
 def get_pocket_binary():